@@ -153,6 +153,12 @@ static int print_deref( LDAP *ld, LDAPControl *ctrl );
 #ifdef LDAP_CONTROL_X_WHATFAILED
 static int print_whatfailed( LDAP *ld, LDAPControl *ctrl );
 #endif
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+static int print_explain( LDAP *ld, LDAPControl *ctrl );
+#endif
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+static int print_count( LDAP *ld, LDAPControl *ctrl );
+#endif
 static int print_syncstate( LDAP *ld, LDAPControl *ctrl );
 static int print_syncdone( LDAP *ld, LDAPControl *ctrl );
 #ifdef LDAP_CONTROL_X_DIRSYNC
@@ -181,6 +187,12 @@ static struct tool_ctrls_t {
 #endif
 #ifdef LDAP_CONTROL_X_WHATFAILED
 	{ LDAP_CONTROL_X_WHATFAILED,			TOOL_ALL,	print_whatfailed },
+#endif
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+	{ LDAP_CONTROL_X_SEARCH_EXPLAIN,		TOOL_SEARCH,	print_explain },
+#endif
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+	{ LDAP_CONTROL_X_SEARCH_COUNT,		TOOL_SEARCH,	print_count },
 #endif
 	{ LDAP_CONTROL_SYNC_STATE,			TOOL_SEARCH,	print_syncstate },
 	{ LDAP_CONTROL_SYNC_DONE,			TOOL_SEARCH,	print_syncdone },
@@ -2345,6 +2357,53 @@ print_whatfailed( LDAP *ld, LDAPControl *ctrl )
 }
 #endif
 
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+static int
+print_explain( LDAP *ld, LDAPControl *ctrl )
+{
+	char *line, *next, *end;
+
+	/* the plan is text, one step per line */
+	tool_write_ldif( LDIF_PUT_COMMENT, " search plan:", NULL, 0 );
+
+	line = ctrl->ldctl_value.bv_val;
+	end = line + ctrl->ldctl_value.bv_len;
+	for ( ; line < end; line = next + 1 ) {
+		next = memchr( line, '\n', end - line );
+		if ( next == NULL )
+			next = end;
+		tool_write_ldif( LDIF_PUT_COMMENT, NULL, line, next - line );
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+static int
+print_count( LDAP *ld, LDAPControl *ctrl )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	ber_int_t err, nentries, nrefs;
+	char buf[ BUFSIZ ];
+	int rc;
+
+	ber_init2( ber, &ctrl->ldctl_value, LBER_USE_DER );
+	if ( ber_scanf( ber, "{iii}", &err, &nentries, &nrefs ) == LBER_ERROR ) {
+		return 1;
+	}
+
+	rc = snprintf( buf, sizeof(buf), "entries=%d references=%d (%d) %s",
+		nentries, nrefs, err, ldap_err2string(err) );
+
+	tool_write_ldif( ldif ? LDIF_PUT_COMMENT : LDIF_PUT_VALUE,
+		ldif ? "searchCount: " : "searchCount", buf, rc );
+
+	return 0;
+}
+#endif
+
 static int
 print_syncstate( LDAP *ld, LDAPControl *ctrl )
 {
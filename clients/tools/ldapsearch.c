@@ -139,6 +139,12 @@ usage( void )
 #ifdef LDAP_CONTROL_X_DEREF
 	fprintf( stderr, _("             [!]deref=derefAttr:attr[,...][;derefAttr:attr[,...][;...]]\n"));
 #endif
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+	fprintf( stderr, _("             [!]explain[=only]           (search plan, instead of entries)\n"));
+#endif
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+	fprintf( stderr, _("             [!]count                    (number of entries, instead of them)\n"));
+#endif
 #ifdef LDAP_CONTROL_X_DIRSYNC
 	fprintf( stderr, _("             !dirSync=<flags>/<maxAttrCount>[/<cookie>]\n"));
 	fprintf( stderr, _("                                         (MS AD DirSync)\n"));
@@ -255,6 +261,15 @@ static LDAPDerefSpec *ds;
 static struct berval derefval;
 #endif
 
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+static int explain;
+static int explainOnly;
+#endif
+
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+static int searchCount;
+#endif
+
 #ifdef LDAP_CONTROL_X_DIRSYNC
 static int dirSync;
 static int dirSyncFlags;
@@ -651,6 +666,40 @@ handle_private_option( int i )
 			ldap_memfree( specs );
 #endif /* LDAP_CONTROL_X_DEREF */
 
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+		} else if ( strcasecmp( control, "explain" ) == 0 ) {
+			if( explain ) {
+				fprintf( stderr,
+					_("explain control previously specified\n"));
+				exit( EXIT_FAILURE );
+			}
+			if ( cvalue != NULL ) {
+				if ( strcasecmp( cvalue, "only" ) != 0 ) {
+					fprintf( stderr,
+						_("explain control value \"%s\" invalid\n"),
+						cvalue );
+					exit( EXIT_FAILURE );
+				}
+				explainOnly = 1;
+			}
+			explain = 1 + crit;
+#endif /* LDAP_CONTROL_X_SEARCH_EXPLAIN */
+
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+		} else if ( strcasecmp( control, "count" ) == 0 ) {
+			if( searchCount ) {
+				fprintf( stderr,
+					_("count control previously specified\n"));
+				exit( EXIT_FAILURE );
+			}
+			if ( cvalue != NULL ) {
+				fprintf( stderr,
+					_("count: no control value expected\n") );
+				usage();
+			}
+			searchCount = 1 + crit;
+#endif /* LDAP_CONTROL_X_SEARCH_COUNT */
+
 #ifdef LDAP_CONTROL_X_DIRSYNC
 		} else if ( strcasecmp( control, "dirSync" ) == 0 ) {
 			char *maxattrp;
@@ -928,6 +977,9 @@ main( int argc, char **argv )
 	int			rc, rc1, i, first;
 	LDAP		*ld = NULL;
 	BerElement	*seber = NULL, *vrber = NULL;
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+	BerElement	*exber = NULL;
+#endif
 
 	BerElement      *syncber = NULL;
 	struct berval   *syncbvalp = NULL;
@@ -1059,6 +1111,12 @@ getNextPage:
 #ifdef LDAP_CONTROL_X_DEREF
 		|| derefcrit
 #endif
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+		|| explain
+#endif
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+		|| searchCount
+#endif
 #ifdef LDAP_CONTROL_X_DIRSYNC
 		|| dirSync
 #endif
@@ -1266,6 +1324,48 @@ getNextPage:
 			i++;
 		}
 #endif /* LDAP_CONTROL_X_DEREF */
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+		if ( explain ) {
+			if ( ctrl_add() ) {
+				tool_exit( ld, EXIT_FAILURE );
+			}
+
+			c[i].ldctl_value.bv_val = NULL;
+			c[i].ldctl_value.bv_len = 0;
+			if ( explainOnly ) {
+				if (( exber = ber_alloc_t(LBER_USE_DER)) == NULL ) {
+					tool_exit( ld, EXIT_FAILURE );
+				}
+
+				if ( ber_printf( exber, "{b}", (ber_int_t) 1 ) == -1 ) {
+					ber_free( exber, 1 );
+					fprintf( stderr, _("Explain control encoding error!\n") );
+					tool_exit( ld, EXIT_FAILURE );
+				}
+
+				if ( ber_flatten2( exber, &c[i].ldctl_value, 0 ) == -1 ) {
+					tool_exit( ld, EXIT_FAILURE );
+				}
+			}
+
+			c[i].ldctl_oid = LDAP_CONTROL_X_SEARCH_EXPLAIN;
+			c[i].ldctl_iscritical = explain > 1;
+			i++;
+		}
+#endif /* LDAP_CONTROL_X_SEARCH_EXPLAIN */
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+		if ( searchCount ) {
+			if ( ctrl_add() ) {
+				tool_exit( ld, EXIT_FAILURE );
+			}
+
+			c[i].ldctl_oid = LDAP_CONTROL_X_SEARCH_COUNT;
+			c[i].ldctl_value.bv_val = NULL;
+			c[i].ldctl_value.bv_len = 0;
+			c[i].ldctl_iscritical = searchCount > 1;
+			i++;
+		}
+#endif /* LDAP_CONTROL_X_SEARCH_COUNT */
 #ifdef LDAP_CONTROL_X_DIRSYNC
 		if ( dirSync ) {
 			if ( ctrl_add() ) {
@@ -1320,6 +1420,12 @@ getNextPage:
 
 	if ( seber ) ber_free( seber, 1 );
 	if ( vrber ) ber_free( vrber, 1 );
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+	if ( exber ) {
+		ber_free( exber, 1 );
+		exber = NULL;
+	}
+#endif
 
 	/* step back to the original number of controls, so that 
 	 * those set while parsing args are preserved */
@@ -1415,6 +1521,19 @@ getNextPage:
 				derefcrit > 1 ? _("critical ") : "" );
 		}
 #endif
+#ifdef LDAP_CONTROL_X_SEARCH_EXPLAIN
+		if ( explain ) {
+			printf(_("\n# with search explain %scontrol%s"),
+				explain > 1 ? _("critical ") : "",
+				explainOnly ? _(": plan only") : "" );
+		}
+#endif
+#ifdef LDAP_CONTROL_X_SEARCH_COUNT
+		if ( searchCount ) {
+			printf(_("\n# with search count %scontrol"),
+				searchCount > 1 ? _("critical ") : "" );
+		}
+#endif
 
 		printf( _("\n#\n\n") );
 
@@ -324,6 +324,8 @@ typedef struct ldapcontrol {
 #define LDAP_CONTROL_VALSORT			"1.3.6.1.4.1.4203.666.5.14"
 #define	LDAP_CONTROL_X_DEREF			"1.3.6.1.4.1.4203.666.5.16"
 #define	LDAP_CONTROL_X_WHATFAILED		"1.3.6.1.4.1.4203.666.5.17"
+#define	LDAP_CONTROL_X_SEARCH_EXPLAIN	"1.3.6.1.4.1.4203.666.5.19"
+#define	LDAP_CONTROL_X_SEARCH_COUNT		"1.3.6.1.4.1.4203.666.5.20"
 
 /* LDAP Chaining Behavior Control *//* work in progress */
 /* <draft-sermersheim-ldap-chaining>;
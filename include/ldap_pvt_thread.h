@@ -253,7 +253,9 @@ typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_PENDING_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD_MAX,
-	LDAP_PVT_THREAD_POOL_PARAM_STATE
+	LDAP_PVT_THREAD_POOL_PARAM_STATE,
+	LDAP_PVT_THREAD_POOL_PARAM_STEALS,
+	LDAP_PVT_THREAD_POOL_PARAM_STEAL_WAKEUPS
 } ldap_pvt_thread_pool_param_t;
 #endif /* !LDAP_PVT_THREAD_H_DONE */
 
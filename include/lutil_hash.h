@@ -27,6 +27,12 @@ LDAP_BEGIN_DECL
 typedef union lutil_HASHContext {
 	ber_uint_t hash;
 	unsigned long long hash64;
+	struct {
+		unsigned long long acc[4];
+		unsigned long long total;
+		unsigned char buf[32];
+		unsigned int buflen;
+	} xxh64;
 } lutil_HASH_CTX;
 
 #else /* !HAVE_LONG_LONG */
@@ -71,6 +77,23 @@ lutil_HASH64Final LDAP_P((
 	unsigned char digest[LUTIL_HASH64_BYTES],
 	lutil_HASH_CTX *context));
 
+#define LUTIL_XXH64_BYTES	8
+
+LDAP_LUTIL_F( void )
+lutil_XXH64Init LDAP_P((
+	lutil_HASH_CTX *context));
+
+LDAP_LUTIL_F( void )
+lutil_XXH64Update LDAP_P((
+	lutil_HASH_CTX *context,
+	unsigned char const *buf,
+	ber_len_t len));
+
+LDAP_LUTIL_F( void )
+lutil_XXH64Final LDAP_P((
+	unsigned char digest[LUTIL_XXH64_BYTES],
+	lutil_HASH_CTX *context));
+
 #endif /* HAVE_LONG_LONG */
 
 LDAP_END_DECL
@@ -129,6 +129,10 @@ struct ldap_int_thread_poolq_s {
 	int ltp_active_count;		/* Active, not paused/idle tasks */
 	int ltp_open_count;			/* Number of threads */
 	int ltp_starting;			/* Currently starting threads */
+
+	int ltp_steal_wakeup;		/* Woken to steal from a sibling queue */
+	unsigned long ltp_steals;	/* Tasks taken from sibling queues */
+	unsigned long ltp_steal_wakeups;	/* Times woken to steal */
 };
 
 struct ldap_int_thread_pool_s {
@@ -186,6 +190,9 @@ static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
 static ldap_pvt_thread_mutex_t ldap_pvt_thread_pool_mutex;
 
 static void *ldap_int_thread_pool_wrapper( void *pool );
+static ldap_int_thread_task_t *ldap_int_thread_pool_steal(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq );
 
 static ldap_pvt_thread_key_t	ldap_tpool_key;
 
@@ -358,7 +365,7 @@ ldap_pvt_thread_pool_submit2 (
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
-	int i, j;
+	int i, j, steal_q = -1;
 
 	if (tpool == NULL)
 		return(-1);
@@ -468,8 +475,34 @@ ldap_pvt_thread_pool_submit2 (
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
+	/* No idle or starting thread in this queue: wake up an idle
+	 * thread of another queue to steal the task.
+	 */
+	if (pool->ltp_numqs > 1 && !pq->ltp_starting &&
+		pq->ltp_open_count <= pq->ltp_active_count)
+	{
+		for (j = 1; j < pool->ltp_numqs; j++) {
+			struct ldap_int_thread_poolq_s *sq;
+			sq = pool->ltp_wqs[(i + j) % pool->ltp_numqs];
+			if (sq->ltp_open_count - sq->ltp_starting > sq->ltp_active_count) {
+				steal_q = (i + j) % pool->ltp_numqs;
+				break;
+			}
+		}
+	}
+
  done:
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
+	if (steal_q >= 0) {
+		/* never hold two queue locks at once */
+		pq = pool->ltp_wqs[steal_q];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_steal_wakeup = 1;
+		pq->ltp_steal_wakeups++;
+		ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
 	return(0);
 
  failed:
@@ -739,6 +772,24 @@ ldap_pvt_thread_pool_query(
 		}
 		break;
 
+	case LDAP_PVT_THREAD_POOL_PARAM_STEALS:
+	case LDAP_PVT_THREAD_POOL_PARAM_STEAL_WAKEUPS:
+		{
+			unsigned long total = 0;
+			int i;
+			for (i=0; i<pool->ltp_numqs; i++) {
+				struct ldap_int_thread_poolq_s *pq = pool->ltp_wqs[i];
+				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+				if (param == LDAP_PVT_THREAD_POOL_PARAM_STEALS)
+					total += pq->ltp_steals;
+				else
+					total += pq->ltp_steal_wakeups;
+				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+			}
+			count = total & INT_MAX;
+		}
+		break;
+
 	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX:
 		break;
 
@@ -986,6 +1037,19 @@ ldap_int_thread_pool_wrapper (
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
 		task = LDAP_STAILQ_FIRST(work_list);
+		if (task == NULL && pool->ltp_numqs > 1 &&
+			work_list == &pq->ltp_pending_list)
+		{
+			/* Not paused and nothing to do here.  We are still
+			 * counted as active, so no pause can complete while
+			 * we look at the other queues.
+			 */
+			task = ldap_int_thread_pool_steal(pool, pq);
+			if (task != NULL)
+				goto run;
+			work_list = pq->ltp_work_list;
+			task = LDAP_STAILQ_FIRST(work_list);
+		}
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -1031,6 +1095,13 @@ ldap_int_thread_pool_wrapper (
 
 				work_list = pq->ltp_work_list;
 				task = LDAP_STAILQ_FIRST(work_list);
+				if (task == NULL && !pool_lock && pq->ltp_steal_wakeup &&
+					work_list == &pq->ltp_pending_list)
+				{
+					/* A sibling queue has work and no idle threads */
+					pq->ltp_steal_wakeup = 0;
+					break;
+				}
 			} while (task == NULL);
 
 			if (pool_lock) {
@@ -1039,10 +1110,13 @@ ldap_int_thread_pool_wrapper (
 				pool_lock = 0;
 			}
 			pq->ltp_active_count++;
+			if (task == NULL)
+				continue;
 		}
 
 		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
 		pq->ltp_pending_count--;
+	run:
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
@@ -1085,6 +1159,45 @@ ldap_int_thread_pool_wrapper (
 	return(NULL);
 }
 
+/* Take the oldest pending task of another queue, for a thread of pq
+ * which has run out of work.  Called with pq locked, returns with pq
+ * locked.  Only one queue lock is held at a time, and siblings are
+ * only trylocked, so a thief never stalls the threads of a busy queue.
+ */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_steal(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *sq;
+	ldap_int_thread_task_t *task = NULL;
+	int i, j, numqs = pool->ltp_numqs;
+
+	/* spread thieves over the queues */
+	j = pq->ltp_steals % numqs;
+	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
+	for (i=0; i<numqs && task == NULL; i++, j = (j+1) % numqs) {
+		sq = pool->ltp_wqs[j];
+		if (sq == pq || LDAP_STAILQ_EMPTY(sq->ltp_work_list))
+			continue;
+		if (ldap_pvt_thread_mutex_trylock(&sq->ltp_mutex))
+			continue;
+		/* ltp_work_list is the empty list if a pause got here first */
+		task = LDAP_STAILQ_FIRST(sq->ltp_work_list);
+		if (task != NULL) {
+			LDAP_STAILQ_REMOVE_HEAD(sq->ltp_work_list, ltt_next.q);
+			sq->ltp_pending_count--;
+		}
+		ldap_pvt_thread_mutex_unlock(&sq->ltp_mutex);
+	}
+
+	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	if (task != NULL)
+		pq->ltp_steals++;
+	return task;
+}
+
 /* Arguments > ltp_pause to handle_pause(,PAUSE_ARG()).  arg=PAUSE_ARG
  * ensures (arg-ltp_pause) sets GO_* at need and keeps DO_PAUSE/GO_*.
  */
@@ -21,6 +21,8 @@
 
 #include "portable.h"
 
+#include <ac/string.h>
+
 #include <lutil_hash.h>
 
 /* offset and prime for 32-bit FNV-1 */
@@ -138,4 +140,162 @@ lutil_HASH64Final( unsigned char *digest, lutil_HASH_CTX *ctx )
 	digest[6] = (h>>48) & 0xffU;
 	digest[7] = (h>>56) & 0xffU;
 }
+
+/* xxHash64 by Yann Collet, see https://github.com/Cyan4973/xxHash
+ * It takes eight bytes per multiply where FNV takes one, and four
+ * independent lanes on inputs of 32 bytes or more.
+ */
+
+#define XXH_PRIME1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3	0x165667B19E3779F9ULL
+#define XXH_PRIME4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5	0x27D4EB2F165667C5ULL
+
+#define XXH_ROTL(x,r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static unsigned long long
+xxh_read64( const unsigned char *p )
+{
+	return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 |
+		(unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24 |
+		(unsigned long long)p[4] << 32 | (unsigned long long)p[5] << 40 |
+		(unsigned long long)p[6] << 48 | (unsigned long long)p[7] << 56;
+}
+
+static unsigned long long
+xxh_read32( const unsigned char *p )
+{
+	return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 |
+		(unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24;
+}
+
+static unsigned long long
+xxh_round( unsigned long long acc, unsigned long long in )
+{
+	acc += in * XXH_PRIME2;
+	acc = XXH_ROTL( acc, 31 );
+	return acc * XXH_PRIME1;
+}
+
+static unsigned long long
+xxh_merge( unsigned long long h, unsigned long long acc )
+{
+	h ^= xxh_round( 0, acc );
+	return h * XXH_PRIME1 + XXH_PRIME4;
+}
+
+static void
+xxh_stripe( unsigned long long *acc, const unsigned char *p )
+{
+	acc[0] = xxh_round( acc[0], xxh_read64( p ));
+	acc[1] = xxh_round( acc[1], xxh_read64( p + 8 ));
+	acc[2] = xxh_round( acc[2], xxh_read64( p + 16 ));
+	acc[3] = xxh_round( acc[3], xxh_read64( p + 24 ));
+}
+
+/*
+ * Initialize context
+ */
+void
+lutil_XXH64Init( lutil_HASH_CTX *ctx )
+{
+	ctx->xxh64.acc[0] = XXH_PRIME1 + XXH_PRIME2;
+	ctx->xxh64.acc[1] = XXH_PRIME2;
+	ctx->xxh64.acc[2] = 0;
+	ctx->xxh64.acc[3] = 0 - XXH_PRIME1;
+	ctx->xxh64.total = 0;
+	ctx->xxh64.buflen = 0;
+}
+
+/*
+ * Update hash
+ */
+void
+lutil_XXH64Update(
+    lutil_HASH_CTX	*ctx,
+    const unsigned char		*buf,
+    ber_len_t		len )
+{
+	const unsigned char *p, *e;
+	unsigned n;
+
+	p = buf;
+	e = &buf[len];
+	ctx->xxh64.total += len;
+
+	n = ctx->xxh64.buflen;
+	if ( n + len < 32 ) {
+		AC_MEMCPY( ctx->xxh64.buf + n, p, len );
+		ctx->xxh64.buflen += len;
+		return;
+	}
+
+	if ( n ) {
+		AC_MEMCPY( ctx->xxh64.buf + n, p, 32 - n );
+		xxh_stripe( ctx->xxh64.acc, ctx->xxh64.buf );
+		p += 32 - n;
+	}
+
+	while ( p + 32 <= e ) {
+		xxh_stripe( ctx->xxh64.acc, p );
+		p += 32;
+	}
+
+	ctx->xxh64.buflen = e - p;
+	AC_MEMCPY( ctx->xxh64.buf, p, e - p );
+}
+
+/*
+ * Save hash
+ */
+void
+lutil_XXH64Final( unsigned char *digest, lutil_HASH_CTX *ctx )
+{
+	unsigned long long h, *acc = ctx->xxh64.acc;
+	const unsigned char *p, *e;
+
+	if ( ctx->xxh64.total >= 32 ) {
+		h = XXH_ROTL( acc[0], 1 ) + XXH_ROTL( acc[1], 7 ) +
+			XXH_ROTL( acc[2], 12 ) + XXH_ROTL( acc[3], 18 );
+		h = xxh_merge( h, acc[0] );
+		h = xxh_merge( h, acc[1] );
+		h = xxh_merge( h, acc[2] );
+		h = xxh_merge( h, acc[3] );
+	} else {
+		h = acc[2] + XXH_PRIME5;
+	}
+	h += ctx->xxh64.total;
+
+	p = ctx->xxh64.buf;
+	e = p + ctx->xxh64.buflen;
+	for ( ; p + 8 <= e; p += 8 ) {
+		h ^= xxh_round( 0, xxh_read64( p ));
+		h = XXH_ROTL( h, 27 ) * XXH_PRIME1 + XXH_PRIME4;
+	}
+	if ( p + 4 <= e ) {
+		h ^= xxh_read32( p ) * XXH_PRIME1;
+		h = XXH_ROTL( h, 23 ) * XXH_PRIME2 + XXH_PRIME3;
+		p += 4;
+	}
+	for ( ; p < e; p++ ) {
+		h ^= *p * XXH_PRIME5;
+		h = XXH_ROTL( h, 11 ) * XXH_PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME2;
+	h ^= h >> 29;
+	h *= XXH_PRIME3;
+	h ^= h >> 32;
+
+	digest[0] = h & 0xffU;
+	digest[1] = (h>>8) & 0xffU;
+	digest[2] = (h>>16) & 0xffU;
+	digest[3] = (h>>24) & 0xffU;
+	digest[4] = (h>>32) & 0xffU;
+	digest[5] = (h>>40) & 0xffU;
+	digest[6] = (h>>48) & 0xffU;
+	digest[7] = (h>>56) & 0xffU;
+}
 #endif /* HAVE_LONG_LONG */
@@ -45,6 +45,9 @@ mdb_add(Operation *op, SlapReply *rs )
 	LDAPControl *ctrls[SLAP_MAX_RESPONSE_CONTROLS];
 	int num_ctrls = 0;
 
+	if ( mdb_group_join( op, rs, mdb_add ))
+		return rs->sr_err;
+
 	Debug(LDAP_DEBUG_ARGS, "==> " LDAP_XSTRING(mdb_add) ": %s\n",
 		op->ora_e->e_name.bv_val, 0, 0);
 
@@ -77,6 +80,8 @@ mdb_add(Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 	txn = moi->moi_txn;
+	/* after the txn began: an abort must keep the ads of earlier ops */
+	numads = mdb->mi_numads;
 
 	/* add opattrs to shadow as well, only missing attrs will actually
 	 * be added; helps compatibility with older OL versions */
@@ -370,13 +375,13 @@ mdb_add(Operation *op, SlapReply *rs )
 		opinfo.moi_oe.oe_key = NULL;
 		if ( op->o_noop ) {
 			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		}
 
-		rs->sr_err = mdb_txn_commit( txn );
+		rs->sr_err = mdb_group_commit( mdb, moi, txn );
 		txn = NULL;
 		if ( rs->sr_err != 0 ) {
 			mdb->mi_numads = numads;
@@ -399,12 +404,12 @@ mdb_add(Operation *op, SlapReply *rs )
 
 return_results:
 	success = rs->sr_err;
-	send_ldap_result( op, rs );
+	mdb_group_send( op, rs );
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
 			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
@@ -23,6 +23,7 @@
 
 #include "slap.h"
 #include "back-mdb.h"
+#include "idl.h"
 #include "config.h"
 #include "lutil.h"
 
@@ -87,6 +88,204 @@ mdb_attr_mask(
 	return i < 0 ? NULL : mdb->mi_attrs[i];
 }
 
+/* Find a composite index by its "attr+attr" name, whatever names
+ * of the member attributes it uses
+ */
+CompInfo *
+mdb_comp_find(
+	struct mdb_info	*mdb,
+	const char *name )
+{
+	AttributeDescription *descs[MDB_COMP_MAX];
+	char **attrs;
+	int i, j, n;
+
+	attrs = ldap_str2charray( name, "+" );
+	if ( attrs == NULL )
+		return NULL;
+	for ( n = 0; attrs[n] != NULL; n++ ) {
+		const char *text;
+
+		if ( n == MDB_COMP_MAX ) {
+			n = 0;
+			break;
+		}
+		descs[n] = NULL;
+		if ( slap_str2ad( attrs[n], &descs[n], &text ) != LDAP_SUCCESS ) {
+			n = 0;
+			break;
+		}
+	}
+	ldap_charray_free( attrs );
+
+	for ( i = 0; n && i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+
+		if ( ci->ci_nattrs != n )
+			continue;
+		for ( j = 0; j < n && ci->ci_descs[j] == descs[j]; j++ )
+			;
+		if ( j == n )
+			return ci;
+	}
+	return NULL;
+}
+
+static void
+comp_info_free( CompInfo *ci )
+{
+	ch_free( ci->ci_name.bv_val );
+	ch_free( ci );
+}
+
+/* Declare an index over the tuple of attributes in "attr+attr".
+ * Only equality is supported, so mask must ask for it.
+ */
+static int
+comp_index_config(
+	struct mdb_info	*mdb,
+	const char		*fname,
+	int			lineno,
+	char		*name,
+	slap_mask_t mask,
+	struct		config_reply_s *c_reply)
+{
+	CompInfo *ci, *b;
+	char **attrs, *ptr;
+	ber_len_t len = 0;
+	int i, j, rc = 0;
+
+	if ( !IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ) ||
+		( mask & ( SLAP_INDEX_TYPE|SLAP_INDEX_SUBSTR_TYPE ) &
+			~SLAP_INDEX_EQUALITY ))
+	{
+		if ( c_reply ) {
+			snprintf( c_reply->msg, sizeof(c_reply->msg),
+				"composite index \"%s\" supports eq only", name );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		return LDAP_PARAM_ERROR;
+	}
+
+	attrs = ldap_str2charray( name, "+" );
+	ci = ch_calloc( 1, sizeof(CompInfo) );
+
+	for ( i = 0; attrs && attrs[i] != NULL; i++ ) {
+		AttributeDescription *ad = NULL;
+		const char *text;
+
+		if ( i == MDB_COMP_MAX ) {
+			if ( c_reply ) {
+				snprintf( c_reply->msg, sizeof(c_reply->msg),
+					"composite index \"%s\" has more than %d attributes",
+					name, MDB_COMP_MAX );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_PARAM_ERROR;
+			goto done;
+		}
+
+		rc = slap_str2ad( attrs[i], &ad, &text );
+		if ( rc != LDAP_SUCCESS ) {
+			if ( c_reply ) {
+				snprintf( c_reply->msg, sizeof(c_reply->msg),
+					"index attribute \"%s\" undefined", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			goto done;
+		}
+
+		for ( j = 0; j < i; j++ ) {
+			if ( ci->ci_descs[j] == ad )
+				break;
+		}
+		if ( j < i || ad == slap_schema.si_ad_entryDN ||
+			slap_ad_is_binary( ad ) || !( ad->ad_type->sat_equality
+				&& ad->ad_type->sat_equality->smr_indexer
+				&& ad->ad_type->sat_equality->smr_filter ))
+		{
+			if ( c_reply ) {
+				snprintf( c_reply->msg, sizeof(c_reply->msg),
+					"composite index of attribute \"%s\" disallowed",
+					attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto done;
+		}
+		ci->ci_descs[i] = ad;
+		len += ad->ad_cname.bv_len + 1;
+	}
+	ci->ci_nattrs = i;
+
+	if ( ci->ci_nattrs < 2 ) {
+		if ( c_reply ) {
+			snprintf( c_reply->msg, sizeof(c_reply->msg),
+				"composite index \"%s\" needs two attributes or more",
+				name );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		rc = LDAP_PARAM_ERROR;
+		goto done;
+	}
+
+	/* name it after the canonical names of its members */
+	ci->ci_name.bv_val = ptr = ch_malloc( len );
+	for ( i = 0; i < ci->ci_nattrs; i++ ) {
+		if ( i )
+			*ptr++ = '+';
+		ptr = lutil_strcopy( ptr, ci->ci_descs[i]->ad_cname.bv_val );
+	}
+	ci->ci_name.bv_len = ptr - ci->ci_name.bv_val;
+
+	Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
+		ci->ci_name.bv_val, (long) SLAP_INDEX_EQUALITY, 0 );
+
+	b = mdb_comp_find( mdb, ci->ci_name.bv_val );
+	if ( b ) {
+		/* as with attributes, a definition being deleted is replaced */
+		if (( mdb->mi_flags & MDB_IS_OPEN ) &&
+			( b->ci_indexmask & MDB_INDEX_DELETING ))
+		{
+			b->ci_indexmask &= ~MDB_INDEX_DELETING;
+			if ( b->ci_newmask )
+				b->ci_indexmask = b->ci_newmask;
+			b->ci_newmask = SLAP_INDEX_EQUALITY;
+			goto done;
+		}
+		if ( c_reply ) {
+			snprintf( c_reply->msg, sizeof(c_reply->msg),
+				"duplicate index definition for attr \"%s\"",
+				ci->ci_name.bv_val );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		rc = LDAP_PARAM_ERROR;
+		goto done;
+	}
+
+	if ( mdb->mi_flags & MDB_IS_OPEN ) {
+		ci->ci_newmask = SLAP_INDEX_EQUALITY;
+	} else {
+		ci->ci_indexmask = SLAP_INDEX_EQUALITY;
+	}
+	mdb->mi_comps = ch_realloc( mdb->mi_comps,
+		( mdb->mi_ncomps + 1 ) * sizeof( CompInfo * ));
+	mdb->mi_comps[mdb->mi_ncomps++] = ci;
+	ci = NULL;
+
+done:
+	if ( ci )
+		comp_info_free( ci );
+	ldap_charray_free( attrs );
+	return rc;
+}
+
 /* Open all un-opened index DB handles */
 int
 mdb_attr_dbs_open(
@@ -110,7 +309,8 @@ mdb_attr_dbs_open(
 				cr->msg, 0, 0 );
 			return rc;
 		}
-		dbis = ch_calloc( 1, mdb->mi_nattrs * sizeof(MDB_dbi) );
+		dbis = ch_calloc( 1, ( mdb->mi_nattrs + mdb->mi_ncomps ) *
+			sizeof(MDB_dbi) );
 	} else {
 		rc = 0;
 	}
@@ -142,6 +342,25 @@ mdb_attr_dbs_open(
 			dbis[i] = mdb->mi_attrs[i]->ai_dbi;
 	}
 
+	for ( i=0; !rc && i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( ci->ci_dbi )	/* already open */
+			continue;
+		rc = mdb_dbi_open( txn, ci->ci_name.bv_val, flags, &ci->ci_dbi );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"mdb_dbi_open(%s) failed: %s (%d).",
+				be->be_suffix[0].bv_val, ci->ci_name.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_attr_dbs) ": %s\n",
+				cr->msg, 0, 0 );
+			break;
+		}
+		if ( dbis )
+			dbis[mdb->mi_nattrs + i] = ci->ci_dbi;
+	}
+
 	/* Only commit if this is our txn */
 	if ( tx0 == NULL ) {
 		if ( !rc ) {
@@ -165,6 +384,12 @@ mdb_attr_dbs_open(
 					mdb->mi_attrs[i]->ai_indexmask |= MDB_INDEX_DELETING;
 				}
 			}
+			for ( i=0; i<mdb->mi_ncomps; i++ ) {
+				if ( dbis[mdb->mi_nattrs + i] ) {
+					mdb->mi_comps[i]->ci_dbi = 0;
+					mdb->mi_comps[i]->ci_indexmask |= MDB_INDEX_DELETING;
+				}
+			}
 			mdb_attr_flush( mdb );
 		}
 		ch_free( dbis );
@@ -184,6 +409,11 @@ mdb_attr_dbs_close(
 			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_dbi );
 			mdb->mi_attrs[i]->ai_dbi = 0;
 		}
+	for ( i=0; i<mdb->mi_ncomps; i++ )
+		if ( mdb->mi_comps[i]->ci_dbi ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_comps[i]->ci_dbi );
+			mdb->mi_comps[i]->ci_dbi = 0;
+		}
 }
 
 int
@@ -275,6 +505,14 @@ mdb_attr_index_config(
 			continue;
 		}
 
+		if ( strchr( attrs[i], '+' )) {
+			rc = comp_index_config( mdb, fname, lineno, attrs[i],
+				mask, c_reply );
+			if ( rc )
+				goto done;
+			continue;
+		}
+
 #ifdef LDAP_COMP_MATCH
 		if ( is_component_reference( attrs[i] ) ) {
 			rc = extract_component_reference( attrs[i], &cr );
@@ -385,6 +623,7 @@ fail:
 		a->ai_cursor = NULL;
 		a->ai_root = NULL;
 		a->ai_desc = ad;
+		a->ai_automask = 0;
 		a->ai_dbi = 0;
 		a->ai_multi_hi = UINT_MAX;
 		a->ai_multi_lo = UINT_MAX;
@@ -432,6 +671,7 @@ fail:
 			if ( !( b->ai_indexmask || b->ai_newmask ) && b->ai_multi_lo < UINT_MAX ) {
 				b->ai_indexmask = a->ai_indexmask;
 				b->ai_newmask = a->ai_newmask;
+				b->ai_automask = 0;
 				ch_free( a );
 				rc = 0;
 				continue;
@@ -439,14 +679,18 @@ fail:
 			if ( mdb->mi_flags & MDB_IS_OPEN ) {
 				/* If there is already an index defined for this attribute
 				 * it must be replaced. Otherwise we end up with multiple 
-				 * olcIndex values for the same attribute */
-				if ( b->ai_indexmask & MDB_INDEX_DELETING ) {
+				 * olcIndex values for the same attribute. One that only
+				 * autoindex added has no value, and is replaced too. */
+				if ( b->ai_indexmask & MDB_INDEX_DELETING ||
+					!(( b->ai_indexmask | b->ai_newmask ) & ~b->ai_automask ))
+				{
 					/* If we were editing this attr, reset it */
 					b->ai_indexmask &= ~MDB_INDEX_DELETING;
 					/* If this is leftover from a previous add, commit it */
 					if ( b->ai_newmask )
 						b->ai_indexmask = b->ai_newmask;
 					b->ai_newmask = a->ai_newmask;
+					b->ai_automask = 0;
 					ch_free( a );
 					rc = 0;
 					continue;
@@ -478,15 +722,16 @@ mdb_attr_index_unparser( void *v1, void *v2 )
 	AttrInfo *ai = v1;
 	BerVarray *bva = v2;
 	struct berval bv;
+	slap_mask_t mask = ai->ai_indexmask & ~ai->ai_automask;
 	char *ptr;
 
-	slap_index2bvlen( ai->ai_indexmask, &bv );
+	slap_index2bvlen( mask, &bv );
 	if ( bv.bv_len ) {
 		bv.bv_len += ai->ai_desc->ad_cname.bv_len + 1;
 		ptr = ch_malloc( bv.bv_len+1 );
 		bv.bv_val = lutil_strcopy( ptr, ai->ai_desc->ad_cname.bv_val );
 		*bv.bv_val++ = ' ';
-		slap_index2bv( ai->ai_indexmask, &bv );
+		slap_index2bv( mask, &bv );
 		bv.bv_val = ptr;
 		ber_bvarray_add( bva, &bv );
 	}
@@ -506,8 +751,20 @@ mdb_attr_index_unparse( struct mdb_info *mdb, BerVarray *bva )
 		mdb_attr_index_unparser( &aidef, bva );
 	}
 	for ( i=0; i<mdb->mi_nattrs; i++ )
-		if ( mdb->mi_attrs[i]->ai_indexmask )
+		if ( mdb->mi_attrs[i]->ai_indexmask &
+			~mdb->mi_attrs[i]->ai_automask )
 			mdb_attr_index_unparser( mdb->mi_attrs[i], bva );
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		struct berval bv;
+
+		if ( !ci->ci_indexmask )
+			continue;
+		bv.bv_len = ci->ci_name.bv_len + STRLENOF(" eq");
+		bv.bv_val = ch_malloc( bv.bv_len + 1 );
+		strcpy( lutil_strcopy( bv.bv_val, ci->ci_name.bv_val ), " eq" );
+		ber_bvarray_add( bva, &bv );
+	}
 }
 
 int
@@ -689,6 +946,11 @@ mdb_attr_index_destroy( struct mdb_info *mdb )
 		mdb_attr_info_free( mdb->mi_attrs[i] );
 
 	free( mdb->mi_attrs );
+
+	for ( i=0; i<mdb->mi_ncomps; i++ )
+		comp_info_free( mdb->mi_comps[i] );
+
+	free( mdb->mi_comps );
 }
 
 void mdb_attr_index_free( struct mdb_info *mdb, AttributeDescription *ad )
@@ -714,6 +976,7 @@ void mdb_attr_flush( struct mdb_info *mdb )
 			if ( mdb->mi_attrs[i]->ai_multi_lo < UINT_MAX ) {
 				mdb->mi_attrs[i]->ai_indexmask = 0;
 				mdb->mi_attrs[i]->ai_newmask = 0;
+				mdb->mi_attrs[i]->ai_automask = 0;
 			} else {
 				int j;
 				mdb_attr_info_free( mdb->mi_attrs[i] );
@@ -724,6 +987,17 @@ void mdb_attr_flush( struct mdb_info *mdb )
 			}
 		}
 	}
+
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		if ( mdb->mi_comps[i]->ci_indexmask & MDB_INDEX_DELETING ) {
+			int j;
+			comp_info_free( mdb->mi_comps[i] );
+			mdb->mi_ncomps--;
+			for (j=i; j<mdb->mi_ncomps; j++)
+				mdb->mi_comps[j] = mdb->mi_comps[j+1];
+			i--;
+		}
+	}
 }
 
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn )
@@ -812,3 +1086,99 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad )
 
 	return rc;
 }
+
+/* No attribute is numbered 0, so ad2i key 0 holds the format flags
+ * of the database. A database without them has FNV index keys.
+ */
+static unsigned
+mdb_format_want( void )
+{
+	unsigned fmt = 0;
+
+	if ( slap_hashfunc( -1 ) == SLAP_INDEX_HASH_XXH64 )
+		fmt |= MDB_FMT_XXH64;
+#ifdef MDB_IDL_BITMAPS
+	fmt |= MDB_FMT_BITMAPS;
+#endif
+	return fmt;
+}
+
+int mdb_format_write( struct mdb_info *mdb, MDB_txn *txn )
+{
+	int i = 0, rc;
+	unsigned fmt = mdb_format_want();
+	MDB_val key, val;
+
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	val.mv_size = sizeof(fmt);
+	val.mv_data = &fmt;
+
+	rc = mdb_put( txn, mdb->mi_ad2id, &key, &val, 0 );
+	if ( rc == 0 && ( fmt & MDB_FMT_BITMAPS ))
+		mdb->mi_flags |= MDB_BITMAP_KEYS;
+	return rc;
+}
+
+/* Check that the index keys were made with the configured hash,
+ * and hold no bitmap words unless this build can read them. Only
+ * slapindex may open a database whose keys fail either, to rebuild
+ * them. Keys without bitmap words are readable by any build, so an
+ * older database stays as it is and gets plain ranges only.
+ */
+int mdb_format_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	int i = 0, rc;
+	unsigned fmt = 0, want = mdb_format_want();
+	MDB_val key, val;
+	MDB_stat st;
+
+	mdb->mi_flags &= ~MDB_BITMAP_KEYS;
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	rc = mdb_get( txn, mdb->mi_ad2id, &key, &val );
+	if ( rc == MDB_SUCCESS ) {
+		if ( val.mv_size == sizeof(fmt) )
+			memcpy( &fmt, val.mv_data, sizeof(fmt) );
+	} else if ( rc != MDB_NOTFOUND ) {
+		return rc;
+	}
+
+	if ( fmt == want ) {
+		if ( fmt & MDB_FMT_BITMAPS )
+			mdb->mi_flags |= MDB_BITMAP_KEYS;
+		return 0;
+	}
+
+	/* nothing was indexed yet */
+	rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+	if ( rc )
+		return rc;
+	if ( !st.ms_entries ) {
+		if ( slapMode & SLAP_TOOL_READONLY )
+			return 0;
+		return mdb_format_write( mdb, txn );
+	}
+
+	if ( ( fmt ^ want ) & MDB_FMT_XXH64 ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"index keys were hashed with %s, "
+			"run \"slapindex\" to rebuild them.",
+			be->be_suffix[0].bv_val,
+			( fmt & MDB_FMT_XXH64 ) ? "xxh64" : "fnv" );
+	} else if ( fmt & ~want & MDB_FMT_BITMAPS ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"index keys hold bitmaps this build cannot read, "
+			"run \"slapindex\" to rebuild them.",
+			be->be_suffix[0].bv_val );
+	} else {
+		return 0;
+	}
+	Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_format_check) ": %s\n",
+		cr->msg, 0, 0 );
+	if ( !( slapMode & SLAP_TOOL_READMAIN ))
+		return LDAP_OTHER;
+	mdb->mi_flags |= MDB_NEED_REHASH;
+	return 0;
+}
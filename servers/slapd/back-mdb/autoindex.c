@@ -0,0 +1,425 @@
+/* autoindex.c - track unindexed search filters, and index them */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+#include "config.h"
+#include "lutil.h"
+#include "ldap_rq.h"
+
+/* When a filter item has no index for its attribute, its candidates
+ * are all the entries in scope, and the search reads and tests each
+ * one of them. mdb_index_param notes the attribute and index type of
+ * such items in the search, and when the search is done the number of
+ * entries it tested is added to the counts of each of them. cn=monitor
+ * shows the counts as olmDbNotIndexed.
+ *
+ * With "autoindex" set, a missing index that enough searches, testing
+ * enough entries each, went without is added by a runqueue task the
+ * way a change to olcDbIndex would add it, and the online indexer
+ * builds it. The index types it adds are kept apart in ai_automask and
+ * left out of olcDbIndex, so they are not saved in the configuration.
+ */
+
+#define MDB_AUTOINDEX_TYPES	4
+
+/* States of a missing index */
+#define MDB_AI_NONE		0
+#define MDB_AI_PENDING	1	/* to be added by the task */
+#define MDB_AI_ADDED	2
+#define MDB_AI_FAILED	3
+
+static struct {
+	struct berval	name;
+	slap_mask_t		mask;
+} mdb_ai_types[MDB_AUTOINDEX_TYPES] = {
+	{ BER_BVC("present"), SLAP_INDEX_PRESENT },
+	{ BER_BVC("equality"), SLAP_INDEX_EQUALITY },
+	{ BER_BVC("approx"), SLAP_INDEX_APPROX },
+	{ BER_BVC("substr"), SLAP_INDEX_SUBSTR_DEFAULT }
+};
+
+static char *mdb_ai_states[] = { NULL, "pending", "added", "failed" };
+
+typedef struct mdb_unindexed {
+	AttributeDescription	*un_ad;
+	struct {
+		unsigned long	searches;
+		unsigned long	tested;
+		time_t			last;
+		int				state;
+	} un_type[MDB_AUTOINDEX_TYPES];
+} mdb_unindexed;
+
+static int
+mdb_unindexed_cmp( const void *v1, const void *v2 )
+{
+	const mdb_unindexed *u1 = v1, *u2 = v2;
+
+	return SLAP_PTRCMP( u1->un_ad, u2->un_ad );
+}
+
+static int
+mdb_ai_type( slap_mask_t type )
+{
+	int i;
+
+	for ( i = 0; i < MDB_AUTOINDEX_TYPES; i++ ) {
+		if ( type & mdb_ai_types[i].mask )
+			return i;
+	}
+	return -1;
+}
+
+void
+mdb_autoindex_init( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_init( &mdb->mi_autoindex.ma_mutex );
+}
+
+void
+mdb_autoindex_destroy( struct mdb_info *mdb )
+{
+	mdb_autoindex *ma = &mdb->mi_autoindex;
+
+	if ( ma->ma_task ) {
+		struct re_s *re = ma->ma_task;
+		ma->ma_task = NULL;
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ) )
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+	avl_free( ma->ma_tree, ch_free );
+	ma->ma_tree = NULL;
+	ldap_pvt_thread_mutex_destroy( &ma->ma_mutex );
+}
+
+void
+mdb_autoindex_begin( Operation *op, mdb_unseen *mu )
+{
+	mu->mu_nseen = 0;
+	mu->mu_oe.oe_key = (void *)mdb_autoindex_note;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &mu->mu_oe, oe_next );
+}
+
+/* A filter item of the search has no index of this type */
+void
+mdb_autoindex_note( Operation *op, AttributeDescription *ad, slap_mask_t type )
+{
+	OpExtra *oex;
+	mdb_unseen *mu;
+	int i;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)mdb_autoindex_note )
+			break;
+	}
+	if ( !oex || mdb_ai_type( type ) < 0 )
+		return;
+	mu = (mdb_unseen *)oex;
+
+	/* subtypes are indexed along with their type */
+	ad = ad->ad_type->sat_ad;
+	for ( i = 0; i < mu->mu_nseen; i++ ) {
+		if ( mu->mu_seen[i].ad == ad && mu->mu_seen[i].type == type )
+			return;
+	}
+	if ( i < MDB_AUTOINDEX_SEEN ) {
+		mu->mu_seen[i].ad = ad;
+		mu->mu_seen[i].type = type;
+		mu->mu_nseen++;
+	}
+}
+
+static void *mdb_autoindex_task( void *ctx, void *arg );
+
+/* The search is done, having tested this many entries */
+void
+mdb_autoindex_end( Operation *op, mdb_unseen *mu, ID tested )
+{
+	BackendDB *be = op->o_bd->bd_self;
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_autoindex *ma = &mdb->mi_autoindex;
+	mdb_unindexed dummy, *un;
+	time_t now;
+	int i, k, pending = 0, wake = 0;
+
+	if ( !mu->mu_oe.oe_key )
+		return;
+	LDAP_SLIST_REMOVE( &op->o_extra, &mu->mu_oe, OpExtra, oe_next );
+	mu->mu_oe.oe_key = NULL;
+	if ( !mu->mu_nseen )
+		return;
+
+	now = slap_get_time();
+	ldap_pvt_thread_mutex_lock( &ma->ma_mutex );
+	for ( i = 0; i < mu->mu_nseen; i++ ) {
+		k = mdb_ai_type( mu->mu_seen[i].type );
+		dummy.un_ad = mu->mu_seen[i].ad;
+		un = avl_find( ma->ma_tree, &dummy, mdb_unindexed_cmp );
+		if ( !un ) {
+			un = ch_calloc( 1, sizeof( mdb_unindexed ));
+			un->un_ad = dummy.un_ad;
+			avl_insert( &ma->ma_tree, un, mdb_unindexed_cmp, avl_dup_error );
+		}
+		un->un_type[k].searches++;
+		un->un_type[k].tested += tested;
+		un->un_type[k].last = now;
+
+		if ( ma->ma_searches && un->un_type[k].state == MDB_AI_NONE &&
+			un->un_type[k].searches >= ma->ma_searches &&
+			un->un_type[k].tested / un->un_type[k].searches >= ma->ma_tested )
+		{
+			un->un_type[k].state = MDB_AI_PENDING;
+			pending = 1;
+		}
+	}
+	if ( pending && !ma->ma_task && ( slapMode & SLAP_SERVER_MODE )) {
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		ma->ma_task = ldap_pvt_runqueue_insert( &slapd_rq, 60,
+			mdb_autoindex_task, be,
+			LDAP_XSTRING(mdb_autoindex_task), be->be_suffix[0].bv_val );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+		wake = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &ma->ma_mutex );
+
+	if ( wake )
+		slap_wake_listener();
+}
+
+static int
+mdb_ai_allowed( AttributeDescription *ad, slap_mask_t mask )
+{
+	MatchingRule *mr;
+
+	switch ( mask ) {
+	case SLAP_INDEX_PRESENT:
+		return 1;
+	case SLAP_INDEX_EQUALITY:
+		mr = ad->ad_type->sat_equality;
+		break;
+	case SLAP_INDEX_APPROX:
+		mr = ad->ad_type->sat_approx;
+		break;
+	default:
+		mr = ad->ad_type->sat_substr;
+		break;
+	}
+	return mr && mr->smr_indexer && mr->smr_filter;
+}
+
+typedef struct mdb_ai_run {
+	BackendDB	*be;
+	int			added;
+} mdb_ai_run;
+
+/* Add the pending indexes of an attribute. Runs with the server paused. */
+static int
+mdb_ai_add( void *v_un, void *v_run )
+{
+	mdb_unindexed *un = v_un;
+	mdb_ai_run *run = v_run;
+	BackendDB *be = run->be;
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	AttributeDescription *ad = un->un_ad;
+	AttrInfo *ai;
+	slap_mask_t mask = 0, want = 0, automask = 0;
+	struct berval bv;
+	char buf[64], *argv[3];
+	int i, rc;
+
+	ai = mdb_attr_mask( mdb, ad );
+	if ( ai && ai->ai_newmask )
+		return 0;	/* still being built, see again next time */
+	if ( ai ) {
+		mask = ai->ai_indexmask;
+		automask = ai->ai_automask;
+	}
+
+	for ( i = 0; i < MDB_AUTOINDEX_TYPES; i++ ) {
+		if ( un->un_type[i].state != MDB_AI_PENDING )
+			continue;
+		if ( !mdb->mi_autoindex.ma_searches ) {
+			/* the policy was turned off */
+			un->un_type[i].state = MDB_AI_NONE;
+		} else if ( IS_SLAP_INDEX( mask, mdb_ai_types[i].mask )) {
+			/* someone else added it meanwhile */
+			un->un_type[i].state = MDB_AI_ADDED;
+		} else if ( !mdb_ai_allowed( ad, mdb_ai_types[i].mask )) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_autoindex_task)
+				": database %s: %s index of attribute %s disallowed\n",
+				be->be_suffix[0].bv_val, mdb_ai_types[i].name.bv_val,
+				ad->ad_cname.bv_val );
+			un->un_type[i].state = MDB_AI_FAILED;
+		} else {
+			want |= mdb_ai_types[i].mask;
+		}
+	}
+	if ( !want )
+		return 0;
+
+	automask |= want & ~mask;
+	mask |= want;
+	slap_index2bvlen( mask, &bv );
+	assert( bv.bv_len < sizeof( buf ));
+	bv.bv_val = buf;
+	slap_index2bv( mask, &bv );
+	buf[bv.bv_len] = '\0';
+
+	argv[0] = ad->ad_cname.bv_val;
+	argv[1] = buf;
+	argv[2] = NULL;
+	/* replace an existing definition, as a change of olcDbIndex does */
+	if ( ai )
+		ai->ai_indexmask |= MDB_INDEX_DELETING;
+	rc = mdb_attr_index_config( mdb, LDAP_XSTRING(mdb_autoindex_task), 0,
+		2, argv, NULL );
+	if ( rc && ai )
+		ai->ai_indexmask &= ~MDB_INDEX_DELETING;
+
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_autoindex_task)
+			": cannot add \"index %s %s\" (%d)\n", argv[0], buf, rc );
+	} else {
+		ai = mdb_attr_mask( mdb, ad );
+		ai->ai_automask = automask;
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_autoindex_task)
+			": database %s: adding \"index %s %s\"\n",
+			be->be_suffix[0].bv_val, argv[0], buf );
+	}
+	for ( i = 0; i < MDB_AUTOINDEX_TYPES; i++ ) {
+		if ( want & mdb_ai_types[i].mask )
+			un->un_type[i].state = rc ? MDB_AI_FAILED : MDB_AI_ADDED;
+	}
+	if ( !rc )
+		run->added++;
+
+	return 0;
+}
+
+static int
+mdb_ai_pending( void *v_un, void *arg )
+{
+	mdb_unindexed *un = v_un;
+	int i;
+
+	for ( i = 0; i < MDB_AUTOINDEX_TYPES; i++ ) {
+		if ( un->un_type[i].state == MDB_AI_PENDING )
+			return 1;
+	}
+	return 0;
+}
+
+static void *
+mdb_autoindex_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	BackendDB *be = rtask->arg;
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_autoindex *ma = &mdb->mi_autoindex;
+	mdb_ai_run run = { be, 0 };
+	ConfigReply cr = { 0 };
+	int busy, pending = 1;
+
+	/* New indexes would have to wait for the ones being built, and
+	 * the server can't be paused meanwhile.
+	 */
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	busy = mdb->mi_index_task != NULL;
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	if ( !busy && slap_pause_server() == LDAP_SUCCESS ) {
+		ldap_pvt_thread_mutex_lock( &ma->ma_mutex );
+		avl_apply( ma->ma_tree, mdb_ai_add, &run, -1, AVL_INORDER );
+		ldap_pvt_thread_mutex_unlock( &ma->ma_mutex );
+
+		if ( run.added && mdb_attr_dbs_open( be, NULL, &cr ) == 0 ) {
+			ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+			if ( !mdb->mi_index_task )
+				mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq,
+					36000, mdb_online_index, be,
+					LDAP_XSTRING(mdb_online_index), be->be_suffix[0].bv_val );
+			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+		}
+		slap_unpause_server();
+	}
+
+	/* go again later if anything is left to add */
+	ldap_pvt_thread_mutex_lock( &ma->ma_mutex );
+	pending = avl_apply( ma->ma_tree, mdb_ai_pending, NULL, 1,
+		AVL_INORDER ) == 1;
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	if ( !pending ) {
+		ma->ma_task = NULL;
+		ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	ldap_pvt_thread_mutex_unlock( &ma->ma_mutex );
+
+	/* the index task, if any, is due now */
+	if ( run.added )
+		slap_wake_listener();
+	return NULL;
+}
+
+/* One olmDbNotIndexed value per attribute and index type */
+static int
+mdb_ai_value( void *v_un, void *v_vals )
+{
+	mdb_unindexed *un = v_un;
+	BerVarray *vals = v_vals;
+	char buf[ SLAP_TEXT_BUFLEN ], tbuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	struct berval bv, ts;
+	int i;
+
+	for ( i = 0; i < MDB_AUTOINDEX_TYPES; i++ ) {
+		if ( !un->un_type[i].searches )
+			continue;
+		ts.bv_val = tbuf;
+		ts.bv_len = sizeof( tbuf );
+		slap_timestamp( &un->un_type[i].last, &ts );
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+			"%s#%s searches=%lu tested=%lu last=%s%s%s",
+			un->un_ad->ad_cname.bv_val, mdb_ai_types[i].name.bv_val,
+			un->un_type[i].searches, un->un_type[i].tested, ts.bv_val,
+			un->un_type[i].state ? " autoindex=" : "",
+			un->un_type[i].state ? mdb_ai_states[un->un_type[i].state] : "" );
+		if ( bv.bv_len >= sizeof( buf ))
+			continue;
+		bv.bv_val = buf;
+		value_add_one( vals, &bv );
+	}
+	return 0;
+}
+
+void
+mdb_autoindex_values( struct mdb_info *mdb, BerVarray *vals )
+{
+	mdb_autoindex *ma = &mdb->mi_autoindex;
+
+	ldap_pvt_thread_mutex_lock( &ma->ma_mutex );
+	avl_apply( ma->ma_tree, mdb_ai_value, vals, -1, AVL_INORDER );
+	ldap_pvt_thread_mutex_unlock( &ma->ma_mutex );
+}
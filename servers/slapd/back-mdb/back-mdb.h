@@ -33,7 +33,12 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_DICT		4
+#define MDB_NDB			5
+
+/* format flags, kept under ad2i key 0 */
+#define MDB_FMT_XXH64	0x01	/* index keys are xxHash64 hashes */
+#define MDB_FMT_BITMAPS	0x02	/* range keys may carry bitmap words */
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -45,15 +50,21 @@ LDAP_BEGIN_DECL
 
 #define	MDB_MAXADS	65536
 
+/* Most compression dictionaries an environment can hold */
+#define	MDB_MAXDICTS	64
+
 /* Default to 10MB max */
 #define DEFAULT_MAPSIZE	(10*1048576)
 
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
-#ifdef LDAP_DEVEL
-#define MDB_MONITOR_IDX
-#endif
+/* Memory and seconds paged searches are kept between pages */
+#define DEFAULT_PAGED_MAX	(8*1048576)
+#define DEFAULT_PAGED_TIMEOUT	300
+
+/* Threads reading entries for the online indexer */
+#define DEFAULT_INDEX_THREADS	2
 
 typedef struct mdb_monitor_t {
 	void		*mdm_cb;
@@ -63,6 +74,120 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* Number of independently locked partitions of the entry cache */
+#define MDB_ECACHE_SHARDS	16
+
+/* A decoded entry in the shared entry cache. The Entry and all of its
+ * attributes and values live in the same allocation, and are never
+ * modified once the node is published.
+ */
+typedef struct mdb_ecnode {
+	struct mdb_ecnode	*en_lrunext;
+	struct mdb_ecnode	*en_lruprev;
+	struct mdb_ecshard	*en_shard;
+	ID			en_id;
+	size_t		en_txnid;	/* snapshot the entry was read from, or the
+							 * txn that invalidated it for tombstones */
+	size_t		en_size;
+	int			en_refcnt;
+	int			en_flags;
+#define	MDB_EN_LINKED	0x01	/* present in the shard tree */
+#define	MDB_EN_STALE	0x02	/* tombstone, carries no entry */
+	Entry		en_e;
+} mdb_ecnode;
+
+typedef struct mdb_ecshard {
+	ldap_pvt_thread_mutex_t	es_mutex;
+	Avlnode		*es_tree;
+	mdb_ecnode	*es_lruhead;
+	mdb_ecnode	*es_lrutail;
+	size_t		es_size;
+	size_t		es_wtxnid;	/* newest invalidation no longer tracked
+							 * by a tombstone */
+	unsigned long	es_count;
+	unsigned long	es_hits;
+	unsigned long	es_misses;
+	unsigned long	es_evictions;
+} mdb_ecshard;
+
+/* A write op waiting for the thread of its batch to run it. The op's
+ * own thread still sends its result.
+ */
+typedef struct mdb_group_op {
+	OpExtra		mgo_oe;
+	Operation	*mgo_op;
+	SlapReply	*mgo_rs;
+	BI_op_func	*mgo_func;
+	ldap_pvt_thread_t	mgo_tid;	/* the op's own thread */
+	int			mgo_state;
+#define MGO_QUEUED	0
+#define MGO_RUNNING	1
+#define MGO_SEND	2	/* its thread is to send the result */
+#define MGO_DONE	3
+	struct mdb_group_op	*mgo_next;	/* in mg_ops */
+	struct mdb_group_op	*mgo_bnext;	/* in mg_batch */
+	int			mgo_committed;	/* its batch is done */
+	int			mgo_brc;	/* and the result of its commit */
+} mdb_group_op;
+
+/* Write txns of concurrent ops committed as one. The thread of the
+ * first op of a batch begins the shared txn, runs each op in a nested
+ * txn of it, and commits it.
+ */
+typedef struct mdb_group {
+	ldap_pvt_thread_mutex_t	mg_mutex;
+	ldap_pvt_thread_cond_t	mg_cond;
+	MDB_txn		*mg_txn;	/* the open batch, if any */
+	mdb_group_op	*mg_leader;	/* op whose thread runs it */
+	mdb_group_op	*mg_ops;	/* ops waiting to be run */
+	mdb_group_op	**mg_tail;
+	mdb_group_op	*mg_batch;	/* ops that joined the batch */
+	int			mg_nops;
+	int			mg_lazy;	/* it was begun with MDB_NOMETASYNC */
+	int			mg_numads;	/* mi_numads when it began */
+} mdb_group;
+
+/* State of the online indexer, see online.c */
+typedef struct mdb_online {
+	ldap_pvt_thread_mutex_t	mo_mutex;
+	ldap_pvt_thread_cond_t	mo_cond;
+	int			mo_active;	/* write ops must record what they index */
+	int			mo_workers;	/* reader threads still running */
+	int			mo_rc;
+	struct mdb_ixbatch	*mo_batches;	/* read, or being read, not yet written */
+	struct mdb_ixtouch	*mo_touched;	/* entries indexed by write ops */
+	int			mo_ntouched;
+	int			mo_maxtouched;
+	ID			mo_next;	/* first id no reader has taken yet */
+	ID			mo_last;
+	unsigned long	mo_entries;
+	unsigned long	mo_keys;
+	unsigned long	mo_redone;	/* entries indexed again by the writer */
+	time_t		mo_start;
+	time_t		mo_end;
+} mdb_online;
+
+/* Searches that found no index for a filter, see autoindex.c */
+typedef struct mdb_autoindex {
+	ldap_pvt_thread_mutex_t	ma_mutex;
+	Avlnode		*ma_tree;	/* of mdb_unindexed, by attribute */
+	unsigned	ma_searches;	/* build an index after this many searches */
+	unsigned	ma_tested;	/* that tested this many entries on average */
+	struct re_s	*ma_task;
+} mdb_autoindex;
+
+/* What one search found unindexed */
+#define MDB_AUTOINDEX_SEEN	8
+
+typedef struct mdb_unseen {
+	OpExtra		mu_oe;
+	int			mu_nseen;
+	struct {
+		AttributeDescription	*ad;
+		slap_mask_t		type;
+	} mu_seen[MDB_AUTOINDEX_SEEN];
+} mdb_unseen;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -74,11 +199,26 @@ struct mdb_info {
 	size_t		mi_mapsize;
 	ID			mi_nextid;
 	size_t		mi_maxentrysize;
+	int			mi_compress;	/* deflate id2entry records */
+	char		*mi_dict_file;	/* with this preset dictionary */
+	int			mi_dict;	/* its index in mi_dicts, or 0 */
+	size_t		mi_ecache_max;
+	mdb_ecshard	*mi_ecache;
+
+	ldap_pvt_thread_mutex_t	mi_paged_mutex;
+	struct mdb_paged	*mi_paged;
+	size_t		mi_paged_size;
+	size_t		mi_paged_max;
+	unsigned	mi_paged_timeout;
+
+	unsigned	mi_group_max;	/* most ops committed together */
+	mdb_group	mi_group;
 
 	slap_mask_t	mi_defaultmask;
 	int			mi_nattrs;
 	struct mdb_attrinfo		**mi_attrs;
-	void		*mi_search_stack;
+	int			mi_ncomps;
+	struct mdb_compinfo		**mi_comps;
 	int			mi_search_stack_depth;
 	int			mi_readers;
 
@@ -89,20 +229,24 @@ struct mdb_info {
 
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
+	unsigned	mi_index_threads;
+	unsigned	mi_index_rate;	/* entries per second, 0 for no limit */
+	size_t		mi_bulk_size;	/* slapadd -q key buffer, 0 for the default */
+	mdb_online	mi_online;
+	mdb_autoindex	mi_autoindex;
 
 	mdb_monitor_t	mi_monitor;
 
-#ifdef MDB_MONITOR_IDX
-	ldap_pvt_thread_mutex_t	mi_idx_mutex;
-	Avlnode		*mi_idx;
-#endif /* MDB_MONITOR_IDX */
-
 	int		mi_flags;
 #define	MDB_IS_OPEN		0x01
 #define	MDB_OPEN_INDEX	0x02
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_OPEN_DICT	0x40
+#define	MDB_NEED_REHASH	0x80
+#define	MDB_TOOL_BULK	0x100	/* slapadd collects index keys for a sorted load */
+#define	MDB_BITMAP_KEYS	0x200	/* write bitmap words, see MDB_FMT_BITMAPS */
 
 	int mi_numads;
 
@@ -116,22 +260,58 @@ struct mdb_info {
 	MDB_dbi	mi_dbis[MDB_NDB];
 	AttributeDescription *mi_ads[MDB_MAXADS];
 	int mi_adxs[MDB_MAXADS];
+
+	/* compression dictionaries stored in the environment, 1-based */
+	int mi_numdicts;
+	struct berval mi_dicts[MDB_MAXDICTS];
 };
 
 #define mi_id2entry	mi_dbis[MDB_ID2ENTRY]
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
+#define mi_dict2id	mi_dbis[MDB_DICT]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
 	MDB_txn*	moi_txn;
 	int			moi_ref;
 	char		moi_flag;
+	struct mdb_group_op	*moi_group;
 } mdb_op_info;
 #define MOI_READER	0x01
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
+#define MOI_GROUPED	0x08	/* moi_txn is nested in a group commit */
+
+/* State of a search carrying the explain control. The plan is text,
+ * one "keyword: values" line per step, indented by filter nesting.
+ */
+typedef struct mdb_explain {
+	int			me_only;	/* plan only, send no entries */
+	int			me_depth;
+	struct berval	me_plan;
+	ber_len_t	me_size;	/* allocated size of me_plan */
+	ID			me_inscope;
+	ID			me_tested;
+	ID			me_matched;
+} mdb_explain;
+
+/* Search candidates produced lazily from index cursors */
+typedef struct mdb_stream mdb_stream;
+
+/* The candidates of a paged search, kept between pages */
+typedef struct mdb_paged mdb_paged;
+
+/* The attributes mdb_entry_decode() should materialize, by their
+ * index in mi_ads. Attributes added after pj_nads are always wanted.
+ */
+typedef struct mdb_projection {
+	int			pj_nads;
+	unsigned char	*pj_want;
+} mdb_projection;
+
+#define MDB_PJ_WANT(pj, i)	((i) > (pj)->pj_nads || (pj)->pj_want[i])
 
 LDAP_END_DECL
 
@@ -140,6 +320,7 @@ typedef struct mdb_attrinfo {
 	AttributeDescription *ai_desc; /* attribute description cn;lang-en */
 	slap_mask_t ai_indexmask;	/* how the attr is indexed	*/
 	slap_mask_t ai_newmask;	/* new settings to replace old mask */
+	slap_mask_t ai_automask;	/* added by autoindex, not unparsed */
 #ifdef LDAP_COMP_MATCH
 	ComponentReference* ai_cr; /*component indexing*/
 #endif
@@ -151,6 +332,28 @@ typedef struct mdb_attrinfo {
 	unsigned ai_multi_lo;
 } AttrInfo;
 
+/* Most attributes a composite index can be declared over */
+#define MDB_COMP_MAX	4
+
+/* Most keys a single entry may have in a composite index. An entry
+ * whose values combine into more is only listed under an overflow key,
+ * and while there is one the index is not used for searches.
+ */
+#define MDB_COMP_MAXKEYS	1024
+
+/* An equality index over a tuple of attributes. Its keys hash together
+ * one equality key of each member, for every combination of their
+ * values. Kept apart from mi_attrs, which is sorted by ai_desc.
+ */
+typedef struct mdb_compinfo {
+	struct berval ci_name;	/* "objectClass+uid", also the DB name */
+	int ci_nattrs;
+	AttributeDescription *ci_descs[MDB_COMP_MAX];
+	slap_mask_t ci_indexmask;
+	slap_mask_t ci_newmask;
+	MDB_dbi ci_dbi;
+} CompInfo;
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
@@ -31,9 +31,12 @@
 static ConfigDriver mdb_cf_gen;
 
 enum {
-	MDB_CHKPT = 1,
+	MDB_AUTOINDEX = 1,
+	MDB_CHKPT,
+	MDB_COMPRESS,
 	MDB_DIRECTORY,
 	MDB_DBNOSYNC,
+	MDB_ECACHESIZE,
 	MDB_ENVFLAGS,
 	MDB_INDEX,
 	MDB_MAXREADERS,
@@ -41,6 +44,8 @@ enum {
 	MDB_MODE,
 	MDB_SSTACK,
 	MDB_MULTIVAL,
+	MDB_PAGEDSIZE,
+	MDB_PAGEDTIMEOUT,
 };
 
 static ConfigTable mdbcfg[] = {
@@ -49,24 +54,53 @@ static ConfigTable mdbcfg[] = {
 			"DESC 'Directory for database content' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "autoindex", "searches> <[entries]", 2, 3, 0, ARG_MAGIC|MDB_AUTOINDEX,
+		mdb_cf_gen, "( OLcfgDbAt:12.14 NAME 'olcDbAutoIndex' "
+			"DESC 'Add a missing index after this many searches went without it, "
+			"testing this many entries each on average' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "checkpoint", "kbyte> <min", 3, 3, 0, ARG_MAGIC|MDB_CHKPT,
 		mdb_cf_gen, "( OLcfgDbAt:1.2 NAME 'olcDbCheckpoint' "
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",NULL, NULL },
+	{ "compress", "on|off|dictfile", 2, 2, 0, ARG_MAGIC|MDB_COMPRESS,
+		mdb_cf_gen, "( OLcfgDbAt:12.10 NAME 'olcDbCompress' "
+			"DESC 'Compress entries, optionally with a preset dictionary file' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "dbnosync", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DBNOSYNC,
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycachesize", "size", 2, 2, 0, ARG_ULONG|ARG_MAGIC|MDB_ECACHESIZE,
+		mdb_cf_gen, "( OLcfgDbAt:12.7 NAME 'olcDbEntryCacheSize' "
+			"DESC 'Maximum size of the decoded entry cache in bytes' "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "ops", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_group_max),
+		"( OLcfgDbAt:12.11 NAME 'olcDbGroupCommit' "
+		"DESC 'Maximum number of concurrent write ops committed together' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "indexrate", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_rate),
+		"( OLcfgDbAt:12.13 NAME 'olcDbIndexRate' "
+		"DESC 'Maximum number of entries indexed per second while "
+			"building new indexes, 0 for no limit' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "indexthreads", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_threads),
+		"( OLcfgDbAt:12.12 NAME 'olcDbIndexThreads' "
+		"DESC 'Number of threads reading entries while building new indexes' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -89,6 +123,14 @@ static ConfigTable mdbcfg[] = {
 		"( OLcfgDbAt:12.6 NAME 'olcDbMultival' "
 		"DESC 'Hi/Lo thresholds for splitting multivalued attr out of main blob' "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "pagedcachesize", "size", 2, 2, 0, ARG_ULONG|ARG_MAGIC|MDB_PAGEDSIZE,
+		mdb_cf_gen, "( OLcfgDbAt:12.8 NAME 'olcDbPagedCacheSize' "
+		"DESC 'Maximum memory in bytes for paged searches kept between pages' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "pagedtimeout", "seconds", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_PAGEDTIMEOUT,
+		mdb_cf_gen, "( OLcfgDbAt:12.9 NAME 'olcDbPagedTimeout' "
+		"DESC 'Seconds a paged search is kept waiting for its next page' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
@@ -98,6 +140,11 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "toolbulksize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_bulk_size),
+		"( OLcfgDbAt:12.15 NAME 'olcDbToolBulkSize' "
+		"DESC 'Bytes of index keys slapadd -q sorts in memory before spilling them' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -112,7 +159,10 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultival ) )",
+		"olcDbMultival $ olcDbEntryCacheSize $ olcDbPagedCacheSize $ "
+		"olcDbPagedTimeout $ olcDbCompress $ olcDbGroupCommit $ "
+		"olcDbIndexThreads $ olcDbIndexRate $ olcDbAutoIndex $ "
+		"olcDbToolBulkSize ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -140,109 +190,6 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
-/* reindex entries on the fly */
-static void *
-mdb_online_index( void *ctx, void *arg )
-{
-	struct re_s *rtask = arg;
-	BackendDB *be = rtask->arg;
-	struct mdb_info *mdb = be->be_private;
-
-	Connection conn = {0};
-	OperationBuffer opbuf;
-	Operation *op;
-
-	MDB_cursor *curs;
-	MDB_val key, data;
-	MDB_txn *txn;
-	ID id;
-	Entry *e;
-	int rc, getnext = 1;
-	int i;
-
-	connection_fake_init( &conn, &opbuf, ctx );
-	op = &opbuf.ob_op;
-
-	op->o_bd = be;
-
-	id = 1;
-	key.mv_size = sizeof(ID);
-
-	while ( 1 ) {
-		if ( slapd_shutdown )
-			break;
-
-		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
-		if ( rc )
-			break;
-		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			break;
-		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
-			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
-				break;
-			}
-			memcpy( &id, key.mv_data, sizeof( id ));
-		}
-
-		rc = mdb_id2entry( op, curs, id, &e );
-		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
-				continue;
-			}
-			break;
-		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
-		if ( rc == 0 ) {
-			rc = mdb_txn_commit( txn );
-			txn = NULL;
-		} else {
-			mdb_txn_abort( txn );
-			txn = NULL;
-		}
-		if ( rc ) {
-			Debug( LDAP_DEBUG_ANY,
-				LDAP_XSTRING(mdb_online_index) ": database %s: "
-				"txn_commit failed: %s (%d)\n",
-				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
-			break;
-		}
-		id++;
-		getnext = 1;
-	}
-
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
-		{
-			continue;
-		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
-	}
-
-	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
-	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
-	mdb->mi_index_task = NULL;
-	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
-	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
-
-	return NULL;
-}
-
 /* Cleanup loose ends after Modify completes */
 static int
 mdb_cf_cleanup( ConfigArgs *c )
@@ -276,6 +223,13 @@ mdb_cf_cleanup( ConfigArgs *c )
 		if ( rc )
 			rc = LDAP_OTHER;
 	}
+
+	if ( mdb->mi_flags & MDB_OPEN_DICT ) {
+		mdb->mi_flags ^= MDB_OPEN_DICT;
+		rc = mdb_dict_open( c->be, NULL, &c->reply );
+		if ( rc )
+			rc = LDAP_OTHER;
+	}
 	return rc;
 }
 
@@ -300,6 +254,23 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			} break;
 
+		case MDB_AUTOINDEX:
+			if ( mdb->mi_autoindex.ma_searches ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_autoindex.ma_searches, mdb->mi_autoindex.ma_tested );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp ) {
 				char buf[64];
@@ -325,6 +296,16 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_COMPRESS:
+			if ( mdb->mi_dict_file ) {
+				c->value_string = ch_strdup( mdb->mi_dict_file );
+			} else if ( mdb->mi_compress ) {
+				c->value_string = ch_strdup( "on" );
+			} else {
+				rc = 1;
+			}
+			break;
+
 		case MDB_DBNOSYNC:
 			if ( mdb->mi_dbenv_flags & MDB_NOSYNC )
 				c->value_int = 1;
@@ -354,6 +335,18 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_ulong = mdb->mi_mapsize;
 			break;
 
+		case MDB_ECACHESIZE:
+			c->value_ulong = mdb->mi_ecache_max;
+			break;
+
+		case MDB_PAGEDSIZE:
+			c->value_ulong = mdb->mi_paged_max;
+			break;
+
+		case MDB_PAGEDTIMEOUT:
+			c->value_uint = mdb->mi_paged_timeout;
+			break;
+
 		case MDB_MULTIVAL:
 			mdb_attr_multi_unparse( mdb, &c->rvalue_vals );
 			if ( !c->rvalue_vals ) rc = 1;
@@ -377,6 +370,26 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			break;
 
+		case MDB_ECACHESIZE:
+			mdb->mi_ecache_max = 0;
+			mdb_ecache_trim( mdb );
+			break;
+
+		case MDB_PAGEDSIZE:
+			mdb->mi_paged_max = DEFAULT_PAGED_MAX;
+			mdb_paged_trim( mdb );
+			break;
+
+		case MDB_PAGEDTIMEOUT:
+			mdb->mi_paged_timeout = DEFAULT_PAGED_TIMEOUT;
+			mdb_paged_trim( mdb );
+			break;
+
+		case MDB_AUTOINDEX:
+			mdb->mi_autoindex.ma_searches = 0;
+			mdb->mi_autoindex.ma_tested = 0;
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp_task ) {
 				struct re_s *re = mdb->mi_txn_cp_task;
@@ -396,6 +409,13 @@ mdb_cf_gen( ConfigArgs *c )
 			c->cleanup = mdb_cf_cleanup;
 			ldap_pvt_thread_pool_purgekey( mdb->mi_dbenv );
 			break;
+		case MDB_COMPRESS:
+			/* records already compressed stay readable */
+			mdb->mi_compress = 0;
+			mdb->mi_dict = 0;
+			ch_free( mdb->mi_dict_file );
+			mdb->mi_dict_file = NULL;
+			break;
 		case MDB_DBNOSYNC:
 			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC, 0 );
 			mdb->mi_dbenv_flags &= ~MDB_NOSYNC;
@@ -444,6 +464,9 @@ mdb_cf_gen( ConfigArgs *c )
 				for ( i = 0; i < mdb->mi_nattrs; i++ ) {
 					mdb->mi_attrs[i]->ai_indexmask |= MDB_INDEX_DELETING;
 				}
+				for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+					mdb->mi_comps[i]->ci_indexmask |= MDB_INDEX_DELETING;
+				}
 				mdb->mi_defaultmask = 0;
 				mdb->mi_flags |= MDB_DEL_INDEX;
 				c->cleanup = mdb_cf_cleanup;
@@ -473,6 +496,17 @@ mdb_cf_gen( ConfigArgs *c )
 						const char *text;
 						AttrInfo *ai;
 
+						if ( strchr( attrs[ i ], '+' )) {
+							CompInfo *ci = mdb_comp_find( mdb, attrs[ i ] );
+							/* if we got here... */
+							assert( ci != NULL );
+
+							ci->ci_indexmask |= MDB_INDEX_DELETING;
+							mdb->mi_flags |= MDB_DEL_INDEX;
+							c->cleanup = mdb_cf_cleanup;
+							continue;
+						}
+
 						slap_str2ad( attrs[ i ], &ad, &text );
 						/* if we got here... */
 						assert( ad != NULL );
@@ -591,6 +625,24 @@ mdb_cf_gen( ConfigArgs *c )
 			mdb->mi_dbenv_mode = mode;
 		}
 		break;
+	case MDB_AUTOINDEX: {
+		unsigned	u, t = 0;
+		if ( lutil_atoux( &u, c->argv[1], 0 ) != 0 || u == 0 ) {
+			fprintf( stderr, "%s: "
+				"invalid searches \"%s\" in \"autoindex\".\n",
+				c->log, c->argv[1] );
+			return 1;
+		}
+		if ( c->argc > 2 && lutil_atoux( &t, c->argv[2], 0 ) != 0 ) {
+			fprintf( stderr, "%s: "
+				"invalid entries \"%s\" in \"autoindex\".\n",
+				c->log, c->argv[2] );
+			return 1;
+		}
+		mdb->mi_autoindex.ma_searches = u;
+		mdb->mi_autoindex.ma_tested = t;
+		} break;
+
 	case MDB_CHKPT: {
 		long	l;
 		mdb->mi_txn_cp = 1;
@@ -661,6 +713,45 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_COMPRESS: {
+		char *file = NULL;
+		int on = 1;
+
+		if ( !strcasecmp( c->argv[1], "off" )) {
+			on = 0;
+		} else if ( strcasecmp( c->argv[1], "on" )) {
+			FILE *f = fopen( c->argv[1], "r" );
+			if ( !f ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: cannot read dictionary \"%s\": %s",
+					c->log, c->argv[1], strerror( errno ));
+				Debug( LDAP_DEBUG_ANY, "%s\n", c->cr_msg, 0, 0 );
+				return 1;
+			}
+			fclose( f );
+			file = ch_strdup( c->argv[1] );
+		}
+#ifndef HAVE_ZLIB
+		if ( on ) {
+			ch_free( file );
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: compression support not available", c->log );
+			Debug( LDAP_DEBUG_ANY, "%s\n", c->cr_msg, 0, 0 );
+			return 1;
+		}
+#endif
+		mdb->mi_compress = on;
+		mdb->mi_dict = 0;
+		if ( mdb->mi_dict_file )
+			ch_free( mdb->mi_dict_file );
+		mdb->mi_dict_file = file;
+		/* store the dictionary in the environment */
+		if ( file && ( mdb->mi_flags & MDB_IS_OPEN )) {
+			mdb->mi_flags |= MDB_OPEN_DICT;
+			c->cleanup = mdb_cf_cleanup;
+		}
+		} break;
+
 	case MDB_DBNOSYNC:
 		if ( c->value_int )
 			mdb->mi_dbenv_flags |= MDB_NOSYNC;
@@ -751,6 +842,21 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_ECACHESIZE:
+		mdb->mi_ecache_max = c->value_ulong;
+		mdb_ecache_trim( mdb );
+		break;
+
+	case MDB_PAGEDSIZE:
+		mdb->mi_paged_max = c->value_ulong;
+		mdb_paged_trim( mdb );
+		break;
+
+	case MDB_PAGEDTIMEOUT:
+		mdb->mi_paged_timeout = c->value_uint;
+		mdb_paged_trim( mdb );
+		break;
+
 	case MDB_MULTIVAL:
 		rc = mdb_attr_multi_config( mdb, c->fname, c->lineno,
 			c->argc - 1, &c->argv[1], &c->reply);
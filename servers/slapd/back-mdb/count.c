@@ -0,0 +1,123 @@
+/* count.c - search count control */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/* A search carrying the count control is carried out in full, but
+ * instead of its entries it gets back, with its result, a control
+ * whose value is
+ *
+ *	SEQUENCE {
+ *		resultCode	INTEGER,
+ *		entries		INTEGER,
+ *		references	INTEGER }
+ *
+ * like the no-op search control of contrib/slapd-modules/noopsrch.
+ * The size limit does not stop the count; resultCode is
+ * sizeLimitExceeded if more entries matched than it allows. The
+ * request value must be absent.
+ */
+
+int mdb_count_cid;
+
+static int
+mdb_parse_count(
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_ctrlflag[mdb_count_cid] != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "search count control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value )) {
+		rs->sr_text = "search count control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_ctrlflag[mdb_count_cid] = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+int
+mdb_count_initialize( void )
+{
+	int rc;
+
+	rc = register_supported_control2( LDAP_CONTROL_X_SEARCH_COUNT,
+		SLAP_CTRL_SEARCH, NULL, mdb_parse_count,
+		1 /* replace */, &mdb_count_cid );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_count_initialize)
+			": failed to register control %s (%d)\n",
+			LDAP_CONTROL_X_SEARCH_COUNT, rc, 0 );
+	}
+	return rc;
+}
+
+/* Attach the counts to the result */
+int
+mdb_count_ctrl(
+	Operation *op,
+	SlapReply *rs,
+	ID nentries,
+	ID nrefs )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	struct berval val;
+	LDAPControl *ctrls[2];
+	int rc = rs->sr_err;
+
+	if ( !MDB_COUNTING( op ))
+		return LDAP_SUCCESS;
+
+	if ( op->ors_slimit >= 0 && nentries > (ID) op->ors_slimit )
+		rc = LDAP_SIZELIMIT_EXCEEDED;
+
+	ber_init2( ber, NULL, LBER_USE_DER );
+	if ( ber_printf( ber, "{iii}", rc, (ber_int_t) nentries,
+			(ber_int_t) nrefs ) == -1 ||
+		ber_flatten2( ber, &val, 0 ) == -1 )
+	{
+		ber_free_buf( ber );
+		return LDAP_OTHER;
+	}
+
+	ctrls[0] = op->o_tmpalloc( sizeof(LDAPControl) + val.bv_len + 1,
+		op->o_tmpmemctx );
+	ctrls[0]->ldctl_oid = LDAP_CONTROL_X_SEARCH_COUNT;
+	ctrls[0]->ldctl_iscritical = 0;
+	ctrls[0]->ldctl_value.bv_val = (char *)&ctrls[0][1];
+	ctrls[0]->ldctl_value.bv_len = val.bv_len;
+	AC_MEMCPY( ctrls[0]->ldctl_value.bv_val, val.bv_val, val.bv_len );
+	ctrls[0]->ldctl_value.bv_val[val.bv_len] = '\0';
+	ctrls[1] = NULL;
+	ber_free_buf( ber );
+
+	slap_add_ctrls( op, rs, ctrls );
+
+	return LDAP_SUCCESS;
+}
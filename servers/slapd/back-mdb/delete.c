@@ -43,6 +43,9 @@ mdb_delete( Operation *op, SlapReply *rs )
 	int	parent_is_glue = 0;
 	int parent_is_leaf = 0;
 
+	if ( mdb_group_join( op, rs, mdb_delete ))
+		return rs->sr_err;
+
 	Debug( LDAP_DEBUG_ARGS, "==> " LDAP_XSTRING(mdb_delete) ": %s\n",
 		op->o_req_dn.bv_val, 0, 0 );
 
@@ -370,12 +373,12 @@ mdb_delete( Operation *op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_group_commit( mdb, moi, txn );
 		}
 		txn = NULL;
 	}
@@ -415,7 +418,7 @@ return_results:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
@@ -424,7 +427,7 @@ return_results:
 		moi->moi_ref--;
 	}
 
-	send_ldap_result( op, rs );
+	mdb_group_send( op, rs );
 	slap_graduate_commit_csn( op );
 
 	if( preread_ctrl != NULL && (*preread_ctrl) != NULL ) {
@@ -0,0 +1,513 @@
+/* ecache.c - shared cache of decoded entries */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/* Entries decoded by mdb_entry_decode() point into the memory map and
+ * are only valid for the life of the read txn. The cache keeps deep
+ * copies of them, tagged with the txnid of the snapshot they were read
+ * from, so that later readers can skip the decode entirely.
+ *
+ * A cached copy may be handed to a reader whose snapshot is at least as
+ * new as the one it was read from. Writers replace the node of every
+ * entry they update or delete with a tombstone carrying their own txnid,
+ * so a reader still working on an older snapshot can't publish a copy
+ * that would be stale for readers that come after the writer.
+ *
+ * Readers get a private Entry shell whose e_private points at the node;
+ * the attributes are shared and must never be modified.
+ */
+
+static int
+mdb_ecnode_cmp( const void *v1, const void *v2 )
+{
+	const mdb_ecnode *e1 = v1, *e2 = v2;
+
+	return e1->en_id < e2->en_id ? -1 : e1->en_id > e2->en_id;
+}
+
+static int
+mdb_ecache_usable( Operation *op, struct mdb_info *mdb, MDB_txn *txn )
+{
+	OpExtra *oex;
+
+	if ( !mdb->mi_ecache_max || !( slapMode & SLAP_SERVER_MODE ))
+		return 0;
+
+	/* Only plain read txns; a write txn may see its own updates */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) {
+			mdb_op_info *moi = (mdb_op_info *)oex;
+			return ( moi->moi_flag & MOI_READER ) && moi->moi_txn == txn;
+		}
+	}
+	return 0;
+}
+
+/* Unlink a node from its shard. Returns the node if nobody else
+ * references it and the caller should free it, NULL otherwise.
+ * Called with the shard locked.
+ */
+static mdb_ecnode *
+mdb_ecnode_unlink( mdb_ecshard *es, mdb_ecnode *en )
+{
+	avl_delete( &es->es_tree, en, mdb_ecnode_cmp );
+	if ( en->en_lruprev )
+		en->en_lruprev->en_lrunext = en->en_lrunext;
+	else
+		es->es_lruhead = en->en_lrunext;
+	if ( en->en_lrunext )
+		en->en_lrunext->en_lruprev = en->en_lruprev;
+	else
+		es->es_lrutail = en->en_lruprev;
+	en->en_lrunext = en->en_lruprev = NULL;
+	en->en_flags &= ~MDB_EN_LINKED;
+	es->es_size -= en->en_size;
+	es->es_count--;
+	if ( en->en_flags & MDB_EN_STALE ) {
+		if ( es->es_wtxnid < en->en_txnid )
+			es->es_wtxnid = en->en_txnid;
+	}
+	return en->en_refcnt ? NULL : en;
+}
+
+/* Called with the shard locked */
+static void
+mdb_ecnode_link( mdb_ecshard *es, mdb_ecnode *en )
+{
+	avl_insert( &es->es_tree, en, mdb_ecnode_cmp, avl_dup_error );
+	en->en_lruprev = NULL;
+	en->en_lrunext = es->es_lruhead;
+	if ( es->es_lruhead )
+		es->es_lruhead->en_lruprev = en;
+	else
+		es->es_lrutail = en;
+	es->es_lruhead = en;
+	en->en_flags |= MDB_EN_LINKED;
+	es->es_size += en->en_size;
+	es->es_count++;
+}
+
+/* Called with the shard locked */
+static void
+mdb_ecnode_touch( mdb_ecshard *es, mdb_ecnode *en )
+{
+	if ( es->es_lruhead == en )
+		return;
+	en->en_lruprev->en_lrunext = en->en_lrunext;
+	if ( en->en_lrunext )
+		en->en_lrunext->en_lruprev = en->en_lruprev;
+	else
+		es->es_lrutail = en->en_lruprev;
+	en->en_lruprev = NULL;
+	en->en_lrunext = es->es_lruhead;
+	es->es_lruhead->en_lruprev = en;
+	es->es_lruhead = en;
+}
+
+/* Evict from the LRU tail until the shard fits in max bytes. The
+ * unreferenced victims are chained on en_lrunext for the caller to
+ * free once the shard is unlocked.
+ */
+static mdb_ecnode *
+mdb_ecshard_evict( mdb_ecshard *es, size_t max, mdb_ecnode *keep )
+{
+	mdb_ecnode *en, *freelist = NULL;
+
+	while ( es->es_size > max && ( en = es->es_lrutail ) && en != keep ) {
+		if ( mdb_ecnode_unlink( es, en )) {
+			en->en_lrunext = freelist;
+			freelist = en;
+		}
+		es->es_evictions++;
+	}
+	return freelist;
+}
+
+static void
+mdb_ecnode_freelist( mdb_ecnode *en )
+{
+	mdb_ecnode *next;
+
+	for ( ; en; en = next ) {
+		next = en->en_lrunext;
+		ch_free( en );
+	}
+}
+
+static mdb_ecnode *
+mdb_ecnode_tombstone( ID id, size_t txnid )
+{
+	mdb_ecnode *en = ch_calloc( 1, sizeof( mdb_ecnode ));
+
+	en->en_id = id;
+	en->en_txnid = txnid;
+	en->en_size = sizeof( mdb_ecnode );
+	en->en_flags = MDB_EN_STALE;
+	return en;
+}
+
+/* Copy a decoded entry into a single self-contained block */
+static mdb_ecnode *
+mdb_ecnode_dup( Entry *x, size_t max )
+{
+	mdb_ecnode *en;
+	Attribute *s, *a;
+	struct berval *bptr;
+	char *ptr;
+	size_t size, len = 0;
+	int i, nattrs = 0, nvals = 0;
+
+	for ( s = x->e_attrs; s; s = s->a_next ) {
+		nattrs++;
+		nvals += s->a_numvals + 1;
+		for ( i = 0; i < s->a_numvals; i++ )
+			len += s->a_vals[i].bv_len + 1;
+		if ( s->a_nvals != s->a_vals ) {
+			nvals += s->a_numvals + 1;
+			for ( i = 0; i < s->a_numvals; i++ )
+				len += s->a_nvals[i].bv_len + 1;
+		}
+	}
+	size = sizeof( mdb_ecnode ) + nattrs * sizeof( Attribute ) +
+		nvals * sizeof( struct berval ) + len;
+	if ( size > max )
+		return NULL;
+
+	en = ch_malloc( size );
+	memset( en, 0, sizeof( mdb_ecnode ));
+	en->en_id = x->e_id;
+	en->en_size = size;
+	en->en_e.e_id = x->e_id;
+	en->en_e.e_ocflags = x->e_ocflags;
+
+	a = (Attribute *)(en+1);
+	en->en_e.e_attrs = nattrs ? a : NULL;
+	bptr = (struct berval *)(a + nattrs);
+	ptr = (char *)(bptr + nvals);
+
+	for ( s = x->e_attrs; s; s = s->a_next, a++ ) {
+		memset( a, 0, sizeof( Attribute ));
+		a->a_desc = s->a_desc;
+		a->a_numvals = s->a_numvals;
+		a->a_flags = s->a_flags | SLAP_ATTR_DONT_FREE_DATA |
+			SLAP_ATTR_DONT_FREE_VALS;
+		a->a_vals = bptr;
+		for ( i = 0; i < s->a_numvals; i++, bptr++ ) {
+			bptr->bv_len = s->a_vals[i].bv_len;
+			bptr->bv_val = ptr;
+			memcpy( ptr, s->a_vals[i].bv_val, bptr->bv_len );
+			ptr += bptr->bv_len;
+			*ptr++ = '\0';
+		}
+		BER_BVZERO( bptr );
+		bptr++;
+		if ( s->a_nvals != s->a_vals ) {
+			a->a_nvals = bptr;
+			for ( i = 0; i < s->a_numvals; i++, bptr++ ) {
+				bptr->bv_len = s->a_nvals[i].bv_len;
+				bptr->bv_val = ptr;
+				memcpy( ptr, s->a_nvals[i].bv_val, bptr->bv_len );
+				ptr += bptr->bv_len;
+				*ptr++ = '\0';
+			}
+			BER_BVZERO( bptr );
+			bptr++;
+		} else {
+			a->a_nvals = a->a_vals;
+		}
+		a->a_next = s->a_next ? a+1 : NULL;
+	}
+	return en;
+}
+
+/* Make a private Entry referencing a cached node */
+static Entry *
+mdb_ecnode_shell( Operation *op, mdb_ecnode *en )
+{
+	Entry *e = op->o_tmpalloc( sizeof( Entry ), op->o_tmpmemctx );
+
+	memset( e, 0, sizeof( Entry ));
+	e->e_id = en->en_id;
+	e->e_ocflags = en->en_e.e_ocflags;
+	e->e_attrs = en->en_e.e_attrs;
+	e->e_private = en;
+	return e;
+}
+
+void
+mdb_ecache_init( struct mdb_info *mdb )
+{
+	int i;
+
+	mdb->mi_ecache = ch_calloc( MDB_ECACHE_SHARDS, sizeof( mdb_ecshard ));
+	for ( i = 0; i < MDB_ECACHE_SHARDS; i++ )
+		ldap_pvt_thread_mutex_init( &mdb->mi_ecache[i].es_mutex );
+}
+
+void
+mdb_ecache_destroy( struct mdb_info *mdb )
+{
+	int i;
+
+	if ( !mdb->mi_ecache )
+		return;
+	mdb_ecache_flush( mdb );
+	for ( i = 0; i < MDB_ECACHE_SHARDS; i++ )
+		ldap_pvt_thread_mutex_destroy( &mdb->mi_ecache[i].es_mutex );
+	ch_free( mdb->mi_ecache );
+	mdb->mi_ecache = NULL;
+}
+
+static void
+mdb_ecache_shrink( struct mdb_info *mdb, size_t max )
+{
+	mdb_ecshard *es;
+	mdb_ecnode *freelist;
+	int i;
+
+	if ( !mdb->mi_ecache )
+		return;
+	for ( i = 0; i < MDB_ECACHE_SHARDS; i++ ) {
+		es = &mdb->mi_ecache[i];
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		freelist = mdb_ecshard_evict( es, max, NULL );
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+		mdb_ecnode_freelist( freelist );
+	}
+}
+
+/* Drop everything, e.g. when the database is closed */
+void
+mdb_ecache_flush( struct mdb_info *mdb )
+{
+	mdb_ecache_shrink( mdb, 0 );
+}
+
+/* Apply a new mi_ecache_max */
+void
+mdb_ecache_trim( struct mdb_info *mdb )
+{
+	mdb_ecache_shrink( mdb, mdb->mi_ecache_max / MDB_ECACHE_SHARDS );
+}
+
+/* Return a cached copy of entry id that is valid for txn's snapshot.
+ * Returns MDB_NOTFOUND if there is none.
+ */
+int
+mdb_ecache_get(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ecshard *es;
+	mdb_ecnode *en, key;
+	size_t txnid;
+
+	if ( !mdb_ecache_usable( op, mdb, txn ))
+		return MDB_NOTFOUND;
+
+	txnid = mdb_txn_id( txn );
+	key.en_id = id;
+	es = &mdb->mi_ecache[ id & ( MDB_ECACHE_SHARDS-1 ) ];
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	en = avl_find( es->es_tree, &key, mdb_ecnode_cmp );
+	if ( en && !( en->en_flags & MDB_EN_STALE ) && en->en_txnid <= txnid ) {
+		en->en_refcnt++;
+		mdb_ecnode_touch( es, en );
+		es->es_hits++;
+	} else {
+		en = NULL;
+		es->es_misses++;
+	}
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+
+	if ( !en )
+		return MDB_NOTFOUND;
+
+	*e = mdb_ecnode_shell( op, en );
+	return MDB_SUCCESS;
+}
+
+/* Offer a freshly decoded entry to the cache. On success the decoded
+ * entry is released and *e is replaced by a reference to the cached copy.
+ */
+void
+mdb_ecache_put(
+	Operation *op,
+	MDB_txn *txn,
+	Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_ecshard *es;
+	mdb_ecnode *en, *old, *freelist = NULL;
+	size_t txnid, max;
+
+	if ( !mdb_ecache_usable( op, mdb, txn ))
+		return;
+
+	max = mdb->mi_ecache_max / MDB_ECACHE_SHARDS;
+	en = mdb_ecnode_dup( *e, max );
+	if ( !en )
+		return;
+
+	txnid = mdb_txn_id( txn );
+	en->en_txnid = txnid;
+	en->en_shard = es = &mdb->mi_ecache[ en->en_id & ( MDB_ECACHE_SHARDS-1 ) ];
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	if ( txnid < es->es_wtxnid ) {
+		/* a writer may have changed it since our snapshot */
+		old = en;
+		goto unlock;
+	}
+	old = avl_find( es->es_tree, en, mdb_ecnode_cmp );
+	if ( old ) {
+		if ( txnid < old->en_txnid ) {
+			/* the cached copy or tombstone is newer than our snapshot */
+			old = en;
+			goto unlock;
+		}
+		if ( !( old->en_flags & MDB_EN_STALE )) {
+			/* someone else got here first; share their copy */
+			old->en_refcnt++;
+			mdb_ecnode_touch( es, old );
+			en->en_lrunext = NULL;
+			freelist = en;
+			en = old;
+			old = NULL;
+			goto unlock;
+		}
+		old = mdb_ecnode_unlink( es, old );
+		if ( old ) {
+			old->en_lrunext = NULL;
+		}
+	}
+	en->en_refcnt = 1;
+	mdb_ecnode_link( es, en );
+	freelist = mdb_ecshard_evict( es, max, en );
+	if ( old ) {
+		old->en_lrunext = freelist;
+		freelist = old;
+	}
+	old = NULL;
+unlock:
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	mdb_ecnode_freelist( freelist );
+
+	if ( old ) {
+		/* not cached, keep the decoded entry */
+		ch_free( old );
+		return;
+	}
+	mdb_entry_return( op, *e );
+	*e = mdb_ecnode_shell( op, en );
+}
+
+void
+mdb_ecache_release( mdb_ecnode *en )
+{
+	mdb_ecshard *es = en->en_shard;
+	int dead;
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	dead = !--en->en_refcnt && !( en->en_flags & MDB_EN_LINKED );
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	if ( dead )
+		ch_free( en );
+}
+
+/* Called by writers for each entry they modify or delete */
+void
+mdb_ecache_invalidate(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id )
+{
+	mdb_ecshard *es;
+	mdb_ecnode *en, *old, *freelist = NULL;
+	size_t txnid;
+
+	if ( !mdb->mi_ecache || !mdb->mi_ecache_max ||
+		!( slapMode & SLAP_SERVER_MODE ))
+		return;
+
+	txnid = mdb_txn_id( txn );
+	en = mdb_ecnode_tombstone( id, txnid );
+	en->en_shard = es = &mdb->mi_ecache[ id & ( MDB_ECACHE_SHARDS-1 ) ];
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	old = avl_find( es->es_tree, en, mdb_ecnode_cmp );
+	if ( old && ( old->en_flags & MDB_EN_STALE )) {
+		if ( old->en_txnid < txnid )
+			old->en_txnid = txnid;
+		mdb_ecnode_touch( es, old );
+		freelist = en;
+		en->en_lrunext = NULL;
+	} else {
+		if ( old ) {
+			old = mdb_ecnode_unlink( es, old );
+			if ( old )
+				old->en_lrunext = NULL;
+		}
+		mdb_ecnode_link( es, en );
+		freelist = mdb_ecshard_evict( es,
+			mdb->mi_ecache_max / MDB_ECACHE_SHARDS, en );
+		if ( old ) {
+			old->en_lrunext = freelist;
+			freelist = old;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	mdb_ecnode_freelist( freelist );
+}
+
+int
+mdb_ecache_stats(
+	struct mdb_info *mdb,
+	char *buf,
+	size_t len )
+{
+	mdb_ecshard *es;
+	unsigned long count = 0, hits = 0, misses = 0, evictions = 0;
+	size_t size = 0;
+	int i;
+
+	if ( mdb->mi_ecache ) {
+		for ( i = 0; i < MDB_ECACHE_SHARDS; i++ ) {
+			es = &mdb->mi_ecache[i];
+			ldap_pvt_thread_mutex_lock( &es->es_mutex );
+			count += es->es_count;
+			size += es->es_size;
+			hits += es->es_hits;
+			misses += es->es_misses;
+			evictions += es->es_evictions;
+			ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+		}
+	}
+	return snprintf( buf, len,
+		"entries=%lu size=%lu max=%lu hits=%lu misses=%lu evictions=%lu",
+		count, (unsigned long)size, (unsigned long)mdb->mi_ecache_max,
+		hits, misses, evictions );
+}
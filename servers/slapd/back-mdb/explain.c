@@ -0,0 +1,255 @@
+/* explain.c - search plan control */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdarg.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/* A search carrying the explain control gets back, with its result,
+ * a control whose value is the plan the backend followed: how each
+ * filter component was resolved, the IDs each index key yielded, and
+ * how many candidates were checked against scope and filter. The
+ * request value is absent, or
+ *
+ *	SEQUENCE { planOnly BOOLEAN DEFAULT FALSE }
+ *
+ * With planOnly the search is carried out in full but no entries are
+ * sent.
+ */
+
+int mdb_explain_cid;
+
+static int
+explain_only( struct berval *val, int *only )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	ber_tag_t tag;
+	ber_len_t len;
+	ber_int_t b = 0;
+
+	*only = 0;
+	if ( BER_BVISNULL( val ))
+		return 0;
+
+	ber_init2( ber, val, 0 );
+	if ( ber_scanf( ber, "{" /*}*/ ) == LBER_ERROR )
+		return -1;
+	tag = ber_peek_tag( ber, &len );
+	if ( tag == LBER_BOOLEAN ) {
+		if ( ber_scanf( ber, "b", &b ) == LBER_ERROR )
+			return -1;
+		tag = ber_peek_tag( ber, &len );
+	}
+	if ( tag != LBER_DEFAULT )
+		return -1;
+
+	*only = b != 0;
+	return 0;
+}
+
+static int
+mdb_parse_explain(
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	int only;
+
+	if ( op->o_ctrlflag[mdb_explain_cid] != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "search explain control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( explain_only( &ctrl->ldctl_value, &only )) {
+		rs->sr_text = "search explain control value is invalid";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_ctrlflag[mdb_explain_cid] = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+int
+mdb_explain_initialize( void )
+{
+	int rc;
+
+	rc = register_supported_control2( LDAP_CONTROL_X_SEARCH_EXPLAIN,
+		SLAP_CTRL_SEARCH, NULL, mdb_parse_explain,
+		1 /* replace */, &mdb_explain_cid );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_explain_initialize)
+			": failed to register control %s (%d)\n",
+			LDAP_CONTROL_X_SEARCH_EXPLAIN, rc, 0 );
+	}
+	return rc;
+}
+
+/* Start a plan for this search if it asked for one. Index sizes say a
+ * lot about the data, so only those who may manage the search base
+ * get to see them.
+ */
+int
+mdb_explain_begin(
+	Operation *op,
+	SlapReply *rs,
+	Entry *base,
+	mdb_explain *me )
+{
+	LDAPControl **ctrls;
+
+	if ( op->o_ctrlflag[mdb_explain_cid] <= SLAP_CONTROL_IGNORED ||
+		!op->o_controls )
+		return LDAP_SUCCESS;
+
+	if ( !access_allowed( op, base, slap_schema.si_ad_entry, NULL,
+		ACL_MANAGE, NULL ))
+	{
+		if ( op->o_ctrlflag[mdb_explain_cid] == SLAP_CONTROL_CRITICAL ) {
+			rs->sr_text = "insufficient access to explain the search";
+			return LDAP_INSUFFICIENT_ACCESS;
+		}
+		return LDAP_SUCCESS;
+	}
+
+	memset( me, 0, sizeof( *me ));
+	for ( ctrls = op->o_ctrls; *ctrls; ctrls++ ) {
+		if ( !strcmp( (*ctrls)->ldctl_oid, LDAP_CONTROL_X_SEARCH_EXPLAIN )) {
+			explain_only( &(*ctrls)->ldctl_value, &me->me_only );
+			break;
+		}
+	}
+	op->o_controls[mdb_explain_cid] = me;
+
+	return LDAP_SUCCESS;
+}
+
+void
+mdb_explain_end(
+	Operation *op,
+	mdb_explain *me )
+{
+	if ( MDB_EXPLAIN( op ) != me )
+		return;
+
+	if ( me->me_plan.bv_val )
+		op->o_tmpfree( me->me_plan.bv_val, op->o_tmpmemctx );
+	BER_BVZERO( &me->me_plan );
+	op->o_controls[mdb_explain_cid] = NULL;
+}
+
+/* Append a line to the plan, indented to the current depth */
+void
+mdb_explain_printf(
+	Operation *op,
+	const char *fmt, ... )
+{
+	mdb_explain *me = MDB_EXPLAIN( op );
+	ber_len_t off;
+	va_list ap;
+	int len;
+
+	if ( !me )
+		return;
+
+	off = me->me_plan.bv_len + 2 * me->me_depth;
+	for (;;) {
+		va_start( ap, fmt );
+		if ( me->me_size > off )
+			len = vsnprintf( me->me_plan.bv_val + off,
+				me->me_size - off, fmt, ap );
+		else
+			len = vsnprintf( NULL, 0, fmt, ap );
+		va_end( ap );
+		if ( len < 0 )
+			return;
+		if ( off + len < me->me_size )
+			break;
+
+		me->me_size = ( off + len + 1 ) * 2;
+		if ( me->me_size < 1024 )
+			me->me_size = 1024;
+		me->me_plan.bv_val = op->o_tmprealloc( me->me_plan.bv_val,
+			me->me_size, op->o_tmpmemctx );
+	}
+
+	memset( me->me_plan.bv_val + me->me_plan.bv_len, ' ',
+		off - me->me_plan.bv_len );
+	me->me_plan.bv_len = off + len;
+}
+
+/* Append a "keyword: filter tail" line */
+void
+mdb_explain_filter(
+	Operation *op,
+	const char *keyword,
+	Filter *f,
+	const char *tail )
+{
+	struct berval fstr = BER_BVNULL;
+
+	if ( !MDB_EXPLAIN( op ))
+		return;
+
+	filter2bv_x( op, f, &fstr );
+	mdb_explain_printf( op, "%s: %s%s\n", keyword,
+		fstr.bv_val ? fstr.bv_val : "(?=undefined)", tail );
+	if ( fstr.bv_val )
+		op->o_tmpfree( fstr.bv_val, op->o_tmpmemctx );
+}
+
+/* Finish the plan with the entry counts and attach it to the result */
+int
+mdb_explain_ctrl(
+	Operation *op,
+	SlapReply *rs )
+{
+	mdb_explain *me = MDB_EXPLAIN( op );
+	LDAPControl *ctrls[2];
+
+	if ( !me )
+		return LDAP_SUCCESS;
+
+	me->me_depth = 0;
+	mdb_explain_printf( op, "inscope: %ld\n", (long) me->me_inscope );
+	mdb_explain_printf( op, "tested: %ld\n", (long) me->me_tested );
+	mdb_explain_printf( op, "matched: %ld\n", (long) me->me_matched );
+	mdb_explain_printf( op, "returned: %d\n", rs->sr_nentries );
+
+	ctrls[0] = op->o_tmpalloc( sizeof(LDAPControl) + me->me_plan.bv_len + 1,
+		op->o_tmpmemctx );
+	ctrls[0]->ldctl_oid = LDAP_CONTROL_X_SEARCH_EXPLAIN;
+	ctrls[0]->ldctl_iscritical = 0;
+	ctrls[0]->ldctl_value.bv_val = (char *)&ctrls[0][1];
+	ctrls[0]->ldctl_value.bv_len = me->me_plan.bv_len;
+	if ( me->me_plan.bv_len )
+		AC_MEMCPY( ctrls[0]->ldctl_value.bv_val, me->me_plan.bv_val,
+			me->me_plan.bv_len );
+	ctrls[0]->ldctl_value.bv_val[me->me_plan.bv_len] = '\0';
+	ctrls[1] = NULL;
+
+	slap_add_ctrls( op, rs, ctrls );
+
+	return LDAP_SUCCESS;
+}
@@ -97,6 +97,58 @@ ava_comp_candidates (
 		ID *stack);
 #endif
 
+/* Plan lines for the explain control */
+static void
+explain_nest( Operation *op, int depth )
+{
+	mdb_explain *me = MDB_EXPLAIN( op );
+
+	if ( me )
+		me->me_depth += depth;
+}
+
+static void
+explain_ids( Operation *op, const char *keyword, int rc, ID *ids )
+{
+	if ( !MDB_EXPLAIN( op ))
+		return;
+
+	if ( rc == MDB_NOTFOUND ) {
+		mdb_explain_printf( op, "%s: 0\n", keyword );
+	} else if ( rc ) {
+		mdb_explain_printf( op, "%s: error=%d\n", keyword, rc );
+	} else if ( MDB_IDL_IS_BITMAP( ids )) {
+		mdb_explain_printf( op, "%s: %ld bitmap=%ld-%ld\n", keyword,
+			(long) MDB_IDL_N( ids ), (long) MDB_IDL_RANGE_FIRST( ids ),
+			(long) MDB_IDL_RANGE_LAST( ids ));
+	} else if ( MDB_IDL_IS_RANGE( ids )) {
+		/* collapsed to a range, every ID in it is a candidate */
+		if ( MDB_IDL_RANGE_LAST( ids ) == NOID ) {
+			mdb_explain_printf( op, "%s: all\n", keyword );
+		} else {
+			mdb_explain_printf( op, "%s: %ld range=%ld-%ld\n", keyword,
+				(long) MDB_IDL_N( ids ), (long) MDB_IDL_RANGE_FIRST( ids ),
+				(long) MDB_IDL_RANGE_LAST( ids ));
+		}
+	} else {
+		mdb_explain_printf( op, "%s: %ld\n", keyword, (long) ids[0] );
+	}
+}
+
+static void
+explain_index(
+	Operation *op,
+	AttributeDescription *desc,
+	const char *type,
+	int rc )
+{
+	if ( !MDB_EXPLAIN( op ))
+		return;
+
+	mdb_explain_printf( op, "index: %s %s%s\n", desc->ad_cname.bv_val, type,
+		rc == LDAP_SUCCESS ? "" : " none" );
+}
+
 int
 mdb_filter_candidates(
 	Operation *op,
@@ -187,6 +239,7 @@ mdb_filter_candidates(
 	case LDAP_FILTER_NOT:
 		/* no indexing to support NOT filters */
 		Debug( LDAP_DEBUG_FILTER, "\tNOT\n", 0, 0, 0 );
+		mdb_explain_printf( op, "index: none\n" );
 		MDB_IDL_ALL( ids );
 		break;
 
@@ -286,6 +339,7 @@ comp_list_candidates(
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
+			mdb_idl_free( save );
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
 		} else {
@@ -294,6 +348,7 @@ comp_list_candidates(
 			} else {
 				mdb_idl_union( ids, save );
 			}
+			mdb_idl_free( save );
 		}
 	}
 
@@ -357,7 +412,7 @@ comp_equality_candidates (
 	if ( !cr )
 		return 0;
 
-	rc = mdb_index_param( op->o_bd, mra->ma_desc, LDAP_FILTER_EQUALITY,
+	rc = mdb_index_param( op, mra->ma_desc, LDAP_FILTER_EQUALITY,
 			&dbi, &mask, &prefix );
 
 	if( rc != LDAP_SUCCESS ) {
@@ -392,6 +447,7 @@ comp_equality_candidates (
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
 
 		if( rc == MDB_NOTFOUND ) {
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			rc = 0;
 			break;
@@ -400,6 +456,7 @@ comp_equality_candidates (
 		}
 
 		if( MDB_IDL_IS_ZERO( tmp ) ) {
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			break;
 		}
@@ -409,6 +466,7 @@ comp_equality_candidates (
 		} else {
 			mdb_idl_intersection( ids, tmp );
 		}
+		mdb_idl_free( tmp );
 
 		if( MDB_IDL_IS_ZERO( ids ) )
 			break;
@@ -514,6 +572,7 @@ ext_candidates(
 		MDB_IDL_ZERO( ids );
 		if ( mra->ma_rule == slap_schema.si_mr_distinguishedNameMatch ) {
 base:
+			explain_index( op, mra->ma_desc, "dn2id", LDAP_SUCCESS );
 			rc = mdb_dn2id( op, rtxn, NULL, &mra->ma_value, &id, NULL, NULL, NULL );
 			if ( rc == MDB_SUCCESS ) {
 				mdb_idl_insert( ids, id );
@@ -524,6 +583,7 @@ base:
 				op->o_bd->be_nsuffix )) {
 			int scope;
 			if ( mra->ma_rule == slap_schema.si_mr_dnSuperiorMatch ) {
+				explain_index( op, mra->ma_desc, "dn2id", LDAP_SUCCESS );
 				mdb_dn2sups( op, rtxn, &mra->ma_value, ids );
 				return 0;
 			}
@@ -554,10 +614,289 @@ base:
 		}
 	}
 
+	mdb_explain_printf( op, "index: none\n" );
 	MDB_IDL_ALL( ids );
 	return 0;
 }
 
+/* The presence index of exactly this attribute holds every entry
+ * that has it, so (!(attr=*)) can be subtracted from an AND.
+ */
+static int
+exact_absence(
+	Operation *op,
+	Filter *f )
+{
+	AttributeDescription *ad;
+	AttrInfo *ai;
+
+	if ( f->f_choice != LDAP_FILTER_NOT ||
+		f->f_not->f_choice != LDAP_FILTER_PRESENT )
+		return 0;
+
+	ad = f->f_not->f_desc;
+	if ( ad == slap_schema.si_ad_objectClass )
+		return 0;
+
+	ai = mdb_attr_mask( op->o_bd->be_private, ad );
+	return ai && ai->ai_desc == ad &&
+		!( ai->ai_indexmask & MDB_INDEX_DELETING ) &&
+		IS_SLAP_INDEX( ai->ai_indexmask, SLAP_INDEX_PRESENT );
+}
+
+/* The components of an AND or OR are planned before any IDL is read.
+ * Each gets a size, the number of IDs it is expected to yield, and a
+ * cost, the number of index items reading it would copy, both from
+ * the dup counts of its index keys. An AND reads the smallest first,
+ * and stops once the candidates are so few that testing them is
+ * cheaper than reading the rest.
+ */
+
+/* Sizes of components that no index narrows */
+#define PLAN_ALL	NOID
+/* Sizes and costs of components that cannot be sized up */
+#define PLAN_UNKNOWN	(NOID-1)
+
+/* Testing a candidate entry costs about as much as reading this many
+ * index items.
+ */
+#define PLAN_TEST_COST	256
+
+typedef struct filter_plan {
+	Filter *fp_f;
+	ID fp_size;
+	ID fp_cost;
+	int fp_absent;	/* an exact absence, subtracted from the rest */
+	CompInfo *fp_comp;	/* a composite key instead of fp_f */
+	struct berval fp_key;
+} filter_plan;
+
+static ID
+plan_add( ID a, ID b )
+{
+	if ( a == PLAN_ALL || b == PLAN_ALL )
+		return PLAN_ALL;
+	if ( a >= PLAN_UNKNOWN - b )
+		return PLAN_UNKNOWN;
+	return a + b;
+}
+
+/* Size up an assertion from its index keys. The candidates are the
+ * intersection of all its keys, so the smallest key bounds them.
+ */
+static void
+plan_keys(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeDescription *desc,
+	int ftype,
+	MatchingRule *mr,
+	void *assertion,
+	filter_plan *fp )
+{
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	ID count, items;
+	int i, rc;
+
+	fp->fp_size = PLAN_ALL;
+	fp->fp_cost = 0;
+
+	rc = mdb_index_param( op, desc, ftype, &dbi, &mask, &prefix );
+	if ( rc != LDAP_SUCCESS )
+		return;
+
+	if ( ftype == LDAP_FILTER_PRESENT ) {
+		if ( prefix.bv_val == NULL ||
+			mdb_key_count( rtxn, dbi, &prefix, &count, &items )) {
+			fp->fp_size = fp->fp_cost = PLAN_UNKNOWN;
+		} else {
+			fp->fp_size = count;
+			fp->fp_cost = items;
+		}
+		return;
+	}
+
+	if ( !mr || !mr->smr_filter )
+		return;
+
+	rc = (mr->smr_filter)( ftype, mask, desc->ad_type->sat_syntax, mr,
+		&prefix, assertion, &keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return;
+
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		if ( mdb_key_count( rtxn, dbi, &keys[i], &count, &items )) {
+			fp->fp_size = fp->fp_cost = PLAN_UNKNOWN;
+			break;
+		}
+		if ( count < fp->fp_size )
+			fp->fp_size = count;
+		fp->fp_cost = plan_add( fp->fp_cost, items );
+		if ( !count )
+			break;
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+}
+
+static void
+plan_filter(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	filter_plan *fp )
+{
+	filter_plan sub;
+	Filter *f2;
+	MatchingRule *mr;
+
+	fp->fp_f = f;
+	fp->fp_absent = 0;
+	fp->fp_comp = NULL;
+	fp->fp_size = fp->fp_cost = PLAN_UNKNOWN;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		fp->fp_size = fp->fp_cost = 0;
+		return;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_TRUE ) {
+			fp->fp_size = PLAN_ALL;
+			fp->fp_cost = 0;
+		} else if ( f->f_result != LDAP_SUCCESS ) {
+			fp->fp_size = fp->fp_cost = 0;
+		}
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass ) {
+			fp->fp_size = PLAN_ALL;
+			fp->fp_cost = 0;
+			break;
+		}
+		plan_keys( op, rtxn, f->f_desc, LDAP_FILTER_PRESENT,
+			NULL, NULL, fp );
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_ava->aa_desc == slap_schema.si_ad_entryDN ) {
+			fp->fp_size = fp->fp_cost = 1;
+			break;
+		}
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute &&
+			is_aliased_attribute( f->f_ava->aa_desc ))
+			break;
+#endif
+		plan_keys( op, rtxn, f->f_ava->aa_desc, LDAP_FILTER_EQUALITY,
+			f->f_ava->aa_desc->ad_type->sat_equality,
+			&f->f_ava->aa_value, fp );
+		break;
+
+	case LDAP_FILTER_APPROX:
+		mr = f->f_ava->aa_desc->ad_type->sat_approx;
+		if ( !mr )
+			mr = f->f_ava->aa_desc->ad_type->sat_equality;
+		plan_keys( op, rtxn, f->f_ava->aa_desc, LDAP_FILTER_APPROX,
+			mr, &f->f_ava->aa_value, fp );
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		plan_keys( op, rtxn, f->f_sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
+			f->f_sub->sa_desc->ad_type->sat_substr, f->f_sub, fp );
+		break;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		mr = f->f_ava->aa_desc->ad_type->sat_ordering;
+		if ( !mr || !( mr->smr_usage & SLAP_MR_ORDERED_INDEX )) {
+			plan_keys( op, rtxn, f->f_ava->aa_desc, LDAP_FILTER_PRESENT,
+				NULL, NULL, fp );
+		} else {
+			/* a range scan, of unknown length */
+			MDB_dbi dbi;
+			slap_mask_t mask;
+			struct berval prefix = {0, NULL};
+
+			if ( mdb_index_param( op, f->f_ava->aa_desc,
+				LDAP_FILTER_EQUALITY, &dbi, &mask, &prefix )) {
+				fp->fp_size = PLAN_ALL;
+				fp->fp_cost = 0;
+			}
+		}
+		break;
+
+	case LDAP_FILTER_AND:
+		fp->fp_size = PLAN_ALL;
+		fp->fp_cost = 0;
+		for ( f2 = f->f_and; f2; f2 = f2->f_next ) {
+			if ( f2->f_choice == SLAPD_FILTER_COMPUTED &&
+				f2->f_result == LDAP_SUCCESS )
+				continue;
+			plan_filter( op, rtxn, f2, &sub );
+			if ( sub.fp_size < fp->fp_size )
+				fp->fp_size = sub.fp_size;
+			fp->fp_cost = plan_add( fp->fp_cost, sub.fp_cost );
+		}
+		break;
+
+	case LDAP_FILTER_OR:
+		fp->fp_size = fp->fp_cost = 0;
+		for ( f2 = f->f_or; f2; f2 = f2->f_next ) {
+			if ( f2->f_choice == SLAPD_FILTER_COMPUTED &&
+				f2->f_result == LDAP_SUCCESS )
+				continue;
+			plan_filter( op, rtxn, f2, &sub );
+			fp->fp_size = plan_add( fp->fp_size, sub.fp_size );
+			fp->fp_cost = plan_add( fp->fp_cost, sub.fp_cost );
+		}
+		if ( fp->fp_size == PLAN_ALL )
+			fp->fp_cost = 0;
+		break;
+
+	case LDAP_FILTER_EXT:
+		break;
+
+	default:
+		/* NOT, and anything else no index supports */
+		fp->fp_size = PLAN_ALL;
+		fp->fp_cost = 0;
+	}
+}
+
+static const char *
+explain_plan_size( ID size, char *buf, size_t len )
+{
+	if ( size == PLAN_ALL )
+		return "all";
+	if ( size == PLAN_UNKNOWN )
+		return "unknown";
+	snprintf( buf, len, "%ld", (long) size );
+	return buf;
+}
+
+static void
+explain_component( Operation *op, filter_plan *fp, const char *note )
+{
+	char size[24], cost[24], tail[80];
+
+	if ( !MDB_EXPLAIN( op ))
+		return;
+
+	snprintf( tail, sizeof( tail ), " size=%s cost=%s%s",
+		explain_plan_size( fp->fp_size, size, sizeof( size )),
+		explain_plan_size( fp->fp_cost, cost, sizeof( cost )), note );
+	if ( fp->fp_comp )
+		mdb_explain_printf( op, "component: %s%s\n",
+			fp->fp_comp->ci_name.bv_val, tail );
+	else
+		mdb_explain_filter( op, "component", fp->fp_f, tail );
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -568,45 +907,177 @@ list_candidates(
 	ID *tmp,
 	ID *save )
 {
-	int rc = 0;
-	Filter	*f;
+	int rc = 0, n, i, first = 1;
+	Filter	*f, *cfs[MDB_COMP_MAX];
+	filter_plan *plan, fp;
+	CompInfo *ci = NULL;
+	struct berval ckey = BER_BVNULL;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
+
+	for ( n = 0, f = flist; f != NULL; f = f->f_next )
+		n++;
+	plan = op->o_tmpalloc( n * sizeof(filter_plan), op->o_tmpmemctx );
+
+	/* A composite index stands in for the assertions it covers */
+	if ( ftype == LDAP_FILTER_AND )
+		ci = mdb_index_comp_filter( op, rtxn, flist, cfs, &ckey );
+	n = 0;
+	if ( ci ) {
+		ID count, items;
+
+		plan[0].fp_f = cfs[0];
+		plan[0].fp_absent = 0;
+		plan[0].fp_comp = ci;
+		plan[0].fp_key = ckey;
+		if ( mdb_key_count( rtxn, ci->ci_dbi, &ckey, &count, &items )) {
+			plan[0].fp_size = plan[0].fp_cost = PLAN_UNKNOWN;
+		} else {
+			plan[0].fp_size = count;
+			plan[0].fp_cost = items;
+		}
+		n = 1;
+	}
+
+	/* Size up the components and sort them, smallest first, with
+	 * the absences behind the rest they are subtracted from.
+	 */
 	for ( f = flist; f != NULL; f = f->f_next ) {
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
 			continue;
 		}
+		if ( ci ) {
+			for ( i = 0; i < ci->ci_nattrs && cfs[i] != f; i++ )
+				;
+			if ( i < ci->ci_nattrs )
+				continue;
+		}
+		if ( ftype == LDAP_FILTER_AND && f != flist &&
+			exact_absence( op, f )) {
+			plan_keys( op, rtxn, f->f_not->f_desc, LDAP_FILTER_PRESENT,
+				NULL, NULL, &fp );
+			fp.fp_f = f;
+			fp.fp_absent = 1;
+		} else {
+			plan_filter( op, rtxn, f, &fp );
+		}
+		Debug( LDAP_DEBUG_FILTER, "\tplan 0x%lx: size=%ld cost=%ld\n",
+			(unsigned long) f->f_choice, (long) fp.fp_size,
+			(long) fp.fp_cost );
+
+		/* The whole OR is ALL; reading just that component
+		 * still logs whatever made it so.
+		 */
+		if ( ftype == LDAP_FILTER_OR && fp.fp_size == PLAN_ALL ) {
+			plan[0] = fp;
+			n = 1;
+			break;
+		}
+
+		for ( i = n; i > 0; i-- ) {
+			if ( fp.fp_absent > plan[i-1].fp_absent ||
+				( fp.fp_absent == plan[i-1].fp_absent &&
+				fp.fp_size >= plan[i-1].fp_size ))
+				break;
+			plan[i] = plan[i-1];
+		}
+		plan[i] = fp;
+		n++;
+	}
+
+	mdb_explain_printf( op, "%s:\n",
+		ftype == LDAP_FILTER_AND ? "and" : "or" );
+	explain_nest( op, 1 );
+
+	for ( i = 0; i < n; i++ ) {
+		f = plan[i].fp_f;
+
+		if ( ftype == LDAP_FILTER_AND && !first ) {
+			/* test the few candidates left instead */
+			if ( MDB_IDL_N( ids ) < plan[i].fp_cost / PLAN_TEST_COST ) {
+				Debug( LDAP_DEBUG_FILTER,
+					"\tplan: %ld candidates left, %d components skipped\n",
+					(long) MDB_IDL_N( ids ), n - i, 0 );
+				break;
+			}
+			/* subtract absences once the rest is known */
+			if ( plan[i].fp_absent ) {
+				explain_component( op, &plan[i], " subtracted" );
+				explain_nest( op, 1 );
+				MDB_IDL_ZERO( save );
+				if ( presence_candidates( op, rtxn,
+					f->f_not->f_desc, save ) == 0 )
+					mdb_idl_notin( ids, save );
+				mdb_idl_free( save );
+				explain_ids( op, "ids", 0, ids );
+				explain_nest( op, -1 );
+				if ( MDB_IDL_IS_ZERO( ids )) {
+					i++;
+					break;
+				}
+				continue;
+			}
+		}
+		if ( plan[i].fp_absent ) {
+			explain_component( op, &plan[i], " skipped" );
+			continue;
+		}
+
+		explain_component( op, &plan[i], "" );
+		explain_nest( op, 1 );
 		MDB_IDL_ZERO( save );
-		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
-			save+MDB_IDL_UM_SIZE );
+		if ( plan[i].fp_comp ) {
+			mdb_explain_printf( op, "index: %s eq\n",
+				plan[i].fp_comp->ci_name.bv_val );
+			rc = mdb_key_read( op->o_bd, rtxn, plan[i].fp_comp->ci_dbi,
+				&plan[i].fp_key, save, NULL, 0 );
+			explain_ids( op, "key", rc, save );
+			if ( rc == MDB_NOTFOUND ) {
+				MDB_IDL_ZERO( save );
+				rc = 0;
+			}
+		} else {
+			rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
+				save+MDB_IDL_UM_SIZE );
+		}
+		explain_ids( op, "ids", rc, save );
+		explain_nest( op, -1 );
 
 		if ( rc != 0 ) {
+			mdb_idl_free( save );
 			if ( ftype == LDAP_FILTER_AND ) {
 				rc = 0;
 				continue;
 			}
+			i++;
 			break;
 		}
 
-		
-		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
-				MDB_IDL_CPY( ids, save );
-			} else {
-				mdb_idl_intersection( ids, save );
-			}
-			if( MDB_IDL_IS_ZERO( ids ) )
-				break;
+		if ( first ) {
+			MDB_IDL_CPY( ids, save );
+			first = 0;
+		} else if ( ftype == LDAP_FILTER_AND ) {
+			mdb_idl_intersection( ids, save );
 		} else {
-			if ( f == flist ) {
-				MDB_IDL_CPY( ids, save );
-			} else {
-				mdb_idl_union( ids, save );
-			}
+			mdb_idl_union( ids, save );
+		}
+		mdb_idl_free( save );
+		if ( ftype == LDAP_FILTER_AND && MDB_IDL_IS_ZERO( ids )) {
+			i++;
+			break;
 		}
 	}
+	for ( ; i < n; i++ )
+		explain_component( op, &plan[i], " skipped" );
+	explain_nest( op, -1 );
+	if ( first && rc == LDAP_SUCCESS )
+		MDB_IDL_ALL( ids );
+
+	if ( ckey.bv_val )
+		op->o_tmpfree( ckey.bv_val, op->o_tmpmemctx );
+	op->o_tmpfree( plan, op->o_tmpmemctx );
 
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -642,11 +1113,13 @@ presence_candidates(
 	MDB_IDL_ALL( ids );
 
 	if( desc == slap_schema.si_ad_objectClass ) {
+		mdb_explain_printf( op, "index: objectClass all\n" );
 		return 0;
 	}
 
-	rc = mdb_index_param( op->o_bd, desc, LDAP_FILTER_PRESENT,
+	rc = mdb_index_param( op, desc, LDAP_FILTER_PRESENT,
 		&dbi, &mask, &prefix );
+	explain_index( op, desc, "pres", rc );
 
 	if( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		/* not indexed */
@@ -672,6 +1145,7 @@ presence_candidates(
 	}
 
 	rc = mdb_key_read( op->o_bd, rtxn, dbi, &prefix, ids, NULL, 0 );
+	explain_ids( op, "key", rc, ids );
 
 	if( rc == MDB_NOTFOUND ) {
 		MDB_IDL_ZERO( ids );
@@ -715,6 +1189,7 @@ equality_candidates(
 
 	if ( ava->aa_desc == slap_schema.si_ad_entryDN ) {
 		ID id;
+		explain_index( op, ava->aa_desc, "dn2id", LDAP_SUCCESS );
 		rc = mdb_dn2id( op, rtxn, NULL, &ava->aa_value, &id, NULL, NULL, NULL );
 		if ( rc == LDAP_SUCCESS ) {
 			/* exactly one ID can match */
@@ -730,8 +1205,9 @@ equality_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
+	rc = mdb_index_param( op, ava->aa_desc, LDAP_FILTER_EQUALITY,
 		&dbi, &mask, &prefix );
+	explain_index( op, ava->aa_desc, "eq", rc );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -783,8 +1259,10 @@ equality_candidates(
 
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		explain_ids( op, "key", rc, tmp );
 
 		if( rc == MDB_NOTFOUND ) {
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			rc = 0;
 			break;
@@ -800,6 +1278,7 @@ equality_candidates(
 			Debug( LDAP_DEBUG_TRACE,
 				"<= mdb_equality_candidates: (%s) NULL\n", 
 				ava->aa_desc->ad_cname.bv_val, 0, 0 );
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			break;
 		}
@@ -809,6 +1288,7 @@ equality_candidates(
 		} else {
 			mdb_idl_intersection( ids, tmp );
 		}
+		mdb_idl_free( tmp );
 
 		if( MDB_IDL_IS_ZERO( ids ) )
 			break;
@@ -846,8 +1326,9 @@ approx_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_APPROX,
+	rc = mdb_index_param( op, ava->aa_desc, LDAP_FILTER_APPROX,
 		&dbi, &mask, &prefix );
+	explain_index( op, ava->aa_desc, "approx", rc );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -904,8 +1385,10 @@ approx_candidates(
 
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		explain_ids( op, "key", rc, tmp );
 
 		if( rc == MDB_NOTFOUND ) {
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			rc = 0;
 			break;
@@ -921,6 +1404,7 @@ approx_candidates(
 			Debug( LDAP_DEBUG_TRACE,
 				"<= mdb_approx_candidates: (%s) NULL\n",
 				ava->aa_desc->ad_cname.bv_val, 0, 0 );
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			break;
 		}
@@ -930,6 +1414,7 @@ approx_candidates(
 		} else {
 			mdb_idl_intersection( ids, tmp );
 		}
+		mdb_idl_free( tmp );
 
 		if( MDB_IDL_IS_ZERO( ids ) )
 			break;
@@ -965,8 +1450,9 @@ substring_candidates(
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
+	rc = mdb_index_param( op, sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
 		&dbi, &mask, &prefix );
+	explain_index( op, sub->sa_desc, "sub", rc );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1019,8 +1505,10 @@ substring_candidates(
 
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
+		explain_ids( op, "key", rc, tmp );
 
 		if( rc == MDB_NOTFOUND ) {
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			rc = 0;
 			break;
@@ -1036,6 +1524,7 @@ substring_candidates(
 			Debug( LDAP_DEBUG_TRACE,
 				"<= mdb_substring_candidates: (%s) NULL\n",
 				sub->sa_desc->ad_cname.bv_val, 0, 0 );
+			mdb_idl_free( ids );
 			MDB_IDL_ZERO( ids );
 			break;
 		}
@@ -1045,6 +1534,7 @@ substring_candidates(
 		} else {
 			mdb_idl_intersection( ids, tmp );
 		}
+		mdb_idl_free( tmp );
 
 		if( MDB_IDL_IS_ZERO( ids ) )
 			break;
@@ -1075,14 +1565,17 @@ inequality_candidates(
 	struct berval *keys = NULL;
 	MatchingRule *mr;
 	MDB_cursor *cursor = NULL;
+	int nkeys = 0;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_inequality_candidates (%s)\n",
 			ava->aa_desc->ad_cname.bv_val, 0, 0 );
 
 	MDB_IDL_ALL( ids );
 
-	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
+	rc = mdb_index_param( op, ava->aa_desc, LDAP_FILTER_EQUALITY,
 		&dbi, &mask, &prefix );
+	explain_index( op, ava->aa_desc,
+		gtorlt == LDAP_FILTER_GE ? "ge" : "le", rc );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1154,7 +1647,9 @@ inequality_candidates(
 			break;
 		}
 
+		nkeys++;
 		mdb_idl_union( ids, tmp );
+		mdb_idl_free( tmp );
 
 		if( op->ors_limit && op->ors_limit->lms_s_unchecked != -1 &&
 			MDB_IDL_N( ids ) >= (unsigned) op->ors_limit->lms_s_unchecked ) {
@@ -1163,6 +1658,7 @@ inequality_candidates(
 		}
 	}
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	mdb_explain_printf( op, "scan: %d keys\n", nkeys );
 
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_inequality_candidates: id=%ld, first=%ld, last=%ld\n",
@@ -0,0 +1,324 @@
+/* group.c - group commit of write txns */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/* Every write op normally begins and commits a txn of its own, and
+ * pays for a sync of the environment each time. With groupcommit set,
+ * ops writing at the same time share one txn instead. An op queues
+ * itself on entry to the backend; the first one, the leader, runs on
+ * its own thread, begins the shared txn and makes its changes in a
+ * nested txn of it. Once its nested txn is done the leader's thread
+ * runs the next queued op, up to mi_group_max of them, and the last
+ * one commits the lot with a single sync. An op whose nested txn
+ * fails only loses its own changes.
+ *
+ * A txn and its children belong to the thread that began it, so all
+ * the txns of a batch are used by the leader's thread alone. The ops
+ * it runs are called from the commit of the op before them, so their
+ * frames are still there when the batch is committed, and each one
+ * returns through its own result after that. The result itself is
+ * sent by the op's own thread, which is waiting in mdb_group_join():
+ * the callbacks of the overlays above expect that thread. Ops begun
+ * by a thread that is serving a batch, such as the internal ops of
+ * those callbacks, are not grouped. Nested txns aren't supported
+ * with MDB_WRITEMAP, so ops are not grouped with it.
+ */
+
+void
+mdb_group_init( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_init( &mdb->mi_group.mg_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_group.mg_cond );
+	mdb->mi_group.mg_tail = &mdb->mi_group.mg_ops;
+}
+
+void
+mdb_group_destroy( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_cond_destroy( &mdb->mi_group.mg_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_group.mg_mutex );
+}
+
+static mdb_group_op *
+mdb_group_find( Operation *op, mdb_group *mg )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mg && ((mdb_group_op *)oex)->mgo_op == op )
+			return (mdb_group_op *)oex;
+	}
+	return NULL;
+}
+
+/* Called on entry to a write op. Returns 0 if the caller is to do the
+ * op itself, or 1 once it was done as part of a batch.
+ */
+int
+mdb_group_join( Operation *op, SlapReply *rs, BI_op_func *func )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_group *mg = &mdb->mi_group;
+	mdb_group_op mgo = {{{ 0 }}};
+	OpExtra *oex;
+	void *ctx, *data;
+
+	if ( !mdb->mi_group_max || !( slapMode & SLAP_SERVER_MODE ) ||
+		( mdb->mi_dbenv_flags & MDB_WRITEMAP ))
+		return 0;
+
+	/* being run by a batch, or continuing the txn of another op */
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mg || oex->oe_key == mdb )
+			return 0;
+	}
+	ctx = ldap_pvt_thread_pool_context();
+	if ( !ctx || !ldap_pvt_thread_pool_getkey( ctx,
+		(void *)mdb_group_join, &data, NULL ))
+		return 0;
+
+	mgo.mgo_oe.oe_key = mg;
+	mgo.mgo_op = op;
+	mgo.mgo_rs = rs;
+	mgo.mgo_func = func;
+	mgo.mgo_tid = ldap_pvt_thread_self();
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &mgo.mgo_oe, oe_next );
+	ldap_pvt_thread_pool_setkey( ctx, (void *)mdb_group_join, &mgo,
+		NULL, NULL, NULL );
+
+	ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+	*mg->mg_tail = &mgo;
+	mg->mg_tail = &mgo.mgo_next;
+
+	while ( mgo.mgo_state != MGO_DONE ) {
+		if ( mgo.mgo_state == MGO_SEND ) {
+			ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+			send_ldap_result( op, rs );
+			ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+			mgo.mgo_state = MGO_RUNNING;
+			ldap_pvt_thread_cond_broadcast( &mg->mg_cond );
+			continue;
+		}
+		if ( !mg->mg_leader && mg->mg_ops == &mgo ) {
+			/* lead the next batch */
+			mg->mg_ops = mgo.mgo_next;
+			if ( !mg->mg_ops )
+				mg->mg_tail = &mg->mg_ops;
+			mg->mg_leader = &mgo;
+			mgo.mgo_state = MGO_RUNNING;
+			ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+
+			func( op, rs );
+
+			ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+			/* still set if the op never began a txn */
+			if ( mg->mg_leader == &mgo ) {
+				mg->mg_leader = NULL;
+				ldap_pvt_thread_cond_broadcast( &mg->mg_cond );
+			}
+			break;
+		}
+		ldap_pvt_thread_cond_wait( &mg->mg_cond, &mg->mg_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+
+	LDAP_SLIST_REMOVE( &op->o_extra, &mgo.mgo_oe, OpExtra, oe_next );
+	ldap_pvt_thread_pool_setkey( ctx, (void *)mdb_group_join, NULL,
+		NULL, NULL, NULL );
+	return 1;
+}
+
+/* Send the result of a write op from the op's own thread */
+void
+mdb_group_send( Operation *op, SlapReply *rs )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_group *mg = &mdb->mi_group;
+	mdb_group_op *mgo = mdb_group_find( op, mg );
+
+	if ( !mgo || ldap_pvt_thread_equal( mgo->mgo_tid,
+		ldap_pvt_thread_self() ))
+	{
+		send_ldap_result( op, rs );
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+	mgo->mgo_state = MGO_SEND;
+	ldap_pvt_thread_cond_broadcast( &mg->mg_cond );
+	while ( mgo->mgo_state == MGO_SEND )
+		ldap_pvt_thread_cond_wait( &mg->mg_cond, &mg->mg_mutex );
+	ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+}
+
+/* Called by the leader's thread once the nested txn of mgo is gone.
+ * Runs the queued ops that may join the batch, and commits it after
+ * the last of them. Returns the result of the commit.
+ */
+static int
+mdb_group_next( struct mdb_info *mdb, mdb_group_op *mgo )
+{
+	mdb_group *mg = &mdb->mi_group;
+	mdb_group_op *m, **prev;
+	MDB_txn *txn;
+	int numads, nops, err;
+
+	while ( !mgo->mgo_committed ) {
+		ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+		m = NULL;
+		if ( mg->mg_nops < (int) mdb->mi_group_max ) {
+			/* a lazy batch may only take lazy ops */
+			for ( prev = &mg->mg_ops; *prev; prev = &(*prev)->mgo_next ) {
+				if ( !mg->mg_lazy || get_lazyCommit( (*prev)->mgo_op )) {
+					m = *prev;
+					*prev = m->mgo_next;
+					if ( !*prev )
+						mg->mg_tail = prev;
+					m->mgo_state = MGO_RUNNING;
+					break;
+				}
+			}
+		}
+		if ( m ) {
+			ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+			m->mgo_func( m->mgo_op, m->mgo_rs );
+			ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+			m->mgo_state = MGO_DONE;
+			ldap_pvt_thread_cond_broadcast( &mg->mg_cond );
+			ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+			continue;
+		}
+
+		txn = mg->mg_txn;
+		m = mg->mg_batch;
+		numads = mg->mg_numads;
+		nops = mg->mg_nops;
+		mg->mg_txn = NULL;
+		mg->mg_batch = NULL;
+		ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+
+		Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_group_next)
+			": committing %d ops\n", nops, 0, 0 );
+		err = mdb_txn_commit( txn );
+		if ( err ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_group_next)
+				": txn_commit failed: %s (%d)\n",
+				mdb_strerror(err), err, 0 );
+			mdb->mi_numads = numads;
+		}
+		for ( ; m; m = m->mgo_bnext ) {
+			m->mgo_committed = 1;
+			m->mgo_brc = err;
+		}
+
+		/* the next batch may begin while this thread unwinds */
+		ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+		mg->mg_leader = NULL;
+		ldap_pvt_thread_cond_broadcast( &mg->mg_cond );
+		ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+	}
+	return mgo->mgo_brc;
+}
+
+/* Begin the write txn of a write op */
+int
+mdb_group_begin( Operation *op, struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_group *mg = &mdb->mi_group;
+	mdb_group_op *mgo;
+	int lazy = get_lazyCommit( op ) ? MDB_NOMETASYNC : 0;
+	int rc;
+
+	if ( !mdb->mi_group_max || !( slapMode & SLAP_SERVER_MODE ) ||
+		( mdb->mi_dbenv_flags & MDB_WRITEMAP ) ||
+		!( mgo = mdb_group_find( op, mg )))
+	{
+		return mdb_txn_begin( mdb->mi_dbenv, NULL, lazy, &moi->moi_txn );
+	}
+
+	ldap_pvt_thread_mutex_lock( &mg->mg_mutex );
+	if ( !mg->mg_leader || !ldap_pvt_thread_equal(
+		mg->mg_leader->mgo_tid, ldap_pvt_thread_self() ))
+	{
+		/* not run by a batch */
+		ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+		return mdb_txn_begin( mdb->mi_dbenv, NULL, lazy, &moi->moi_txn );
+	}
+	ldap_pvt_thread_mutex_unlock( &mg->mg_mutex );
+
+	/* Only the leader's thread touches the batch from here on */
+	if ( !mg->mg_txn ) {
+		/* The batch skips the meta page sync only if all its ops
+		 * asked for lazyCommit; this is the first of them.
+		 */
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, lazy, &mg->mg_txn );
+		if ( rc )
+			return rc;
+		mg->mg_lazy = lazy;
+		mg->mg_nops = 0;
+		mg->mg_numads = mdb->mi_numads;
+	}
+
+	mg->mg_nops++;
+	mgo->mgo_committed = 0;
+	mgo->mgo_bnext = mg->mg_batch;
+	mg->mg_batch = mgo;
+	rc = mdb_txn_begin( mdb->mi_dbenv, mg->mg_txn, 0, &moi->moi_txn );
+	if ( rc ) {
+		moi->moi_txn = NULL;
+		mdb_group_next( mdb, mgo );
+		return rc;
+	}
+	moi->moi_group = mgo;
+	moi->moi_flag |= MOI_GROUPED;
+	return 0;
+}
+
+/* Commit the write txn of a write op. Returns once its changes are
+ * durable, or failed to be.
+ */
+int
+mdb_group_commit( struct mdb_info *mdb, mdb_op_info *moi, MDB_txn *txn )
+{
+	int rc, err;
+
+	rc = mdb_txn_commit( txn );
+	if ( !( moi->moi_flag & MOI_GROUPED ))
+		return rc;
+
+	moi->moi_flag &= ~MOI_GROUPED;
+	err = mdb_group_next( mdb, moi->moi_group );
+	moi->moi_group = NULL;
+	return rc ? rc : err;
+}
+
+void
+mdb_group_abort( struct mdb_info *mdb, mdb_op_info *moi, MDB_txn *txn )
+{
+	mdb_txn_abort( txn );
+	if ( !( moi->moi_flag & MOI_GROUPED ))
+		return;
+
+	moi->moi_flag &= ~MOI_GROUPED;
+	mdb_group_next( mdb, moi->moi_group );
+	moi->moi_group = NULL;
+}
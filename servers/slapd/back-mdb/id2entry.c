@@ -21,6 +21,11 @@
 #include <ac/errno.h>
 
 #include "back-mdb.h"
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 typedef struct Ecount {
 	ber_len_t len;	/* total entry size */
@@ -35,7 +40,12 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	Ecount *eh);
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data,
 	Ecount *ec);
-static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals );
+static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals,
+	ber_len_t extra );
+#ifdef HAVE_ZLIB
+static int mdb_entry_compress(Operation *op, Entry *e, Ecount *ec,
+	MDB_val *data);
+#endif
 
 #define ID2VKSZ	(sizeof(ID)+2)
 
@@ -271,7 +281,7 @@ static int mdb_id2entry_put(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	Ecount ec;
-	MDB_val key, data;
+	MDB_val key, data, zdata = {0, NULL};
 	int rc, adding = flag;
 
 	/* We only store rdns, and they go in the dn2id database. */
@@ -283,24 +293,41 @@ static int mdb_id2entry_put(
 	if (rc)
 		return LDAP_OTHER;
 
-	flag |= MDB_RESERVE;
-
 	if (e->e_id < mdb->mi_nextid)
 		flag &= ~MDB_APPEND;
 
 	if (mdb->mi_maxentrysize && ec.len > mdb->mi_maxentrysize)
 		return LDAP_ADMINLIMIT_EXCEEDED;
 
+#ifdef HAVE_ZLIB
+	if (mdb->mi_compress) {
+		rc = mdb_entry_compress( op, e, &ec, &zdata );
+		if( rc != LDAP_SUCCESS )
+			return rc;
+	} else
+#endif
+	{
+		flag |= MDB_RESERVE;
+	}
+
+	if (!adding)
+		mdb_ecache_invalidate( mdb, txn, e->e_id );
+
 again:
-	data.mv_size = ec.dlen;
+	if ( zdata.mv_data )
+		data = zdata;
+	else
+		data.mv_size = ec.dlen;
 	if ( mc )
 		rc = mdb_cursor_put( mc, &key, &data, flag );
 	else
 		rc = mdb_put( txn, mdb->mi_id2entry, &key, &data, flag );
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_entry_encode( op, e, &data, &ec );
-		if( rc != LDAP_SUCCESS )
-			return rc;
+		if ( !zdata.mv_data ) {
+			rc = mdb_entry_encode( op, e, &data, &ec );
+			if( rc != LDAP_SUCCESS )
+				return rc;
+		}
 		/* Handle adds of large multi-valued attrs here.
 		 * Modifies handle them directly.
 		 */
@@ -323,7 +350,8 @@ again:
 					"mdb_id2entry_put: mdb_mval_put failed: %s(%d) \"%s\"\n",
 					mdb_strerror(rc), rc,
 					e->e_nname.bv_val );
-				return LDAP_OTHER;
+				rc = LDAP_OTHER;
+				goto leave;
 			}
 		}
 	}
@@ -340,6 +368,9 @@ again:
 		if ( rc != MDB_KEYEXIST )
 			rc = LDAP_OTHER;
 	}
+leave:
+	if ( zdata.mv_data )
+		op->o_tmpfree( zdata.mv_data, op->o_tmpmemctx );
 	return rc;
 }
 
@@ -395,6 +426,9 @@ int mdb_id2entry(
 
 	*e = NULL;
 
+	if ( mdb_ecache_get( op, mdb_cursor_txn( mc ), id, e ) == MDB_SUCCESS )
+		return MDB_SUCCESS;
+
 	key.mv_data = &id;
 	key.mv_size = sizeof(ID);
 
@@ -404,7 +438,7 @@ int mdb_id2entry(
 		/* Looking for root entry on an empty-dn suffix? */
 		if ( !id && BER_BVISEMPTY( &op->o_bd->be_nsuffix[0] )) {
 			struct berval gluebv = BER_BVC("glue");
-			Entry *r = mdb_entry_alloc(op, 2, 4);
+			Entry *r = mdb_entry_alloc(op, 2, 4, 0);
 			Attribute *a = r->e_attrs;
 			struct berval *bptr;
 
@@ -437,13 +471,15 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
+	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e, NULL );
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
 	(*e)->e_name.bv_val = NULL;
 	(*e)->e_nname.bv_val = NULL;
 
+	mdb_ecache_put( op, mdb_cursor_txn( mc ), e );
+
 	return rc;
 }
 
@@ -461,6 +497,8 @@ int mdb_id2entry_delete(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_ecache_invalidate( mdb, tid, e->e_id );
+
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 	if (rc)
@@ -489,14 +527,18 @@ int mdb_id2entry_delete(
 	return rc;
 }
 
+/* The Entry, its Attributes and their value arrays are one block. If
+ * extra is set, that many bytes follow for the entry's own data.
+ */
 static Entry * mdb_entry_alloc(
 	Operation *op,
 	int nattrs,
-	int nvals )
+	int nvals,
+	ber_len_t extra )
 {
 	Entry *e = op->o_tmpalloc( sizeof(Entry) +
 		nattrs * sizeof(Attribute) +
-		nvals * sizeof(struct berval), op->o_tmpmemctx );
+		nvals * sizeof(struct berval) + extra, op->o_tmpmemctx );
 	BER_BVZERO(&e->e_bv);
 	e->e_private = e;
 	if (nattrs) {
@@ -517,6 +559,9 @@ int mdb_entry_return(
 	if ( !e )
 		return 0;
 	if ( e->e_private ) {
+		/* a reference to the entry cache */
+		if ( e->e_private != e )
+			mdb_ecache_release( e->e_private );
 		if ( op->o_hdr && op->o_tmpmfuncs ) {
 			op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
@@ -734,10 +779,15 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 			if (( slapMode & SLAP_TOOL_MODE ) && mdb_tool_txn ) {
 				moi->moi_txn = mdb_tool_txn;
 			} else {
-				int flag = 0;
-				if ( get_lazyCommit( op ))
-					flag |= MDB_NOMETASYNC;
-				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flag, &moi->moi_txn );
+				if ( moi->moi_flag & MOI_FREEIT ) {
+					int flag = 0;
+					if ( get_lazyCommit( op ))
+						flag |= MDB_NOMETASYNC;
+					rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flag, &moi->moi_txn );
+				} else {
+					/* A write op that commits its own txn */
+					rc = mdb_group_begin( op, mdb, moi );
+				}
 				if (rc) {
 					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 						mdb_strerror(rc), rc, 0 );
@@ -906,6 +956,9 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 #define MDB_AT_NVALS	(1<<(sizeof(unsigned int)*CHAR_BIT-1))
 	/* this attribute has normalized values */
 
+#define MDB_ENT_PACKED	(1U<<(sizeof(unsigned int)*CHAR_BIT-1))
+	/* set in nattrs: the rest of the entry is compressed */
+
 /* Flatten an Entry into a buffer. The buffer starts with the count of the
  * number of attributes in the entry, the total number of values in the
  * entry, and the e_ocflags. It then contains a list of integers for each
@@ -994,20 +1047,149 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 	return 0;
 }
 
+#ifdef HAVE_ZLIB
+static voidpf
+mdb_zalloc( voidpf opaque, uInt items, uInt size )
+{
+	Operation *op = opaque;
+
+	return op->o_tmpalloc( (ber_len_t) items * size, op->o_tmpmemctx );
+}
+
+static void
+mdb_zfree( voidpf opaque, voidpf ptr )
+{
+	Operation *op = opaque;
+
+	op->o_tmpfree( ptr, op->o_tmpmemctx );
+}
+
+/* Encode an entry and deflate it, with the current dictionary if any.
+ * nattrs and nvals stay in the clear, so the decoder can size the Entry
+ * before inflating. nattrs gets MDB_ENT_PACKED and is followed by the
+ * dictionary index and the inflated length of the rest, then the raw
+ * deflate stream of the rest. If that turns out no smaller, the plain
+ * encoding is returned instead. Either way data is tmpalloc'd.
+ */
+static int mdb_entry_compress(Operation *op, Entry *e, Ecount *ec,
+	MDB_val *data)
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_val raw;
+	z_stream zs = {0};
+	unsigned int *lp, *rp;
+	int rc, dict = mdb->mi_dict;
+	uLong len;
+
+	raw.mv_size = ec->dlen;
+	raw.mv_data = op->o_tmpalloc( raw.mv_size, op->o_tmpmemctx );
+	rc = mdb_entry_encode( op, e, &raw, ec );
+	if ( rc != LDAP_SUCCESS ) {
+		op->o_tmpfree( raw.mv_data, op->o_tmpmemctx );
+		return rc;
+	}
+	*data = raw;
+
+	zs.zalloc = mdb_zalloc;
+	zs.zfree = mdb_zfree;
+	zs.opaque = op;
+	if ( deflateInit2( &zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+		8, Z_DEFAULT_STRATEGY ) != Z_OK )
+		return LDAP_SUCCESS;
+	if ( dict )
+		deflateSetDictionary( &zs, (Bytef *)mdb->mi_dicts[dict].bv_val,
+			mdb->mi_dicts[dict].bv_len );
+
+	rp = raw.mv_data;
+	len = raw.mv_size - 2*sizeof(int);
+	data->mv_size = 4*sizeof(int) + deflateBound( &zs, len );
+	data->mv_data = op->o_tmpalloc( data->mv_size, op->o_tmpmemctx );
+	lp = data->mv_data;
+	*lp++ = rp[0] | MDB_ENT_PACKED;
+	*lp++ = rp[1];
+	*lp++ = dict;
+	*lp++ = len;
+
+	zs.next_in = (Bytef *)(rp + 2);
+	zs.avail_in = len;
+	zs.next_out = (Bytef *)lp;
+	zs.avail_out = data->mv_size - 4*sizeof(int);
+	rc = deflate( &zs, Z_FINISH );
+	deflateEnd( &zs );
+
+	if ( rc == Z_STREAM_END && 4*sizeof(int) + zs.total_out < raw.mv_size ) {
+		data->mv_size = 4*sizeof(int) + zs.total_out;
+		op->o_tmpfree( raw.mv_data, op->o_tmpmemctx );
+	} else {
+		op->o_tmpfree( data->mv_data, op->o_tmpmemctx );
+		*data = raw;
+	}
+	return LDAP_SUCCESS;
+}
+
+/* Inflate the rest of a compressed entry. lp points past nattrs and
+ * nvals, at len bytes of the record.
+ */
+static int mdb_entry_inflate(Operation *op, unsigned int *lp, size_t len,
+	unsigned char *out)
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	z_stream zs = {0};
+	unsigned int dict = lp[0], olen = lp[1];
+	int rc;
+
+	if ( dict > (unsigned) mdb->mi_numdicts ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_entry_inflate: dictionary %u not found\n",
+			dict, 0, 0 );
+		return LDAP_OTHER;
+	}
+
+	zs.zalloc = mdb_zalloc;
+	zs.zfree = mdb_zfree;
+	zs.opaque = op;
+	if ( inflateInit2( &zs, -MAX_WBITS ) != Z_OK )
+		return LDAP_OTHER;
+	if ( dict )
+		inflateSetDictionary( &zs, (Bytef *)mdb->mi_dicts[dict].bv_val,
+			mdb->mi_dicts[dict].bv_len );
+
+	zs.next_in = (Bytef *)(lp + 2);
+	zs.avail_in = len - 2*sizeof(int);
+	zs.next_out = out;
+	zs.avail_out = olen;
+	rc = inflate( &zs, Z_FINISH );
+	inflateEnd( &zs );
+
+	if ( rc != Z_STREAM_END || zs.total_out != olen ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_entry_inflate: inflate failed (%d)\n",
+			rc, 0, 0 );
+		return LDAP_OTHER;
+	}
+	return 0;
+}
+#endif /* HAVE_ZLIB */
+
 /* Retrieve an Entry that was stored using entry_encode above.
  *
  * Note: everything is stored in a single contiguous block, so
  * you can not free individual attributes or names from this
  * structure. Attempting to do so will likely corrupt memory.
+ *
+ * If pj is set, only the attributes it wants are returned. All the
+ * value lengths precede the data, so the values of the others are
+ * stepped over without being looked at.
  */
 
-int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
+int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e,
+	mdb_projection *pj)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int i, j, nattrs, nvals;
 	int rc;
 	Attribute *a;
-	Entry *x;
+	Entry *x = NULL;
 	const char *text;
 	unsigned int *lp = (unsigned int *)data->mv_data;
 	unsigned char *ptr;
@@ -1020,9 +1202,59 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 
 	nattrs = *lp++;
 	nvals = *lp++;
-	x = mdb_entry_alloc(op, nattrs, nvals);
+	if ((unsigned int)nattrs & MDB_ENT_PACKED) {
+#ifdef HAVE_ZLIB
+		/* inflate into the tail of an Entry sized for all of it */
+		nattrs = (unsigned int)nattrs & ~MDB_ENT_PACKED;
+		x = mdb_entry_alloc(op, nattrs, nvals, lp[1]);
+		ptr = (unsigned char *)(x+1) + nattrs * sizeof(Attribute) +
+			nvals * sizeof(struct berval);
+		rc = mdb_entry_inflate(op, lp, data->mv_size - 2*sizeof(int), ptr);
+		if (rc) {
+			op->o_tmpfree(x, op->o_tmpmemctx);
+			return rc;
+		}
+		lp = (unsigned int *)ptr;
+#else
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_entry_decode: entry %lu is compressed, "
+			"compression support not available\n",
+			(unsigned long) id, 0, 0 );
+		return LDAP_OTHER;
+#endif
+	}
+	if (pj && nvals) {
+		/* size the entry for the wanted attributes only */
+		unsigned int *hp = lp + 2, n, k;
+		int kattrs = 0, kvals = 0;
+
+		for (j=0; j<nattrs; j++) {
+			i = *hp++;
+			n = *hp++;
+			k = 1;
+			if (n & MDB_AT_NVALS) {
+				n ^= MDB_AT_NVALS;
+				k = 2;
+			}
+			if (!(i & MDB_AT_MULTI))
+				hp += k * n;
+			if (MDB_PJ_WANT(pj, i & ~(MDB_AT_SORTED|MDB_AT_MULTI))) {
+				kattrs++;
+				kvals += k * (n + 1);
+			}
+		}
+		if (kattrs == nattrs) {
+			pj = NULL;
+		} else {
+			nattrs = kattrs;
+			nvals = kvals;
+		}
+	}
+	if (!x)
+		x = mdb_entry_alloc(op, nattrs, nvals, 0);
 	x->e_ocflags = *lp++;
 	if (!nvals) {
+		x->e_attrs = NULL;
 		goto done;
 	}
 	a = x->e_attrs;
@@ -1031,18 +1263,37 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 	ptr = (unsigned char *)(lp + i);
 
 	for (;nattrs>0; nattrs--) {
-		int have_nval = 0, multi = 0;
-		a->a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		int have_nval = 0, multi = 0, sorted = 0;
+		unsigned int n;
+
 		i = *lp++;
 		if (i & MDB_AT_SORTED) {
 			i ^= MDB_AT_SORTED;
-			a->a_flags |= SLAP_ATTR_SORTED_VALS;
+			sorted = 1;
 		}
 		if (i & MDB_AT_MULTI) {
 			i ^= MDB_AT_MULTI;
-			a->a_flags |= SLAP_ATTR_BIG_MULTI;
 			multi = 1;
 		}
+		if (pj && !MDB_PJ_WANT(pj, i)) {
+			/* step over the values, without counting the attr */
+			n = *lp++;
+			if (n & MDB_AT_NVALS) {
+				n ^= MDB_AT_NVALS;
+				n *= 2;
+			}
+			if (!multi) {
+				for (; n; n--)
+					ptr += *lp++ + 1;
+			}
+			nattrs++;
+			continue;
+		}
+		a->a_flags = SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		if (sorted)
+			a->a_flags |= SLAP_ATTR_SORTED_VALS;
+		if (multi)
+			a->a_flags |= SLAP_ATTR_BIG_MULTI;
 		if (i > mdb->mi_numads) {
 			rc = mdb_ad_read(mdb, txn);
 			if (rc)
@@ -1129,3 +1380,178 @@ leave:
 		mdb_cursor_close(mvc);
 	return rc;
 }
+
+/* Compression dictionaries are kept in the dict DB, numbered from 1
+ * like the AttributeDescriptions in ad2id, and never removed: records
+ * compressed with an older one must stay readable.
+ */
+static int mdb_dict_read( struct mdb_info *mdb, MDB_txn *txn )
+{
+	int i, rc;
+	MDB_cursor *mc;
+	MDB_val key, data;
+
+	/* slapcat of an environment without any */
+	if ( !mdb->mi_dict2id )
+		return 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dict2id, &mc );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_dict_read: cursor_open failed %s(%d)\n",
+			mdb_strerror(rc), rc, 0);
+		return rc;
+	}
+
+	i = mdb->mi_numdicts+1;
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+	while ( rc == MDB_SUCCESS ) {
+		if ( i >= MDB_MAXDICTS ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_dict_read: too many dictionaries\n",
+				0, 0, 0 );
+			rc = LDAP_OTHER;
+			break;
+		}
+		mdb->mi_dicts[i].bv_len = data.mv_size;
+		mdb->mi_dicts[i].bv_val = ch_malloc( data.mv_size );
+		memcpy( mdb->mi_dicts[i].bv_val, data.mv_data, data.mv_size );
+		mdb->mi_numdicts = i++;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+/* Read the stored dictionaries, and make the configured one current,
+ * storing it first if it's new. Only the last 32KB of the file are
+ * kept; deflate can't use more.
+ */
+int mdb_dict_open( BackendDB *be, MDB_txn *txn, ConfigReply *cr )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_txn *ltxn = txn;
+	MDB_val key, data;
+	struct berval bv = BER_BVNULL;
+	FILE *f = NULL;
+	long size;
+	int i, rc;
+
+	if ( !ltxn ) {
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &ltxn );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg),
+				"database \"%s\": txn_begin failed: %s (%d).",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_dict_open) ": %s\n",
+				cr->msg, 0, 0 );
+			return rc;
+		}
+	}
+
+	rc = mdb_dict_read( mdb, ltxn );
+	if ( rc )
+		goto done;
+
+	mdb->mi_dict = 0;
+	if ( !mdb->mi_compress || !mdb->mi_dict_file )
+		goto done;
+
+	f = fopen( mdb->mi_dict_file, "rb" );
+	if ( !f || fseek( f, 0, SEEK_END ) || ( size = ftell( f )) < 0 ) {
+		rc = LDAP_OTHER;
+		snprintf( cr->msg, sizeof(cr->msg),
+			"database \"%s\": cannot read dictionary \"%s\": %s.",
+			be->be_suffix[0].bv_val, mdb->mi_dict_file,
+			strerror( errno ));
+		goto fail;
+	}
+	if ( size > 32768 )
+		size = 32768;
+	if ( !size )
+		goto done;
+	bv.bv_len = size;
+	bv.bv_val = ch_malloc( bv.bv_len );
+	if ( fseek( f, -size, SEEK_END ) ||
+		fread( bv.bv_val, 1, bv.bv_len, f ) != bv.bv_len )
+	{
+		rc = LDAP_OTHER;
+		snprintf( cr->msg, sizeof(cr->msg),
+			"database \"%s\": cannot read dictionary \"%s\".",
+			be->be_suffix[0].bv_val, mdb->mi_dict_file );
+		goto fail;
+	}
+
+	for ( i = 1; i <= mdb->mi_numdicts; i++ ) {
+		if ( ber_bvcmp( &bv, &mdb->mi_dicts[i] ) == 0 ) {
+			mdb->mi_dict = i;
+			goto done;
+		}
+	}
+
+	/* slapcat only reads, it doesn't need the new one */
+	if ( slapMode & SLAP_TOOL_READONLY )
+		goto done;
+
+	if ( mdb->mi_numdicts+1 >= MDB_MAXDICTS ) {
+		rc = LDAP_OTHER;
+		snprintf( cr->msg, sizeof(cr->msg),
+			"database \"%s\": too many dictionaries.",
+			be->be_suffix[0].bv_val );
+		goto fail;
+	}
+	i = mdb->mi_numdicts+1;
+	key.mv_size = sizeof(int);
+	key.mv_data = &i;
+	data.mv_size = bv.bv_len;
+	data.mv_data = bv.bv_val;
+	rc = mdb_put( ltxn, mdb->mi_dict2id, &key, &data, MDB_NOOVERWRITE );
+	if ( rc ) {
+		snprintf( cr->msg, sizeof(cr->msg),
+			"database \"%s\": mdb_put failed: %s (%d).",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		goto fail;
+	}
+	mdb->mi_dicts[i] = bv;
+	BER_BVZERO( &bv );
+	mdb->mi_numdicts = i;
+	mdb->mi_dict = i;
+	goto done;
+
+fail:
+	Debug( LDAP_DEBUG_ANY,
+		LDAP_XSTRING(mdb_dict_open) ": %s\n",
+		cr->msg, 0, 0 );
+done:
+	if ( f )
+		fclose( f );
+	if ( bv.bv_val )
+		ch_free( bv.bv_val );
+	if ( !txn ) {
+		if ( rc ) {
+			mdb_txn_abort( ltxn );
+		} else {
+			rc = mdb_txn_commit( ltxn );
+		}
+	}
+	return rc;
+}
+
+void mdb_dict_flush( struct mdb_info *mdb )
+{
+	int i;
+
+	for ( i = 1; i <= mdb->mi_numdicts; i++ ) {
+		ch_free( mdb->mi_dicts[i].bv_val );
+		BER_BVZERO( &mdb->mi_dicts[i] );
+	}
+	mdb->mi_numdicts = 0;
+	mdb->mi_dict = 0;
+}
@@ -125,6 +125,398 @@ unsigned mdb_idl_search( ID *ids, ID id )
 #endif
 }
 
+#ifdef MDB_IDL_BITMAPS
+static unsigned
+idl_bm_popcount( ID m )
+{
+#ifdef __GNUC__
+	return __builtin_popcountl( m );
+#else
+	unsigned n;
+	for ( n = 0; m; n++ )
+		m &= m - 1;
+	return n;
+#endif
+}
+
+/* lowest set bit of a nonzero word */
+static unsigned
+idl_bm_lowbit( ID m )
+{
+#ifdef __GNUC__
+	return __builtin_ctzl( m );
+#else
+	unsigned n = 0;
+	while ( !( m & 1 )) {
+		m >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/* highest set bit of a nonzero word */
+static unsigned
+idl_bm_highbit( ID m )
+{
+#ifdef __GNUC__
+	return sizeof(ID)*8 - 1 - __builtin_clzl( m );
+#else
+	unsigned n = 0;
+	while ( m >>= 1 )
+		n++;
+	return n;
+#endif
+}
+
+#define IDL_BM_MEMBER(x, m)	( ((x) << MDB_IDL_BM_SHIFT) + idl_bm_lowbit(m) )
+#define IDL_BM_BIT(id)	( (ID)1 << ((id) & (MDB_IDL_BM_BITS-1)) )
+
+/* Recompute the bounds and count of a bitmap from its words.
+ * An empty bitmap becomes an empty IDL.
+ */
+static void
+idl_bm_fix( ID *ids )
+{
+	ID *w = MDB_IDL_BM_WORDS( ids );
+	ID n = MDB_IDL_BM_NWORDS( ids ), i, count = 0;
+
+	if ( !n ) {
+		ids[0] = 0;
+		return;
+	}
+	for ( i = 0; i < n; i++ )
+		count += idl_bm_popcount( MDB_IDL_BM_BITMASK( w[i] ));
+	ids[1] = IDL_BM_MEMBER( MDB_IDL_BM_IDX( w[0] ), MDB_IDL_BM_BITMASK( w[0] ));
+	ids[2] = ( MDB_IDL_BM_IDX( w[n-1] ) << MDB_IDL_BM_SHIFT ) +
+		idl_bm_highbit( MDB_IDL_BM_BITMASK( w[n-1] ));
+	ids[4] = count;
+}
+
+/* Make the n words at w the words of bitmap ids. w is either the
+ * buffer's own words or an array from ch_malloc, which is kept only
+ * while the words don't fit in the buffer.
+ */
+static void
+idl_bm_set( ID *ids, ID *w, ID n )
+{
+	ID *in = ids + MDB_IDL_BM_HDR;
+
+	if ( w != in && n <= MDB_IDL_BM_MAXWORDS ) {
+		AC_MEMCPY( in, w, n * sizeof(ID) );
+		ch_free( w );
+		w = in;
+	}
+	ids[3] = n;
+	if ( w != in )
+		ids[MDB_IDL_BM_HDR] = (ID) w;
+	idl_bm_fix( ids );
+}
+
+/* A bitmap small enough to be a plain list is turned back into one.
+ * The words are moved to the end of the buffer and expanded from there,
+ * so ids must be a full MDB_IDL_UM_SIZE buffer.
+ */
+static void
+idl_bm_shrink( ID *ids )
+{
+	ID n, *w, i, c, x, m;
+
+	if ( !MDB_IDL_IS_BITMAP( ids ) || MDB_IDL_BM_COUNT( ids ) >= MDB_IDL_DB_SIZE )
+		return;
+
+	n = MDB_IDL_BM_NWORDS( ids );
+	w = ids + MDB_IDL_UM_SIZE - n;
+	memmove( w, MDB_IDL_BM_WORDS( ids ), n * sizeof(ID) );
+	c = 0;
+	for ( i = 0; i < n; i++ ) {
+		x = MDB_IDL_BM_IDX( w[i] );
+		for ( m = MDB_IDL_BM_BITMASK( w[i] ); m; m &= m - 1 )
+			ids[++c] = IDL_BM_MEMBER( x, m );
+	}
+	ids[0] = c;
+}
+
+/* Convert a sorted list into a bitmap, in place */
+static int
+idl_list2bm( ID *ids )
+{
+	ID n = ids[0], *w, i, x, m = 0, k = 0;
+
+	if ( ids[n] > MDB_IDL_BM_MAXID )
+		return -1;
+
+	if ( n + MDB_IDL_BM_HDR > MDB_IDL_UM_SIZE )
+		w = ch_malloc( n * sizeof(ID) );
+	else
+		w = ids + MDB_IDL_BM_HDR;
+	memmove( w, ids + 1, n * sizeof(ID) );
+	x = w[0] >> MDB_IDL_BM_SHIFT;
+	for ( i = 0; i < n; i++ ) {
+		ID id = w[i];
+		if ( id >> MDB_IDL_BM_SHIFT != x ) {
+			w[k++] = MDB_IDL_BM_WORD( x, m );
+			x = id >> MDB_IDL_BM_SHIFT;
+			m = 0;
+		}
+		m |= IDL_BM_BIT( id );
+	}
+	w[k++] = MDB_IDL_BM_WORD( x, m );
+	ids[0] = NOID;
+	idl_bm_set( ids, w, k );
+	return 0;
+}
+
+/* Expand a plain range into a bitmap with every bit set */
+static int
+idl_range2bm( ID *ids )
+{
+	ID lo = ids[1], hi = ids[2], *w, x, k;
+
+	if ( hi > MDB_IDL_BM_MAXID )
+		return -1;
+	k = ( hi >> MDB_IDL_BM_SHIFT ) - ( lo >> MDB_IDL_BM_SHIFT ) + 1;
+	if ( k > MDB_IDL_BM_LIMIT )
+		return -1;
+	if ( k > MDB_IDL_BM_MAXWORDS )
+		w = ch_malloc( k * sizeof(ID) );
+	else
+		w = ids + MDB_IDL_BM_HDR;
+
+	k = 0;
+	for ( x = lo >> MDB_IDL_BM_SHIFT; x <= hi >> MDB_IDL_BM_SHIFT; x++ )
+		w[k++] = MDB_IDL_BM_WORD( x, 0xffffffffUL );
+	w[0] &= ~( IDL_BM_BIT( lo ) - 1 );
+	if ( ( hi & ( MDB_IDL_BM_BITS-1 )) != MDB_IDL_BM_BITS-1 )
+		w[k-1] &= ( ( IDL_BM_BIT( hi ) << 1 ) - 1 ) | ~0xffffffffUL;
+	idl_bm_set( ids, w, k );
+	return 0;
+}
+
+/* Return the first member of a bitmap that is >= id, or NOID */
+static ID
+idl_bm_next( ID *ids, ID id )
+{
+	ID *w = MDB_IDL_BM_WORDS( ids );
+	ID n = MDB_IDL_BM_NWORDS( ids ), base = 0, x, m;
+
+	if ( id < ids[1] )
+		id = ids[1];
+	if ( id > ids[2] )
+		return NOID;
+
+	/* binary search for the first word at or after id */
+	x = id >> MDB_IDL_BM_SHIFT;
+	while ( n > 0 ) {
+		ID pivot = n >> 1;
+		if ( MDB_IDL_BM_IDX( w[base + pivot] ) < x ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	for ( ; base < MDB_IDL_BM_NWORDS( ids ); base++ ) {
+		m = MDB_IDL_BM_BITMASK( w[base] );
+		if ( MDB_IDL_BM_IDX( w[base] ) == x )
+			m &= ~( IDL_BM_BIT( id ) - 1 );
+		if ( m ) {
+			id = IDL_BM_MEMBER( MDB_IDL_BM_IDX( w[base] ), m );
+			return id <= ids[2] ? id : NOID;
+		}
+	}
+	return NOID;
+}
+
+/* Keep only the members within [lo, hi] */
+static void
+idl_bm_clip( ID *ids, ID lo, ID hi )
+{
+	ID *w = MDB_IDL_BM_WORDS( ids );
+	ID n = MDB_IDL_BM_NWORDS( ids ), i, k = 0, x, m;
+
+	for ( i = 0; i < n; i++ ) {
+		x = MDB_IDL_BM_IDX( w[i] );
+		if ( x < lo >> MDB_IDL_BM_SHIFT )
+			continue;
+		if ( x > hi >> MDB_IDL_BM_SHIFT )
+			break;
+		m = MDB_IDL_BM_BITMASK( w[i] );
+		if ( x == lo >> MDB_IDL_BM_SHIFT )
+			m &= ~( IDL_BM_BIT( lo ) - 1 );
+		if ( x == hi >> MDB_IDL_BM_SHIFT &&
+			( hi & ( MDB_IDL_BM_BITS-1 )) != MDB_IDL_BM_BITS-1 )
+			m &= ( IDL_BM_BIT( hi ) << 1 ) - 1;
+		if ( m )
+			w[k++] = MDB_IDL_BM_WORD( x, m );
+	}
+	idl_bm_set( ids, w, k );
+}
+
+/* Filter the list a by the members of bitmap b: keep the IDs
+ * that are in b if keep is set, otherwise those that are not.
+ */
+static void
+idl_bm_filter( ID *a, ID *b, int keep )
+{
+	ID *w = MDB_IDL_BM_WORDS( b );
+	ID n = MDB_IDL_BM_NWORDS( b ), i, j = 0, k = 0, in;
+
+	for ( i = 1; i <= a[0]; i++ ) {
+		ID x = a[i] >> MDB_IDL_BM_SHIFT;
+		while ( j < n && MDB_IDL_BM_IDX( w[j] ) < x )
+			j++;
+		in = j < n && MDB_IDL_BM_IDX( w[j] ) == x &&
+			( w[j] & IDL_BM_BIT( a[i] ));
+		if ( in ? keep : !keep )
+			a[++k] = a[i];
+	}
+	a[0] = k;
+}
+
+/* a = a intersection b, both bitmaps */
+static void
+idl_bm_and( ID *a, ID *b )
+{
+	ID *wa = MDB_IDL_BM_WORDS( a ), *wb = MDB_IDL_BM_WORDS( b );
+	ID na = MDB_IDL_BM_NWORDS( a ), nb = MDB_IDL_BM_NWORDS( b );
+	ID i = 0, j = 0, k = 0, m;
+
+	while ( i < na && j < nb ) {
+		ID xa = MDB_IDL_BM_IDX( wa[i] ), xb = MDB_IDL_BM_IDX( wb[j] );
+		if ( xa < xb ) {
+			i++;
+		} else if ( xa > xb ) {
+			j++;
+		} else {
+			m = MDB_IDL_BM_BITMASK( wa[i] & wb[j] );
+			if ( m )
+				wa[k++] = MDB_IDL_BM_WORD( xa, m );
+			i++;
+			j++;
+		}
+	}
+	idl_bm_set( a, wa, k );
+}
+
+/* a = a minus b, both bitmaps */
+static void
+idl_bm_andnot( ID *a, ID *b )
+{
+	ID *wa = MDB_IDL_BM_WORDS( a ), *wb = MDB_IDL_BM_WORDS( b );
+	ID na = MDB_IDL_BM_NWORDS( a ), nb = MDB_IDL_BM_NWORDS( b );
+	ID i = 0, j = 0, k = 0, m;
+
+	while ( i < na ) {
+		ID xa = MDB_IDL_BM_IDX( wa[i] );
+		while ( j < nb && MDB_IDL_BM_IDX( wb[j] ) < xa )
+			j++;
+		m = MDB_IDL_BM_BITMASK( wa[i] );
+		if ( j < nb && MDB_IDL_BM_IDX( wb[j] ) == xa )
+			m &= ~wb[j];
+		if ( m )
+			wa[k++] = MDB_IDL_BM_WORD( xa, m );
+		i++;
+	}
+	idl_bm_set( a, wa, k );
+}
+
+/* a = a union b. Lists are converted to bitmaps first; the words
+ * are merged from the end so that a can be written in place, unless
+ * the result needs an array of its own.
+ */
+static int
+idl_bm_or( ID *a, ID *b )
+{
+	ID *wa, *wb, *wc, na, nb, i, j, k, n;
+
+	if ( !MDB_IDL_IS_RANGE( a ) && idl_list2bm( a ))
+		return -1;
+	if ( !MDB_IDL_IS_RANGE( b ) && idl_list2bm( b ))
+		return -1;
+
+	wa = MDB_IDL_BM_WORDS( a );
+	wb = MDB_IDL_BM_WORDS( b );
+	na = MDB_IDL_BM_NWORDS( a );
+	nb = MDB_IDL_BM_NWORDS( b );
+
+	/* size the result */
+	i = j = n = 0;
+	while ( i < na || j < nb ) {
+		if ( j == nb || ( i < na &&
+			MDB_IDL_BM_IDX( wa[i] ) < MDB_IDL_BM_IDX( wb[j] ))) {
+			i++;
+		} else if ( i == na ||
+			MDB_IDL_BM_IDX( wa[i] ) > MDB_IDL_BM_IDX( wb[j] )) {
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+		n++;
+	}
+	if ( n > MDB_IDL_BM_LIMIT )
+		return -1;
+	if ( n > MDB_IDL_BM_MAXWORDS )
+		wc = ch_malloc( n * sizeof(ID) );
+	else
+		wc = wa;
+
+	k = n;
+	while ( k > 0 ) {
+		if ( j == 0 || ( i > 0 &&
+			MDB_IDL_BM_IDX( wa[i-1] ) > MDB_IDL_BM_IDX( wb[j-1] ))) {
+			wc[--k] = wa[--i];
+		} else if ( i == 0 ||
+			MDB_IDL_BM_IDX( wa[i-1] ) < MDB_IDL_BM_IDX( wb[j-1] )) {
+			wc[--k] = wb[--j];
+		} else {
+			--i;
+			--j;
+			wc[--k] = wa[i] | wb[j];
+		}
+	}
+	if ( wc != wa && MDB_IDL_BM_EXTERN( a ))
+		ch_free( wa );
+	idl_bm_set( a, wc, n );
+	return 0;
+}
+#endif /* MDB_IDL_BITMAPS */
+
+/* Test whether id is a member of a bitmap. Plain ranges and lists
+ * are not checked.
+ */
+int mdb_idl_bm_test( ID *ids, ID id )
+{
+#ifdef MDB_IDL_BITMAPS
+	if ( MDB_IDL_IS_BITMAP( ids ))
+		return idl_bm_next( ids, id ) == id;
+#endif
+	return 1;
+}
+
+/* Free the words of a bitmap that are kept outside its buffer. The
+ * IDL is left a plain range.
+ */
+void mdb_idl_free( ID *ids )
+{
+	if ( MDB_IDL_IS_RANGE( ids ) && MDB_IDL_BM_EXTERN( ids )) {
+		ch_free( (ID *) ids[MDB_IDL_BM_HDR] );
+		ids[3] = 0;
+	}
+}
+
+/* Copy an IDL, giving dst its own copy of any outside words */
+void mdb_idl_copy( ID *dst, ID *src )
+{
+	AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ));
+	if ( MDB_IDL_IS_RANGE( src ) && MDB_IDL_BM_EXTERN( src )) {
+		ID *w = ch_malloc( src[3] * sizeof(ID) );
+		AC_MEMCPY( w, MDB_IDL_BM_WORDS( src ), src[3] * sizeof(ID) );
+		dst[MDB_IDL_BM_HDR] = (ID) w;
+	}
+}
+
 int mdb_idl_insert( ID *ids, ID id )
 {
 	unsigned x;
@@ -137,6 +529,13 @@ int mdb_idl_insert( ID *ids, ID id )
 #endif
 
 	if (MDB_IDL_IS_RANGE( ids )) {
+		if ( MDB_IDL_IS_BITMAP( ids )) {
+			if ( mdb_idl_bm_test( ids, id ))
+				return -1;
+			/* the bitmap can't grow here, keep just the range */
+			mdb_idl_free( ids );
+			ids[3] = 0;
+		}
 		/* if already in range, treat as a dup */
 		if (id >= MDB_IDL_RANGE_FIRST(ids) && id <= MDB_IDL_RANGE_LAST(ids))
 			return -1;
@@ -170,6 +569,7 @@ int mdb_idl_insert( ID *ids, ID id )
 			ids[2] = ids[ids[0]-1];
 		}
 		ids[0] = NOID;
+		ids[3] = 0;
 	
 	} else {
 		/* insert id */
@@ -332,25 +732,79 @@ mdb_idl_fetch_key(
 		rc = MDB_NOTFOUND;
 	}
 	if (rc == 0) {
-		i = ids+1;
-		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
-		while (rc == 0) {
-			memcpy( i, data.mv_data, data.mv_size );
-			i += data.mv_size / sizeof(ID);
-			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
-		}
-		if ( rc == MDB_NOTFOUND ) rc = 0;
-		ids[0] = i - &ids[1];
-		/* On disk, a range is denoted by 0 in the first element */
-		if (ids[1] == 0) {
-			if (ids[0] != MDB_IDL_RANGE_SIZE) {
+		ID first;
+		size_t count = 0;
+
+		memcpy( &first, data.mv_data, sizeof(ID) );
+		/* On disk, a range is denoted by 0 in the first element.
+		 * Any items after its lo and hi are the words of its bitmap.
+		 */
+		if ( first == 0 ) {
+			rc = mdb_cursor_count( cursor, &count );
+			if ( rc == 0 && count < MDB_IDL_RANGE_SIZE ) {
 				Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
 					"range size mismatch: expected %d, got %ld\n",
-					MDB_IDL_RANGE_SIZE, ids[0], 0 );
+					MDB_IDL_RANGE_SIZE, (long) count, 0 );
 				mdb_cursor_close( cursor );
 				return -1;
 			}
-			MDB_IDL_RANGE( ids, ids[2], ids[3] );
+		}
+		if ( rc ) {
+			/* cursor count failed */
+#ifdef MDB_IDL_BITMAPS
+		} else if ( count && ( count == MDB_IDL_RANGE_SIZE ||
+			count - MDB_IDL_RANGE_SIZE > MDB_IDL_BM_LIMIT )) {
+#else
+		} else if ( count ) {
+#endif
+			/* a plain range, or a bitmap too large to hold */
+			ID lo, hi;
+			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &lo, data.mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				memcpy( &hi, data.mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( cursor, key, &data, MDB_LAST_DUP );
+			}
+			if ( rc == 0 )
+				MDB_IDL_RANGE( ids, lo, hi );
+		} else {
+			/* The items of a bitmap are read so that the words
+			 * land right after the in-memory header, or into an
+			 * array of their own if the buffer can't hold them.
+			 */
+			ID *ext = NULL;
+#ifdef MDB_IDL_BITMAPS
+			if ( count && count - MDB_IDL_RANGE_SIZE > MDB_IDL_BM_MAXWORDS )
+				i = ext = ch_malloc( count * sizeof(ID) );
+			else
+#endif
+			i = count ? ids+2 : ids+1;
+			rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+			while (rc == 0) {
+				memcpy( i, data.mv_data, data.mv_size );
+				i += data.mv_size / sizeof(ID);
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+			}
+			if ( rc == MDB_NOTFOUND ) rc = 0;
+			ids[0] = ext ? 0 : i - &ids[1];
+#ifdef MDB_IDL_BITMAPS
+			if ( ext && rc ) {
+				ch_free( ext );
+			} else if ( count ) {
+				ids[0] = NOID;
+				ids[3] = count - MDB_IDL_RANGE_SIZE;
+				if ( ext ) {
+					memmove( ext, ext + MDB_IDL_RANGE_SIZE,
+						ids[3] * sizeof(ID) );
+					ids[MDB_IDL_BM_HDR] = (ID) ext;
+				}
+				idl_bm_fix( ids );
+				idl_bm_shrink( ids );
+			}
+#endif
 		}
 		data.mv_size = MDB_IDL_SIZEOF(ids);
 	}
@@ -389,6 +843,362 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/* Position a cursor on a key and tell what it holds: a list of IDs,
+ * a plain range, or a bitmap. lo and hi are set to the bounds of a
+ * range or bitmap. count is set to the number of IDs, which for a
+ * range is its span and for a bitmap is capped by the bits its words
+ * can hold. items is set to the number of dups of the key.
+ */
+int
+mdb_idl_key_shape(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	int			*kind,
+	ID			*lo,
+	ID			*hi,
+	ID			*count,
+	ID			*items )
+{
+	MDB_val k = *key, data;
+	size_t n = 0;
+	ID first;
+	int rc;
+
+	rc = mdb_cursor_get( cursor, &k, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_cursor_count( cursor, &n );
+	if ( rc )
+		return rc;
+
+	*items = n;
+	memcpy( &first, data.mv_data, sizeof(ID) );
+	if ( first ) {
+		*kind = MDB_IDL_KEY_LIST;
+		*lo = first;
+		*hi = NOID;
+		*count = n;
+		return 0;
+	}
+	if ( n < MDB_IDL_RANGE_SIZE )
+		return -1;
+
+	rc = mdb_cursor_get( cursor, &k, &data, MDB_NEXT_DUP );
+	if ( rc == 0 ) {
+		memcpy( lo, data.mv_data, sizeof(ID) );
+		rc = mdb_cursor_get( cursor, &k, &data, MDB_NEXT_DUP );
+	}
+	if ( rc )
+		return rc;
+	memcpy( hi, data.mv_data, sizeof(ID) );
+	*kind = MDB_IDL_KEY_RANGE;
+	*count = *hi - *lo + 1;
+#ifdef MDB_IDL_BITMAPS
+	if ( n > MDB_IDL_RANGE_SIZE ) {
+		*kind = MDB_IDL_KEY_BITMAP;
+		if ( ( n - MDB_IDL_RANGE_SIZE ) * MDB_IDL_BM_BITS < *count )
+			*count = ( n - MDB_IDL_RANGE_SIZE ) * MDB_IDL_BM_BITS;
+	}
+#endif
+	return 0;
+}
+
+/* Size up the IDL of a key from its item count, without reading it.
+ * A list is counted exactly. A range counts its span, which for a
+ * bitmap is capped by the bits its words can hold. items is set to
+ * the number of items that reading the key would copy.
+ */
+int
+mdb_idl_count_key(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count,
+	ID			*items )
+{
+	MDB_cursor *cursor;
+	ID lo, hi;
+	int rc, kind;
+
+	*count = *items = 0;
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc )
+		return rc;
+	rc = mdb_idl_key_shape( cursor, key, &kind, &lo, &hi, count, items );
+	mdb_cursor_close( cursor );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
+/* Find the first member >= id of a list key, without reading the rest.
+ * On input next is the member the cursor is on, or NOID if it is not
+ * on one; if id comes right after it the cursor is just stepped. On
+ * output next is the member found, or NOID if there is none.
+ */
+int
+mdb_idl_seek_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	ID			*next )
+{
+	MDB_val k = *key, data;
+	int rc;
+
+	data.mv_data = &id;
+	data.mv_size = sizeof(ID);
+	if ( *next != NOID && *next + 1 == id )
+		rc = mdb_cursor_get( cursor, &k, &data, MDB_NEXT_DUP );
+	else
+		rc = mdb_cursor_get( cursor, &k, &data, MDB_GET_BOTH_RANGE );
+	if ( rc == 0 ) {
+		memcpy( next, data.mv_data, sizeof(ID) );
+	} else if ( rc == MDB_NOTFOUND ) {
+		*next = NOID;
+		rc = 0;
+	}
+	return rc;
+}
+
+#ifdef MDB_IDL_BITMAPS
+/* Find the first member >= id of a bitmap key, reading only the words
+ * from there on. word is the word the cursor is on, or 0 if it is not
+ * on one, and is updated; words ahead of the cursor are stepped to.
+ */
+int
+mdb_idl_bm_seek_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	ID			*word,
+	ID			*next )
+{
+	MDB_val k = *key, data;
+	ID w, x = id >> MDB_IDL_BM_SHIFT, m;
+	int rc = 0;
+
+	if ( *word && MDB_IDL_BM_IDX( *word ) >= x ) {
+		w = *word;
+	} else if ( *word && MDB_IDL_BM_IDX( *word ) + 1 == x ) {
+		rc = mdb_cursor_get( cursor, &k, &data, MDB_NEXT_DUP );
+		if ( rc == 0 )
+			memcpy( &w, data.mv_data, sizeof(ID) );
+	} else {
+		w = MDB_IDL_BM_WORD( x, 0 );
+		data.mv_data = &w;
+		data.mv_size = sizeof(ID);
+		rc = mdb_cursor_get( cursor, &k, &data, MDB_GET_BOTH_RANGE );
+		if ( rc == 0 )
+			memcpy( &w, data.mv_data, sizeof(ID) );
+	}
+
+	while ( rc == 0 ) {
+		m = MDB_IDL_BM_BITMASK( w );
+		if ( MDB_IDL_BM_IDX( w ) == x )
+			m &= ~( IDL_BM_BIT( id ) - 1 );
+		else if ( MDB_IDL_BM_IDX( w ) < x )
+			m = 0;
+		if ( m ) {
+			*word = w;
+			*next = IDL_BM_MEMBER( MDB_IDL_BM_IDX( w ), m );
+			return 0;
+		}
+		rc = mdb_cursor_get( cursor, &k, &data, MDB_NEXT_DUP );
+		if ( rc == 0 )
+			memcpy( &w, data.mv_data, sizeof(ID) );
+	}
+	*word = 0;
+	if ( rc == MDB_NOTFOUND ) {
+		*next = NOID;
+		rc = 0;
+	}
+	return rc;
+}
+#endif
+
+#ifdef MDB_IDL_BITMAPS
+/* Convert a full list key into a bitmap key holding the list and id.
+ * The cursor must be on the key.
+ */
+static int
+idl_bm_store_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	char		**err )
+{
+	MDB_val k2, data, mdata[2];
+	ID *ids, *i, x;
+	int rc;
+
+	ids = ch_malloc( MDB_IDL_UM_SIZEOF );
+	i = ids+1;
+	*err = "c_get multiple";
+	/* these may point k2 into the page, key must stay intact */
+	k2 = *key;
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		memcpy( i, data.mv_data, data.mv_size );
+		i += data.mv_size / sizeof(ID);
+		rc = mdb_cursor_get( cursor, &k2, &data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND )
+		goto done;
+	ids[0] = i - &ids[1];
+	x = mdb_idl_search( ids, id );
+	if ( x > ids[0] || ids[x] != id ) {
+		AC_MEMCPY( &ids[x+1], &ids[x], (ids[0]+1-x) * sizeof(ID) );
+		ids[x] = id;
+		ids[0]++;
+	}
+	*err = "bitmap";
+	rc = idl_list2bm( ids );
+	if ( rc != 0 )
+		goto done;
+
+	/* delete the old key */
+	*err = "c_del dups";
+	rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+	if ( rc != 0 )
+		goto done;
+
+	/* Store the range, followed by the words */
+	data.mv_size = sizeof(ID);
+	*err = "c_put range";
+	x = 0;
+	data.mv_data = &x;
+	rc = mdb_cursor_put( cursor, key, &data, 0 );
+	if ( rc == 0 ) {
+		data.mv_data = &ids[1];
+		rc = mdb_cursor_put( cursor, key, &data, 0 );
+	}
+	if ( rc == 0 ) {
+		data.mv_data = &ids[2];
+		rc = mdb_cursor_put( cursor, key, &data, 0 );
+	}
+	if ( rc == 0 ) {
+		*err = "c_put words";
+		mdata[0].mv_size = sizeof(ID);
+		mdata[0].mv_data = MDB_IDL_BM_WORDS( ids );
+		mdata[1].mv_size = MDB_IDL_BM_NWORDS( ids );
+		rc = mdb_cursor_put( cursor, key, mdata, MDB_MULTIPLE );
+	}
+done:
+	ch_free( ids );
+	return rc;
+}
+
+/* Set or clear the bit for id in a bitmap key. The range items are
+ * left alone.
+ */
+static int
+idl_bm_update_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	int			set )
+{
+	MDB_val data;
+	ID w, bit = IDL_BM_BIT( id );
+	int rc;
+
+	w = MDB_IDL_BM_WORD( id >> MDB_IDL_BM_SHIFT, 0 );
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	rc = mdb_cursor_get( cursor, key, &data, MDB_GET_BOTH_RANGE );
+	if ( rc == 0 ) {
+		memcpy( &w, data.mv_data, sizeof(ID) );
+		if ( MDB_IDL_BM_IDX( w ) != id >> MDB_IDL_BM_SHIFT )
+			rc = MDB_NOTFOUND;
+	}
+	if ( rc == MDB_NOTFOUND ) {
+		if ( !set )
+			return 0;
+		w = MDB_IDL_BM_WORD( id >> MDB_IDL_BM_SHIFT, bit );
+		data.mv_size = sizeof(ID);
+		data.mv_data = &w;
+		return mdb_cursor_put( cursor, key, &data, 0 );
+	}
+	if ( rc != 0 || !( w & bit ) == !set )
+		return rc;
+
+	/* Replacing a word keeps its place, its index is unchanged */
+	w ^= bit;
+	if ( !MDB_IDL_BM_BITMASK( w ))
+		return mdb_cursor_del( cursor, 0 );
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	return mdb_cursor_put( cursor, key, &data, MDB_CURRENT );
+}
+
+/* After deleting a boundary member of a bitmap key, move lo and hi
+ * to the actual first and last members that remain.
+ */
+static int
+idl_bm_bounds_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			lo,
+	ID			hi )
+{
+	MDB_val data;
+	ID w, lo2, hi2;
+	int rc;
+
+	w = MDB_IDL_BM_FLAG;
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	rc = mdb_cursor_get( cursor, key, &data, MDB_GET_BOTH_RANGE );
+	if ( rc == MDB_NOTFOUND ) {
+		/* no members left */
+		rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+		if ( rc == 0 )
+			rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+		return rc;
+	}
+	if ( rc != 0 )
+		return rc;
+	memcpy( &w, data.mv_data, sizeof(ID) );
+	lo2 = IDL_BM_MEMBER( MDB_IDL_BM_IDX( w ), MDB_IDL_BM_BITMASK( w ));
+	rc = mdb_cursor_get( cursor, key, &data, MDB_LAST_DUP );
+	if ( rc != 0 )
+		return rc;
+	memcpy( &w, data.mv_data, sizeof(ID) );
+	hi2 = ( MDB_IDL_BM_IDX( w ) << MDB_IDL_BM_SHIFT ) +
+		idl_bm_highbit( MDB_IDL_BM_BITMASK( w ));
+
+	if ( lo2 == hi2 ) {
+		/* a single member left, store it as a list */
+		rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+		if ( rc == 0 ) {
+			data.mv_size = sizeof(ID);
+			data.mv_data = &lo2;
+			rc = mdb_cursor_put( cursor, key, &data, 0 );
+		}
+		return rc;
+	}
+
+	data.mv_size = sizeof(ID);
+	if ( lo2 != lo ) {
+		data.mv_data = &lo;
+		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_BOTH );
+		if ( rc == 0 ) {
+			data.mv_data = &lo2;
+			rc = mdb_cursor_put( cursor, key, &data, MDB_CURRENT );
+		}
+	}
+	if ( rc == 0 && hi2 != hi ) {
+		data.mv_data = &hi;
+		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_BOTH );
+		if ( rc == 0 ) {
+			data.mv_data = &hi2;
+			rc = mdb_cursor_put( cursor, key, &data, MDB_CURRENT );
+		}
+	}
+	return rc;
+}
+#endif /* MDB_IDL_BITMAPS */
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -397,7 +1207,7 @@ mdb_idl_insert_keys(
 	ID			id )
 {
 	struct mdb_info *mdb = be->be_private;
-	MDB_val key, data;
+	MDB_val key, key0, data;
 	ID lo, hi, *i;
 	char *err;
 	int	rc = 0, k;
@@ -434,6 +1244,8 @@ mdb_idl_insert_keys(
 		key.mv_size = keys[k].bv_len;
 		key.mv_data = keys[k].bv_val;
 	}
+	/* key may be repointed into the page by cursor ops */
+	key0 = key;
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
 	err = "c_get";
 	if ( rc == 0 ) {
@@ -448,6 +1260,16 @@ mdb_idl_insert_keys(
 				goto fail;
 			}
 			if ( count >= MDB_IDL_DB_MAX ) {
+#ifdef MDB_IDL_BITMAPS
+			/* No room, convert to a bitmap */
+				if ( id <= MDB_IDL_BM_MAXID &&
+					( mdb->mi_flags & MDB_BITMAP_KEYS )) {
+					rc = idl_bm_store_key( cursor, &key0, id, &err );
+					if ( rc != 0 )
+						goto fail;
+					continue;
+				}
+#endif
 			/* No room, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
@@ -500,8 +1322,14 @@ mdb_idl_insert_keys(
 			/* It's a range, see if we need to rewrite
 			 * the boundaries
 			 */
+			size_t count;
 			lo = i[1];
 			hi = i[2];
+			rc = mdb_cursor_count( cursor, &count );
+			if ( rc != 0 ) {
+				err = "c_count";
+				goto fail;
+			}
 			if ( id < lo || id > hi ) {
 				/* position on lo */
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
@@ -526,6 +1354,32 @@ mdb_idl_insert_keys(
 					goto fail;
 				}
 			}
+#ifdef MDB_IDL_BITMAPS
+			/* If it has a bitmap, add the member */
+			if ( count > MDB_IDL_RANGE_SIZE ) {
+				if ( id > MDB_IDL_BM_MAXID ||
+					count - MDB_IDL_RANGE_SIZE >= MDB_IDL_BM_LIMIT ) {
+					/* Too large for the bitmap, keep just the range */
+					ID r[MDB_IDL_RANGE_SIZE];
+					int j;
+					r[0] = 0;
+					r[1] = IDL_MIN( lo, id );
+					r[2] = IDL_MAX( hi, id );
+					rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+					data.mv_size = sizeof(ID);
+					for ( j = 0; rc == 0 && j < MDB_IDL_RANGE_SIZE; j++ ) {
+						data.mv_data = &r[j];
+						rc = mdb_cursor_put( cursor, &key0, &data, 0 );
+					}
+				} else {
+					rc = idl_bm_update_key( cursor, &key0, id, 1 );
+				}
+				if ( rc != 0 ) {
+					err = "c_put bitmap";
+					goto fail;
+				}
+			}
+#endif
 		}
 	} else if ( rc == MDB_NOTFOUND ) {
 		flag &= ~MDB_APPENDDUP;
@@ -558,7 +1412,7 @@ mdb_idl_delete_keys(
 	ID			id )
 {
 	int	rc = 0, k;
-	MDB_val key, data;
+	MDB_val key, key0, data;
 	ID lo, hi, tmp, *i;
 	char *err;
 #ifndef	MISALIGNED_OK
@@ -592,6 +1446,8 @@ mdb_idl_delete_keys(
 		key.mv_size = keys[k].bv_len;
 		key.mv_data = keys[k].bv_val;
 	}
+	/* key may be repointed into the page by cursor ops */
+	key0 = key;
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
 	err = "c_get";
 	if ( rc == 0 ) {
@@ -616,6 +1472,31 @@ mdb_idl_delete_keys(
 			 */
 			lo = i[1];
 			hi = i[2];
+#ifdef MDB_IDL_BITMAPS
+			{
+				size_t count;
+				rc = mdb_cursor_count( cursor, &count );
+				if ( rc != 0 ) {
+					err = "c_count";
+					goto fail;
+				}
+				/* With a bitmap, clear the member and keep
+				 * the boundaries exact
+				 */
+				if ( count > MDB_IDL_RANGE_SIZE ) {
+					if ( id > MDB_IDL_BM_MAXID )
+						continue;
+					rc = idl_bm_update_key( cursor, &key0, id, 0 );
+					if ( rc == 0 && ( id == lo || id == hi ))
+						rc = idl_bm_bounds_key( cursor, &key0, lo, hi );
+					if ( rc != 0 ) {
+						err = "c_del bitmap";
+						goto fail;
+					}
+					continue;
+				}
+			}
+#endif
 			if ( id == lo || id == hi ) {
 				ID lo2 = lo, hi2 = hi;
 				if ( id == lo ) {
@@ -674,12 +1555,12 @@ mdb_idl_intersection(
 	ID *a,
 	ID *b )
 {
-	ID ida, idb;
 	ID idmax, idmin;
-	ID cursora = 0, cursorb = 0, cursorc;
+	unsigned cursora, cursorb, cursorc;
 	int swap = 0;
 
 	if ( MDB_IDL_IS_ZERO( a ) || MDB_IDL_IS_ZERO( b ) ) {
+		mdb_idl_free( a );
 		a[0] = 0;
 		return 0;
 	}
@@ -687,9 +1568,11 @@ mdb_idl_intersection(
 	idmin = IDL_MAX( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 	idmax = IDL_MIN( MDB_IDL_LAST(a), MDB_IDL_LAST(b) );
 	if ( idmin > idmax ) {
+		mdb_idl_free( a );
 		a[0] = 0;
 		return 0;
 	} else if ( idmin == idmax ) {
+		mdb_idl_free( a );
 		a[0] = 1;
 		a[1] = idmin;
 		return 0;
@@ -697,6 +1580,19 @@ mdb_idl_intersection(
 
 	if ( MDB_IDL_IS_RANGE( a ) ) {
 		if ( MDB_IDL_IS_RANGE(b) ) {
+#ifdef MDB_IDL_BITMAPS
+			if ( MDB_IDL_IS_BITMAP( a ) || MDB_IDL_IS_BITMAP( b )) {
+			/* A plain range just clips the other side's bitmap */
+				if ( !MDB_IDL_IS_BITMAP( a ))
+					MDB_IDL_CPY( a, b );
+				else if ( MDB_IDL_IS_BITMAP( b ))
+					idl_bm_and( a, b );
+				if ( !MDB_IDL_IS_ZERO( a ))
+					idl_bm_clip( a, idmin, idmax );
+				idl_bm_shrink( a );
+				return 0;
+			}
+#endif
 		/* If both are ranges, just shrink the boundaries */
 			a[1] = idmin;
 			a[2] = idmax;
@@ -713,35 +1609,39 @@ mdb_idl_intersection(
 	/* If a range completely covers the list, the result is
 	 * just the list.
 	 */
-	if ( MDB_IDL_IS_RANGE( b )
+	if ( MDB_IDL_IS_RANGE( b ) && !MDB_IDL_IS_BITMAP( b )
 		&& MDB_IDL_RANGE_FIRST( b ) <= MDB_IDL_FIRST( a )
 		&& MDB_IDL_RANGE_LAST( b ) >= MDB_IDL_LLAST( a ) ) {
 		goto done;
 	}
 
-	/* Fine, do the intersection one element at a time.
-	 * First advance to idmin in both IDLs.
-	 */
-	cursora = cursorb = idmin;
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-	cursorc = 0;
+#ifdef MDB_IDL_BITMAPS
+	/* Probe the bitmap for each member of the list */
+	if ( MDB_IDL_IS_BITMAP( b )) {
+		idl_bm_filter( a, b, 1 );
+		goto done;
+	}
+#endif
 
-	while( ida <= idmax || idb <= idmax ) {
-		if( ida == idb ) {
-			a[++cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		} else if ( ida < idb ) {
-			ida = mdb_idl_next( a, &cursora );
-		} else {
-			idb = mdb_idl_next( b, &cursorb );
-		}
+	/* Clip the list to idmin..idmax. That is all a plain range
+	 * needs; two lists are handed to the merge kernels.
+	 */
+	cursora = mdb_idl_search( a, idmin );
+	cursorc = mdb_idl_search( a, idmax + 1 ) - cursora;
+	if ( MDB_IDL_IS_RANGE( b ) ) {
+		if ( cursora > 1 )
+			AC_MEMCPY( a+1, a+cursora, cursorc * sizeof(ID) );
+		a[0] = cursorc;
+	} else {
+		cursorb = mdb_idl_search( b, idmin );
+		a[0] = mdb_idl_isect_lists( a+cursora, cursorc,
+			b+cursorb, mdb_idl_search( b, idmax + 1 ) - cursorb, a+1 );
 	}
-	a[0] = cursorc;
 done:
-	if (swap)
+	if (swap) {
+		mdb_idl_free( b );
 		MDB_IDL_CPY( b, a );
+	}
 
 	return 0;
 }
@@ -768,11 +1668,26 @@ mdb_idl_union(
 	}
 
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ) {
+#ifdef MDB_IDL_BITMAPS
+		/* Only a plain range loses the members */
+		if (( !MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_BITMAP( a )) &&
+			( !MDB_IDL_IS_RANGE( b ) || MDB_IDL_IS_BITMAP( b )))
+			goto bitmap;
+#endif
 over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		idb = IDL_MAX( MDB_IDL_LAST(a), MDB_IDL_LAST(b) );
-		a[0] = NOID;
-		a[1] = ida;
-		a[2] = idb;
+		mdb_idl_free( a );
+		MDB_IDL_RANGE( a, ida, idb );
+		return 0;
+	}
+
+	/* If the result is sure to fit, move a up to the end of its
+	 * buffer and let the kernels merge both lists down into place.
+	 */
+	if ( a[0] + b[0] + MDB_IDL_KERNEL_PAD < MDB_IDL_UM_SIZE ) {
+		ID *tail = a + MDB_IDL_UM_SIZE - a[0];
+		AC_MEMCPY( tail, a+1, a[0] * sizeof(ID) );
+		a[0] = mdb_idl_union_lists( tail, a[0], b+1, b[0], a+1 );
 		return 0;
 	}
 
@@ -785,7 +1700,11 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 	while( ida != NOID || idb != NOID ) {
 		if ( ida < idb ) {
 			if( ++cursorc > MDB_IDL_UM_MAX ) {
+#ifdef MDB_IDL_BITMAPS
+				goto bitmap;
+#else
 				goto over;
+#endif
 			}
 			b[cursorc] = ida;
 			ida = mdb_idl_next( a, &cursora );
@@ -816,48 +1735,66 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 	}
 
 	return 0;
+
+#ifdef MDB_IDL_BITMAPS
+bitmap:
+	if ( idl_bm_or( a, b ))
+		goto over;
+	idl_bm_shrink( a );
+	return 0;
+#endif
 }
 
 
-#if 0
 /*
- * mdb_idl_notin - return a intersection ~b (or a minus b)
+ * mdb_idl_notin - return a = a intersection ~b (or a minus b)
+ *
+ * A plain range in b is only a bound on its members, so nothing can
+ * be removed for it.
  */
 int
 mdb_idl_notin(
 	ID	*a,
-	ID	*b,
-	ID *ids )
+	ID	*b )
 {
 	ID ida, idb;
-	ID cursora = 0, cursorb = 0;
+	ID cursora = 0, cursorb = 0, cursorc;
 
 	if( MDB_IDL_IS_ZERO( a ) ||
 		MDB_IDL_IS_ZERO( b ) ||
-		MDB_IDL_IS_RANGE( b ) )
+		( MDB_IDL_IS_RANGE( b ) && !MDB_IDL_IS_BITMAP( b )) ||
+		MDB_IDL_LAST( b ) < MDB_IDL_FIRST( a ) ||
+		MDB_IDL_FIRST( b ) > MDB_IDL_LAST( a ))
 	{
-		MDB_IDL_CPY( ids, a );
 		return 0;
 	}
 
 	if( MDB_IDL_IS_RANGE( a ) ) {
-		MDB_IDL_CPY( ids, a );
+#ifdef MDB_IDL_BITMAPS
+		if ( !MDB_IDL_IS_BITMAP( a ) && idl_range2bm( a ))
+			return 0;
+		if ( !MDB_IDL_IS_RANGE( b ) && idl_list2bm( b ))
+			return 0;
+		idl_bm_andnot( a, b );
+		idl_bm_shrink( a );
+#endif
 		return 0;
 	}
 
+#ifdef MDB_IDL_BITMAPS
+	if ( MDB_IDL_IS_BITMAP( b )) {
+		idl_bm_filter( a, b, 0 );
+		return 0;
+	}
+#endif
+
 	ida = mdb_idl_first( a, &cursora ),
 	idb = mdb_idl_first( b, &cursorb );
-
-	ids[0] = 0;
+	cursorc = 0;
 
 	while( ida != NOID ) {
-		if ( idb == NOID ) {
-			/* we could shortcut this */
-			ids[++ids[0]] = ida;
-			ida = mdb_idl_next( a, &cursora );
-
-		} else if ( ida < idb ) {
-			ids[++ids[0]] = ida;
+		if ( idb == NOID || ida < idb ) {
+			a[++cursorc] = ida;
 			ida = mdb_idl_next( a, &cursora );
 
 		} else if ( ida > idb ) {
@@ -868,10 +1805,10 @@ mdb_idl_notin(
 			idb = mdb_idl_next( b, &cursorb );
 		}
 	}
+	a[0] = cursorc;
 
 	return 0;
 }
-#endif
 
 ID mdb_idl_first( ID *ids, ID *cursor )
 {
@@ -883,6 +1820,12 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 	}
 
 	if ( MDB_IDL_IS_RANGE( ids ) ) {
+#ifdef MDB_IDL_BITMAPS
+		if ( MDB_IDL_IS_BITMAP( ids )) {
+			*cursor = idl_bm_next( ids, *cursor );
+			return *cursor;
+		}
+#endif
 		if( *cursor < ids[1] ) {
 			*cursor = ids[1];
 		}
@@ -905,6 +1848,13 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 ID mdb_idl_next( ID *ids, ID *cursor )
 {
 	if ( MDB_IDL_IS_RANGE( ids ) ) {
+#ifdef MDB_IDL_BITMAPS
+		if ( MDB_IDL_IS_BITMAP( ids )) {
+			if ( *cursor != NOID )
+				*cursor = idl_bm_next( ids, *cursor + 1 );
+			return *cursor;
+		}
+#endif
 		if( ids[2] < ++(*cursor) ) {
 			return NOID;
 		}
@@ -925,6 +1875,12 @@ ID mdb_idl_next( ID *ids, ID *cursor )
 int mdb_idl_append_one( ID *ids, ID id )
 {
 	if (MDB_IDL_IS_RANGE( ids )) {
+		if ( MDB_IDL_IS_BITMAP( ids )) {
+			if ( mdb_idl_bm_test( ids, id ))
+				return -1;
+			mdb_idl_free( ids );
+			ids[3] = 0;
+		}
 		/* if already in range, treat as a dup */
 		if (id >= MDB_IDL_RANGE_FIRST(ids) && id <= MDB_IDL_RANGE_LAST(ids))
 			return -1;
@@ -952,6 +1908,7 @@ int mdb_idl_append_one( ID *ids, ID id )
 	if ( ids[0] >= MDB_IDL_UM_MAX ) {
 		ids[0] = NOID;
 		ids[2] = id;
+		ids[3] = 0;
 	} else {
 		ids[ids[0]] = id;
 	}
@@ -978,9 +1935,11 @@ int mdb_idl_append( ID *a, ID *b )
 	idb = MDB_IDL_LAST( b );
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ||
 		a[0] + b[0] >= MDB_IDL_UM_MAX ) {
+		mdb_idl_free( a );
 		a[2] = IDL_MAX( ida, idb );
 		a[1] = IDL_MIN( a[1], b[1] );
 		a[0] = NOID;
+		a[3] = 0;
 		return 0;
 	}
 
@@ -32,8 +32,55 @@
 #define MDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
+
+/* A range may carry a bitmap of its actual members, so that sets too
+ * large for a list stay exact. In memory the layout is
+ *   NOID, first, last, nwords, count, words...
+ * and a plain range has nwords == 0. Each word holds 32 IDs: the word
+ * index (id >> 5) in its upper half, the member bits in its lower half,
+ * and the top bit set so that on disk the words sort after the 0, lo, hi
+ * items of a range key. Bitmaps need a 64 bit ID.
+ */
+#if SIZEOF_LONG >= 8
+#define MDB_IDL_BITMAPS	1
+#endif
+
+#define MDB_IDL_BM_HDR		5
+#define MDB_IDL_BM_SHIFT	5
+#define MDB_IDL_BM_BITS		(1<<MDB_IDL_BM_SHIFT)
+#define MDB_IDL_BM_MAXWORDS	(MDB_IDL_UM_SIZE - MDB_IDL_BM_HDR)
+#define MDB_IDL_BM_LIMIT	(1<<24)
+#define MDB_IDL_BM_FLAG		((ID)1 << (sizeof(ID)*8-1))
+#define MDB_IDL_BM_MAXID	((MDB_IDL_BM_FLAG >> (32-MDB_IDL_BM_SHIFT)) - 1)
+#define MDB_IDL_BM_IDX(w)	(((w) & ~MDB_IDL_BM_FLAG) >> 32)
+#define MDB_IDL_BM_BITMASK(w)	((w) & 0xffffffffUL)
+#define MDB_IDL_BM_WORD(x, m)	(MDB_IDL_BM_FLAG | ((ID)(x) << 32) | (m))
+
+#define MDB_IDL_BM_NWORDS(ids)	((ids)[3])
+#define MDB_IDL_BM_COUNT(ids)	((ids)[4])
+/* A bitmap with more words than an IDL buffer holds keeps them in an
+ * array of their own, pointed to by the slot after the header. Whoever
+ * holds such an IDL frees the array with #mdb_idl_free. Past
+ * MDB_IDL_BM_LIMIT words a set is kept as a plain range.
+ */
+#define MDB_IDL_BM_EXTERN(ids)	((ids)[3] > MDB_IDL_BM_MAXWORDS)
+#define MDB_IDL_BM_WORDS(ids)	(MDB_IDL_BM_EXTERN(ids) \
+	? (ID *)(ids)[MDB_IDL_BM_HDR] : (ids)+MDB_IDL_BM_HDR)
+#define MDB_IDL_IS_BITMAP(ids)	(MDB_IDL_IS_RANGE(ids) && (ids)[3])
+
+/* What an index key holds, from #mdb_idl_key_shape */
+#define MDB_IDL_KEY_LIST	0
+#define MDB_IDL_KEY_RANGE	1
+#define MDB_IDL_KEY_BITMAP	2
+
 #define MDB_IDL_SIZEOF(ids)		((MDB_IDL_IS_RANGE(ids) \
-	? MDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
+	? MDB_IDL_BM_HDR + (MDB_IDL_BM_EXTERN(ids) ? 1 : (ids)[3]) \
+	: ((ids)[0]+1)) * sizeof(ID))
+
+/* The memory an IDL holds, with any outside words */
+#define MDB_IDL_MEMSIZE(ids)	(MDB_IDL_SIZEOF(ids) + \
+	(MDB_IDL_IS_RANGE(ids) && MDB_IDL_BM_EXTERN(ids) \
+	? (ids)[3] * sizeof(ID) : 0))
 
 #define MDB_IDL_RANGE_FIRST(ids)	((ids)[1])
 #define MDB_IDL_RANGE_LAST(ids)		((ids)[2])
@@ -43,6 +90,7 @@
 		(ids)[0] = NOID; \
 		(ids)[1] = (f);  \
 		(ids)[2] = (l);  \
+		(ids)[3] = 0;    \
 	} while(0)
 
 #define MDB_IDL_ZERO(ids) \
@@ -56,7 +104,7 @@
 #define MDB_IDL_IS_ALL( range, ids ) ( (ids)[0] == NOID \
 	&& (ids)[1] <= (range)[1] && (range)[2] <= (ids)[2] )
 
-#define MDB_IDL_CPY( dst, src ) (AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ) ))
+#define MDB_IDL_CPY( dst, src ) mdb_idl_copy( dst, src )
 
 #define MDB_IDL_ID( mdb, ids, id ) MDB_IDL_RANGE( ids, id, NOID )
 #define MDB_IDL_ALL( ids ) MDB_IDL_RANGE( ids, 1, NOID )
@@ -67,7 +115,7 @@
 	? (ids)[2] : (ids)[(ids)[0]] )
 
 #define MDB_IDL_N( ids )		( MDB_IDL_IS_RANGE(ids) \
-	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
+	? ( (ids)[3] ? (ids)[4] : ((ids)[2]-(ids)[1])+1 ) : (ids)[0] )
 
 	/** An ID2 is an ID/value pair.
 	 */
@@ -111,6 +159,60 @@ unsigned mdb_id2l_search( ID2L ids, ID id );
 	 * @return	0 on success, -1 if the ID was already present in the MIDL2.
 	 */
 int mdb_id2l_insert( ID2L ids, ID2 *id );
+
+	/** A merge kernel over two sorted, duplicate free ID arrays.
+	 * Arrays are bare, without the count in slot 0, and never hold NOID.
+	 * @param[in] a	The first array.
+	 * @param[in] na	The number of IDs in \b a.
+	 * @param[in] b	The second array.
+	 * @param[in] nb	The number of IDs in \b b.
+	 * @param[out] c	The result. For an intersection \b c may point at
+	 *	or below \b a. For a union \b c must not overlap \b b, and
+	 *	may only overlap \b a if it starts at least nb +
+	 *	#MDB_IDL_KERNEL_PAD slots below it.
+	 * @return	The number of IDs stored in \b c.
+	 */
+typedef unsigned (mdb_idl_kernel_func)( const ID *a, unsigned na,
+	const ID *b, unsigned nb, ID *c );
+
+	/** Vector stores may write this many slots past the result. */
+#define MDB_IDL_KERNEL_PAD	4
+
+	/** Arrays more than this many times larger than the other side
+	 * are probed by galloping instead of merged. A union has to copy
+	 * the large side anyway, so galloping pays off sooner there.
+	 */
+#define MDB_IDL_GALLOP_ISECT	32
+#define MDB_IDL_GALLOP_UNION	8
+
+	/** A set of kernels for one instruction set. */
+typedef struct mdb_idl_kernel {
+	const char *ik_name;
+	int (*ik_usable)( void );	/**< NULL if always usable */
+	mdb_idl_kernel_func *ik_isect;
+	mdb_idl_kernel_func *ik_union;
+} mdb_idl_kernel;
+
+	/** All kernels, best last, terminated by a NULL name.
+	 * The "gallop" entry is never picked by CPU; it is used for
+	 * skewed sizes by #mdb_idl_isect_lists and #mdb_idl_union_lists.
+	 */
+extern const mdb_idl_kernel mdb_idl_kernels[];
+
+	/** Pick the best kernel this CPU supports.
+	 * @return	The name of the kernel in use.
+	 */
+const char *mdb_idl_kernel_init( void );
+
+	/** Intersect two ID arrays with the current kernel, galloping
+	 * through the larger one if the sizes are skewed.
+	 */
+mdb_idl_kernel_func mdb_idl_isect_lists;
+
+	/** Merge two ID arrays with the current kernel, galloping
+	 * through the larger one if the sizes are skewed.
+	 */
+mdb_idl_kernel_func mdb_idl_union_lists;
 LDAP_END_DECL
 
 #endif
@@ -0,0 +1,230 @@
+/* idlbench.c - microbenchmark for the IDL merge kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Build with "make idlbench" in the back-mdb build directory. Each
+ * kernel the CPU supports is checked against the scalar one, with
+ * the same buffer aliasing idl.c uses, and then timed on a few
+ * synthetic ID distributions. "auto" is what slapd actually runs:
+ * the best kernel, or galloping for skewed sizes.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+/* This is a standalone program, it must not use slapd's ch_free */
+#define CH_FREE	1
+
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+typedef struct bench_dist {
+	const char *bd_name;
+	int bd_adiv;	/* a has n / adiv IDs */
+	int bd_spread;	/* IDs are drawn from 1..n * spread */
+	int bd_run;	/* IDs come in runs of this length */
+} bench_dist;
+
+static const bench_dist dists[] = {
+	{ "dense", 1, 2, 1 },
+	{ "sparse", 1, 64, 1 },
+	{ "clustered", 1, 8, 64 },
+	{ "skew-1:16", 16, 4, 1 },
+	{ "skew-1:256", 256, 4, 1 },
+	{ "alternating", 1, 0, 1 },
+	{ NULL }
+};
+
+static unsigned long long rnd_state = 88172645463325252ULL;
+
+static unsigned long
+rnd( void )
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+/* Fill ids with about n sorted IDs out of 1..range, in runs */
+static unsigned
+gen( ID *ids, unsigned n, unsigned long range, int run )
+{
+	unsigned long id;
+	unsigned k = 0;
+	int r;
+
+	for ( id = 1; id <= range && k < n; id += run ) {
+		if ( rnd() % range >= (unsigned long) n )
+			continue;
+		for ( r = 0; r < run && id + r <= range && k < n; r++ )
+			ids[k++] = id + r;
+	}
+	return k;
+}
+
+static double
+now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Return the ns per call of f, repeating it for at least 0.1s */
+static double
+bench( mdb_idl_kernel_func *f, ID *a, unsigned na, ID *b, unsigned nb, ID *c )
+{
+	double t0, t;
+	unsigned long i, iters = 1;
+
+	for (;;) {
+		t0 = now();
+		for ( i = 0; i < iters; i++ )
+			f( a, na, b, nb, c );
+		t = now() - t0;
+		if ( t >= 0.1 )
+			break;
+		iters *= t < 0.01 ? 10 : 2;
+	}
+	return t * 1e9 / iters;
+}
+
+static int
+check( const char *kernel, const char *op, ID *want, unsigned nwant,
+	ID *got, unsigned ngot )
+{
+	if ( ngot == nwant && !memcmp( want, got, ngot * sizeof(ID) ))
+		return 0;
+	fprintf( stderr, "%s %s: wrong result, %u IDs instead of %u\n",
+		kernel, op, ngot, nwant );
+	return 1;
+}
+
+static void
+usage( const char *name )
+{
+	fprintf( stderr, "usage: %s [-n size] [-k kernel] [-s seed]\n", name );
+	exit( EXIT_FAILURE );
+}
+
+int
+main( int argc, char **argv )
+{
+	const bench_dist *bd;
+	const mdb_idl_kernel *ik;
+	mdb_idl_kernel auto_kernel = { "auto", NULL,
+		mdb_idl_isect_lists, mdb_idl_union_lists };
+	const char *only = NULL;
+	unsigned n = MDB_IDL_DB_SIZE, na, nb, ni, nu, k;
+	ID *a, *b, *c, *isect, *uni;
+	int i, rc = 0;
+
+	while (( i = getopt( argc, argv, "k:n:s:" )) != EOF ) {
+		switch ( i ) {
+		case 'k':
+			only = optarg;
+			break;
+		case 'n':
+			n = strtoul( optarg, NULL, 0 );
+			if ( n < 1 || n > MDB_IDL_UM_SIZE / 2 - MDB_IDL_KERNEL_PAD ) {
+				fprintf( stderr, "size must be 1..%d\n",
+					MDB_IDL_UM_SIZE / 2 - MDB_IDL_KERNEL_PAD );
+				exit( EXIT_FAILURE );
+			}
+			break;
+		case 's':
+			rnd_state = strtoull( optarg, NULL, 0 ) | 1;
+			break;
+		default:
+			usage( argv[0] );
+		}
+	}
+
+	a = malloc( MDB_IDL_UM_SIZEOF );
+	b = malloc( MDB_IDL_UM_SIZEOF );
+	c = malloc( MDB_IDL_UM_SIZEOF );
+	isect = malloc( MDB_IDL_UM_SIZEOF );
+	uni = malloc( MDB_IDL_UM_SIZEOF );
+	if ( !a || !b || !c || !isect || !uni ) {
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	printf( "slapd uses the %s kernels\n\n", mdb_idl_kernel_init() );
+	printf( "%-12s %7s %7s %7s %7s  %-8s %12s %12s\n", "distribution",
+		"na", "nb", "a&b", "a|b", "kernel", "isect ns/ID", "union ns/ID" );
+
+	for ( bd = dists; bd->bd_name; bd++ ) {
+		if ( bd->bd_spread ) {
+			na = gen( a, n / bd->bd_adiv,
+				(unsigned long) n * bd->bd_spread, bd->bd_run );
+			nb = gen( b, n, (unsigned long) n * bd->bd_spread, bd->bd_run );
+		} else {
+			for ( na = 0; na < n; na++ ) {
+				a[na] = 2 * na + 1;
+				b[na] = 2 * na + 2;
+			}
+			nb = na;
+		}
+		if ( !na || !nb )
+			continue;
+
+		ni = mdb_idl_kernels[0].ik_isect( a, na, b, nb, isect );
+		nu = mdb_idl_kernels[0].ik_union( a, na, b, nb, uni );
+
+		for ( ik = mdb_idl_kernels; ; ik++ ) {
+			double ti, tu;
+
+			if ( !ik->ik_name )
+				ik = &auto_kernel;
+			if ( ik->ik_usable && !ik->ik_usable() )
+				continue;
+			if ( only && strcmp( only, ik->ik_name ))
+				goto next;
+
+			/* In place, the way idl.c calls them */
+			memcpy( c, a, na * sizeof(ID) );
+			k = ik->ik_isect( c, na, b, nb, c );
+			rc |= check( ik->ik_name, "isect", isect, ni, c, k );
+			memcpy( c + nb + MDB_IDL_KERNEL_PAD, a, na * sizeof(ID) );
+			k = ik->ik_union( c + nb + MDB_IDL_KERNEL_PAD, na, b, nb, c );
+			rc |= check( ik->ik_name, "union", uni, nu, c, k );
+
+			ti = bench( ik->ik_isect, a, na, b, nb, c );
+			tu = bench( ik->ik_union, a, na, b, nb, c );
+			printf( "%-12s %7u %7u %7u %7u  %-8s %12.3f %12.3f\n",
+				bd->bd_name, na, nb, ni, nu, ik->ik_name,
+				ti / ( na + nb ), tu / ( na + nb ));
+next:
+			if ( ik == &auto_kernel )
+				break;
+		}
+	}
+
+	free( a );
+	free( b );
+	free( c );
+	free( isect );
+	free( uni );
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,476 @@
+/* idlsimd.c - merge kernels for sorted ID arrays */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* The list by list paths of mdb_idl_intersection and mdb_idl_union
+ * spend their time here. There is a portable scalar kernel, vector
+ * kernels for SSE4.2 and AVX2 that are picked at startup if the CPU
+ * has them, and a galloping search for when one side is much smaller
+ * than the other.
+ *
+ * Nothing in here may call into the rest of slapd, so that idlbench
+ * can link it alone.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+#if SIZEOF_LONG == 8 && defined(__x86_64__) && ( defined(__clang__) || \
+	( defined(__GNUC__) && ( __GNUC__ > 4 || \
+		( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ))))
+#define IDL_SIMD_X86	1
+#include <immintrin.h>
+#endif
+
+#define IDL_MIN(x,y)	( (x) < (y) ? (x) : (y) )
+
+static unsigned
+idl_isect_scalar( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			i++;
+		} else if ( a[i] > b[j] ) {
+			j++;
+		} else {
+			c[k++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return k;
+}
+
+/* Append the rest of one array after a merge */
+static unsigned
+idl_union_rest( const ID *a, unsigned na, ID *c, ID last )
+{
+	if ( na && a[0] == last ) {
+		a++;
+		na--;
+	}
+	AC_MEMCPY( c, a, na * sizeof(ID) );
+	return na;
+}
+
+static unsigned
+idl_union_scalar( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			c[k++] = a[i++];
+		} else {
+			if ( a[i] == b[j] )
+				i++;
+			c[k++] = b[j++];
+		}
+	}
+	if ( i < na )
+		k += idl_union_rest( a+i, na-i, c+k, NOID );
+	else
+		k += idl_union_rest( b+j, nb-j, c+k, NOID );
+	return k;
+}
+
+/* Merge what the vector kernels leave over: the upper half of their
+ * last merge in h, and the unread parts of a and b. last is the last
+ * ID already stored, to drop a duplicate of it.
+ */
+static unsigned
+idl_union_tail( const ID *h, unsigned nh, const ID *a, unsigned na,
+	const ID *b, unsigned nb, ID *c, ID last )
+{
+	unsigned x = 0, i = 0, j = 0, k = 0;
+	ID id;
+
+	while ( x < nh || ( i < na && j < nb )) {
+		id = NOID;
+		if ( x < nh )
+			id = h[x];
+		if ( i < na && a[i] < id )
+			id = a[i];
+		if ( j < nb && b[j] < id )
+			id = b[j];
+		if ( x < nh && h[x] == id )
+			x++;
+		if ( i < na && a[i] == id )
+			i++;
+		if ( j < nb && b[j] == id )
+			j++;
+		if ( id != last )
+			c[k++] = last = id;
+	}
+	if ( i < na )
+		k += idl_union_rest( a+i, na-i, c+k, last );
+	else
+		k += idl_union_rest( b+j, nb-j, c+k, last );
+	return k;
+}
+
+/* Return the position of the first ID >= id in b[lo..nb), probing
+ * ahead in doubling steps and then bisecting the last step.
+ */
+static unsigned
+idl_gallop( const ID *b, unsigned lo, unsigned nb, ID id )
+{
+	unsigned hi = lo, step = 1;
+
+	while ( hi < nb && b[hi] < id ) {
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
+	}
+	if ( hi > nb )
+		hi = nb;
+	while ( lo < hi ) {
+		unsigned mid = lo + (( hi - lo ) >> 1 );
+		if ( b[mid] < id )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* a is the small side */
+static unsigned
+idl_isect_gallop( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i, j = 0, k = 0;
+
+	for ( i = 0; i < na && j < nb; i++ ) {
+		j = idl_gallop( b, j, nb, a[i] );
+		if ( j < nb && b[j] == a[i] ) {
+			c[k++] = a[i];
+			j++;
+		}
+	}
+	return k;
+}
+
+/* a is the small side; runs of b between its IDs are copied whole */
+static unsigned
+idl_union_gallop( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i, j = 0, k = 0, p;
+
+	for ( i = 0; i < na; i++ ) {
+		p = idl_gallop( b, j, nb, a[i] );
+		AC_MEMCPY( c+k, b+j, ( p - j ) * sizeof(ID) );
+		k += p - j;
+		j = p;
+		c[k++] = a[i];
+		if ( j < nb && b[j] == a[i] )
+			j++;
+	}
+	AC_MEMCPY( c+k, b+j, ( nb - j ) * sizeof(ID) );
+	return k + nb - j;
+}
+
+#ifdef IDL_SIMD_X86
+/* The merge network compares as signed 64 bit, so IDs are stored
+ * with the sign bit flipped while in a register.
+ */
+#define IDL_SIGN	((long long)0x8000000000000000ULL)
+
+/* Lane moves for _mm256_permutevar8x32_epi32 that pack the 64 bit
+ * lanes set in a 4 bit mask to the bottom of the register.
+ */
+static const int idl_pack4[16][8] = {
+	{ 0 },
+	{ 0, 1 },
+	{ 2, 3 },
+	{ 0, 1, 2, 3 },
+	{ 4, 5 },
+	{ 0, 1, 4, 5 },
+	{ 2, 3, 4, 5 },
+	{ 0, 1, 2, 3, 4, 5 },
+	{ 6, 7 },
+	{ 0, 1, 6, 7 },
+	{ 2, 3, 6, 7 },
+	{ 0, 1, 2, 3, 6, 7 },
+	{ 4, 5, 6, 7 },
+	{ 0, 1, 4, 5, 6, 7 },
+	{ 2, 3, 4, 5, 6, 7 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7 }
+};
+
+static int
+idl_have_sse42( void )
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "sse4.2" );
+}
+
+static int
+idl_have_avx2( void )
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" );
+}
+
+/* Compare blocks of four IDs from each side all against all, and move
+ * on from the block that ends lower. Matches are stored from memory
+ * one at a time, never past the block, so c may alias a.
+ */
+__attribute__((target("sse4.2")))
+static unsigned
+idl_isect_sse42( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i = 0, j = 0, k = 0, mask;
+	__m128i a0, a1, b0, b1, r0, r1;
+	ID amax, bmax;
+
+	if ( na < 4 || nb < 4 )
+		goto tail;
+
+	a0 = _mm_loadu_si128(( const __m128i *) a );
+	a1 = _mm_loadu_si128(( const __m128i *)( a + 2 ));
+	b0 = _mm_loadu_si128(( const __m128i *) b );
+	b1 = _mm_loadu_si128(( const __m128i *)( b + 2 ));
+	for (;;) {
+		__m128i s0 = _mm_shuffle_epi32( b0, 0x4e );
+		__m128i s1 = _mm_shuffle_epi32( b1, 0x4e );
+
+		r0 = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi64( a0, b0 ), _mm_cmpeq_epi64( a0, s0 )),
+			_mm_or_si128( _mm_cmpeq_epi64( a0, b1 ), _mm_cmpeq_epi64( a0, s1 )));
+		r1 = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi64( a1, b0 ), _mm_cmpeq_epi64( a1, s0 )),
+			_mm_or_si128( _mm_cmpeq_epi64( a1, b1 ), _mm_cmpeq_epi64( a1, s1 )));
+		mask = _mm_movemask_pd( _mm_castsi128_pd( r0 )) |
+			( _mm_movemask_pd( _mm_castsi128_pd( r1 )) << 2 );
+
+		amax = a[i+3];
+		bmax = b[j+3];
+		while ( mask ) {
+			c[k++] = a[i + __builtin_ctz( mask )];
+			mask &= mask - 1;
+		}
+		if ( amax <= bmax ) {
+			i += 4;
+			if ( i + 4 > na ) {
+				if ( bmax <= amax )
+					j += 4;
+				break;
+			}
+			a0 = _mm_loadu_si128(( const __m128i *)( a + i ));
+			a1 = _mm_loadu_si128(( const __m128i *)( a + i + 2 ));
+		}
+		if ( bmax <= amax ) {
+			j += 4;
+			if ( j + 4 > nb )
+				break;
+			b0 = _mm_loadu_si128(( const __m128i *)( b + j ));
+			b1 = _mm_loadu_si128(( const __m128i *)( b + j + 2 ));
+		}
+	}
+tail:
+	return k + idl_isect_scalar( a+i, na-i, b+j, nb-j, c+k );
+}
+
+/* As idl_isect_sse42, comparing one register of four against the
+ * other rotated by each lane.
+ */
+__attribute__((target("avx2")))
+static unsigned
+idl_isect_avx2( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i = 0, j = 0, k = 0, mask;
+	__m256i va, vb, r;
+	ID amax, bmax;
+
+	if ( na < 4 || nb < 4 )
+		goto tail;
+
+	va = _mm256_loadu_si256(( const __m256i *) a );
+	vb = _mm256_loadu_si256(( const __m256i *) b );
+	for (;;) {
+		r = _mm256_or_si256(
+			_mm256_or_si256( _mm256_cmpeq_epi64( va, vb ),
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x39 ))),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x4e )),
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x93 ))));
+		mask = _mm256_movemask_pd( _mm256_castsi256_pd( r ));
+
+		amax = a[i+3];
+		bmax = b[j+3];
+		while ( mask ) {
+			c[k++] = a[i + __builtin_ctz( mask )];
+			mask &= mask - 1;
+		}
+		if ( amax <= bmax ) {
+			i += 4;
+			if ( i + 4 > na ) {
+				if ( bmax <= amax )
+					j += 4;
+				break;
+			}
+			va = _mm256_loadu_si256(( const __m256i *)( a + i ));
+		}
+		if ( bmax <= amax ) {
+			j += 4;
+			if ( j + 4 > nb )
+				break;
+			vb = _mm256_loadu_si256(( const __m256i *)( b + j ));
+		}
+	}
+tail:
+	return k + idl_isect_scalar( a+i, na-i, b+j, nb-j, c+k );
+}
+
+/* Sort two sorted quads of biased IDs into a low and a high quad */
+__attribute__((target("avx2")))
+static inline void
+idl_merge_avx2( __m256i *lo, __m256i *hi )
+{
+	__m256i s, g, l, h, m, x;
+
+	s = _mm256_permute4x64_epi64( *hi, 0x1b );
+	g = _mm256_cmpgt_epi64( *lo, s );
+	l = _mm256_blendv_epi8( *lo, s, g );
+	h = _mm256_blendv_epi8( s, *lo, g );
+
+	s = _mm256_permute4x64_epi64( l, 0x4e );
+	g = _mm256_cmpgt_epi64( l, s );
+	m = _mm256_blendv_epi8( l, s, g );
+	x = _mm256_blendv_epi8( s, l, g );
+	l = _mm256_blend_epi32( m, x, 0xf0 );
+	s = _mm256_permute4x64_epi64( l, 0xb1 );
+	g = _mm256_cmpgt_epi64( l, s );
+	m = _mm256_blendv_epi8( l, s, g );
+	x = _mm256_blendv_epi8( s, l, g );
+	*lo = _mm256_blend_epi32( m, x, 0xcc );
+
+	s = _mm256_permute4x64_epi64( h, 0x4e );
+	g = _mm256_cmpgt_epi64( h, s );
+	m = _mm256_blendv_epi8( h, s, g );
+	x = _mm256_blendv_epi8( s, h, g );
+	h = _mm256_blend_epi32( m, x, 0xf0 );
+	s = _mm256_permute4x64_epi64( h, 0xb1 );
+	g = _mm256_cmpgt_epi64( h, s );
+	m = _mm256_blendv_epi8( h, s, g );
+	x = _mm256_blendv_epi8( s, h, g );
+	*hi = _mm256_blend_epi32( m, x, 0xcc );
+}
+
+/* Merge four IDs at a time through a bitonic network, always reading
+ * the next block from the side with the lower next ID. The low half
+ * of each merge is final; duplicates are dropped by comparing it with
+ * itself shifted by one lane. A block that starts above everything
+ * read so far skips the network, which makes clustered IDs cheap.
+ */
+__attribute__((target("avx2")))
+static unsigned
+idl_union_avx2( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	unsigned i, j, k = 0, keep, takea, inorder = 0;
+	__m256i sign, va, vb, last, o;
+	ID h[4], lastid;
+
+	if ( na < 4 || nb < 4 )
+		return idl_union_tail( NULL, 0, a, na, b, nb, c, NOID );
+
+	sign = _mm256_set1_epi64x( IDL_SIGN );
+	va = _mm256_xor_si256( _mm256_loadu_si256(( const __m256i *) a ), sign );
+	vb = _mm256_xor_si256( _mm256_loadu_si256(( const __m256i *) b ), sign );
+	last = _mm256_set1_epi64x(( long long )( IDL_MIN( a[0], b[0] ) - 1 ) ^ IDL_SIGN );
+	i = j = 4;
+	for (;;) {
+		if ( !inorder )
+			idl_merge_avx2( &va, &vb );
+		o = _mm256_blend_epi32( _mm256_permute4x64_epi64( va, 0x90 ), last, 0x03 );
+		keep = ~_mm256_movemask_pd( _mm256_castsi256_pd(
+			_mm256_cmpeq_epi64( va, o ))) & 0xf;
+		o = _mm256_permutevar8x32_epi32( va,
+			_mm256_loadu_si256(( const __m256i *) idl_pack4[keep] ));
+		_mm256_storeu_si256(( __m256i *)( c + k ), _mm256_xor_si256( o, sign ));
+		k += __builtin_popcount( keep );
+		last = _mm256_permute4x64_epi64( va, 0xff );
+		va = vb;
+
+		if ( i + 4 > na || j + 4 > nb )
+			break;
+		takea = a[i] <= b[j];
+		inorder = takea ? b[j-1] <= a[i] : a[i-1] <= b[j];
+		vb = _mm256_xor_si256( _mm256_loadu_si256(( const __m256i *)
+			( takea ? a + i : b + j )), sign );
+		i += takea << 2;
+		j += !takea << 2;
+	}
+	_mm256_storeu_si256(( __m256i *) h, _mm256_xor_si256( va, sign ));
+	lastid = _mm_cvtsi128_si64( _mm256_castsi256_si128( last )) ^ IDL_SIGN;
+	return k + idl_union_tail( h, 4, a+i, na-i, b+j, nb-j, c+k, lastid );
+}
+#endif /* IDL_SIMD_X86 */
+
+const mdb_idl_kernel mdb_idl_kernels[] = {
+	{ "scalar", NULL, idl_isect_scalar, idl_union_scalar },
+	{ "gallop", NULL, idl_isect_gallop, idl_union_gallop },
+#ifdef IDL_SIMD_X86
+	/* A two lane merge network is no faster than the scalar merge */
+	{ "sse4.2", idl_have_sse42, idl_isect_sse42, idl_union_scalar },
+	{ "avx2", idl_have_avx2, idl_isect_avx2, idl_union_avx2 },
+#endif
+	{ NULL }
+};
+
+static const mdb_idl_kernel *idl_kernel = mdb_idl_kernels;
+
+const char *
+mdb_idl_kernel_init( void )
+{
+	const mdb_idl_kernel *ik;
+
+	for ( ik = mdb_idl_kernels; ik->ik_name; ik++ ) {
+		if ( ik->ik_isect == idl_isect_gallop )
+			continue;
+		if ( !ik->ik_usable || ik->ik_usable() )
+			idl_kernel = ik;
+	}
+	return idl_kernel->ik_name;
+}
+
+unsigned
+mdb_idl_isect_lists( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	if ( !na || !nb )
+		return 0;
+	if ( na / MDB_IDL_GALLOP_ISECT > nb )
+		return idl_isect_gallop( b, nb, a, na, c );
+	if ( nb / MDB_IDL_GALLOP_ISECT > na )
+		return idl_isect_gallop( a, na, b, nb, c );
+	return idl_kernel->ik_isect( a, na, b, nb, c );
+}
+
+unsigned
+mdb_idl_union_lists( const ID *a, unsigned na, const ID *b, unsigned nb, ID *c )
+{
+	if ( na / MDB_IDL_GALLOP_UNION > nb )
+		return idl_union_gallop( b, nb, a, na, c );
+	if ( nb / MDB_IDL_GALLOP_UNION > na )
+		return idl_union_gallop( a, na, b, nb, c );
+	return idl_kernel->ik_union( a, na, b, nb, c );
+}
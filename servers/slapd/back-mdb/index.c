@@ -28,6 +28,26 @@
 static char presence_keyval[] = {0,0,0,0,0};
 static struct berval presence_key[2] = {BER_BVC(presence_keyval), BER_BVNULL};
 
+/* Composite keys are new, so they can always be as wide as the
+ * hash allows.
+ */
+#ifdef LUTIL_HASH64_BYTES
+#define COMP_KEY_BYTES	LUTIL_HASH64_BYTES
+#define COMP_HASHInit(c)	lutil_HASH64Init(c)
+#define COMP_HASHUpdate(c,buf,len)	lutil_HASH64Update(c,buf,len)
+#define COMP_HASHFinal(d,c)	lutil_HASH64Final(d,c)
+#else
+#define COMP_KEY_BYTES	LUTIL_HASH_BYTES
+#define COMP_HASHInit(c)	lutil_HASHInit(c)
+#define COMP_HASHUpdate(c,buf,len)	lutil_HASHUpdate(c,buf,len)
+#define COMP_HASHFinal(d,c)	lutil_HASHFinal(d,c)
+#endif
+
+/* Lists the entries with too many combinations of values. It is
+ * shorter than any hash, so it can never be the key of a tuple.
+ */
+static struct berval comp_overflow = BER_BVC( "+" );
+
 AttrInfo *mdb_index_mask(
 	Backend *be,
 	AttributeDescription *desc,
@@ -70,10 +90,31 @@ AttrInfo *mdb_index_mask(
 	return 0;
 }
 
+/* Is key the presence key of an attribute index, as padded by
+ * mdb_key_read?
+ */
+int
+mdb_index_is_presence( MDB_val *key )
+{
+	size_t i, len = presence_key[0].bv_len;
+	char *p = key->mv_data;
+
+#ifndef MISALIGNED_OK
+	if ( len & ALIGNER )
+		len = 2 * sizeof(int);
+#endif
+	if ( key->mv_size != len )
+		return 0;
+	for ( i = 0; i < len; i++ )
+		if ( p[i] )
+			return 0;
+	return 1;
+}
+
 /* This function is only called when evaluating search filters.
  */
 int mdb_index_param(
-	Backend *be,
+	Operation *op,
 	AttributeDescription *desc,
 	int ftype,
 	MDB_dbi *dbip,
@@ -83,16 +124,17 @@ int mdb_index_param(
 	AttrInfo *ai;
 	slap_mask_t mask, type = 0;
 
-	ai = mdb_index_mask( be, desc, prefixp );
+	ai = mdb_index_mask( op->o_bd, desc, prefixp );
 
 	if ( !ai ) {
-#ifdef MDB_MONITOR_IDX
 		switch ( ftype ) {
 		case LDAP_FILTER_PRESENT:
 			type = SLAP_INDEX_PRESENT;
 			break;
 		case LDAP_FILTER_APPROX:
-			type = SLAP_INDEX_APPROX;
+			/* without an approx rule, the eq index is used as below */
+			type = desc->ad_type->sat_approx ? SLAP_INDEX_APPROX
+				: SLAP_INDEX_EQUALITY;
 			break;
 		case LDAP_FILTER_EQUALITY:
 			type = SLAP_INDEX_EQUALITY;
@@ -103,8 +145,7 @@ int mdb_index_param(
 		default:
 			return LDAP_INAPPROPRIATE_MATCHING;
 		}
-		mdb_monitor_idx_add( be->be_private, desc, type );
-#endif /* MDB_MONITOR_IDX */
+		mdb_autoindex_note( op, desc, type );
 
 		return LDAP_INAPPROPRIATE_MATCHING;
 	}
@@ -149,9 +190,7 @@ int mdb_index_param(
 		return LDAP_OTHER;
 	}
 
-#ifdef MDB_MONITOR_IDX
-	mdb_monitor_idx_add( be->be_private, desc, type );
-#endif /* MDB_MONITOR_IDX */
+	mdb_autoindex_note( op, desc, type );
 
 	return LDAP_INAPPROPRIATE_MATCHING;
 
@@ -174,12 +213,24 @@ static int indexer(
 {
 	int rc;
 	struct berval *keys;
-	MDB_cursor *mc = ai->ai_cursor;
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc = ai->ai_cursor, *ox = NULL;
 	mdb_idl_keyfunc *keyfunc;
 	char *err;
 
 	assert( mask != 0 );
 
+	if ( opid == SLAP_INDEX_ADD_OP &&
+		( ox = mdb_online_collector( op, ai->ai_dbi )) != NULL )
+	{
+		/* the online indexer writes them later */
+		keyfunc = mdb_online_keys;
+		mc = ox;
+		goto keys;
+	}
+	if ( ai->ai_newmask )
+		mdb_online_touch( op, txn, id );
+
 	if ( !mc ) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
@@ -197,10 +248,14 @@ static int indexer(
 			mc = (MDB_cursor *)ax;
 		} else
 #endif
+		if ( mdb->mi_flags & MDB_TOOL_BULK )
+			keyfunc = mdb_tool_bulk_keys;
+		else
 			keyfunc = mdb_idl_insert_keys;
 	} else
 		keyfunc = mdb_idl_delete_keys;
 
+keys:
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) ) {
 		rc = keyfunc( op->o_bd, mc, presence_key, id );
 		if( rc ) {
@@ -269,7 +324,7 @@ static int indexer(
 	}
 
 done:
-	if ( !(slapMode & SLAP_TOOL_QUICK))
+	if ( !(slapMode & SLAP_TOOL_QUICK) && !ox )
 		mdb_cursor_close( mc );
 	switch( rc ) {
 	/* The callers all know how to deal with these results */
@@ -471,6 +526,367 @@ int mdb_index_recrun(
 	return rc;
 }
 
+/* Hash together the equality keys at pos of each member of a
+ * composite index
+ */
+static void
+comp_key(
+	CompInfo *ci,
+	BerVarray *mkeys,
+	int *pos,
+	struct berval *key )
+{
+	lutil_HASH_CTX ctx;
+	int i;
+
+	COMP_HASHInit( &ctx );
+	for ( i = 0; i < ci->ci_nattrs; i++ ) {
+		struct berval *k = &mkeys[i][pos[i]];
+
+		COMP_HASHUpdate( &ctx, (unsigned char *)&k->bv_len,
+			sizeof( k->bv_len ));
+		COMP_HASHUpdate( &ctx, (unsigned char *)k->bv_val, k->bv_len );
+	}
+	COMP_HASHFinal( (unsigned char *)key->bv_val, &ctx );
+	key->bv_len = COMP_KEY_BYTES;
+}
+
+/* The equality keys of a member's values, including those of its
+ * subtypes, just as a filter on the member would match them.
+ */
+static int
+comp_member_keys(
+	Operation *op,
+	AttributeDescription *desc,
+	Attribute *attrs,
+	BerVarray *keysp )
+{
+	MatchingRule *mr = desc->ad_type->sat_equality;
+	BerVarray keys = NULL, k;
+	Attribute *a;
+	int i, rc;
+
+	*keysp = NULL;
+	for ( a = attrs; a != NULL; a = a->a_next ) {
+		if ( !is_ad_subtype( a->a_desc, desc ))
+			continue;
+		k = NULL;
+		rc = mr->smr_indexer( LDAP_FILTER_EQUALITY, SLAP_INDEX_EQUALITY,
+			desc->ad_type->sat_syntax, mr, &desc->ad_type->sat_cname,
+			a->a_nvals, &k, op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS ) {
+			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+			return rc;
+		}
+		for ( i = 0; k && k[i].bv_val != NULL; i++ )
+			ber_bvarray_add_x( &keys, &k[i], op->o_tmpmemctx );
+		if ( k )
+			op->o_tmpfree( k, op->o_tmpmemctx );
+	}
+	*keysp = keys;
+	return LDAP_SUCCESS;
+}
+
+/* The keys of a composite index for a set of attributes, one for
+ * every combination of their members' equality keys. There are none
+ * unless every member has a value, and only the overflow key if there
+ * are more than MDB_COMP_MAXKEYS combinations.
+ */
+static int
+comp_keys(
+	Operation *op,
+	CompInfo *ci,
+	Entry *e,
+	Attribute *attrs,
+	BerVarray *keysp )
+{
+	BerVarray mkeys[MDB_COMP_MAX], keys = NULL;
+	int pos[MDB_COMP_MAX];
+	char buf[COMP_KEY_BYTES];
+	struct berval key;
+	unsigned long combos = 1;
+	int i, n = 0, rc = LDAP_SUCCESS;
+
+	*keysp = NULL;
+	for ( n = 0; n < ci->ci_nattrs; n++ ) {
+		rc = comp_member_keys( op, ci->ci_descs[n], attrs, &mkeys[n] );
+		if ( rc != LDAP_SUCCESS )
+			goto done;
+		if ( mkeys[n] == NULL ) {
+			n++;
+			goto done;
+		}
+		pos[n] = 0;
+		for ( i = 0; !BER_BVISNULL( &mkeys[n][i] ); i++ )
+			;
+		if ( combos <= MDB_COMP_MAXKEYS )
+			combos = i > MDB_COMP_MAXKEYS / combos ?
+				MDB_COMP_MAXKEYS + 1 : combos * i;
+	}
+
+	if ( combos > MDB_COMP_MAXKEYS ) {
+		/* not again for the old attributes of a modify */
+		if ( attrs == e->e_attrs )
+			Debug( LDAP_DEBUG_ANY, "comp_keys: index %s: "
+				"entry %ld has over %d keys, using the overflow key\n",
+				ci->ci_name.bv_val, (long) e->e_id, MDB_COMP_MAXKEYS );
+		ber_dupbv_x( &key, &comp_overflow, op->o_tmpmemctx );
+		ber_bvarray_add_x( &keys, &key, op->o_tmpmemctx );
+		goto done;
+	}
+
+	/* step through the combinations like an odometer */
+	key.bv_val = buf;
+	do {
+		struct berval bv;
+
+		comp_key( ci, mkeys, pos, &key );
+		ber_dupbv_x( &bv, &key, op->o_tmpmemctx );
+		ber_bvarray_add_x( &keys, &bv, op->o_tmpmemctx );
+
+		for ( i = n - 1; i >= 0; i-- ) {
+			if ( !BER_BVISNULL( &mkeys[i][++pos[i]] ))
+				break;
+			pos[i] = 0;
+		}
+	} while ( i >= 0 );
+
+done:
+	while ( n-- > 0 )
+		ber_bvarray_free_x( mkeys[n], op->o_tmpmemctx );
+	*keysp = keys;
+	return rc;
+}
+
+static int
+comp_apply(
+	Operation *op,
+	MDB_txn *txn,
+	CompInfo *ci,
+	BerVarray keys,
+	ID id,
+	int opid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	int rc;
+
+	if ( keys == NULL )
+		return LDAP_SUCCESS;
+
+	if ( opid == SLAP_INDEX_ADD_OP &&
+		( mc = mdb_online_collector( op, ci->ci_dbi )) != NULL )
+		return mdb_online_keys( op->o_bd, mc, keys, id );
+	if ( ci->ci_newmask )
+		mdb_online_touch( op, txn, id );
+
+	rc = mdb_cursor_open( txn, ci->ci_dbi, &mc );
+	if ( rc == 0 ) {
+		if ( opid == SLAP_INDEX_DELETE_OP )
+			rc = mdb_idl_delete_keys( op->o_bd, mc, keys, id );
+		else if ( mdb->mi_flags & MDB_TOOL_BULK )
+			rc = mdb_tool_bulk_keys( op->o_bd, mc, keys, id );
+		else
+			rc = mdb_idl_insert_keys( op->o_bd, mc, keys, id );
+		mdb_cursor_close( mc );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "comp_apply: index %s failed: %s (%d)\n",
+			ci->ci_name.bv_val, mdb_strerror( rc ), rc );
+		rc = LDAP_OTHER;
+	}
+	return rc;
+}
+
+/* Add or delete the keys of an entry in the composite indexes */
+int
+mdb_index_comps(
+	Operation *op,
+	MDB_txn *txn,
+	int opid,
+	Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	BerVarray keys;
+	int i, rc = LDAP_SUCCESS;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+
+		/* as for attributes, an update only adds new indexes */
+		if ( opid == MDB_INDEX_UPDATE_OP ) {
+			if ( !ci->ci_newmask || ci->ci_indexmask )
+				continue;
+		} else if ( !( ci->ci_indexmask || ci->ci_newmask )) {
+			continue;
+		}
+
+		rc = comp_keys( op, ci, e, e->e_attrs, &keys );
+		if ( rc == LDAP_SUCCESS ) {
+			rc = comp_apply( op, txn, ci, keys, e->e_id,
+				opid == SLAP_INDEX_DELETE_OP ? opid : SLAP_INDEX_ADD_OP );
+			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+		}
+		if ( rc )
+			break;
+	}
+	return rc;
+}
+
+/* Bring the composite indexes over modified attributes up to date,
+ * deleting the keys only the old attributes had and adding those
+ * only the new ones have.
+ */
+int
+mdb_index_comps_modify(
+	Operation *op,
+	MDB_txn *txn,
+	Modifications *modlist,
+	Attribute *old,
+	Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	Modifications *ml;
+	BerVarray okeys, nkeys;
+	int i, j, k, n, rc = LDAP_SUCCESS;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+
+		if ( !( ci->ci_indexmask || ci->ci_newmask ))
+			continue;
+		for ( ml = modlist; ml != NULL; ml = ml->sml_next ) {
+			for ( j = 0; j < ci->ci_nattrs; j++ ) {
+				if ( is_ad_subtype( ml->sml_desc, ci->ci_descs[j] ))
+					break;
+				/* follows objectClass without being in modlist */
+				if ( ci->ci_descs[j] ==
+						slap_schema.si_ad_structuralObjectClass &&
+					ml->sml_desc == slap_schema.si_ad_objectClass )
+					break;
+			}
+			if ( j < ci->ci_nattrs )
+				break;
+		}
+		if ( ml == NULL )
+			continue;
+
+		okeys = nkeys = NULL;
+		rc = comp_keys( op, ci, e, old, &okeys );
+		if ( rc == LDAP_SUCCESS )
+			rc = comp_keys( op, ci, e, e->e_attrs, &nkeys );
+
+		/* leave the keys both have out of either */
+		for ( j = 0; rc == LDAP_SUCCESS && okeys && okeys[j].bv_val; ) {
+			for ( k = 0; nkeys && nkeys[k].bv_val; k++ ) {
+				if ( bvmatch( &okeys[j], &nkeys[k] ))
+					break;
+			}
+			if ( !nkeys || !nkeys[k].bv_val ) {
+				j++;
+				continue;
+			}
+			op->o_tmpfree( okeys[j].bv_val, op->o_tmpmemctx );
+			op->o_tmpfree( nkeys[k].bv_val, op->o_tmpmemctx );
+			for ( n = j; okeys[n].bv_val; n++ )
+				okeys[n] = okeys[n+1];
+			for ( n = k; nkeys[n].bv_val; n++ )
+				nkeys[n] = nkeys[n+1];
+		}
+		if ( rc == LDAP_SUCCESS && okeys && okeys[0].bv_val )
+			rc = comp_apply( op, txn, ci, okeys, e->e_id,
+				SLAP_INDEX_DELETE_OP );
+		if ( rc == LDAP_SUCCESS && nkeys && nkeys[0].bv_val )
+			rc = comp_apply( op, txn, ci, nkeys, e->e_id,
+				SLAP_INDEX_ADD_OP );
+		ber_bvarray_free_x( okeys, op->o_tmpmemctx );
+		ber_bvarray_free_x( nkeys, op->o_tmpmemctx );
+		if ( rc )
+			break;
+	}
+	return rc;
+}
+
+/* Find the composite index that covers the most equality assertions
+ * of an AND, and its key for them, allocated in tmp memory. fs gets
+ * the assertion used for each member. The key is a hash, so the
+ * entries it yields still have to be tested. An index with entries
+ * under its overflow key would miss them, so it is passed over.
+ */
+CompInfo *
+mdb_index_comp_filter(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *flist,
+	Filter **fs,
+	struct berval *key )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	CompInfo *ci, *best = NULL;
+	Filter *f, *cand[MDB_COMP_MAX];
+	BerVarray mkeys[MDB_COMP_MAX];
+	int pos[MDB_COMP_MAX];
+	int i, j, rc;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		ci = mdb->mi_comps[i];
+		/* only one that is fully built and not being deleted */
+		if ( !ci->ci_dbi || ci->ci_indexmask != SLAP_INDEX_EQUALITY )
+			continue;
+		if ( best && best->ci_nattrs >= ci->ci_nattrs )
+			continue;
+		for ( j = 0; j < ci->ci_nattrs; j++ ) {
+			for ( f = flist; f != NULL; f = f->f_next ) {
+				if ( f->f_choice == LDAP_FILTER_EQUALITY &&
+					f->f_av_desc == ci->ci_descs[j] )
+					break;
+			}
+			if ( f == NULL )
+				break;
+			cand[j] = f;
+		}
+		if ( j == ci->ci_nattrs ) {
+			MDB_val key, data;
+
+			key.mv_data = comp_overflow.bv_val;
+			key.mv_size = comp_overflow.bv_len;
+			if ( mdb_get( txn, ci->ci_dbi, &key, &data ) != MDB_NOTFOUND )
+				continue;
+			best = ci;
+			AC_MEMCPY( fs, cand, j * sizeof( Filter * ));
+		}
+	}
+	if ( best == NULL )
+		return NULL;
+
+	/* every assertion must come down to a single key */
+	for ( j = 0; j < best->ci_nattrs; j++ ) {
+		AttributeDescription *desc = best->ci_descs[j];
+		MatchingRule *mr = desc->ad_type->sat_equality;
+
+		mkeys[j] = NULL;
+		pos[j] = 0;
+		rc = mr->smr_filter( LDAP_FILTER_EQUALITY, SLAP_INDEX_EQUALITY,
+			desc->ad_type->sat_syntax, mr, &desc->ad_type->sat_cname,
+			&fs[j]->f_av_value, &mkeys[j], op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS || mkeys[j] == NULL ||
+			BER_BVISNULL( &mkeys[j][0] ) || !BER_BVISNULL( &mkeys[j][1] ))
+		{
+			j++;
+			best = NULL;
+			break;
+		}
+	}
+
+	if ( best ) {
+		key->bv_val = op->o_tmpalloc( COMP_KEY_BYTES, op->o_tmpmemctx );
+		comp_key( best, mkeys, pos, key );
+	}
+	while ( j-- > 0 )
+		ber_bvarray_free_x( mkeys[j], op->o_tmpmemctx );
+	return best;
+}
+
 int
 mdb_index_entry(
 	Operation *op,
@@ -569,6 +985,15 @@ mdb_index_entry(
 		}
 	}
 
+	rc = mdb_index_comps( op, txn, opid, e );
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= index_entry_%s( %ld, \"%s\" ) composite failure\n",
+			opid == SLAP_INDEX_ADD_OP ? "add" : "del",
+			(long) e->e_id, e->e_dn );
+		return rc;
+	}
+
 	Debug( LDAP_DEBUG_TRACE, "<= index_entry_%s( %ld, \"%s\" ) success\n",
 		opid == SLAP_INDEX_DELETE_OP ? "del" : "add",
 		(long) e->e_id, e->e_dn ? e->e_dn : "" );
@@ -23,6 +23,7 @@
 #include <ac/errno.h>
 #include <sys/stat.h>
 #include "back-mdb.h"
+#include "idl.h"
 #include <lutil.h>
 #include <ldap_rq.h>
 #include "config.h"
@@ -32,6 +33,7 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
+	BER_BVC("dict"),
 	BER_BVNULL
 };
 
@@ -60,13 +62,22 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 	mdb->mi_dbenv_mode = SLAPD_DEFAULT_DB_MODE;
 
 	mdb->mi_search_stack_depth = DEFAULT_SEARCH_STACK_DEPTH;
-	mdb->mi_search_stack = NULL;
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
+	mdb->mi_paged_max = DEFAULT_PAGED_MAX;
+	mdb->mi_paged_timeout = DEFAULT_PAGED_TIMEOUT;
+	mdb->mi_index_threads = DEFAULT_INDEX_THREADS;
+
+	mdb_ecache_init( mdb );
+	mdb_paged_init( mdb );
+	mdb_group_init( mdb );
+	mdb_online_init( mdb );
+	mdb_autoindex_init( mdb );
+
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
 
@@ -215,6 +226,12 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* slapcat of an environment that never had compression */
+		if ( rc == MDB_NOTFOUND && i == MDB_DICT ) {
+			mdb->mi_dbis[i] = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -273,6 +290,18 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	rc = mdb_format_check( be, txn, cr );
+	if ( rc ) {
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
+	rc = mdb_dict_open( be, txn, cr );
+	if ( rc ) {
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
 	/* slapcat doesn't need indexes. avoid a failure if
 	 * a configured index wasn't created yet.
 	 */
@@ -323,6 +352,10 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
 
+	mdb_ecache_flush( mdb );
+	mdb_paged_flush( mdb );
+	mdb_dict_flush( mdb );
+
 	if ( mdb->mi_dbenv ) {
 		if ( mdb->mi_dbis[0] ) {
 			int i;
@@ -372,8 +405,14 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 	(void)mdb_monitor_db_destroy( be );
 
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
+	if( mdb->mi_dict_file ) ch_free( mdb->mi_dict_file );
 
 	mdb_attr_index_destroy( mdb );
+	mdb_ecache_destroy( mdb );
+	mdb_paged_destroy( mdb );
+	mdb_group_destroy( mdb );
+	mdb_online_destroy( mdb );
+	mdb_autoindex_destroy( mdb );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -396,6 +435,8 @@ mdb_back_initialize(
 		LDAP_CONTROL_POST_READ,
 		LDAP_CONTROL_SUBENTRIES,
 		LDAP_CONTROL_X_PERMISSIVE_MODIFY,
+		LDAP_CONTROL_X_SEARCH_EXPLAIN,
+		LDAP_CONTROL_X_SEARCH_COUNT,
 #ifdef LDAP_X_TXN
 		LDAP_CONTROL_X_TXN_SPEC,
 #endif
@@ -415,6 +456,14 @@ mdb_back_initialize(
 
 	bi->bi_controls = controls;
 
+	rc = mdb_explain_initialize();
+	if ( rc )
+		return rc;
+
+	rc = mdb_count_initialize();
+	if ( rc )
+		return rc;
+
 	{	/* version check */
 		int major, minor, patch, ver;
 		char *version = mdb_version( &major, &minor, &patch );
@@ -444,6 +493,9 @@ mdb_back_initialize(
 			": %s\n", version, 0, 0 );
 	}
 
+	Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_back_initialize)
+		": using %s IDL kernels\n", mdb_idl_kernel_init(), 0, 0 );
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
@@ -490,9 +542,10 @@ mdb_back_initialize(
 	bi->bi_tool_dn2id_get = mdb_tool_dn2id_get;
 	bi->bi_tool_entry_modify = mdb_tool_entry_modify;
 	bi->bi_tool_entry_delete = mdb_tool_entry_delete;
+	bi->bi_tool_entry_walk = mdb_tool_entry_walk;
 
 	bi->bi_connection_init = 0;
-	bi->bi_connection_destroy = 0;
+	bi->bi_connection_destroy = mdb_paged_conn_destroy;
 
 	rc = mdb_back_init_cf( bi );
 
@@ -70,3 +70,32 @@ mdb_key_read(
 
 	return rc;
 }
+
+/* size up a key without reading it */
+int
+mdb_key_count(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count,
+	ID *items
+)
+{
+	MDB_val key;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+
+	if (k->bv_len & ALIGNER) {
+		key.mv_size = sizeof(kbuf);
+		key.mv_data = kbuf;
+		kbuf[1] = 0;
+		memcpy(kbuf, k->bv_val, k->bv_len);
+	} else
+#endif
+	{
+		key.mv_size = k->bv_len;
+		key.mv_data = k->bv_val;
+	}
+
+	return mdb_idl_count_key( txn, dbi, &key, count, items );
+}
@@ -548,6 +548,19 @@ do_del:
 		}
 	}
 
+	/* and those of the composite indexes over them */
+	if ( mdb->mi_ncomps ) {
+		rc = mdb_index_comps_modify( op, tid, modlist, save_attrs, e );
+		if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_ANY,
+				"%s: composite index update failure\n",
+				op->o_log_prefix, 0, 0 );
+			attrs_free( e->e_attrs );
+			e->e_attrs = save_attrs;
+			return rc;
+		}
+	}
+
 	return rc;
 }
 
@@ -570,6 +583,9 @@ mdb_modify( Operation *op, SlapReply *rs )
 	int num_ctrls = 0;
 	int numads = mdb->mi_numads;
 
+	if ( mdb_group_join( op, rs, mdb_modify ))
+		return rs->sr_err;
+
 	Debug( LDAP_DEBUG_ARGS, LDAP_XSTRING(mdb_modify) ": %s\n",
 		op->o_req_dn.bv_val, 0, 0 );
 
@@ -592,6 +608,8 @@ mdb_modify( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 	txn = moi->moi_txn;
+	/* after the txn began: an abort must keep the ads of earlier ops */
+	numads = mdb->mi_numads;
 
 	/* Don't touch the opattrs, if this is a contextCSN update
 	 * initiated from updatedn */
@@ -646,7 +664,7 @@ mdb_modify( Operation *op, SlapReply *rs )
 
 		rs->sr_flags = REP_MATCHED_MUSTBEFREED | REP_REF_MUSTBEFREED;
 		rs->sr_err = LDAP_REFERRAL;
-		send_ldap_result( op, rs );
+		mdb_group_send( op, rs );
 		goto done;
 	}
 
@@ -661,7 +679,7 @@ mdb_modify( Operation *op, SlapReply *rs )
 		rs->sr_err = LDAP_REFERRAL;
 		rs->sr_matched = e->e_name.bv_val;
 		rs->sr_flags = REP_REF_MUSTBEFREED;
-		send_ldap_result( op, rs );
+		mdb_group_send( op, rs );
 		rs->sr_matched = NULL;
 		goto done;
 	}
@@ -747,12 +765,12 @@ mdb_modify( Operation *op, SlapReply *rs )
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
 			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_group_commit( mdb, moi, txn );
 			if ( rs->sr_err )
 				mdb->mi_numads = numads;
 			txn = NULL;
@@ -783,7 +801,7 @@ return_results:
 	if( dummy.e_attrs ) {
 		attrs_free( dummy.e_attrs );
 	}
-	send_ldap_result( op, rs );
+	mdb_group_send( op, rs );
 
 #if 0
 	if( rs->sr_err == LDAP_SUCCESS && mdb->bi_txn_cp_kbyte ) {
@@ -798,7 +816,7 @@ done:
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
 			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
@@ -55,6 +55,9 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 	int parent_is_glue = 0;
 	int parent_is_leaf = 0;
 
+	if ( mdb_group_join( op, rs, mdb_modrdn ))
+		return rs->sr_err;
+
 	Debug( LDAP_DEBUG_TRACE, "==>" LDAP_XSTRING(mdb_modrdn) "(%s,%s,%s)\n",
 		op->o_req_dn.bv_val,op->oq_modrdn.rs_newrdn.bv_val,
 		op->oq_modrdn.rs_newSup ? op->oq_modrdn.rs_newSup->bv_val : "NULL" );
@@ -117,7 +120,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 					&op->o_req_dn, LDAP_SCOPE_DEFAULT );
 		rs->sr_err = LDAP_REFERRAL;
 
-		send_ldap_result( op, rs );
+		mdb_group_send( op, rs );
 
 		ber_bvarray_free( rs->sr_ref );
 		goto done;
@@ -201,7 +204,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		}
 
 		rs->sr_err = LDAP_REFERRAL;
-		send_ldap_result( op, rs );
+		mdb_group_send( op, rs );
 
 		ber_bvarray_free( rs->sr_ref );
 		free( (char *)rs->sr_matched );
@@ -237,7 +240,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 
 		rs->sr_err = LDAP_REFERRAL,
 		rs->sr_matched = e->e_name.bv_val;
-		send_ldap_result( op, rs );
+		mdb_group_send( op, rs );
 
 		ber_bvarray_free( rs->sr_ref );
 		rs->sr_ref = NULL;
@@ -543,7 +546,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			/* Only free attrs if they were dup'd.  */
@@ -551,7 +554,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 			goto return_results;
 
 		} else {
-			if(( rs->sr_err=mdb_txn_commit( txn )) != 0 ) {
+			if(( rs->sr_err=mdb_group_commit( mdb, moi, txn )) != 0 ) {
 				rs->sr_text = "txn_commit failed";
 			} else {
 				rs->sr_err = LDAP_SUCCESS;
@@ -581,7 +584,7 @@ return_results:
 	if ( dummy.e_attrs ) {
 		attrs_free( dummy.e_attrs );
 	}
-	send_ldap_result( op, rs );
+	mdb_group_send( op, rs );
 
 #if 0
 	if( rs->sr_err == LDAP_SUCCESS && mdb->bi_txn_cp_kbyte ) {
@@ -618,7 +621,7 @@ done:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb_txn_abort( txn );
+			mdb_group_abort( mdb, moi, txn );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
@@ -32,15 +32,9 @@
 static ObjectClass		*oc_olmMDBDatabase;
 
 static AttributeDescription *ad_olmDbDirectory;
-
-#ifdef MDB_MONITOR_IDX
-static int
-mdb_monitor_idx_entry_add(
-	struct mdb_info	*mdb,
-	Entry		*e );
-
-static AttributeDescription	*ad_olmDbNotIndexed;
-#endif /* MDB_MONITOR_IDX */
+static AttributeDescription *ad_olmDbEntryCache;
+static AttributeDescription *ad_olmDbIndexing;
+static AttributeDescription *ad_olmDbNotIndexed;
 
 /*
  * NOTE: there's some confusion in monitor OID arc;
@@ -78,7 +72,22 @@ static struct {
 		"USAGE dSAOperation )",
 		&ad_olmDbDirectory },
 
-#ifdef MDB_MONITOR_IDX
+	{ "( olmDatabaseAttributes:3 "
+		"NAME ( 'olmDbEntryCache' ) "
+		"DESC 'Decoded entry cache usage' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbEntryCache },
+
+	{ "( olmDatabaseAttributes:4 "
+		"NAME ( 'olmDbIndexing' ) "
+		"DESC 'Progress of building new indexes' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmDbIndexing },
+
 	{ "( olmDatabaseAttributes:2 "
 		"NAME ( 'olmDbNotIndexed' ) "
 		"DESC 'Missing indexes resulting from candidate selection' "
@@ -86,7 +95,6 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmDbNotIndexed },
-#endif /* MDB_MONITOR_IDX */
 
 	{ NULL }
 };
@@ -102,9 +110,9 @@ static struct {
 		"SUP top AUXILIARY "
 		"MAY ( "
 			"olmDbDirectory "
-#ifdef MDB_MONITOR_IDX
+			"$ olmDbEntryCache "
+			"$ olmDbIndexing "
 			"$ olmDbNotIndexed "
-#endif /* MDB_MONITOR_IDX */
 			") )",
 		&oc_olmMDBDatabase },
 
@@ -118,11 +126,26 @@ mdb_monitor_update(
 	Entry		*e,
 	void		*priv )
 {
-#ifdef MDB_MONITOR_IDX
 	struct mdb_info		*mdb = (struct mdb_info *) priv;
-
-	mdb_monitor_idx_entry_add( mdb, e );
-#endif /* MDB_MONITOR_IDX */
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	struct berval		bv;
+	BerVarray		vals = NULL;
+
+	bv.bv_val = buf;
+	bv.bv_len = mdb_ecache_stats( mdb, buf, sizeof( buf ) );
+	attr_delete( &e->e_attrs, ad_olmDbEntryCache );
+	attr_merge_normalize_one( e, ad_olmDbEntryCache, &bv, NULL );
+
+	bv.bv_len = mdb_online_stats( mdb, buf, sizeof( buf ) );
+	attr_delete( &e->e_attrs, ad_olmDbIndexing );
+	attr_merge_normalize_one( e, ad_olmDbIndexing, &bv, NULL );
+
+	mdb_autoindex_values( mdb, &vals );
+	attr_delete( &e->e_attrs, ad_olmDbNotIndexed );
+	if ( vals ) {
+		attr_merge( e, ad_olmDbNotIndexed, vals, NULL );
+		ber_bvarray_free( vals );
+	}
 
 	return SLAP_CB_CONTINUE;
 }
@@ -259,20 +282,11 @@ mdb_monitor_initialize( void )
 int
 mdb_monitor_db_init( BackendDB *be )
 {
-#ifdef MDB_MONITOR_IDX
-	struct mdb_info		*mdb = (struct mdb_info *) be->be_private;
-#endif /* MDB_MONITOR_IDX */
-
 	if ( mdb_monitor_initialize() == LDAP_SUCCESS ) {
 		/* monitoring in back-mdb is on by default */
 		SLAP_DBFLAGS( be ) |= SLAP_DBFLAG_MONITORING;
 	}
 
-#ifdef MDB_MONITOR_IDX
-	mdb->mi_idx = NULL;
-	ldap_pvt_thread_mutex_init( &mdb->mi_idx_mutex );
-#endif /* MDB_MONITOR_IDX */
-
 	return 0;
 }
 
@@ -447,211 +461,5 @@ mdb_monitor_db_close( BackendDB *be )
 int
 mdb_monitor_db_destroy( BackendDB *be )
 {
-#ifdef MDB_MONITOR_IDX
-	struct mdb_info		*mdb = (struct mdb_info *) be->be_private;
-
-	/* TODO: free tree */
-	ldap_pvt_thread_mutex_destroy( &mdb->mi_idx_mutex );
-	avl_free( mdb->mi_idx, ch_free );
-#endif /* MDB_MONITOR_IDX */
-
-	return 0;
-}
-
-#ifdef MDB_MONITOR_IDX
-
-#define MDB_MONITOR_IDX_TYPES	(4)
-
-typedef struct monitor_idx_t monitor_idx_t;
-
-struct monitor_idx_t {
-	AttributeDescription	*idx_ad;
-	unsigned long		idx_count[MDB_MONITOR_IDX_TYPES];
-};
-
-static int
-mdb_monitor_bitmask2key( slap_mask_t bitmask )
-{
-	int	key;
-
-	for ( key = 0; key < 8 * (int)sizeof(slap_mask_t) && !( bitmask & 0x1U );
-			key++ )
-		bitmask >>= 1;
-
-	return key;
-}
-
-static struct berval idxbv[] = {
-	BER_BVC( "present=" ),
-	BER_BVC( "equality=" ),
-	BER_BVC( "approx=" ),
-	BER_BVC( "substr=" ),
-	BER_BVNULL
-};
-
-static ber_len_t
-mdb_monitor_idx2len( monitor_idx_t *idx )
-{
-	int		i;
-	ber_len_t	len = 0;
-
-	for ( i = 0; i < MDB_MONITOR_IDX_TYPES; i++ ) {
-		if ( idx->idx_count[ i ] != 0 ) {
-			len += idxbv[i].bv_len;
-		}
-	}
-
-	return len;
-}
-
-static int
-monitor_idx_cmp( const void *p1, const void *p2 )
-{
-	const monitor_idx_t	*idx1 = (const monitor_idx_t *)p1;
-	const monitor_idx_t	*idx2 = (const monitor_idx_t *)p2;
-
-	return SLAP_PTRCMP( idx1->idx_ad, idx2->idx_ad );
-}
-
-static int
-monitor_idx_dup( void *p1, void *p2 )
-{
-	monitor_idx_t	*idx1 = (monitor_idx_t *)p1;
-	monitor_idx_t	*idx2 = (monitor_idx_t *)p2;
-
-	return SLAP_PTRCMP( idx1->idx_ad, idx2->idx_ad ) == 0 ? -1 : 0;
-}
-
-int
-mdb_monitor_idx_add(
-	struct mdb_info		*mdb,
-	AttributeDescription	*desc,
-	slap_mask_t		type )
-{
-	monitor_idx_t		idx_dummy = { 0 },
-				*idx;
-	int			rc = 0, key;
-
-	idx_dummy.idx_ad = desc;
-	key = mdb_monitor_bitmask2key( type ) - 1;
-	if ( key >= MDB_MONITOR_IDX_TYPES ) {
-		/* invalid index type */
-		return -1;
-	}
-
-	ldap_pvt_thread_mutex_lock( &mdb->mi_idx_mutex );
-
-	idx = (monitor_idx_t *)avl_find( mdb->mi_idx,
-		(caddr_t)&idx_dummy, monitor_idx_cmp );
-	if ( idx == NULL ) {
-		idx = (monitor_idx_t *)ch_calloc( sizeof( monitor_idx_t ), 1 );
-		idx->idx_ad = desc;
-		idx->idx_count[ key ] = 1;
-
-		switch ( avl_insert( &mdb->mi_idx, (caddr_t)idx, 
-			monitor_idx_cmp, monitor_idx_dup ) )
-		{
-		case 0:
-			break;
-
-		default:
-			ch_free( idx );
-			rc = -1;
-		}
-
-	} else {
-		idx->idx_count[ key ]++;
-	}
-
-	ldap_pvt_thread_mutex_unlock( &mdb->mi_idx_mutex );
-
-	return rc;
-}
-
-static int
-mdb_monitor_idx_apply( void *v_idx, void *v_valp )
-{
-	monitor_idx_t	*idx = (monitor_idx_t *)v_idx;
-	BerVarray	*valp = (BerVarray *)v_valp;
-
-	struct berval	bv;
-	char		*ptr;
-	char		count_buf[ MDB_MONITOR_IDX_TYPES ][ SLAP_TEXT_BUFLEN ];
-	ber_len_t	count_len[ MDB_MONITOR_IDX_TYPES ],
-			idx_len;
-	int		i, num = 0;
-
-	idx_len = mdb_monitor_idx2len( idx );
-
-	bv.bv_len = 0;
-	for ( i = 0; i < MDB_MONITOR_IDX_TYPES; i++ ) {
-		if ( idx->idx_count[ i ] == 0 ) {
-			continue;
-		}
-
-		count_len[ i ] = snprintf( count_buf[ i ],
-			sizeof( count_buf[ i ] ), "%lu", idx->idx_count[ i ] );
-		bv.bv_len += count_len[ i ];
-		num++;
-	}
-
-	bv.bv_len += idx->idx_ad->ad_cname.bv_len
-		+ num
-		+ idx_len;
-	ptr = bv.bv_val = ch_malloc( bv.bv_len + 1 );
-	ptr = lutil_strcopy( ptr, idx->idx_ad->ad_cname.bv_val );
-	for ( i = 0; i < MDB_MONITOR_IDX_TYPES; i++ ) {
-		if ( idx->idx_count[ i ] == 0 ) {
-			continue;
-		}
-
-		ptr[ 0 ] = '#';
-		++ptr;
-		ptr = lutil_strcopy( ptr, idxbv[ i ].bv_val );
-		ptr = lutil_strcopy( ptr, count_buf[ i ] );
-	}
-
-	ber_bvarray_add( valp, &bv );
-
-	return 0;
-}
-
-static int
-mdb_monitor_idx_entry_add(
-	struct mdb_info	*mdb,
-	Entry		*e )
-{
-	BerVarray	vals = NULL;
-	Attribute	*a;
-
-	a = attr_find( e->e_attrs, ad_olmDbNotIndexed );
-
-	ldap_pvt_thread_mutex_lock( &mdb->mi_idx_mutex );
-
-	avl_apply( mdb->mi_idx, mdb_monitor_idx_apply,
-		&vals, -1, AVL_INORDER );
-
-	ldap_pvt_thread_mutex_unlock( &mdb->mi_idx_mutex );
-
-	if ( vals != NULL ) {
-		if ( a != NULL ) {
-			assert( a->a_nvals == a->a_vals );
-
-			ber_bvarray_free( a->a_vals );
-
-		} else {
-			Attribute	**ap;
-
-			for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
-				;
-			*ap = attr_alloc( ad_olmDbNotIndexed );
-			a = *ap;
-		}
-		a->a_vals = vals;
-		a->a_nvals = a->a_vals;
-	}
-
 	return 0;
 }
-
-#endif /* MDB_MONITOR_IDX */
@@ -0,0 +1,696 @@
+/* online.c - build new indexes while the database is in use */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+
+#include "ldap_rq.h"
+
+/* When indexes are added at runtime, "indexthreads" reader threads
+ * go through id2entry a chunk of ids at a time, each in a read txn of
+ * its own. They decode the entries and run them through the usual
+ * indexing code, which hands the keys to mdb_online_keys instead of
+ * writing them. A chunk's keys are sorted and queued, and the task
+ * itself, as the only writer, inserts the queued batches in one write
+ * txn. Live write ops meanwhile index the new attributes themselves,
+ * as they use ai_newmask.
+ *
+ * A batch may be out of date by the time it is written: an entry may
+ * have been modified or deleted after the reader's snapshot. So while
+ * the indexer runs, write ops record the ids they index, along with
+ * the id of their txn. Before writing a batch the writer drops the
+ * keys of the entries written to after its snapshot, and indexes
+ * them again as they are now.
+ *
+ * "indexrate" limits the entries indexed per second: the writer waits
+ * as needed, and the readers wait for it.
+ */
+
+#define MDB_ONLINE_CHUNK	1024	/* ids a reader takes at a time */
+#define MDB_ONLINE_QUEUE	2	/* batches queued per reader */
+
+typedef struct mdb_ixkey {
+	ID			ik_id;
+	MDB_dbi		ik_dbi;
+	unsigned	ik_len;
+	size_t		ik_off;	/* of the key in ib_buf */
+	char		*ik_val;	/* same, once ib_buf stops moving */
+} mdb_ixkey;
+
+typedef struct mdb_ixbatch {
+	OpExtra		ib_oe;
+	struct mdb_ixbatch	*ib_next;
+	ID			ib_lo, ib_hi;	/* the chunk of ids read */
+	size_t		ib_snap;	/* txn id of the reader's snapshot */
+	int			ib_ready;
+	int			ib_rc;
+	unsigned long	ib_entries;
+	MDB_dbi		ib_dbi;	/* index of the keys being collected */
+	mdb_ixkey	*ib_keys;
+	int			ib_nkeys, ib_maxkeys;
+	char		*ib_buf;
+	size_t		ib_len, ib_size;
+	ID			*ib_redo;	/* ids written to since the snapshot */
+	int			ib_nredo;
+} mdb_ixbatch;
+
+typedef struct mdb_ixtouch {
+	ID			it_id;
+	size_t		it_txnid;
+} mdb_ixtouch;
+
+void
+mdb_online_init( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_init( &mdb->mi_online.mo_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_online.mo_cond );
+}
+
+void
+mdb_online_destroy( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_cond_destroy( &mdb->mi_online.mo_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_online.mo_mutex );
+}
+
+/* The keyfunc of a reader: collect the keys for the writer */
+int
+mdb_online_keys(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	mdb_ixbatch *ib = (mdb_ixbatch *)mc;
+	mdb_ixkey *ik;
+
+	for ( ; keys->bv_val; keys++ ) {
+		if ( ib->ib_nkeys == ib->ib_maxkeys ) {
+			ib->ib_maxkeys = ib->ib_maxkeys ? ib->ib_maxkeys * 2 : 1024;
+			ib->ib_keys = ch_realloc( ib->ib_keys,
+				ib->ib_maxkeys * sizeof( mdb_ixkey ));
+		}
+		while ( ib->ib_len + keys->bv_len > ib->ib_size ) {
+			ib->ib_size = ib->ib_size ? ib->ib_size * 2 : 16384;
+			ib->ib_buf = ch_realloc( ib->ib_buf, ib->ib_size );
+		}
+		ik = &ib->ib_keys[ib->ib_nkeys++];
+		ik->ik_id = id;
+		ik->ik_dbi = ib->ib_dbi;
+		ik->ik_len = keys->bv_len;
+		ik->ik_off = ib->ib_len;
+		AC_MEMCPY( ib->ib_buf + ib->ib_len, keys->bv_val, keys->bv_len );
+		ib->ib_len += keys->bv_len;
+	}
+	return 0;
+}
+
+/* If op is a reader of the online indexer, the "cursor" to give
+ * mdb_online_keys for the keys of dbi.
+ */
+MDB_cursor *
+mdb_online_collector( Operation *op, MDB_dbi dbi )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)mdb_online_keys ) {
+			((mdb_ixbatch *)oex)->ib_dbi = dbi;
+			return (MDB_cursor *)oex;
+		}
+	}
+	return NULL;
+}
+
+/* A write op is indexing entry id for a new index */
+void
+mdb_online_touch( Operation *op, MDB_txn *txn, ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_online *mo = &mdb->mi_online;
+	mdb_ixtouch *it;
+
+	/* mo_active only changes while the indexer holds the write txn,
+	 * so it cannot change during this op's txn.
+	 */
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	if ( !mo->mo_active ) {
+		ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+		return;
+	}
+	if ( mo->mo_ntouched == mo->mo_maxtouched ) {
+		mo->mo_maxtouched = mo->mo_maxtouched ? mo->mo_maxtouched * 2 : 256;
+		mo->mo_touched = ch_realloc( mo->mo_touched,
+			mo->mo_maxtouched * sizeof( mdb_ixtouch ));
+	}
+	it = &mo->mo_touched[mo->mo_ntouched++];
+	it->it_id = id;
+	it->it_txnid = mdb_txn_id( txn );
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+}
+
+static int
+mdb_ixkey_cmp( const void *v1, const void *v2 )
+{
+	const mdb_ixkey *k1 = v1, *k2 = v2;
+	int rc;
+
+	if ( k1->ik_dbi != k2->ik_dbi )
+		return k1->ik_dbi < k2->ik_dbi ? -1 : 1;
+	rc = memcmp( k1->ik_val, k2->ik_val,
+		k1->ik_len < k2->ik_len ? k1->ik_len : k2->ik_len );
+	if ( rc == 0 && k1->ik_len != k2->ik_len )
+		rc = k1->ik_len < k2->ik_len ? -1 : 1;
+	if ( rc == 0 && k1->ik_id != k2->ik_id )
+		rc = k1->ik_id < k2->ik_id ? -1 : 1;
+	return rc;
+}
+
+static int
+mdb_id_cmp( const void *v1, const void *v2 )
+{
+	const ID *i1 = v1, *i2 = v2;
+
+	return *i1 < *i2 ? -1 : *i1 > *i2;
+}
+
+static void
+mdb_ixbatch_free( mdb_ixbatch *ib )
+{
+	ch_free( ib->ib_keys );
+	ch_free( ib->ib_buf );
+	ch_free( ib->ib_redo );
+	ch_free( ib );
+}
+
+/* Collect the keys of the entries in a chunk of ids, in key order */
+static int
+mdb_online_read( Operation *op, MDB_txn *txn, mdb_ixbatch *ib )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *curs;
+	MDB_val key, data;
+	Entry *e;
+	ID id;
+	int i, rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
+	if ( rc )
+		return rc;
+
+	ib->ib_oe.oe_key = (void *)mdb_online_keys;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &ib->ib_oe, oe_next );
+
+	key.mv_size = sizeof(ID);
+	for ( id = ib->ib_lo; id < ib->ib_hi; id++ ) {
+		key.mv_data = &id;
+		rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
+		if ( rc )
+			break;
+		memcpy( &id, key.mv_data, sizeof(ID) );
+		if ( id >= ib->ib_hi )
+			break;
+
+		rc = mdb_id2entry( op, curs, id, &e );
+		if ( rc == MDB_NOTFOUND )
+			continue;
+		if ( rc )
+			break;
+		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+		mdb_entry_return( op, e );
+		if ( rc ) {
+			rc = LDAP_OTHER;
+			break;
+		}
+		ib->ib_entries++;
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, &ib->ib_oe, OpExtra, oe_next );
+	mdb_cursor_close( curs );
+
+	for ( i = 0; i < ib->ib_nkeys; i++ )
+		ib->ib_keys[i].ik_val = ib->ib_buf + ib->ib_keys[i].ik_off;
+	qsort( ib->ib_keys, ib->ib_nkeys, sizeof( mdb_ixkey ), mdb_ixkey_cmp );
+
+	return rc;
+}
+
+static void *
+mdb_online_reader( void *ctx, void *arg )
+{
+	BackendDB *be = arg;
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_online *mo = &mdb->mi_online;
+
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+
+	mdb_op_info opinfo, *moi;
+	mdb_ixbatch *ib;
+	int rc = 0, nqueued;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	op->o_bd = be;
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	while ( 1 ) {
+		/* don't read ahead of the writer too far */
+		for ( ;; ) {
+			nqueued = 0;
+			for ( ib = mo->mo_batches; ib; ib = ib->ib_next )
+				nqueued++;
+			if ( mo->mo_rc || mo->mo_next > mo->mo_last ||
+				nqueued < mo->mo_workers * MDB_ONLINE_QUEUE )
+				break;
+			ldap_pvt_thread_cond_wait( &mo->mo_cond, &mo->mo_mutex );
+		}
+		if ( mo->mo_rc || mo->mo_next > mo->mo_last || slapd_shutdown )
+			break;
+
+		/* take the snapshot while no batch can be written, so that the
+		 * writer knows which write ops it has to look out for
+		 */
+		memset( &opinfo, 0, sizeof( opinfo ));
+		moi = &opinfo;
+		rc = mdb_opinfo_get( op, mdb, 1, &moi );
+		if ( rc )
+			break;
+		ib = ch_calloc( 1, sizeof( mdb_ixbatch ));
+		ib->ib_lo = mo->mo_next;
+		ib->ib_hi = mo->mo_next + MDB_ONLINE_CHUNK;
+		if ( ib->ib_hi > mo->mo_last + 1 )
+			ib->ib_hi = mo->mo_last + 1;
+		ib->ib_snap = mdb_txn_id( moi->moi_txn );
+		mo->mo_next = ib->ib_hi;
+		ib->ib_next = mo->mo_batches;
+		mo->mo_batches = ib;
+		ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+		rc = mdb_online_read( op, moi->moi_txn, ib );
+		mdb_txn_reset( moi->moi_txn );
+		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
+
+		ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+		ib->ib_rc = rc;
+		ib->ib_ready = 1;
+		ldap_pvt_thread_cond_broadcast( &mo->mo_cond );
+		if ( rc )
+			break;
+	}
+	if ( rc && !mo->mo_rc )
+		mo->mo_rc = rc;
+	mo->mo_workers--;
+	ldap_pvt_thread_cond_broadcast( &mo->mo_cond );
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+	return NULL;
+}
+
+/* Write a batch, and index the entries it may be out of date for */
+static int
+mdb_online_write( Operation *op, MDB_txn *txn, mdb_ixbatch *ib )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc = NULL;
+	MDB_dbi dbi = 0;
+	struct berval keys[2];
+	mdb_ixkey *ik;
+	Entry *e;
+	int i, rc = 0;
+
+	BER_BVZERO( &keys[1] );
+	for ( i = 0; i < ib->ib_nkeys; i++ ) {
+		ik = &ib->ib_keys[i];
+		if ( ib->ib_nredo && bsearch( &ik->ik_id, ib->ib_redo,
+			ib->ib_nredo, sizeof( ID ), mdb_id_cmp ))
+			continue;
+		if ( !mc || ik->ik_dbi != dbi ) {
+			if ( mc )
+				mdb_cursor_close( mc );
+			dbi = ik->ik_dbi;
+			rc = mdb_cursor_open( txn, dbi, &mc );
+			if ( rc ) {
+				mc = NULL;
+				break;
+			}
+		}
+		keys[0].bv_val = ik->ik_val;
+		keys[0].bv_len = ik->ik_len;
+		rc = mdb_idl_insert_keys( op->o_bd, mc, keys, ik->ik_id );
+		if ( rc )
+			break;
+	}
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( rc )
+		return rc;
+
+	if ( ib->ib_nredo ) {
+		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+		if ( rc )
+			return rc;
+		for ( i = 0; i < ib->ib_nredo; i++ ) {
+			rc = mdb_id2entry( op, mc, ib->ib_redo[i], &e );
+			if ( rc == MDB_NOTFOUND ) {
+				rc = 0;
+				continue;
+			}
+			if ( rc )
+				break;
+			rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+			mdb_entry_return( op, e );
+			if ( rc )
+				break;
+		}
+		mdb_cursor_close( mc );
+	}
+	return rc;
+}
+
+/* Pick the entries of each batch that were written to since its
+ * snapshot, and forget those no batch can need anymore.
+ */
+static void
+mdb_online_redo( mdb_online *mo, mdb_ixbatch *ready, size_t lasttxn )
+{
+	mdb_ixbatch *ib;
+	mdb_ixtouch *it;
+	size_t oldest = lasttxn;
+	int i, j;
+
+	for ( ib = ready; ib; ib = ib->ib_next ) {
+		for ( i = 0; i < mo->mo_ntouched; i++ ) {
+			it = &mo->mo_touched[i];
+			if ( it->it_id < ib->ib_lo || it->it_id >= ib->ib_hi ||
+				it->it_txnid <= ib->ib_snap )
+				continue;
+			ib->ib_redo = ch_realloc( ib->ib_redo,
+				( ib->ib_nredo + 1 ) * sizeof( ID ));
+			ib->ib_redo[ib->ib_nredo++] = it->it_id;
+		}
+		if ( ib->ib_nredo ) {
+			qsort( ib->ib_redo, ib->ib_nredo, sizeof( ID ), mdb_id_cmp );
+			for ( i = j = 1; i < ib->ib_nredo; i++ ) {
+				if ( ib->ib_redo[i] != ib->ib_redo[j-1] )
+					ib->ib_redo[j++] = ib->ib_redo[i];
+			}
+			ib->ib_nredo = j;
+		}
+	}
+
+	for ( ib = mo->mo_batches; ib; ib = ib->ib_next ) {
+		if ( ib->ib_snap < oldest )
+			oldest = ib->ib_snap;
+	}
+	for ( i = j = 0; i < mo->mo_ntouched; i++ ) {
+		if ( mo->mo_touched[i].it_txnid > oldest )
+			mo->mo_touched[j++] = mo->mo_touched[i];
+	}
+	mo->mo_ntouched = j;
+}
+
+/* Hold the writer back to mi_index_rate */
+static void
+mdb_online_throttle( struct mdb_info *mdb, struct timeval *start )
+{
+	struct timeval now, tv;
+	double due, elapsed;
+
+	if ( !mdb->mi_index_rate )
+		return;
+
+	gettimeofday( &now, NULL );
+	due = (double)mdb->mi_online.mo_entries / mdb->mi_index_rate;
+	elapsed = ( now.tv_sec - start->tv_sec ) +
+		( now.tv_usec - start->tv_usec ) / 1000000.0;
+	if ( due > elapsed ) {
+		due -= elapsed;
+		tv.tv_sec = (long)due;
+		tv.tv_usec = (long)(( due - tv.tv_sec ) * 1000000 );
+		select( 0, NULL, NULL, NULL, &tv );
+	}
+}
+
+/* The runqueue task that builds the new indexes */
+void *
+mdb_online_index( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	BackendDB *be = rtask->arg;
+	struct mdb_info *mdb = be->be_private;
+	mdb_online *mo = &mdb->mi_online;
+
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+
+	MDB_cursor *curs;
+	MDB_val key, data;
+	MDB_txn *txn;
+	mdb_ixbatch *ib, *ready, **prev;
+	struct timeval start;
+	unsigned long entries, keys, redone;
+	int i, rc, nworkers;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+
+	op->o_bd = be;
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	mo->mo_rc = 0;
+	mo->mo_workers = 0;
+	mo->mo_next = 1;
+	mo->mo_last = 0;
+	mo->mo_entries = mo->mo_keys = mo->mo_redone = 0;
+	mo->mo_start = slap_get_time();
+	mo->mo_end = 0;
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+	/* Every write op that begins after this txn records what it
+	 * indexes, and every one before it has committed, so the workers'
+	 * read txns see its changes. Entries added later get ids past
+	 * the last one.
+	 */
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc == 0 ) {
+		ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+		mo->mo_active = 1;
+		ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
+		if ( rc == 0 ) {
+			rc = mdb_cursor_get( curs, &key, &data, MDB_LAST );
+			if ( rc == 0 )
+				memcpy( &mo->mo_last, key.mv_data, sizeof(ID) );
+			else if ( rc == MDB_NOTFOUND )
+				rc = 0;
+			mdb_cursor_close( curs );
+		}
+		mdb_txn_abort( txn );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"cannot find last entry: %s (%d)\n",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+		mo->mo_rc = rc;
+		goto done;
+	}
+
+	nworkers = mdb->mi_index_threads;
+	if ( nworkers > connection_pool_max / 2 )
+		nworkers = connection_pool_max / 2;
+	if ( nworkers < 1 )
+		nworkers = 1;
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	for ( i = 0; i < nworkers; i++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_online_reader, be ) == 0 )
+			mo->mo_workers++;
+	}
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+	Debug( LDAP_DEBUG_STATS,
+		LDAP_XSTRING(mdb_online_index) ": database %s: "
+		"indexing ids up to %lu with %d readers\n",
+		be->be_suffix[0].bv_val, (unsigned long) mo->mo_last, nworkers );
+
+	gettimeofday( &start, NULL );
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	while ( 1 ) {
+		ready = NULL;
+		for ( prev = &mo->mo_batches; ( ib = *prev ); ) {
+			if ( ib->ib_ready ) {
+				*prev = ib->ib_next;
+				ib->ib_next = ready;
+				ready = ib;
+			} else {
+				prev = &ib->ib_next;
+			}
+		}
+		if ( !ready ) {
+			if ( !mo->mo_workers )
+				break;
+			ldap_pvt_thread_cond_wait( &mo->mo_cond, &mo->mo_mutex );
+			continue;
+		}
+		/* the readers may go on */
+		ldap_pvt_thread_cond_broadcast( &mo->mo_cond );
+		ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+		entries = keys = redone = 0;
+		rc = mo->mo_rc;
+		txn = NULL;
+		if ( !rc )
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+		if ( !rc ) {
+			ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+			mdb_online_redo( mo, ready, mdb_txn_id( txn ));
+			ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+		}
+		for ( ib = ready; ib && !rc; ib = ib->ib_next ) {
+			rc = mdb_online_write( op, txn, ib );
+			entries += ib->ib_entries;
+			keys += ib->ib_nkeys;
+			redone += ib->ib_nredo;
+		}
+		if ( txn ) {
+			if ( rc == 0 ) {
+				rc = mdb_txn_commit( txn );
+			} else {
+				mdb_txn_abort( txn );
+			}
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_online_index) ": database %s: "
+					"txn_commit failed: %s (%d)\n",
+					be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			}
+		}
+		while (( ib = ready )) {
+			ready = ib->ib_next;
+			mdb_ixbatch_free( ib );
+		}
+
+		ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+		if ( rc && !mo->mo_rc )
+			mo->mo_rc = rc;
+		if ( !rc ) {
+			mo->mo_entries += entries;
+			mo->mo_keys += keys;
+			mo->mo_redone += redone;
+		}
+		ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+		mdb_online_throttle( mdb, &start );
+		ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+done:
+	/* no write txn may be left that would still record anything */
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	mo->mo_active = 0;
+	ch_free( mo->mo_touched );
+	mo->mo_touched = NULL;
+	mo->mo_ntouched = mo->mo_maxtouched = 0;
+	mo->mo_end = slap_get_time();
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+	if ( rc == 0 )
+		mdb_txn_abort( txn );
+
+	if ( mo->mo_rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"indexing failed (%d)\n",
+			be->be_suffix[0].bv_val, mo->mo_rc, 0 );
+	} else {
+		Debug( LDAP_DEBUG_STATS,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"indexed %lu entries\n",
+			be->be_suffix[0].bv_val, mo->mo_entries, 0 );
+	}
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
+			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
+		{
+			continue;
+		}
+		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
+		mdb->mi_attrs[ i ]->ai_newmask = 0;
+	}
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		if ( mdb->mi_comps[ i ]->ci_indexmask & MDB_INDEX_DELETING
+			|| mdb->mi_comps[ i ]->ci_newmask == 0 )
+		{
+			continue;
+		}
+		mdb->mi_comps[ i ]->ci_indexmask = mdb->mi_comps[ i ]->ci_newmask;
+		mdb->mi_comps[ i ]->ci_newmask = 0;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	mdb->mi_index_task = NULL;
+	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+int
+mdb_online_stats(
+	struct mdb_info *mdb,
+	char *buf,
+	size_t len )
+{
+	mdb_online *mo = &mdb->mi_online;
+	unsigned long next, last, entries, keys, redone;
+	time_t start, end;
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &mo->mo_mutex );
+	next = mo->mo_next;
+	last = mo->mo_last;
+	entries = mo->mo_entries;
+	keys = mo->mo_keys;
+	redone = mo->mo_redone;
+	start = mo->mo_start;
+	end = mo->mo_end;
+	rc = mo->mo_rc;
+	ldap_pvt_thread_mutex_unlock( &mo->mo_mutex );
+
+	if ( !start )
+		return snprintf( buf, len, "state=idle" );
+	if ( next > last + 1 )
+		next = last + 1;
+	return snprintf( buf, len,
+		"state=%s id=%lu last=%lu entries=%lu keys=%lu redone=%lu seconds=%ld",
+		!end ? "running" : rc ? "failed" : "done",
+		next - 1, last, entries, keys, redone,
+		(long)(( end ? end : slap_get_time() ) - start ));
+}
@@ -0,0 +1,321 @@
+/* paged.c - keep the candidates of paged searches between pages */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* A paged search returns one page per request, and the cookie only
+ * names the last entry sent. Instead of selecting the candidates all
+ * over again for every page, the candidate stream of the search, or
+ * its IDL if it was not streamed, is kept here until the next page is
+ * asked for. The frontend runs one paged search at a time on a
+ * connection, so there is at most one of them per connection.
+ *
+ * A kept search is only picked up by the request that continues it:
+ * same connection, cookie, base, scope, filter, and controls that
+ * change the filter. It is dropped once it is older than
+ * mi_paged_timeout, or when newer ones need the room under
+ * mi_paged_max.
+ */
+
+struct mdb_paged {
+	struct mdb_paged	*mp_next;
+	unsigned long	mp_connid;
+	ID			mp_cookie;	/* the last entry sent */
+	ID			mp_baseid;
+	time_t		mp_time;
+	int			mp_scope;
+	int			mp_deref;
+	int			mp_flags;
+#define	MP_MANAGEDSAIT	0x01
+#define	MP_DOMAINSCOPE	0x02
+#define	MP_SUBENTRIES	0x04
+	struct berval	mp_base;
+	struct berval	mp_filter;
+	mdb_stream	*mp_stream;
+	ID			*mp_ids;
+	size_t		mp_size;
+};
+
+static int
+mdb_paged_flags( Operation *op )
+{
+	int flags = 0;
+
+	if ( get_manageDSAit( op ))
+		flags |= MP_MANAGEDSAIT;
+	if ( get_domainScope( op ))
+		flags |= MP_DOMAINSCOPE;
+	if ( get_subentries_visibility( op ))
+		flags |= MP_SUBENTRIES;
+	return flags;
+}
+
+static void
+mdb_paged_free( mdb_paged *mp )
+{
+	mdb_paged *next;
+
+	for ( ; mp; mp = next ) {
+		next = mp->mp_next;
+		if ( mp->mp_stream )
+			mdb_stream_close( mp->mp_stream );
+		if ( mp->mp_ids ) {
+			mdb_idl_free( mp->mp_ids );
+			ch_free( mp->mp_ids );
+		}
+		ch_free( mp );
+	}
+}
+
+/* Move the searches that are too old, or that take more than max
+ * bytes counting from the newest, to the freelist. Called with the
+ * store locked.
+ */
+static mdb_paged *
+mdb_paged_evict( struct mdb_info *mdb, size_t max, time_t now,
+	mdb_paged *freelist )
+{
+	mdb_paged **prev, *mp;
+	size_t size = 0;
+
+	for ( prev = &mdb->mi_paged; ( mp = *prev ) != NULL; ) {
+		if ( size + mp->mp_size > max ||
+			now - mp->mp_time > (time_t) mdb->mi_paged_timeout )
+		{
+			*prev = mp->mp_next;
+			mdb->mi_paged_size -= mp->mp_size;
+			mp->mp_next = freelist;
+			freelist = mp;
+			continue;
+		}
+		size += mp->mp_size;
+		prev = &mp->mp_next;
+	}
+	return freelist;
+}
+
+/* Unlink the search kept for a connection, if any.
+ * Called with the store locked.
+ */
+static mdb_paged *
+mdb_paged_unlink( struct mdb_info *mdb, unsigned long connid )
+{
+	mdb_paged **prev, *mp;
+
+	for ( prev = &mdb->mi_paged; ( mp = *prev ) != NULL;
+		prev = &mp->mp_next )
+	{
+		if ( mp->mp_connid == connid ) {
+			*prev = mp->mp_next;
+			mdb->mi_paged_size -= mp->mp_size;
+			mp->mp_next = NULL;
+			return mp;
+		}
+	}
+	return NULL;
+}
+
+void
+mdb_paged_init( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_init( &mdb->mi_paged_mutex );
+}
+
+void
+mdb_paged_destroy( struct mdb_info *mdb )
+{
+	mdb_paged_flush( mdb );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_paged_mutex );
+}
+
+/* Drop everything, e.g. when the database is closed */
+void
+mdb_paged_flush( struct mdb_info *mdb )
+{
+	mdb_paged *freelist;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	freelist = mdb->mi_paged;
+	mdb->mi_paged = NULL;
+	mdb->mi_paged_size = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( freelist );
+}
+
+/* Apply a new mi_paged_max or mi_paged_timeout */
+void
+mdb_paged_trim( struct mdb_info *mdb )
+{
+	mdb_paged *freelist;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	freelist = mdb_paged_evict( mdb, mdb->mi_paged_max, slap_get_time(),
+		NULL );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( freelist );
+}
+
+/* Pick up the search this request continues. On success either *msp
+ * is the kept stream, renewed on txn, or ids holds the kept IDL.
+ * Anything else kept for the connection is dropped. Returns
+ * MDB_NOTFOUND if the candidates have to be selected again.
+ */
+int
+mdb_paged_get(
+	Operation *op,
+	MDB_txn *txn,
+	ID baseid,
+	mdb_stream **msp,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	PagedResultsState *ps = op->o_pagedresults_state;
+	PagedResultsCookie cookie;
+	mdb_paged *mp;
+	int rc = MDB_NOTFOUND;
+
+	*msp = NULL;
+	if ( !op->o_conn || !mdb->mi_paged )
+		return rc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	mp = mdb_paged_unlink( mdb, op->o_conn->c_connid );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	if ( !mp )
+		return rc;
+
+	if ( ps->ps_cookieval.bv_len != sizeof( cookie ))
+		goto done;
+	AC_MEMCPY( &cookie, ps->ps_cookieval.bv_val, sizeof( cookie ));
+
+	if ( (ID) cookie != mp->mp_cookie ||
+		baseid != mp->mp_baseid ||
+		op->ors_scope != mp->mp_scope ||
+		op->ors_deref != mp->mp_deref ||
+		mdb_paged_flags( op ) != mp->mp_flags ||
+		slap_get_time() - mp->mp_time > (time_t) mdb->mi_paged_timeout ||
+		ber_bvcmp( &op->o_req_ndn, &mp->mp_base ) ||
+		ber_bvcmp( &op->ors_filterstr, &mp->mp_filter ))
+		goto done;
+
+	if ( mp->mp_stream ) {
+		if ( mdb_stream_renew( op, txn, mp->mp_stream ))
+			goto done;
+		*msp = mp->mp_stream;
+		mp->mp_stream = NULL;
+	} else {
+		MDB_IDL_CPY( ids, mp->mp_ids );
+	}
+	rc = 0;
+
+	Debug( LDAP_DEBUG_TRACE,
+		"mdb_paged_get: conn=%lu resumed after %ld\n",
+		op->o_conn->c_connid, (long) mp->mp_cookie, 0 );
+
+done:
+	mdb_paged_free( mp );
+	return rc;
+}
+
+/* Keep the candidates of a search whose page ended at lastid. The
+ * stream, if any, is taken over, and closed if it cannot be kept.
+ */
+void
+mdb_paged_put(
+	Operation *op,
+	ID baseid,
+	ID lastid,
+	mdb_stream *ms,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_paged *mp, *freelist;
+	size_t size;
+	char *ptr;
+
+	size = sizeof( mdb_paged ) + op->o_req_ndn.bv_len +
+		op->ors_filterstr.bv_len + 2;
+	if ( ms )
+		size += mdb_stream_size( ms );
+	else
+		size += MDB_IDL_MEMSIZE( ids );
+
+	if ( !op->o_conn || !mdb->mi_paged_timeout ||
+		size > mdb->mi_paged_max )
+	{
+		if ( ms )
+			mdb_stream_close( ms );
+		return;
+	}
+
+	mp = ch_calloc( 1, sizeof( mdb_paged ) + op->o_req_ndn.bv_len +
+		op->ors_filterstr.bv_len + 2 );
+	mp->mp_connid = op->o_conn->c_connid;
+	mp->mp_cookie = lastid;
+	mp->mp_baseid = baseid;
+	mp->mp_time = slap_get_time();
+	mp->mp_scope = op->ors_scope;
+	mp->mp_deref = op->ors_deref;
+	mp->mp_flags = mdb_paged_flags( op );
+	ptr = (char *)( mp + 1 );
+	mp->mp_base.bv_val = ptr;
+	mp->mp_base.bv_len = op->o_req_ndn.bv_len;
+	AC_MEMCPY( ptr, op->o_req_ndn.bv_val, op->o_req_ndn.bv_len );
+	ptr += op->o_req_ndn.bv_len + 1;
+	mp->mp_filter.bv_val = ptr;
+	mp->mp_filter.bv_len = op->ors_filterstr.bv_len;
+	AC_MEMCPY( ptr, op->ors_filterstr.bv_val, op->ors_filterstr.bv_len );
+	if ( ms ) {
+		mp->mp_stream = ms;
+	} else {
+		mp->mp_ids = ch_malloc( MDB_IDL_SIZEOF( ids ));
+		MDB_IDL_CPY( mp->mp_ids, ids );
+	}
+	mp->mp_size = size;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	freelist = mdb_paged_unlink( mdb, mp->mp_connid );
+	freelist = mdb_paged_evict( mdb, mdb->mi_paged_max - size,
+		mp->mp_time, freelist );
+	mp->mp_next = mdb->mi_paged;
+	mdb->mi_paged = mp;
+	mdb->mi_paged_size += size;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( freelist );
+}
+
+/* Drop what is kept for a connection that is closing */
+int
+mdb_paged_conn_destroy( BackendDB *be, Connection *conn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_paged *mp;
+
+	if ( !mdb->mi_paged )
+		return 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_paged_mutex );
+	mp = mdb_paged_unlink( mdb, conn->c_connid );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_paged_mutex );
+	mdb_paged_free( mp );
+	return 0;
+}
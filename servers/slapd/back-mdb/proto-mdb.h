@@ -27,6 +27,8 @@ LDAP_BEGIN_DECL
 AttrInfo *mdb_attr_mask( struct mdb_info *mdb,
 	AttributeDescription *desc );
 
+CompInfo *mdb_comp_find( struct mdb_info *mdb, const char *name );
+
 void mdb_attr_flush( struct mdb_info *mdb );
 
 int mdb_attr_slot( struct mdb_info *mdb,
@@ -57,6 +59,8 @@ void mdb_attr_info_free( AttrInfo *ai );
 
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
+int mdb_format_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr );
+int mdb_format_write( struct mdb_info *mdb, MDB_txn *txn );
 
 /*
  * config.c
@@ -64,6 +68,24 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
 int mdb_back_init_cf( BackendInfo *bi );
 
+/*
+ * count.c
+ */
+
+extern int mdb_count_cid;
+
+/* Count the matches of this search instead of sending them */
+#define MDB_COUNTING(op)	\
+	((op)->o_ctrlflag[mdb_count_cid] > SLAP_CONTROL_IGNORED)
+
+int mdb_count_initialize( void );
+
+int mdb_count_ctrl(
+	Operation *op,
+	SlapReply *rs,
+	ID nentries,
+	ID nrefs );
+
 /*
  * dn2entry.c
  */
@@ -161,6 +183,76 @@ void mdb_dn2id_wrestore(
 
 MDB_cmp_func mdb_dup_compare;
 
+/*
+ * ecache.c
+ */
+
+void mdb_ecache_init( struct mdb_info *mdb );
+void mdb_ecache_destroy( struct mdb_info *mdb );
+void mdb_ecache_flush( struct mdb_info *mdb );
+void mdb_ecache_trim( struct mdb_info *mdb );
+
+int mdb_ecache_get(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	Entry **e );
+
+void mdb_ecache_put(
+	Operation *op,
+	MDB_txn *txn,
+	Entry **e );
+
+void mdb_ecache_release( mdb_ecnode *en );
+
+void mdb_ecache_invalidate(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id );
+
+int mdb_ecache_stats(
+	struct mdb_info *mdb,
+	char *buf,
+	size_t len );
+
+/*
+ * explain.c
+ */
+
+extern int mdb_explain_cid;
+
+/* The plan being built for this search, if it asked for one.
+ * Internal operations may have no control slots at all.
+ */
+#define MDB_EXPLAIN(op)	((op)->o_controls ? \
+	(mdb_explain *)(op)->o_controls[mdb_explain_cid] : NULL)
+
+int mdb_explain_initialize( void );
+
+int mdb_explain_begin(
+	Operation *op,
+	SlapReply *rs,
+	Entry *base,
+	mdb_explain *me );
+
+void mdb_explain_end(
+	Operation *op,
+	mdb_explain *me );
+
+void mdb_explain_printf(
+	Operation *op,
+	const char *fmt, ... ) LDAP_GCCATTR((format(printf, 2, 3)));
+
+void mdb_explain_filter(
+	Operation *op,
+	const char *keyword,
+	Filter *f,
+	const char *tail );
+
+int mdb_explain_ctrl(
+	Operation *op,
+	SlapReply *rs );
+
 /*
  * filterentry.c
  */
@@ -214,7 +306,8 @@ BI_entry_release_rw mdb_entry_release;
 BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
-int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
+int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e,
+	mdb_projection *pj );
 
 void mdb_reader_flush( MDB_env *env );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
@@ -222,6 +315,9 @@ int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info
 int mdb_mval_put(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
 int mdb_mval_del(Operation *op, MDB_cursor *mc, ID id, Attribute *a);
 
+int mdb_dict_open( BackendDB *be, MDB_txn *txn, ConfigReply *cr );
+void mdb_dict_flush( struct mdb_info *mdb );
+
 /*
  * idl.c
  */
@@ -237,6 +333,35 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_key_shape(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	int			*kind,
+	ID			*lo,
+	ID			*hi,
+	ID			*count,
+	ID			*items );
+
+int mdb_idl_count_key(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count,
+	ID			*items );
+
+int mdb_idl_seek_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	ID			*next );
+
+int mdb_idl_bm_seek_key(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			id,
+	ID			*word,
+	ID			*next );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
@@ -258,6 +383,15 @@ mdb_idl_union(
 	ID *a,
 	ID *b );
 
+int
+mdb_idl_notin(
+	ID *a,
+	ID *b );
+
+int mdb_idl_bm_test( ID *ids, ID id );
+void mdb_idl_free( ID *ids );
+void mdb_idl_copy( ID *dst, ID *src );
+
 ID mdb_idl_first( ID *ids, ID *cursor );
 ID mdb_idl_next( ID *ids, ID *cursor );
 
@@ -276,9 +410,12 @@ mdb_index_mask LDAP_P((
 	AttributeDescription *desc,
 	struct berval *name ));
 
+extern int
+mdb_index_is_presence LDAP_P(( MDB_val *key ));
+
 extern int
 mdb_index_param LDAP_P((
-	Backend *be,
+	Operation *op,
 	AttributeDescription *desc,
 	int ftype,
 	MDB_dbi *dbi,
@@ -318,6 +455,24 @@ int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+int mdb_index_comps LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
+
+extern int
+mdb_index_comps_modify LDAP_P((
+	Operation *op,
+	MDB_txn *txn,
+	Modifications *modlist,
+	Attribute *old,
+	Entry *e ));
+
+extern CompInfo *
+mdb_index_comp_filter LDAP_P((
+	Operation *op,
+	MDB_txn *txn,
+	Filter *flist,
+	Filter **fs,
+	struct berval *key ));
+
 /*
  * key.c
  */
@@ -332,6 +487,14 @@ mdb_key_read(
     MDB_cursor **saved_cursor,
         int get_flags );
 
+extern int
+mdb_key_count(
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count,
+	ID *items );
+
 /*
  * nextid.c
  */
@@ -360,13 +523,137 @@ int mdb_monitor_db_open( BackendDB *be );
 int mdb_monitor_db_close( BackendDB *be );
 int mdb_monitor_db_destroy( BackendDB *be );
 
-#ifdef MDB_MONITOR_IDX
-int
-mdb_monitor_idx_add(
-	struct mdb_info		*mdb,
-	AttributeDescription	*desc,
-	slap_mask_t		type );
-#endif /* MDB_MONITOR_IDX */
+/*
+ * paged.c
+ */
+
+void mdb_paged_init( struct mdb_info *mdb );
+void mdb_paged_destroy( struct mdb_info *mdb );
+void mdb_paged_flush( struct mdb_info *mdb );
+void mdb_paged_trim( struct mdb_info *mdb );
+
+int mdb_paged_get(
+	Operation *op,
+	MDB_txn *txn,
+	ID baseid,
+	mdb_stream **msp,
+	ID *ids );
+
+void mdb_paged_put(
+	Operation *op,
+	ID baseid,
+	ID lastid,
+	mdb_stream *ms,
+	ID *ids );
+
+extern BI_connection_destroy	mdb_paged_conn_destroy;
+
+/*
+ * online.c
+ */
+
+void mdb_online_init( struct mdb_info *mdb );
+void mdb_online_destroy( struct mdb_info *mdb );
+void *mdb_online_index( void *ctx, void *arg );
+
+mdb_idl_keyfunc mdb_online_keys;
+MDB_cursor *mdb_online_collector( Operation *op, MDB_dbi dbi );
+void mdb_online_touch( Operation *op, MDB_txn *txn, ID id );
+
+int mdb_online_stats(
+	struct mdb_info *mdb,
+	char *buf,
+	size_t len );
+
+/*
+ * autoindex.c
+ */
+
+void mdb_autoindex_init( struct mdb_info *mdb );
+void mdb_autoindex_destroy( struct mdb_info *mdb );
+
+void mdb_autoindex_begin( Operation *op, mdb_unseen *mu );
+void mdb_autoindex_note(
+	Operation *op,
+	AttributeDescription *ad,
+	slap_mask_t type );
+void mdb_autoindex_end( Operation *op, mdb_unseen *mu, ID tested );
+
+void mdb_autoindex_values( struct mdb_info *mdb, BerVarray *vals );
+
+/*
+ * group.c
+ */
+
+void mdb_group_init( struct mdb_info *mdb );
+void mdb_group_destroy( struct mdb_info *mdb );
+
+int mdb_group_join(
+	Operation *op,
+	SlapReply *rs,
+	BI_op_func *func );
+
+void mdb_group_send(
+	Operation *op,
+	SlapReply *rs );
+
+int mdb_group_begin(
+	Operation *op,
+	struct mdb_info *mdb,
+	mdb_op_info *moi );
+
+int mdb_group_commit(
+	struct mdb_info *mdb,
+	mdb_op_info *moi,
+	MDB_txn *txn );
+
+void mdb_group_abort(
+	struct mdb_info *mdb,
+	mdb_op_info *moi,
+	MDB_txn *txn );
+
+/*
+ * stream.c
+ */
+
+int mdb_stream_open(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	mdb_stream **msp );
+
+int mdb_stream_order(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	ID limit,
+	mdb_stream **msp );
+
+int mdb_stream_sort(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	SortedSearch *ss,
+	int whole,
+	mdb_stream **msp );
+
+int mdb_stream_absent(
+	Operation *op,
+	MDB_txn *txn,
+	AttributeDescription *desc,
+	struct berval *val );
+
+void mdb_stream_close( mdb_stream *ms );
+
+ID mdb_stream_estimate( mdb_stream *ms );
+int mdb_stream_exact( mdb_stream *ms );
+int mdb_stream_ordered( mdb_stream *ms );
+ID mdb_stream_next( mdb_stream *ms, ID min );
+int mdb_stream_test( mdb_stream *ms, ID id );
+int mdb_stream_error( mdb_stream *ms );
+size_t mdb_stream_size( mdb_stream *ms );
+
+int mdb_stream_renew( Operation *op, MDB_txn *txn, mdb_stream *ms );
 
 /*
  * former external.h
@@ -402,8 +689,10 @@ extern BI_tool_entry_reindex		mdb_tool_entry_reindex;
 extern BI_tool_dn2id_get		mdb_tool_dn2id_get;
 extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
+extern BI_tool_entry_walk		mdb_tool_entry_walk;
 
 extern mdb_idl_keyfunc mdb_tool_idl_add;
+extern mdb_idl_keyfunc mdb_tool_bulk_keys;
 
 LDAP_END_DECL
 
@@ -34,7 +34,7 @@ static int search_candidates(
 	IdScopes *isc,
 	MDB_cursor *mci,
 	ID	*ids,
-	ID *stack );
+	mdb_stream **msp );
 
 static int parse_paged_cookie( Operation *op, SlapReply *rs );
 
@@ -159,6 +159,7 @@ static int search_aliases(
 	rs->sr_err = mdb_filter_candidates( op, isc->mt, &af, aliases,
 		curscop, visited );
 	if (rs->sr_err != LDAP_SUCCESS || MDB_IDL_IS_ZERO( aliases )) {
+		mdb_idl_free( aliases );
 		return rs->sr_err;
 	}
 	oldsubs[0] = 1;
@@ -258,6 +259,7 @@ nextido:
 			e_id = ido;
 		}
 	}
+	mdb_idl_free( aliases );
 	return rs->sr_err;
 }
 
@@ -317,8 +319,6 @@ static void scope_chunk_ret( Operation *op, ID2 *scopes )
 			(void *)scopes, scope_chunk_free, NULL, NULL );
 }
 
-static void *search_stack( Operation *op );
-
 typedef struct ww_ctx {
 	MDB_txn *txn;
 	MDB_cursor *mcd;	/* if set, save cursor context */
@@ -364,7 +364,8 @@ mdb_writewait( Operation *op, slap_callback *sc )
 }
 
 static int
-mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdScopes *isc )
+mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdScopes *isc,
+	mdb_stream *ms )
 {
 	MDB_val key;
 	int rc = 0;
@@ -407,19 +408,360 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 			mdb_cursor_get( mcd, &key, &isc->scopes[i].mval, MDB_SET );
 		}
 	}
+	if ( ms && rc == 0 && mdb_stream_renew( op, ww->txn, ms ))
+		rc = LDAP_OTHER;
 	return rc;
 }
 
+/* Does testing this filter look at attribute ad? */
+static int
+filter_uses_ad( Filter *f, AttributeDescription *ad )
+{
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( filter_uses_ad( f, ad ))
+				return 1;
+		}
+		return 0;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		return is_ad_subtype( ad, f->f_av_desc );
+
+	case LDAP_FILTER_SUBSTRINGS:
+		return is_ad_subtype( ad, f->f_sub_desc );
+
+	case LDAP_FILTER_PRESENT:
+		return is_ad_subtype( ad, f->f_desc );
+
+	case LDAP_FILTER_EXT:
+		/* without a type, any attribute may match */
+		return !f->f_mr_desc || is_ad_subtype( ad, f->f_mr_desc );
+
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+
+	default:
+		return 1;
+	}
+}
+
+/* Does checking these ACLs against an entry look at attribute ad? */
+static int
+acl_uses_ad( AccessControl *ac, AttributeDescription *ad )
+{
+	Access *b;
+
+	for ( ; ac; ac = ac->acl_next ) {
+		if ( ac->acl_filter && filter_uses_ad( ac->acl_filter, ad ))
+			return 1;
+		for ( b = ac->acl_access; b; b = b->a_next ) {
+			/* a group may be the entry itself */
+			if (( b->a_dn_at && is_ad_subtype( ad, b->a_dn_at )) ||
+				( b->a_realdn_at && is_ad_subtype( ad, b->a_realdn_at )) ||
+				( b->a_group_at && is_ad_subtype( ad, b->a_group_at )))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/* Can't tell what sets and dynamic ACLs look at */
+static int
+acl_opaque( AccessControl *ac )
+{
+	Access *b;
+
+	for ( ; ac; ac = ac->acl_next ) {
+		for ( b = ac->acl_access; b; b = b->a_next ) {
+			if ( !BER_BVISEMPTY( &b->a_set_pat ))
+				return 1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return 1;
+#endif /* SLAP_DYNACL */
+		}
+	}
+	return 0;
+}
+
+/* Work out which attributes of the candidates have to be decoded:
+ * those the filter tests, those the ACLs look at, and those that
+ * send_search_entry() would return. Returns 0 if that is all of them.
+ */
+static int
+search_projection( Operation *op, mdb_projection *pj )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	AttributeDescription *ad;
+	slap_mask_t flags;
+	int i, want, nwant = 0;
+
+	/* overlays and internal searches may look at anything */
+	if ( op->o_callback )
+		return 0;
+
+	flags = slap_attr_flags( op->ors_attrs );
+	if ( SLAP_USERATTRS( flags ) && SLAP_OPATTRS( flags ) &&
+		!MDB_COUNTING( op ))
+		return 0;
+
+	if ( acl_opaque( op->o_bd->be_acl ) || acl_opaque( frontendDB->be_acl ))
+		return 0;
+
+	pj->pj_nads = mdb->mi_numads;
+	pj->pj_want = op->o_tmpcalloc( pj->pj_nads + 1, 1, op->o_tmpmemctx );
+	for ( i = 1; i <= pj->pj_nads; i++ ) {
+		ad = mdb->mi_ads[i];
+		if ( ad == slap_schema.si_ad_objectClass ||
+			ad == slap_schema.si_ad_ref )
+		{
+			want = 1;
+		} else if ( MDB_COUNTING( op )) {
+			/* nothing is sent */
+			want = 0;
+		} else if ( op->ors_attrs == NULL ) {
+			want = !is_at_operational( ad->ad_type );
+		} else if ( is_at_operational( ad->ad_type )) {
+			want = SLAP_OPATTRS( flags ) || ad_inlist( ad, op->ors_attrs );
+		} else {
+			want = SLAP_USERATTRS( flags ) || ad_inlist( ad, op->ors_attrs );
+		}
+		if ( !want ) {
+			want = filter_uses_ad( op->ors_filter, ad ) ||
+				acl_uses_ad( op->o_bd->be_acl, ad ) ||
+				acl_uses_ad( frontendDB->be_acl, ad );
+		}
+		pj->pj_want[i] = want;
+		nwant += want;
+	}
+
+	if ( nwant == pj->pj_nads ) {
+		op->o_tmpfree( pj->pj_want, op->o_tmpmemctx );
+		return 0;
+	}
+	mdb_explain_printf( op, "decode: %d of %d attributes\n",
+		nwant, pj->pj_nads );
+	return 1;
+}
+
+/* Does the filter assert a supertype of ad, rather than ad itself? */
+static int
+filter_asserts_super( Filter *f, AttributeDescription *ad )
+{
+	AttributeDescription *desc;
+
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( filter_asserts_super( f, ad ))
+				return 1;
+		}
+		return 0;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		desc = f->f_av_desc;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		desc = f->f_sub_desc;
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		desc = f->f_desc;
+		break;
+
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+
+	default:
+		return 1;
+	}
+	return desc != ad && is_ad_subtype( ad, desc );
+}
+
+/* Can these ACLs be checked on an entry that was not read? They must
+ * not look at its attributes, nor tell apart the subtypes of an
+ * attribute the filter asserts, which test_filter() checks one by one.
+ */
+static int
+acl_dn_only( AccessControl *ac, Filter *f )
+{
+	AttributeName *an;
+	Access *b;
+
+	for ( ; ac; ac = ac->acl_next ) {
+		if ( ac->acl_filter )
+			return 0;
+		for ( an = ac->acl_attrs; an && !BER_BVISNULL( &an->an_name ); an++ ) {
+			if ( an->an_desc && filter_asserts_super( f, an->an_desc ))
+				return 0;
+		}
+		for ( b = ac->acl_access; b; b = b->a_next ) {
+			if ( b->a_dn_at || b->a_realdn_at || b->a_group_at )
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static struct berval bv_referral = BER_BVC( "referral" );
+static struct berval bv_subentry = BER_BVC( "subentry" );
+static struct berval bv_glue = BER_BVC( "glue" );
+
+/* Can the candidates be answered without reading them? Only if all of
+ * them are known to match, nothing but their DNs is sent back, and
+ * nothing else about an entry is needed to decide whether it may be.
+ */
+static int
+search_covered( Operation *op, MDB_txn *txn, mdb_stream *ms )
+{
+	AttributeDescription *ad = slap_schema.si_ad_objectClass;
+	AttributeName *an;
+
+	if ( !ms || !mdb_stream_exact( ms ) || op->o_callback ||
+		get_subentries_visibility( op ))
+		return 0;
+
+	if ( !MDB_COUNTING( op )) {
+		if ( !op->ors_attrs || BER_BVISNULL( &op->ors_attrs[0].an_name ))
+			return 0;
+		for ( an = op->ors_attrs; !BER_BVISNULL( &an->an_name ); an++ ) {
+			if ( !bvmatch( &an->an_name, slap_bv_no_attrs ))
+				return 0;
+		}
+	}
+
+	if ( !be_isroot( op ) &&
+		( acl_opaque( op->o_bd->be_acl ) || acl_opaque( frontendDB->be_acl ) ||
+		!acl_dn_only( op->o_bd->be_acl, op->ors_filter ) ||
+		!acl_dn_only( frontendDB->be_acl, op->ors_filter )))
+		return 0;
+
+	/* the entries that are treated differently have to be told apart */
+	if ( !mdb_stream_absent( op, txn, ad, &bv_subentry ))
+		return 0;
+	if ( !get_manageDSAit( op ) &&
+		( !mdb_stream_absent( op, txn, ad, &bv_referral ) ||
+		!mdb_stream_absent( op, txn, ad, &bv_glue )))
+		return 0;
+
+	mdb_explain_printf( op, "covered: entries not read\n" );
+	return 1;
+}
+
+/* Does a sorted search from e see every entry of the database, so
+ * that a virtual list view can count them by the sizes of index keys
+ * and skip them unread? Only if it goes all the way down from the
+ * suffix, and the rootdn makes it: ACLs on DNs alone can still hide
+ * entries, and each would have to be checked. Nor may there be any
+ * entries that a search leaves out or sends differently.
+ */
+static int
+search_whole( Operation *op, MDB_txn *txn, Entry *e )
+{
+	AttributeDescription *ad = slap_schema.si_ad_objectClass;
+
+	if ( op->ors_scope != LDAP_SCOPE_SUBTREE ||
+		!be_issuffix( op->o_bd, &e->e_nname ) || !be_isroot( op ) ||
+		get_subentries_visibility( op ))
+		return 0;
+
+	if ( !mdb_stream_absent( op, txn, ad, &bv_subentry ))
+		return 0;
+	if ( !get_manageDSAit( op ) &&
+		( !mdb_stream_absent( op, txn, ad, &bv_referral ) ||
+		!mdb_stream_absent( op, txn, ad, &bv_glue )))
+		return 0;
+	return 1;
+}
+
+/* The candidates of a covered search all match. Whether they may be
+ * seen to match depends on access to the attributes asserted, which
+ * test_filter() would have checked first.
+ */
+static int
+covered_access( Operation *op, Entry *e, Filter *f )
+{
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( !covered_access( op, e, f ))
+				return 0;
+		}
+		return 1;
+
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		return access_allowed( op, e, f->f_av_desc, &f->f_av_value,
+			ACL_SEARCH, NULL );
+
+	case LDAP_FILTER_SUBSTRINGS:
+		return access_allowed( op, e, f->f_sub_desc, NULL, ACL_SEARCH, NULL );
+
+	case LDAP_FILTER_PRESENT:
+		return access_allowed( op, e, f->f_desc, NULL, ACL_SEARCH, NULL );
+
+	case SLAPD_FILTER_COMPUTED:
+		return f->f_result == LDAP_COMPARE_TRUE;
+
+	default:
+		return 0;
+	}
+}
+
+/* Read the entry a covered search could not decide without it */
+static int
+covered_read(
+	Operation *op,
+	MDB_txn *txn,
+	MDB_cursor *mci,
+	mdb_projection *pj,
+	Entry **ep )
+{
+	Entry *e = *ep, *r;
+	MDB_val edata;
+	int rc;
+
+	if ( mdb_ecache_get( op, txn, e->e_id, &r ) != MDB_SUCCESS ) {
+		rc = mdb_id2edata( op, mci, e->e_id, &edata );
+		if ( rc == 0 )
+			rc = mdb_entry_decode( op, txn, &edata, e->e_id, &r, pj );
+		if ( rc )
+			return rc;
+	}
+	r->e_id = e->e_id;
+	r->e_name = e->e_name;
+	r->e_nname = e->e_nname;
+	op->o_tmpfree( e, op->o_tmpmemctx );
+	*ep = r;
+	return 0;
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	ID		id, cursor, nsubs, ncand, cscope;
+	ID		id, cursor, nsubs, ncand, cscope, baseid;
 	ID		lastid = NOID;
 	ID		candidates[MDB_IDL_UM_SIZE];
 	ID		iscopes[MDB_IDL_DB_SIZE];
 	ID2		*scopes;
-	void	*stack;
+	mdb_stream	*ms = NULL;
 	Entry		*e = NULL, *base = NULL;
 	Entry		*matched = NULL;
 	AttributeName	*attrs;
@@ -431,6 +773,11 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	mdb_explain	explain, *me = NULL, *outer;
+	mdb_projection	proj, *pj = NULL;
+	mdb_unseen	unseen = {{{0}}};
+	ID		ncount = 0, nrefs = 0, ntested = 0;
+	int		covered = 0, stub = 0;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -464,17 +811,23 @@ mdb_search( Operation *op, SlapReply *rs )
 		return rs->sr_err;
 	}
 
+	/* An internal search made while this op is being explained,
+	 * e.g. by an overlay, shares its control slots. Keep the outer
+	 * plan out of its way until it is done.
+	 */
+	outer = MDB_EXPLAIN( op );
+	if ( outer )
+		op->o_controls[mdb_explain_cid] = NULL;
+
 	scopes = scope_chunk_get( op );
-	stack = search_stack( op );
 	isc.mt = ltid;
 	isc.mc = mcd;
 	isc.scopes = scopes;
 	isc.oscope = op->ors_scope;
-	isc.sctmp = stack;
+	isc.sctmp = op->o_tmpalloc( ( MAXRDNS + 1 ) * sizeof( ID2 ),
+		op->o_tmpmemctx );
 
-	if ( op->ors_deref & LDAP_DEREF_FINDING ) {
-		MDB_IDL_ZERO(candidates);
-	}
+	MDB_IDL_ZERO(candidates);
 dn2entry_retry:
 	/* get entry with reader lock */
 	rs->sr_err = mdb_dn2entry( op, ltid, mcd, &op->o_req_ndn, &e, &nsubs, 1 );
@@ -634,11 +987,24 @@ dn2entry_retry:
 	stoptime = op->o_time + op->ors_tlimit;
 
 	base = e;
+	baseid = base->e_id;
 
 	e = NULL;
 
+	rs->sr_err = mdb_explain_begin( op, rs, base, &explain );
+	if ( rs->sr_err != LDAP_SUCCESS ) {
+		send_ldap_result( op, rs );
+		goto done;
+	}
+	me = MDB_EXPLAIN( op );
+	mdb_autoindex_begin( op, &unseen );
+
+	if ( search_projection( op, &proj ))
+		pj = &proj;
+
 	/* select candidates */
 	if ( op->oq_search.rs_scope == LDAP_SCOPE_BASE ) {
+		mdb_explain_filter( op, "filter", op->ors_filter, "" );
 		rs->sr_err = base_candidate( op->o_bd, base, candidates );
 		scopes[0].mid = 0;
 		ncand = 1;
@@ -663,9 +1029,20 @@ dn2entry_retry:
 		scopes[0].mid = 1;
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
-		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
-		ncand = MDB_IDL_N( candidates );
+		if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED &&
+			mdb_paged_get( op, ltid, base->e_id, &ms, candidates ) == 0 )
+		{
+			/* pick up where the previous page left off */
+			mdb_explain_printf( op, "paged: resumed\n" );
+			rs->sr_err = LDAP_SUCCESS;
+		} else {
+			rs->sr_err = search_candidates( op, rs, base,
+				&isc, mci, candidates, &ms );
+		}
+		if ( ms )
+			ncand = mdb_stream_estimate( ms );
+		else
+			ncand = MDB_IDL_N( candidates );
 		if ( !base->e_id || ncand == NOID ) {
 			/* grab entry count from id2entry stat
 			 */
@@ -677,12 +1054,15 @@ dn2entry_retry:
 				ncand = ms.ms_entries;
 		}
 	}
+	covered = search_covered( op, ltid, ms );
+	mdb_explain_printf( op, "candidates: %ld%s\n", (long) ncand,
+		ms ? " estimated" : "" );
 
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
 
-	if ( candidates[0] == 0 ) {
+	if ( ms ? ncand == 0 : candidates[0] == 0 ) {
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_search) ": no candidates\n",
 			0, 0, 0 );
@@ -735,7 +1115,10 @@ dn2entry_retry:
 			send_ldap_result( op, rs );
 			goto done;
 		}
-		id = mdb_idl_first( candidates, &cursor );
+		if ( ms )
+			id = mdb_stream_next( ms, cursor );
+		else
+			id = mdb_idl_first( candidates, &cursor );
 		if ( id == NOID ) {
 			Debug( LDAP_DEBUG_TRACE, 
 				LDAP_XSTRING(mdb_search)
@@ -747,13 +1130,19 @@ dn2entry_retry:
 			goto done;
 		}
 		if ( id == (ID)ps->ps_cookie )
-			id = mdb_idl_next( candidates, &cursor );
+			id = ms ? mdb_stream_next( ms, id + 1 )
+				: mdb_idl_next( candidates, &cursor );
 		nsubs = ncand;	/* always bypass scope'd search */
+		mdb_explain_printf( op, "scope: check candidates\n" );
 		goto loop_begin;
 	}
+	/* an ordered stream has to be followed in its own order */
+	if ( ms && mdb_stream_ordered( ms ))
+		nsubs = ncand;
 	if ( nsubs < ncand ) {
 		int rc;
 		/* Do scope-based search */
+		mdb_explain_printf( op, "scope: walk %ld entries\n", (long) nsubs );
 
 		/* if any alias scopes were set, save them */
 		if (scopes[0].mid > 1) {
@@ -779,7 +1168,11 @@ dn2entry_retry:
 			id = isc.id;
 		cscope = 0;
 	} else {
-		id = mdb_idl_first( candidates, &cursor );
+		mdb_explain_printf( op, "scope: check candidates\n" );
+		if ( ms )
+			id = mdb_stream_next( ms, 0 );
+		else
+			id = mdb_idl_first( candidates, &cursor );
 	}
 
 	while (id != NOID)
@@ -821,9 +1214,12 @@ loop_begin:
 			unsigned i;
 			/* Is this entry in the candidate list? */
 			scopeok = 0;
-			if (MDB_IDL_IS_RANGE( candidates )) {
+			if ( ms ) {
+				scopeok = mdb_stream_test( ms, id );
+			} else if (MDB_IDL_IS_RANGE( candidates )) {
 				if ( id >= MDB_IDL_RANGE_FIRST( candidates ) &&
-					id <= MDB_IDL_RANGE_LAST( candidates ))
+					id <= MDB_IDL_RANGE_LAST( candidates ) &&
+					mdb_idl_bm_test( candidates, id ))
 					scopeok = 1;
 			} else {
 				i = mdb_idl_search( candidates, id );
@@ -882,9 +1278,19 @@ loop_begin:
 		}
 
 scopeok:
+		if ( me )
+			me->me_inscope++;
+		stub = 0;
 		if ( id == base->e_id ) {
 			e = base;
-		} else {
+		} else if ( covered ) {
+			/* just the DN, filled in below */
+			e = op->o_tmpcalloc( 1, sizeof( Entry ), op->o_tmpmemctx );
+			e->e_id = id;
+			e->e_private = e;
+			e->e_ocflags = SLAP_OC__END;
+			stub = 1;
+		} else if ( mdb_ecache_get( op, ltid, id, &e ) != MDB_SUCCESS ) {
 
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
@@ -893,7 +1299,7 @@ notfound:
 				if( nsubs < ncand )
 					goto loop_continue;
 
-				if( !MDB_IDL_IS_RANGE(candidates) ) {
+				if( ms || !MDB_IDL_IS_RANGE(candidates) ) {
 					/* only complain for non-range IDLs */
 					Debug( LDAP_DEBUG_TRACE,
 						LDAP_XSTRING(mdb_search)
@@ -922,7 +1328,7 @@ notfound:
 				goto done;
 			}
 
-			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e );
+			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e, pj );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
@@ -1044,7 +1450,9 @@ notfound:
 			rs->sr_entry = e;
 			rs->sr_flags = 0;
 
-			send_search_reference( op, rs );
+			if ( !me || !me->me_only )
+				send_search_reference( op, rs );
+			nrefs++;
 
 			if (e != base)
 				mdb_entry_return( op, e );
@@ -1058,8 +1466,27 @@ notfound:
 			goto loop_continue;
 		}
 
+		if ( stub && !covered_access( op, e, op->oq_search.rs_filter )) {
+			/* let test_filter() work out what may be seen */
+			rs->sr_err = covered_read( op, ltid, mci, pj, &e );
+			if ( rs->sr_err ) {
+				rs->sr_err = LDAP_OTHER;
+				rs->sr_text = "internal error in mdb_entry_decode";
+				send_ldap_result( op, rs );
+				goto done;
+			}
+			stub = 0;
+		}
+
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		rs->sr_err = stub ? LDAP_COMPARE_TRUE
+			: test_filter( op, e, op->oq_search.rs_filter );
+		ntested++;
+		if ( me ) {
+			me->me_tested++;
+			if ( rs->sr_err == LDAP_COMPARE_TRUE )
+				me->me_matched++;
+		}
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
@@ -1068,13 +1495,24 @@ notfound:
 					if (e != base)
 						mdb_entry_return( op, e );
 					e = NULL;
+					/* keep the candidates for the next page */
+					if ( moi == &opinfo && !( ms && mdb_stream_error( ms ))) {
+						mdb_paged_put( op, baseid, lastid, ms, candidates );
+						ms = NULL;
+					}
+					mdb_explain_ctrl( op, rs );
 					send_paged_response( op, rs, &lastid, tentries );
 					goto done;
 				}
 				lastid = id;
 			}
 
-			if (e) {
+			if ( e && MDB_COUNTING( op )) {
+				/* count what send_search_entry() would send */
+				if ( access_allowed( op, e, slap_schema.si_ad_entry,
+					NULL, ACL_READ, NULL ))
+					ncount++;
+			} else if ( e && !( me && me->me_only )) {
 				/* safe default */
 				rs->sr_attrs = op->oq_search.rs_attrs;
 				rs->sr_operational_attrs = NULL;
@@ -1102,6 +1540,7 @@ notfound:
 				case LDAP_SIZELIMIT_EXCEEDED:
 					if ( rs->sr_err == LDAP_SIZELIMIT_EXCEEDED ) {
 						rs->sr_ref = rs->sr_v2ref;
+						mdb_explain_ctrl( op, rs );
 						send_ldap_result( op, rs );
 						rs->sr_err = LDAP_SUCCESS;
 
@@ -1131,7 +1570,9 @@ loop_continue:
 			}
 		}
 		if ( wwctx.flag ) {
-			rs->sr_err = mdb_waitfixup( op, &wwctx, mci, mcd, &isc );
+			/* a newer snapshot may hold what the checks ruled out */
+			covered = 0;
+			rs->sr_err = mdb_waitfixup( op, &wwctx, mci, mcd, &isc, ms );
 			if ( rs->sr_err ) {
 				send_ldap_result( op, rs );
 				goto done;
@@ -1173,16 +1614,27 @@ loop_continue:
 				}
 			} else
 				id = isc.id;
+		} else if ( ms ) {
+			id = mdb_stream_next( ms, id + 1 );
 		} else {
 			id = mdb_idl_next( candidates, &cursor );
 		}
 	}
 
 nochange:
+	if ( ms && mdb_stream_error( ms )) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "internal error in candidate stream";
+		send_ldap_result( op, rs );
+		goto done;
+	}
+
 	rs->sr_ctrls = NULL;
 	rs->sr_ref = rs->sr_v2ref;
 	rs->sr_err = (rs->sr_v2ref == NULL) ? LDAP_SUCCESS : LDAP_REFERRAL;
 	rs->sr_rspoid = NULL;
+	mdb_explain_ctrl( op, rs );
+	mdb_count_ctrl( op, rs, ncount, nrefs );
 	if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
 		send_paged_response( op, rs, NULL, 0 );
 	} else {
@@ -1203,6 +1655,8 @@ done:
 			}
 		}
 	}
+	if ( ms )
+		mdb_stream_close( ms );
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
 	if ( moi == &opinfo ) {
@@ -1217,7 +1671,15 @@ done:
 	}
 	if (base)
 		mdb_entry_return( op, base );
+	mdb_autoindex_end( op, &unseen, ntested );
+	mdb_explain_end( op, &explain );
+	if ( outer )
+		op->o_controls[mdb_explain_cid] = outer;
+	if ( pj )
+		op->o_tmpfree( pj->pj_want, op->o_tmpmemctx );
 	scope_chunk_ret( op, scopes );
+	op->o_tmpfree( isc.sctmp, op->o_tmpmemctx );
+	mdb_idl_free( candidates );
 
 	return rs->sr_err;
 }
@@ -1271,36 +1733,6 @@ static int oc_filter(
 	return rc;
 }
 
-static void search_stack_free( void *key, void *data )
-{
-	ber_memfree_x(data, NULL);
-}
-
-static void *search_stack( Operation *op )
-{
-	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	void *ret = NULL;
-
-	if ( op->o_threadctx ) {
-		ldap_pvt_thread_pool_getkey( op->o_threadctx, (void *)search_stack,
-			&ret, NULL );
-	} else {
-		ret = mdb->mi_search_stack;
-	}
-
-	if ( !ret ) {
-		ret = ch_malloc( mdb->mi_search_stack_depth * MDB_IDL_UM_SIZE
-			* sizeof( ID ) );
-		if ( op->o_threadctx ) {
-			ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)search_stack,
-				ret, search_stack_free, NULL, NULL );
-		} else {
-			mdb->mi_search_stack = ret;
-		}
-	}
-	return ret;
-}
-
 static int search_candidates(
 	Operation *op,
 	SlapReply *rs,
@@ -1308,13 +1740,14 @@ static int search_candidates(
 	IdScopes *isc,
 	MDB_cursor *mci,
 	ID	*ids,
-	ID *stack )
+	mdb_stream **msp )
 {
-	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int rc, depth = 1;
+	ID *stack;
 	Filter		*f, rf, xf, nf, sf;
 	AttributeAssertion aa_ref = ATTRIBUTEASSERTION_INIT;
 	AttributeAssertion aa_subentry = ATTRIBUTEASSERTION_INIT;
+	struct berval bv_ref = BER_BVC( "referral" );
 
 	/*
 	 * This routine takes as input a filter (user-filter)
@@ -1336,7 +1769,6 @@ static int search_candidates(
 		&& !get_subentries_visibility(op)) {
 		if( !get_manageDSAit(op) && !get_domainScope(op) ) {
 			/* match referral objects */
-			struct berval bv_ref = BER_BVC( "referral" );
 			rf.f_choice = LDAP_FILTER_EQUALITY;
 			rf.f_ava = &aa_ref;
 			rf.f_av_desc = slap_schema.si_ad_objectClass;
@@ -1364,11 +1796,54 @@ static int search_candidates(
 		depth++;
 	}
 
-	/* Allocate IDL stack, plus 1 more for former tmp */
-	if ( depth+1 > mdb->mi_search_stack_depth ) {
-		stack = ch_malloc( (depth + 1) * MDB_IDL_UM_SIZE * sizeof( ID ) );
+	mdb_explain_filter( op, "filter", f, "" );
+
+	/* Stream the candidates, unless aliases have to be found first
+	 * or their number has to be checked against a limit up front.
+	 */
+	*msp = NULL;
+	if ( !( op->ors_deref & LDAP_DEREF_SEARCHING ) &&
+		( op->ors_limit == NULL || op->ors_limit->lms_s_unchecked == -1 ))
+	{
+		SortedSearch *ss = backend_sorted_search( op );
+
+		rc = LDAP_UNWILLING_TO_PERFORM;
+		/* A search its sizelimit may cut short walks an ordered index
+		 * in key order, if the user's filter allows it and no referral
+		 * has to be found besides. So does a search an overlay wants
+		 * sorted, unless its results are merged with those of other
+		 * databases.
+		 */
+		if ( get_pagedresults( op ) <= SLAP_CONTROL_IGNORED &&
+			( f == op->ors_filter || ( f == &xf && mdb_stream_absent( op,
+				isc->mt, slap_schema.si_ad_objectClass, &bv_ref ))))
+		{
+			if ( !ss ) {
+				if ( op->ors_slimit > 0 )
+					rc = mdb_stream_order( op, isc->mt, op->ors_filter,
+						op->ors_slimit, msp );
+			} else if ( !SLAP_GLUE_INSTANCE( op->o_bd ) &&
+				!SLAP_GLUE_SUBORDINATE( op->o_bd ))
+			{
+				rc = mdb_stream_sort( op, isc->mt, op->ors_filter, ss,
+					ss->ss_window && search_whole( op, isc->mt, e ), msp );
+			}
+		}
+		if ( rc == LDAP_UNWILLING_TO_PERFORM )
+			rc = mdb_stream_open( op, isc->mt, f, msp );
+		if ( rc != LDAP_UNWILLING_TO_PERFORM ) {
+			Debug(LDAP_DEBUG_TRACE,
+				"mdb_search_candidates: stream rc=%d estimate=%ld\n",
+				rc, *msp ? (long) mdb_stream_estimate( *msp ) : 0L, 0 );
+			return rc;
+		}
 	}
 
+	/* Allocate IDL stack, plus 1 more for former tmp; aliases need 3 */
+	if ( depth < 2 )
+		depth = 2;
+	stack = ch_malloc( (depth + 1) * MDB_IDL_UM_SIZE * sizeof( ID ) );
+
 	if( op->ors_deref & LDAP_DEREF_SEARCHING ) {
 		rc = search_aliases( op, rs, e->e_id, isc, mci, stack );
 	} else {
@@ -1380,9 +1855,7 @@ static int search_candidates(
 			stack, stack+MDB_IDL_UM_SIZE );
 	}
 
-	if ( depth+1 > mdb->mi_search_stack_depth ) {
-		ch_free( stack );
-	}
+	ch_free( stack );
 
 	if( rc ) {
 		Debug(LDAP_DEBUG_TRACE,
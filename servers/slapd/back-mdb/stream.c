@@ -0,0 +1,1529 @@
+/* stream.c - produce search candidates lazily from index cursors */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2018 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* A candidate stream is a tree shaped like the search filter. Its
+ * leaves are cursors on index keys, or on id2entry for the parts of
+ * the filter that no index narrows. An AND seeks each of its members
+ * to the highest ID any of them is on, until they all agree; an OR
+ * yields the lowest ID any of its members is on. Nothing is read
+ * until it is asked for, so no IDL has to be built, and a search that
+ * stops early never reads the rest of the index.
+ *
+ * Candidates can be asked for in order, by mdb_stream_next(), or one
+ * by one, by mdb_stream_test(), when the entries in scope are walked
+ * instead.
+ *
+ * The few assertions that cannot be streamed, inequalities over an
+ * ordered index and extensible matches, are read into an IDL up front.
+ * A search that a sizelimit may cut short can instead walk the keys of
+ * an ordered index from one bound of an inequality to the other, and
+ * take the IDs in key order, see mdb_stream_order(). A search that an
+ * overlay wants sorted walks the index of the sort attribute the same
+ * way, in either direction, see mdb_stream_sort().
+ *
+ * Most index keys are hashes, so their candidates still have to be
+ * tested against the filter. Streams made only of exact sources,
+ * presence keys, entryDN lookups and objectClass=*, are marked as
+ * such; their candidates all match, see mdb_stream_exact().
+ *
+ * Streams live on the heap rather than in the operation's tmp memory,
+ * so that a paged search can keep its stream from one page to the next.
+ */
+
+struct mdb_stream {
+	int			ms_type;
+#define	MS_EMPTY	0
+#define	MS_RANGE	1	/* every entry from lo to hi */
+#define	MS_LIST		2	/* the IDs of an index key */
+#define	MS_BITMAP	3	/* the bitmap words of an index key */
+#define	MS_IDL		4	/* an IDL read up front */
+#define	MS_AND		5
+#define	MS_OR		6
+#define	MS_ORDER	7	/* the IDs of ordered index keys, in key order */
+	ID			ms_lo;
+	ID			ms_hi;
+	ID			ms_est;		/* estimated number of IDs */
+	ID			ms_min;		/* the last seek, and */
+	ID			ms_cur;		/* its result; good for seeks in [min, cur] */
+	ID			ms_word;	/* the bitmap word the cursor is on */
+	int			ms_pos;		/* the cursor is on ms_cur */
+	MDB_cursor	*ms_mc;		/* on the index key, if there is one */
+	MDB_cursor	*ms_me;		/* on id2entry, for ranges */
+	MDB_val		ms_key;
+	ID			*ms_ids;
+	int			ms_rc;		/* first error, kept at the root */
+	int			ms_exact;	/* every ID it yields matches its filter */
+	int			ms_nsubs;
+	struct mdb_stream	**ms_subs;
+	MDB_val		ms_end;		/* the last key of an ordered walk */
+	Avlnode		*ms_seen;	/* the IDs it yielded, if an entry may have many keys */
+	int			ms_multi;
+	int			ms_reverse;	/* walks its keys from last to first */
+	SortedSearch	*ms_sort;	/* told of each key it moves on to */
+	BackendDB	*ms_be;
+};
+
+#define	MS_IS_ALL(ms)	((ms)->ms_type == MS_RANGE && \
+	(ms)->ms_lo <= 1 && (ms)->ms_hi == NOID)
+
+/* Sizes that would overflow are capped */
+static ID
+stream_add( ID a, ID b )
+{
+	return a >= NOID - b ? NOID : a + b;
+}
+
+static mdb_stream *
+stream_alloc( int type )
+{
+	mdb_stream *ms;
+
+	ms = ch_calloc( 1, sizeof( mdb_stream ));
+	ms->ms_type = type;
+	ms->ms_min = NOID;
+	return ms;
+}
+
+static void
+stream_free( mdb_stream *ms )
+{
+	int i;
+
+	for ( i = 0; i < ms->ms_nsubs; i++ )
+		stream_free( ms->ms_subs[i] );
+	if ( ms->ms_subs )
+		ch_free( ms->ms_subs );
+	if ( ms->ms_mc )
+		mdb_cursor_close( ms->ms_mc );
+	if ( ms->ms_me )
+		mdb_cursor_close( ms->ms_me );
+	if ( ms->ms_key.mv_data )
+		ch_free( ms->ms_key.mv_data );
+	if ( ms->ms_ids ) {
+		mdb_idl_free( ms->ms_ids );
+		ch_free( ms->ms_ids );
+	}
+	if ( ms->ms_end.mv_data )
+		ch_free( ms->ms_end.mv_data );
+	if ( ms->ms_seen )
+		avl_free( ms->ms_seen, NULL );
+	ch_free( ms );
+}
+
+/* Walk the entries from lo to hi */
+static int
+stream_range(
+	Operation *op,
+	MDB_txn *txn,
+	mdb_stream *ms,
+	ID lo,
+	ID hi )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+
+	ms->ms_type = MS_RANGE;
+	ms->ms_lo = lo;
+	ms->ms_hi = hi;
+	if ( ms->ms_me )
+		return 0;
+	return mdb_cursor_open( txn, mdb->mi_id2entry, &ms->ms_me );
+}
+
+/* Every entry, counted from id2entry */
+static int
+stream_all( Operation *op, MDB_txn *txn, mdb_stream **msp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_stream *ms = stream_alloc( MS_RANGE );
+	MDB_stat st;
+	int rc;
+
+	*msp = ms;
+	rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+	ms->ms_est = rc ? NOID : st.ms_entries;
+	if ( rc == 0 )
+		rc = stream_range( op, txn, ms, 1, NOID );
+	return rc;
+}
+
+/* See what an index key holds now, and seek it from scratch */
+static int
+stream_key_shape( Operation *op, MDB_txn *txn, mdb_stream *ms )
+{
+	ID lo, hi, items;
+	int rc, kind;
+
+	ms->ms_min = NOID;
+	ms->ms_pos = 0;
+	ms->ms_word = 0;
+	rc = mdb_idl_key_shape( ms->ms_mc, &ms->ms_key, &kind,
+		&lo, &hi, &ms->ms_est, &items );
+	if ( rc == MDB_NOTFOUND ) {
+		ms->ms_type = MS_EMPTY;
+		ms->ms_est = 0;
+		return 0;
+	}
+	if ( rc )
+		return rc;
+
+	switch ( kind ) {
+	case MDB_IDL_KEY_RANGE:
+		/* a key collapsed to a range covers every entry in it */
+		return stream_range( op, txn, ms, lo, hi );
+	case MDB_IDL_KEY_BITMAP:
+		ms->ms_type = MS_BITMAP;
+		break;
+	default:
+		ms->ms_type = MS_LIST;
+	}
+	ms->ms_lo = lo;
+	ms->ms_hi = hi;
+	return 0;
+}
+
+static void
+explain_key( Operation *op, mdb_stream *ms )
+{
+	if ( !MDB_EXPLAIN( op ))
+		return;
+
+	switch ( ms->ms_type ) {
+	case MS_EMPTY:
+		mdb_explain_printf( op, "key: 0\n" );
+		break;
+	case MS_RANGE:
+		mdb_explain_printf( op, "key: %ld range=%ld-%ld\n", (long) ms->ms_est,
+			(long) ms->ms_lo, (long) ms->ms_hi );
+		break;
+	case MS_BITMAP:
+		mdb_explain_printf( op, "key: %ld bitmap=%ld-%ld\n", (long) ms->ms_est,
+			(long) ms->ms_lo, (long) ms->ms_hi );
+		break;
+	default:
+		mdb_explain_printf( op, "key: %ld\n", (long) ms->ms_est );
+	}
+}
+
+/* Copy an index key, padded the way mdb_key_read does */
+static void
+stream_key_copy( struct berval *k, MDB_val *key )
+{
+	key->mv_size = k->bv_len;
+#ifndef MISALIGNED_OK
+	if ( k->bv_len & ALIGNER )
+		key->mv_size = 2 * sizeof(int);
+#endif
+	key->mv_data = ch_calloc( 1, key->mv_size );
+	AC_MEMCPY( key->mv_data, k->bv_val, k->bv_len );
+}
+
+/* A cursor on one index key */
+static int
+stream_key(
+	Operation *op,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	mdb_stream **msp )
+{
+	mdb_stream *ms = stream_alloc( MS_EMPTY );
+	int rc;
+
+	*msp = ms;
+	stream_key_copy( k, &ms->ms_key );
+
+	rc = mdb_cursor_open( txn, dbi, &ms->ms_mc );
+	if ( rc == 0 )
+		rc = stream_key_shape( op, txn, ms );
+	explain_key( op, ms );
+	return rc;
+}
+
+/* The candidates of an assertion are the intersection of its keys */
+static int
+stream_keys(
+	Operation *op,
+	MDB_txn *txn,
+	AttributeDescription *desc,
+	int ftype,
+	const char *type,
+	MatchingRule *mr,
+	void *assertion,
+	mdb_stream **msp )
+{
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	mdb_stream *ms = NULL;
+	int i, n, rc;
+
+	rc = mdb_index_param( op, desc, ftype, &dbi, &mask, &prefix );
+	if ( MDB_EXPLAIN( op ))
+		mdb_explain_printf( op, "index: %s %s%s\n", desc->ad_cname.bv_val,
+			type, rc == LDAP_SUCCESS ? "" : " none" );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= mdb_stream_keys: (%s) not indexed\n",
+			desc->ad_cname.bv_val, 0, 0 );
+		return stream_all( op, txn, msp );
+	}
+
+	if ( ftype == LDAP_FILTER_PRESENT ) {
+		if ( prefix.bv_val == NULL )
+			return stream_all( op, txn, msp );
+		rc = stream_key( op, txn, dbi, &prefix, msp );
+		/* unless it is borrowed from a supertype, the presence
+		 * key holds just the entries that have the attribute
+		 */
+		if ( mdb_attr_mask( op->o_bd->be_private, desc ))
+			(*msp)->ms_exact = 1;
+		return rc;
+	}
+
+	if ( !mr || !mr->smr_filter )
+		return stream_all( op, txn, msp );
+
+	rc = (mr->smr_filter)( ftype, mask, desc->ad_type->sat_syntax, mr,
+		&prefix, assertion, &keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return stream_all( op, txn, msp );
+
+	for ( n = 0; keys[n].bv_val != NULL; n++ )
+		;
+	if ( n == 0 ) {
+		rc = stream_all( op, txn, msp );
+	} else if ( n == 1 ) {
+		rc = stream_key( op, txn, dbi, &keys[0], msp );
+	} else {
+		ms = stream_alloc( MS_AND );
+		ms->ms_subs = ch_calloc( n, sizeof( mdb_stream * ));
+		ms->ms_est = NOID;
+		*msp = ms;
+		for ( i = 0; i < n; i++ ) {
+			rc = stream_key( op, txn, dbi, &keys[i], &ms->ms_subs[i] );
+			ms->ms_nsubs++;
+			if ( rc )
+				break;
+			if ( ms->ms_subs[i]->ms_est < ms->ms_est )
+				ms->ms_est = ms->ms_subs[i]->ms_est;
+		}
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Read an assertion that cannot be streamed into an IDL */
+static int
+stream_idl(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	mdb_stream **msp )
+{
+	mdb_stream *ms = stream_alloc( MS_IDL );
+	ID *ids;
+	int rc;
+
+	*msp = ms;
+	ids = ch_malloc( 2 * MDB_IDL_UM_SIZEOF );
+	MDB_IDL_ZERO( ids );
+	rc = mdb_filter_candidates( op, txn, f, ids, ids + MDB_IDL_UM_SIZE, NULL );
+	if ( rc || MDB_IDL_IS_ZERO( ids )) {
+		ms->ms_type = MS_EMPTY;
+	} else if ( MDB_IDL_IS_RANGE( ids ) && !MDB_IDL_IS_BITMAP( ids )) {
+		ms->ms_est = MDB_IDL_N( ids );
+		rc = stream_range( op, txn, ms, MDB_IDL_RANGE_FIRST( ids ),
+			MDB_IDL_RANGE_LAST( ids ));
+	} else {
+		ms->ms_est = MDB_IDL_N( ids );
+		ms->ms_ids = ch_realloc( ids, MDB_IDL_SIZEOF( ids ));
+		ids = NULL;
+	}
+	if ( ids ) {
+		mdb_idl_free( ids );
+		ch_free( ids );
+	}
+	if ( MDB_EXPLAIN( op ))
+		mdb_explain_printf( op, "ids: %ld\n", (long) ms->ms_est );
+	return rc;
+}
+
+static int stream_filter(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	mdb_stream **msp );
+
+static int
+stream_list(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *flist,
+	int ftype,
+	mdb_stream **msp )
+{
+	mdb_stream *ms, *sub;
+	Filter *f, *cfs[MDB_COMP_MAX];
+	CompInfo *ci = NULL;
+	struct berval ckey;
+	int i, n, empty, exact = 1, rc = LDAP_SUCCESS;
+
+	for ( n = 0, f = flist; f; f = f->f_next )
+		n++;
+	ms = stream_alloc( ftype == LDAP_FILTER_AND ? MS_AND : MS_OR );
+	ms->ms_subs = ch_calloc( n, sizeof( mdb_stream * ));
+	*msp = ms;
+
+	mdb_explain_printf( op, "%s:\n",
+		ftype == LDAP_FILTER_AND ? "and" : "or" );
+	if ( MDB_EXPLAIN( op ))
+		MDB_EXPLAIN( op )->me_depth++;
+
+	/* A composite index replaces the assertions it covers with
+	 * a single key
+	 */
+	if ( ftype == LDAP_FILTER_AND )
+		ci = mdb_index_comp_filter( op, txn, flist, cfs, &ckey );
+	if ( ci ) {
+		mdb_explain_printf( op, "index: %s eq\n", ci->ci_name.bv_val );
+		rc = stream_key( op, txn, ci->ci_dbi, &ckey, &sub );
+		op->o_tmpfree( ckey.bv_val, op->o_tmpmemctx );
+		ms->ms_subs[ms->ms_nsubs++] = sub;
+		exact = 0;
+		if ( sub->ms_type == MS_EMPTY )
+			flist = NULL;
+	}
+
+	for ( f = flist; f && rc == LDAP_SUCCESS; f = f->f_next ) {
+		/* ignore precomputed scopes */
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+			f->f_result == LDAP_SUCCESS ) {
+			exact = 0;
+			continue;
+		}
+		if ( ci ) {
+			for ( i = 0; i < ci->ci_nattrs && cfs[i] != f; i++ )
+				;
+			if ( i < ci->ci_nattrs )
+				continue;
+		}
+
+		rc = stream_filter( op, txn, f, &sub );
+		if ( sub ) {
+			/* An AND is kept sorted by size, so that its smallest
+			 * member leads the seeks.
+			 */
+			for ( i = ms->ms_nsubs; i > 0; i-- ) {
+				if ( ftype == LDAP_FILTER_OR ||
+					sub->ms_est >= ms->ms_subs[i-1]->ms_est )
+					break;
+				ms->ms_subs[i] = ms->ms_subs[i-1];
+			}
+			ms->ms_subs[i] = sub;
+			ms->ms_nsubs++;
+		}
+		if ( rc )
+			break;
+
+		/* an empty member decides an AND, a full one an OR */
+		if ( ftype == LDAP_FILTER_AND ? sub->ms_type == MS_EMPTY
+			: MS_IS_ALL( sub ))
+			break;
+	}
+
+	if ( MDB_EXPLAIN( op ))
+		MDB_EXPLAIN( op )->me_depth--;
+	if ( rc )
+		return rc;
+
+	/* Drop the members that do not narrow anything */
+	for ( i = 0, n = 0, empty = 0; i < ms->ms_nsubs; i++ ) {
+		sub = ms->ms_subs[i];
+		if ( sub->ms_type == MS_EMPTY )
+			empty = 1;
+		if ( ftype == LDAP_FILTER_AND ? MS_IS_ALL( sub )
+			: sub->ms_type == MS_EMPTY ) {
+			if ( !mdb_stream_exact( sub ))
+				exact = 0;
+			stream_free( sub );
+			continue;
+		}
+		ms->ms_subs[n++] = sub;
+	}
+	ms->ms_nsubs = n;
+
+	if ( ftype == LDAP_FILTER_AND ) {
+		if ( empty ) {
+			stream_free( ms );
+			*msp = stream_alloc( MS_EMPTY );
+			return LDAP_SUCCESS;
+		}
+		if ( n == 0 ) {
+			stream_free( ms );
+			rc = stream_all( op, txn, msp );
+			(*msp)->ms_exact = exact;
+			return rc;
+		}
+		ms->ms_est = ms->ms_subs[0]->ms_est;
+	} else {
+		for ( i = 0; i < n; i++ ) {
+			if ( MS_IS_ALL( ms->ms_subs[i] )) {
+				sub = ms->ms_subs[i];
+				ms->ms_subs[i] = ms->ms_subs[--ms->ms_nsubs];
+				stream_free( ms );
+				*msp = sub;
+				return LDAP_SUCCESS;
+			}
+			ms->ms_est = stream_add( ms->ms_est, ms->ms_subs[i]->ms_est );
+		}
+		if ( n == 0 ) {
+			ms->ms_type = MS_EMPTY;
+			return LDAP_SUCCESS;
+		}
+	}
+
+	ms->ms_exact = exact;
+	if ( n == 1 ) {
+		sub = ms->ms_subs[0];
+		ms->ms_nsubs = 0;
+		stream_free( ms );
+		sub->ms_exact = exact && mdb_stream_exact( sub );
+		*msp = sub;
+	}
+	return LDAP_SUCCESS;
+}
+
+static int
+stream_filter(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	mdb_stream **msp )
+{
+	AttributeDescription *ad;
+	MatchingRule *mr;
+	int rc = LDAP_SUCCESS;
+
+	*msp = NULL;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		*msp = stream_alloc( MS_EMPTY );
+		return rc;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_TRUE ) {
+			rc = stream_all( op, txn, msp );
+			(*msp)->ms_exact = 1;
+			return rc;
+		}
+		*msp = stream_alloc( MS_EMPTY );
+		break;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass ) {
+			mdb_explain_printf( op, "index: objectClass all\n" );
+			rc = stream_all( op, txn, msp );
+			(*msp)->ms_exact = 1;
+			return rc;
+		}
+		rc = stream_keys( op, txn, f->f_desc, LDAP_FILTER_PRESENT,
+			"pres", NULL, NULL, msp );
+		break;
+
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_ava->aa_desc;
+		if ( ad == slap_schema.si_ad_entryDN ) {
+			ID id;
+			mdb_explain_printf( op, "index: entryDN dn2id\n" );
+			rc = mdb_dn2id( op, txn, NULL, &f->f_ava->aa_value, &id,
+				NULL, NULL, NULL );
+			if ( rc == MDB_NOTFOUND ) {
+				*msp = stream_alloc( MS_EMPTY );
+				return LDAP_SUCCESS;
+			}
+			*msp = stream_alloc( MS_EMPTY );
+			(*msp)->ms_exact = 1;
+			if ( rc == 0 ) {
+				(*msp)->ms_est = 1;
+				rc = stream_range( op, txn, *msp, id, id );
+			}
+			break;
+		}
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( ad ))
+			return LDAP_UNWILLING_TO_PERFORM;
+#endif
+		rc = stream_keys( op, txn, ad, LDAP_FILTER_EQUALITY, "eq",
+			ad->ad_type->sat_equality, &f->f_ava->aa_value, msp );
+		break;
+
+	case LDAP_FILTER_APPROX:
+		ad = f->f_ava->aa_desc;
+		mr = ad->ad_type->sat_approx;
+		if ( !mr )
+			mr = ad->ad_type->sat_equality;
+		rc = stream_keys( op, txn, ad, LDAP_FILTER_APPROX, "approx",
+			mr, &f->f_ava->aa_value, msp );
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub->sa_desc;
+		rc = stream_keys( op, txn, ad, LDAP_FILTER_SUBSTRINGS, "sub",
+			ad->ad_type->sat_substr, f->f_sub, msp );
+		break;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		ad = f->f_ava->aa_desc;
+		mr = ad->ad_type->sat_ordering;
+		if ( mr && ( mr->smr_usage & SLAP_MR_ORDERED_INDEX ))
+			rc = stream_idl( op, txn, f, msp );
+		else
+			rc = stream_keys( op, txn, ad, LDAP_FILTER_PRESENT, "pres",
+				NULL, NULL, msp );
+		break;
+
+	case LDAP_FILTER_AND:
+		rc = stream_list( op, txn, f->f_and, LDAP_FILTER_AND, msp );
+		break;
+
+	case LDAP_FILTER_OR:
+		rc = stream_list( op, txn, f->f_or, LDAP_FILTER_OR, msp );
+		break;
+
+	case LDAP_FILTER_EXT:
+#ifdef LDAP_COMP_MATCH
+		if ( f->f_mra->ma_cf )
+			return LDAP_UNWILLING_TO_PERFORM;
+#endif
+		rc = stream_idl( op, txn, f, msp );
+		break;
+
+	default:
+		/* NOT, and anything else no index supports */
+		mdb_explain_printf( op, "index: none\n" );
+		return stream_all( op, txn, msp );
+	}
+
+	return rc;
+}
+
+/* Build the candidate stream of a filter. Returns
+ * LDAP_UNWILLING_TO_PERFORM if the filter has to be evaluated
+ * as an IDL instead.
+ */
+int
+mdb_stream_open(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	mdb_stream **msp )
+{
+	int rc;
+
+	rc = stream_filter( op, txn, f, msp );
+	if ( rc ) {
+		if ( *msp )
+			stream_free( *msp );
+		*msp = NULL;
+		if ( rc != LDAP_UNWILLING_TO_PERFORM ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_stream_open: failed (%d)\n", rc, 0, 0 );
+			rc = LDAP_OTHER;
+		}
+	}
+	return rc;
+}
+
+/* Move an ordered walk on to its next key within bounds. mop is
+ * MDB_FIRST to start from the end the walk begins at, MDB_SET_RANGE
+ * to start from the key in ms_key, or MDB_NEXT_NODUP to step on; a
+ * walk in reverse turns them around. A walk that is not bounded
+ * learns the size of its keys from the first one it finds. After a
+ * renew the cursor is sought back to the key last read, which is
+ * passed over if it is still there.
+ */
+static int
+stream_order_key( mdb_stream *ms, MDB_cursor_op mop )
+{
+	MDB_cursor_op step = ms->ms_reverse ? MDB_PREV_NODUP : MDB_NEXT_NODUP;
+	MDB_val key, data;
+	size_t len = ms->ms_key.mv_size;
+	int rc, cmp;
+
+	if ( mop == MDB_FIRST && ms->ms_reverse )
+		mop = MDB_LAST;
+	else if ( mop == MDB_NEXT_NODUP )
+		mop = step;
+	key = ms->ms_key;
+	rc = mdb_cursor_get( ms->ms_mc, &key, &data, mop );
+	if ( mop == MDB_SET_RANGE ) {
+		cmp = rc || key.mv_size != len ||
+			memcmp( key.mv_data, ms->ms_key.mv_data, len );
+		if ( ms->ms_reverse ) {
+			/* the key found is the first one at or past it */
+			if ( rc == MDB_NOTFOUND )
+				rc = mdb_cursor_get( ms->ms_mc, &key, &data, MDB_LAST );
+			else if ( rc == 0 && ( cmp || ms->ms_word ))
+				rc = mdb_cursor_get( ms->ms_mc, &key, &data, step );
+		} else if ( rc == 0 && !cmp && ms->ms_word ) {
+			rc = mdb_cursor_get( ms->ms_mc, &key, &data, step );
+		}
+	}
+	ms->ms_word = 0;
+	/* skip the presence key */
+	while ( rc == 0 && (( len && key.mv_size != len ) ||
+		mdb_index_is_presence( &key )))
+		rc = mdb_cursor_get( ms->ms_mc, &key, &data, step );
+	if ( rc == 0 && ms->ms_end.mv_data ) {
+		cmp = memcmp( key.mv_data, ms->ms_end.mv_data, len );
+		if ( ms->ms_reverse ? cmp < 0 : cmp > 0 )
+			rc = MDB_NOTFOUND;
+	}
+	if ( rc )
+		return rc;
+
+	if ( !len ) {
+		ms->ms_key.mv_size = len = key.mv_size;
+		ms->ms_key.mv_data = ch_malloc( len );
+	}
+	AC_MEMCPY( ms->ms_key.mv_data, key.mv_data, len );
+	return 0;
+}
+
+/* Read the IDs of the key an ordered walk is on */
+static int
+stream_order_read( mdb_stream *ms )
+{
+	MDB_val key = ms->ms_key;
+
+	ms->ms_pos = 0;
+	if ( ms->ms_sort )
+		ms->ms_sort->ss_run++;
+	mdb_idl_free( ms->ms_ids );
+	return mdb_idl_fetch_key( ms->ms_be, mdb_cursor_txn( ms->ms_mc ),
+		mdb_cursor_dbi( ms->ms_mc ), &key, ms->ms_ids, NULL, 0 );
+}
+
+/* Size up the key an ordered walk is on */
+static int
+stream_order_size( mdb_stream *ms, ID *count )
+{
+	ID lo, hi, items;
+	int kind;
+
+	return mdb_idl_key_shape( ms->ms_mc, &ms->ms_key, &kind,
+		&lo, &hi, count, &items );
+}
+
+/* Can inequalities on ad walk an ordered index? */
+static int
+stream_order_index(
+	Operation *op,
+	AttributeDescription *ad,
+	MDB_dbi *dbi,
+	slap_mask_t *mask,
+	struct berval *prefix )
+{
+	MatchingRule *mr = ad->ad_type->sat_ordering;
+
+	if ( !mr || !( mr->smr_usage & SLAP_MR_ORDERED_INDEX ))
+		return 0;
+	mr = ad->ad_type->sat_equality;
+	if ( !mr || !mr->smr_filter )
+		return 0;
+	return mdb_index_param( op, ad, LDAP_FILTER_EQUALITY,
+		dbi, mask, prefix ) == LDAP_SUCCESS;
+}
+
+/* The key an inequality starts or ends at */
+static int
+stream_order_bound(
+	Operation *op,
+	Filter *f,
+	slap_mask_t mask,
+	struct berval *prefix,
+	MDB_val *key )
+{
+	AttributeDescription *ad = f->f_av_desc;
+	MatchingRule *mr = ad->ad_type->sat_equality;
+	struct berval *keys = NULL;
+	int rc;
+
+	rc = (mr->smr_filter)( LDAP_FILTER_EQUALITY, mask,
+		ad->ad_type->sat_syntax, mr, prefix, &f->f_av_value,
+		&keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL || keys[0].bv_val == NULL ) {
+		if ( keys )
+			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+		return LDAP_UNWILLING_TO_PERFORM;
+	}
+	stream_key_copy( &keys[0], key );
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return LDAP_SUCCESS;
+}
+
+/* Count the IDs under the keys of a sorted walk for a virtual list
+ * view, and those under the keys that sort before target. Once the
+ * overlay has picked its window, pass over as many whole keys as it
+ * wants skipped, and stop on the first key it wants any of.
+ */
+static int
+stream_order_window(
+	Operation *op,
+	mdb_stream *ms,
+	MDB_cursor_op mop,
+	MDB_val *target,
+	SortedSearch *ss )
+{
+	MDB_val from = ms->ms_key;
+	ID n;
+	int rc, cmp;
+
+	/* the walk is started over, from the same key */
+	if ( from.mv_size ) {
+		from.mv_data = op->o_tmpalloc( from.mv_size, op->o_tmpmemctx );
+		AC_MEMCPY( from.mv_data, ms->ms_key.mv_data, from.mv_size );
+	}
+	ss->ss_count = 0;
+	ss->ss_target = 0;
+	ss->ss_skip = 0;
+	for ( rc = stream_order_key( ms, mop ); rc == 0;
+		rc = stream_order_key( ms, MDB_NEXT_NODUP ))
+	{
+		rc = stream_order_size( ms, &n );
+		if ( rc )
+			break;
+		ss->ss_count += n;
+		if ( target->mv_data ) {
+			cmp = memcmp( ms->ms_key.mv_data, target->mv_data,
+				ms->ms_key.mv_size );
+			if ( ms->ms_reverse ? cmp > 0 : cmp < 0 )
+				ss->ss_target += n;
+		}
+	}
+	if ( rc == MDB_NOTFOUND ) {
+		mdb_explain_printf( op, "sort: counted %ld\n", (long) ss->ss_count );
+		if ( ss->ss_window( op, ss ))
+			goto done;
+		if ( from.mv_size )
+			AC_MEMCPY( ms->ms_key.mv_data, from.mv_data, from.mv_size );
+		for ( rc = stream_order_key( ms, mop ); rc == 0;
+			rc = stream_order_key( ms, MDB_NEXT_NODUP ))
+		{
+			rc = stream_order_size( ms, &n );
+			if ( rc || n > ss->ss_skip )
+				break;
+			ss->ss_skip -= n;
+		}
+	}
+done:
+	if ( from.mv_size )
+		op->o_tmpfree( from.mv_data, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Build a stream that yields the candidates of a filter in the order
+ * of the keys of an ordered index. The filter is an inequality, or an
+ * AND of up to two inequalities on one attribute and other assertions,
+ * whose candidates each ID is tested against.
+ *
+ * For a search its sizelimit may cut short, limit is the sizelimit.
+ * For a sorted search the attribute is the one sorted on, and a
+ * presence assertion on it will do as well; limit is then a fraction
+ * of the index. Returns LDAP_UNWILLING_TO_PERFORM if the filter has no
+ * such shape, or if the other assertions leave no more than limit
+ * candidates, which the usual stream reads more cheaply.
+ */
+static int
+stream_order_open(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	SortedSearch *ss,
+	int whole,
+	ID limit,
+	mdb_stream **msp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	AttributeDescription *ad = NULL;
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+	Filter *list, *sub, *ge = NULL, *le = NULL, *pres = NULL, *rest = NULL;
+	Filter *from, *to, fand, fval;
+	MDB_dbi dbi = 0;
+	slap_mask_t mask = 0;
+	struct berval prefix = {0, NULL};
+	mdb_stream *ms, *rs = NULL;
+	MDB_cursor_op mop;
+	MDB_val target = {0, NULL};
+	MDB_stat st;
+	const char *what = ss ? "sort" : "order";
+	int n, rc;
+
+	*msp = NULL;
+	if ( ss ) {
+		ad = ss->ss_ad;
+		if ( !stream_order_index( op, ad, &dbi, &mask, &prefix ))
+			return LDAP_UNWILLING_TO_PERFORM;
+		if ( mdb_stat( txn, dbi, &st ) == 0 )
+			limit = st.ms_entries / 8;
+	}
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		if ( !ss )
+			return LDAP_UNWILLING_TO_PERFORM;
+		/* FALLTHRU */
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		list = f;
+		break;
+	case LDAP_FILTER_AND:
+		list = f->f_and;
+		break;
+	default:
+		return LDAP_UNWILLING_TO_PERFORM;
+	}
+
+	for ( n = 0, sub = list; sub; sub = sub == f ? NULL : sub->f_next )
+		n++;
+	fand.f_choice = LDAP_FILTER_AND;
+	fand.f_and = NULL;
+	fand.f_next = NULL;
+	rest = op->o_tmpalloc( n * sizeof( Filter ), op->o_tmpmemctx );
+
+	for ( n = 0, sub = list; sub; sub = sub == f ? NULL : sub->f_next ) {
+		if ( ss && sub->f_choice == LDAP_FILTER_PRESENT &&
+			sub->f_desc == ad )
+		{
+			pres = sub;
+			continue;
+		}
+		if (( sub->f_choice == LDAP_FILTER_GE ||
+			sub->f_choice == LDAP_FILTER_LE ) &&
+			( ad ? sub->f_av_desc == ad : stream_order_index( op,
+				sub->f_av_desc, &dbi, &mask, &prefix )))
+		{
+			ad = sub->f_av_desc;
+			if ( sub->f_choice == LDAP_FILTER_GE && !ge ) {
+				ge = sub;
+				continue;
+			}
+			if ( sub->f_choice == LDAP_FILTER_LE && !le ) {
+				le = sub;
+				continue;
+			}
+		}
+		/* precomputed scopes were dealt with already */
+		if ( sub->f_choice == SLAPD_FILTER_COMPUTED &&
+			sub->f_result == LDAP_SUCCESS )
+			continue;
+		rest[n] = *sub;
+		rest[n].f_next = fand.f_and;
+		fand.f_and = &rest[n++];
+	}
+	/* an entry without the attribute would never be walked to */
+	if ( !ad || !( ge || le || pres )) {
+		op->o_tmpfree( rest, op->o_tmpmemctx );
+		return LDAP_UNWILLING_TO_PERFORM;
+	}
+
+	mdb_explain_printf( op, "%s: %s%s%s%s\n", what, ad->ad_cname.bv_val,
+		ge ? " ge" : "", le ? " le" : "",
+		ss && ss->ss_reverse ? " reverse" : "" );
+	rc = LDAP_SUCCESS;
+	if ( ss ) {
+		/* An entry sorts by its least value. A forward walk meets
+		 * that first, unless a lower bound passes it by. Keys can
+		 * only be counted as entries if each holds one of them,
+		 * and all of them match.
+		 */
+		if ( !ad->ad_type->sat_single_value &&
+			( ss->ss_reverse || ge || ss->ss_window ))
+			rc = LDAP_UNWILLING_TO_PERFORM;
+		else if ( ss->ss_window && ( n || !whole ))
+			rc = LDAP_UNWILLING_TO_PERFORM;
+	}
+	if ( rc == LDAP_SUCCESS && n ) {
+		if ( MDB_EXPLAIN( op ))
+			MDB_EXPLAIN( op )->me_depth++;
+		rc = stream_filter( op, txn, n > 1 ? &fand : fand.f_and, &rs );
+		if ( MDB_EXPLAIN( op ))
+			MDB_EXPLAIN( op )->me_depth--;
+	}
+	op->o_tmpfree( rest, op->o_tmpmemctx );
+	if ( rc == LDAP_SUCCESS && rs ) {
+		if ( rs->ms_type == MS_EMPTY ) {
+			/* nothing to walk */
+			*msp = rs;
+			return LDAP_SUCCESS;
+		}
+		if ( MS_IS_ALL( rs )) {
+			stream_free( rs );
+			rs = NULL;
+		} else if ( rs->ms_est <= limit ) {
+			rc = LDAP_UNWILLING_TO_PERFORM;
+		}
+	}
+	if ( rc ) {
+		if ( rc == LDAP_UNWILLING_TO_PERFORM )
+			mdb_explain_printf( op, "%s: declined\n", what );
+		if ( rs )
+			stream_free( rs );
+		return rc;
+	}
+
+	ms = stream_alloc( MS_ORDER );
+	ms->ms_be = op->o_bd;
+	ms->ms_multi = !ad->ad_type->sat_single_value;
+	ms->ms_reverse = ss && ss->ss_reverse;
+	ms->ms_sort = ss;
+	if ( rs ) {
+		ms->ms_subs = ch_malloc( sizeof( mdb_stream * ));
+		ms->ms_subs[0] = rs;
+		ms->ms_nsubs = 1;
+		ms->ms_est = rs->ms_est;
+	} else {
+		rc = mdb_stat( txn, mdb->mi_id2entry, &st );
+		ms->ms_est = rc ? NOID : st.ms_entries;
+	}
+	*msp = ms;
+
+	/* a walk in reverse goes from the upper bound to the lower */
+	from = ms->ms_reverse ? le : ge;
+	to = ms->ms_reverse ? ge : le;
+	rc = LDAP_SUCCESS;
+	if ( to )
+		rc = stream_order_bound( op, to, mask, &prefix, &ms->ms_end );
+	if ( rc == LDAP_SUCCESS ) {
+		if ( from ) {
+			rc = stream_order_bound( op, from, mask, &prefix, &ms->ms_key );
+			mop = MDB_SET_RANGE;
+		} else {
+			/* only the size of the key is needed, if it is known */
+			ms->ms_key.mv_size = ms->ms_end.mv_size;
+			if ( ms->ms_key.mv_size )
+				ms->ms_key.mv_data = ch_calloc( 1, ms->ms_key.mv_size );
+			mop = MDB_FIRST;
+		}
+	}
+	if ( rc == LDAP_SUCCESS && ss && ss->ss_window &&
+		!BER_BVISNULL( &ss->ss_value ))
+	{
+		fval.f_choice = LDAP_FILTER_EQUALITY;
+		fval.f_ava = &ava;
+		ava.aa_desc = ad;
+		ava.aa_value = ss->ss_value;
+		rc = stream_order_bound( op, &fval, mask, &prefix, &target );
+	}
+	if ( rc == LDAP_SUCCESS ) {
+		ms->ms_ids = ch_malloc( MDB_IDL_UM_SIZEOF );
+		MDB_IDL_ZERO( ms->ms_ids );
+		rc = mdb_cursor_open( txn, dbi, &ms->ms_mc );
+	}
+	if ( rc == LDAP_SUCCESS ) {
+		if ( ss && ss->ss_window )
+			rc = stream_order_window( op, ms, mop, &target, ss );
+		else
+			rc = stream_order_key( ms, mop );
+		if ( rc == 0 )
+			rc = stream_order_read( ms );
+		if ( rc == MDB_NOTFOUND ) {
+			mdb_cursor_close( ms->ms_mc );
+			ms->ms_mc = NULL;
+			ms->ms_type = MS_EMPTY;
+			rc = LDAP_SUCCESS;
+		}
+	}
+	if ( target.mv_data )
+		ch_free( target.mv_data );
+	if ( rc == LDAP_SUCCESS && ss )
+		ss->ss_sorted = 1;
+	if ( rc ) {
+		stream_free( ms );
+		*msp = NULL;
+		if ( rc != LDAP_UNWILLING_TO_PERFORM ) {
+			Debug( LDAP_DEBUG_ANY,
+				"mdb_stream_order: failed (%d)\n", rc, 0, 0 );
+			rc = LDAP_OTHER;
+		}
+	}
+	return rc;
+}
+
+/* Walk an ordered index from one bound of an inequality to the other,
+ * so that a search stopped by its sizelimit never reads the rest of
+ * the range. Gives way if the other assertions of the filter leave no
+ * more than limit candidates.
+ */
+int
+mdb_stream_order(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	ID limit,
+	mdb_stream **msp )
+{
+	return stream_order_open( op, txn, f, NULL, 0, limit, msp );
+}
+
+/* Walk the index of the attribute a search is to be sorted on, so that
+ * the entries come out in order, see SortedSearch. The filter has to
+ * assert the attribute, by its presence or an inequality, since an
+ * entry without it is never walked to. whole tells whether the search
+ * sees every entry of the database, so that a virtual list view can
+ * count them by their keys.
+ */
+int
+mdb_stream_sort(
+	Operation *op,
+	MDB_txn *txn,
+	Filter *f,
+	SortedSearch *ss,
+	int whole,
+	mdb_stream **msp )
+{
+	return stream_order_open( op, txn, f, ss, whole, 0, msp );
+}
+
+/* Does the stream yield its IDs in key order rather than ID order? */
+int
+mdb_stream_ordered( mdb_stream *ms )
+{
+	return ms->ms_type == MS_ORDER;
+}
+
+/* Is it certain that no entry holds this value? A key that is present
+ * may belong to some other value, and an unindexed value may be
+ * anywhere, so this can only ever err on the side of no.
+ */
+int
+mdb_stream_absent(
+	Operation *op,
+	MDB_txn *txn,
+	AttributeDescription *desc,
+	struct berval *val )
+{
+	MatchingRule *mr = desc->ad_type->sat_equality;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	int i, rc, absent = 0;
+
+	if ( !mr || !mr->smr_filter )
+		return 0;
+	if ( mdb_index_param( op, desc, LDAP_FILTER_EQUALITY,
+		&dbi, &mask, &prefix ) != LDAP_SUCCESS )
+		return 0;
+	rc = (mr->smr_filter)( LDAP_FILTER_EQUALITY, mask,
+		desc->ad_type->sat_syntax, mr, &prefix, val, &keys,
+		op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return 0;
+
+	for ( i = 0; !absent && keys[i].bv_val != NULL; i++ ) {
+		/* keys are padded the way mdb_key_read does */
+		key.mv_size = keys[i].bv_len;
+#ifndef MISALIGNED_OK
+		if ( keys[i].bv_len & ALIGNER )
+			key.mv_size = 2 * sizeof(int);
+#endif
+		key.mv_data = op->o_tmpcalloc( 1, key.mv_size, op->o_tmpmemctx );
+		AC_MEMCPY( key.mv_data, keys[i].bv_val, keys[i].bv_len );
+		if ( mdb_get( txn, dbi, &key, &data ) == MDB_NOTFOUND )
+			absent = 1;
+		op->o_tmpfree( key.mv_data, op->o_tmpmemctx );
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return absent;
+}
+
+void
+mdb_stream_close( mdb_stream *ms )
+{
+	stream_free( ms );
+}
+
+/* Does every candidate of the stream match its filter? A presence key
+ * that has grown into a range since it was opened no longer does.
+ */
+int
+mdb_stream_exact( mdb_stream *ms )
+{
+	int i;
+
+	if ( ms->ms_type == MS_EMPTY )
+		return 1;
+	if ( !ms->ms_exact || ( ms->ms_type == MS_RANGE && ms->ms_mc ))
+		return 0;
+	for ( i = 0; i < ms->ms_nsubs; i++ ) {
+		if ( !mdb_stream_exact( ms->ms_subs[i] ))
+			return 0;
+	}
+	return 1;
+}
+
+ID
+mdb_stream_estimate( mdb_stream *ms )
+{
+	return ms->ms_type == MS_EMPTY ? 0 : ms->ms_est;
+}
+
+int
+mdb_stream_error( mdb_stream *ms )
+{
+	return ms->ms_rc;
+}
+
+/* The memory a stream holds, not counting its cursors */
+size_t
+mdb_stream_size( mdb_stream *ms )
+{
+	size_t size = sizeof( mdb_stream ) + ms->ms_key.mv_size;
+	int i;
+
+	if ( ms->ms_ids )
+		size += MDB_IDL_MEMSIZE( ms->ms_ids );
+	size += ms->ms_nsubs * sizeof( mdb_stream * );
+	for ( i = 0; i < ms->ms_nsubs; i++ )
+		size += mdb_stream_size( ms->ms_subs[i] );
+	return size;
+}
+
+/* Find the first candidate >= min */
+static int
+stream_next( mdb_stream *ms, ID min, ID *idp )
+{
+	MDB_val key, data;
+	ID id = NOID, next;
+	int i, agree, rc = 0;
+
+	/* the last answer still holds */
+	if ( ms->ms_min <= min && ( ms->ms_cur == NOID || min <= ms->ms_cur )) {
+		*idp = ms->ms_cur;
+		return 0;
+	}
+
+	switch ( ms->ms_type ) {
+	case MS_RANGE:
+		if ( min < ms->ms_lo )
+			min = ms->ms_lo;
+		if ( min > ms->ms_hi )
+			break;
+		if ( ms->ms_pos && ms->ms_cur + 1 == min ) {
+			rc = mdb_cursor_get( ms->ms_me, &key, &data, MDB_NEXT );
+		} else {
+			key.mv_data = &min;
+			key.mv_size = sizeof(ID);
+			rc = mdb_cursor_get( ms->ms_me, &key, &data, MDB_SET_RANGE );
+		}
+		if ( rc == 0 ) {
+			memcpy( &id, key.mv_data, sizeof(ID) );
+			if ( id > ms->ms_hi )
+				id = NOID;
+		}
+		break;
+
+	case MS_LIST:
+		next = ms->ms_pos ? ms->ms_cur : NOID;
+		rc = mdb_idl_seek_key( ms->ms_mc, &ms->ms_key, min, &next );
+		if ( rc == 0 )
+			id = next;
+		break;
+
+#ifdef MDB_IDL_BITMAPS
+	case MS_BITMAP:
+		/* words before the cursor may hold members >= min */
+		if ( !ms->ms_pos || min < ms->ms_min )
+			ms->ms_word = 0;
+		if ( min < ms->ms_lo )
+			min = ms->ms_lo;
+		if ( min > ms->ms_hi )
+			break;
+		rc = mdb_idl_bm_seek_key( ms->ms_mc, &ms->ms_key, min,
+			&ms->ms_word, &next );
+		if ( rc == 0 && next <= ms->ms_hi )
+			id = next;
+		break;
+#endif
+
+	case MS_IDL:
+		next = min;
+		id = mdb_idl_first( ms->ms_ids, &next );
+		if ( MDB_IDL_IS_RANGE( ms->ms_ids ) &&
+			id > MDB_IDL_RANGE_LAST( ms->ms_ids ))
+			id = NOID;
+		break;
+
+	case MS_AND:
+		/* leapfrog: every member has to land on the same ID */
+		id = min;
+		for ( i = 0, agree = 0; agree < ms->ms_nsubs; ) {
+			rc = stream_next( ms->ms_subs[i], id, &next );
+			if ( rc || next == NOID ) {
+				id = NOID;
+				break;
+			}
+			if ( next != id ) {
+				id = next;
+				agree = 1;
+			} else {
+				agree++;
+			}
+			if ( ++i == ms->ms_nsubs )
+				i = 0;
+		}
+		break;
+
+	case MS_OR:
+		for ( i = 0; i < ms->ms_nsubs; i++ ) {
+			rc = stream_next( ms->ms_subs[i], min, &next );
+			if ( rc )
+				break;
+			if ( next < id )
+				id = next;
+		}
+		break;
+	}
+
+	if ( rc == MDB_NOTFOUND ) {
+		rc = 0;
+		id = NOID;
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_stream_next: %s (%d)\n",
+			mdb_strerror( rc ), rc, 0 );
+		ms->ms_min = NOID;
+		ms->ms_pos = 0;
+		return rc;
+	}
+	ms->ms_min = min;
+	ms->ms_cur = id;
+	ms->ms_pos = id != NOID;
+	*idp = id;
+	return 0;
+}
+
+static int stream_test( mdb_stream *ms, ID id );
+
+static int
+stream_id_cmp( const void *a, const void *b )
+{
+	ID x = (ID) a, y = (ID) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Find the next candidate of an ordered walk */
+static int
+stream_order_next( mdb_stream *ms, ID *idp )
+{
+	ID id;
+	int rc;
+
+	for (;;) {
+		if ( ms->ms_pos ) {
+			id = mdb_idl_next( ms->ms_ids, &ms->ms_cur );
+		} else {
+			ms->ms_cur = 0;
+			id = mdb_idl_first( ms->ms_ids, &ms->ms_cur );
+			ms->ms_pos = 1;
+		}
+		if ( id == NOID ) {
+			if ( !ms->ms_mc )
+				break;
+			rc = stream_order_key( ms,
+				ms->ms_word ? MDB_SET_RANGE : MDB_NEXT_NODUP );
+			if ( rc == 0 )
+				rc = stream_order_read( ms );
+			if ( rc == MDB_NOTFOUND ) {
+				mdb_cursor_close( ms->ms_mc );
+				ms->ms_mc = NULL;
+				break;
+			}
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY, "mdb_stream_next: %s (%d)\n",
+					mdb_strerror( rc ), rc, 0 );
+				return rc;
+			}
+			continue;
+		}
+		if ( ms->ms_nsubs ) {
+			rc = stream_test( ms->ms_subs[0], id );
+			if ( rc < 0 )
+				return LDAP_OTHER;
+			if ( !rc )
+				continue;
+		}
+		/* an entry shows up under each of its keys in range */
+		if ( ms->ms_multi && avl_insert( &ms->ms_seen, (void *) id,
+			stream_id_cmp, avl_dup_error ))
+			continue;
+		break;
+	}
+	*idp = id;
+	return 0;
+}
+
+/* Return the first candidate >= min, or NOID when there are no more.
+ * An ordered stream ignores min and just returns its next candidate.
+ */
+ID
+mdb_stream_next( mdb_stream *ms, ID min )
+{
+	ID id = NOID;
+
+	if ( !ms->ms_rc )
+		ms->ms_rc = ms->ms_type == MS_ORDER ? stream_order_next( ms, &id )
+			: stream_next( ms, min, &id );
+	return ms->ms_rc ? NOID : id;
+}
+
+static int
+stream_test( mdb_stream *ms, ID id )
+{
+	MDB_val key, data;
+	ID next, word;
+	int i, rc;
+
+	switch ( ms->ms_type ) {
+	case MS_RANGE:
+		/* only entries that exist are tested */
+		return id >= ms->ms_lo && id <= ms->ms_hi;
+
+	case MS_LIST:
+		ms->ms_pos = 0;
+		key = ms->ms_key;
+		data.mv_data = &id;
+		data.mv_size = sizeof(ID);
+		rc = mdb_cursor_get( ms->ms_mc, &key, &data, MDB_GET_BOTH );
+		if ( rc && rc != MDB_NOTFOUND )
+			return -1;
+		return rc == 0;
+
+#ifdef MDB_IDL_BITMAPS
+	case MS_BITMAP:
+		ms->ms_pos = 0;
+		if ( id < ms->ms_lo || id > ms->ms_hi )
+			return 0;
+		word = 0;
+		rc = mdb_idl_bm_seek_key( ms->ms_mc, &ms->ms_key, id, &word, &next );
+		if ( rc )
+			return -1;
+		return next == id;
+#endif
+
+	case MS_IDL:
+		if ( MDB_IDL_IS_RANGE( ms->ms_ids ))
+			return id >= MDB_IDL_RANGE_FIRST( ms->ms_ids ) &&
+				id <= MDB_IDL_RANGE_LAST( ms->ms_ids ) &&
+				mdb_idl_bm_test( ms->ms_ids, id );
+		i = mdb_idl_search( ms->ms_ids, id );
+		return i <= ms->ms_ids[0] && ms->ms_ids[i] == id;
+
+	case MS_AND:
+		for ( i = 0; i < ms->ms_nsubs; i++ ) {
+			rc = stream_test( ms->ms_subs[i], id );
+			if ( rc <= 0 )
+				return rc;
+		}
+		return 1;
+
+	case MS_OR:
+		for ( i = 0; i < ms->ms_nsubs; i++ ) {
+			rc = stream_test( ms->ms_subs[i], id );
+			if ( rc )
+				return rc;
+		}
+		return 0;
+
+	case MS_ORDER:
+		/* the range itself is left to the filter */
+		return ms->ms_nsubs ? stream_test( ms->ms_subs[0], id ) : 1;
+	}
+	return 0;
+}
+
+/* Tell whether an entry is a candidate, for walks in scope order */
+int
+mdb_stream_test( mdb_stream *ms, ID id )
+{
+	int rc;
+
+	if ( ms->ms_rc )
+		return 0;
+	rc = stream_test( ms, id );
+	if ( rc < 0 ) {
+		ms->ms_rc = LDAP_OTHER;
+		rc = 0;
+	}
+	return rc;
+}
+
+static int
+stream_renew( Operation *op, MDB_txn *txn, mdb_stream *ms )
+{
+	int i, rc = 0;
+
+	if ( ms->ms_type == MS_ORDER ) {
+		/* seek back to the key last read when its IDs run out */
+		if ( ms->ms_mc ) {
+			rc = mdb_cursor_renew( txn, ms->ms_mc );
+			ms->ms_word = 1;
+		}
+		if ( rc == 0 && ms->ms_nsubs )
+			rc = stream_renew( op, txn, ms->ms_subs[0] );
+		return rc;
+	}
+	ms->ms_min = NOID;
+	ms->ms_pos = 0;
+	if ( ms->ms_me )
+		rc = mdb_cursor_renew( txn, ms->ms_me );
+	if ( ms->ms_mc && rc == 0 ) {
+		rc = mdb_cursor_renew( txn, ms->ms_mc );
+		/* the key may have changed shape since */
+		if ( rc == 0 )
+			rc = stream_key_shape( op, txn, ms );
+	}
+	for ( i = 0; i < ms->ms_nsubs && rc == 0; i++ )
+		rc = stream_renew( op, txn, ms->ms_subs[i] );
+	return rc;
+}
+
+/* Move the stream to a new read txn, after the old one was released.
+ * The next seek resumes from wherever the caller left off.
+ */
+int
+mdb_stream_renew( Operation *op, MDB_txn *txn, mdb_stream *ms )
+{
+	int rc = stream_renew( op, txn, ms );
+
+	if ( rc && !ms->ms_rc )
+		ms->ms_rc = rc;
+	return rc;
+}
@@ -58,6 +58,11 @@ static MDB_cursor *mcp = NULL, *mcd = NULL;
 static MDB_val key, data;
 static ID previd = NOID;
 
+/* rebuilding the indexes for a new index_hash:
+ * 1 while running, 2 once every entry was reindexed, -1 on failure
+ */
+static int tool_rehash;
+
 typedef struct dn_id {
 	ID id;
 	struct berval dn;
@@ -95,12 +100,53 @@ static int	mdb_writes, mdb_writes_per_commit;
 #define MDB_WRITES_PER_COMMIT	500
 #endif
 
+/* Default bulk load buffer size, it is spilled to run files when full */
+#ifndef MDB_TOOL_BULK_SIZE
+#define MDB_TOOL_BULK_SIZE	(256*1024*1024)
+#endif
+
+/* Number of puts per commit when merging the runs */
+#ifndef MDB_TOOL_BULK_PUTS
+#define MDB_TOOL_BULK_PUTS	(1024*1024)
+#endif
+
+static char *bulk_buf;
+static size_t bulk_len, bulk_size;
+static size_t bulk_mark;	/* end of the committed keys */
+static FILE **bulk_runs;
+static unsigned bulk_nruns;
+static unsigned bulk_keep;	/* runs that hold only committed keys */
+static int bulk_rc;
+static int bulk_bitmaps;	/* MDB_BITMAP_KEYS */
+
+static int mdb_tool_bulk_spill( struct mdb_info *mdb );
+static void mdb_tool_bulk_commit( void );
+static void mdb_tool_bulk_abort( struct mdb_info *mdb );
+static int mdb_tool_bulk_merge( BackendDB *be );
+static void mdb_tool_bulk_free( struct mdb_info *mdb );
+
+/* Readers of a parallel dump, they must all see the same snapshot */
+typedef struct mdb_tool_walker {
+	MDB_txn *mw_txn;
+	MDB_cursor *mw_cursor;
+	MDB_cursor *mw_idcursor;
+} mdb_tool_walker;
+
+static ldap_pvt_thread_mutex_t mdb_tool_walk_mutex;
+static size_t mdb_tool_walk_txnid;
+static int mdb_tool_walk_set;
+
 static int
 mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep );
 
 int mdb_tool_entry_open(
 	BackendDB *be, int mode )
 {
+	if ( slapMode & SLAP_TOOL_READONLY ) {
+		ldap_pvt_thread_mutex_init( &mdb_tool_walk_mutex );
+		mdb_tool_walk_set = 0;
+	}
+
 	/* In Quick mode, commit once per 500 entries */
 	mdb_writes = 0;
 	if ( slapMode & SLAP_TOOL_QUICK )
@@ -108,6 +154,26 @@ int mdb_tool_entry_open(
 	else
 		mdb_writes_per_commit = 1;
 
+	/* Bulk load the indexes of a new database in slapadd -q */
+	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READMAIN|SLAP_TOOL_READONLY))
+		== SLAP_TOOL_QUICK && mode )
+	{
+		struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+		MDB_txn *txn;
+		MDB_stat st;
+
+		if (( mdb->mi_nattrs || mdb->mi_ncomps ) &&
+			mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn ) == 0 )
+		{
+			if ( mdb_stat( txn, mdb->mi_id2entry, &st ) == 0 &&
+				!st.ms_entries )
+				mdb->mi_flags |= MDB_TOOL_BULK;
+			bulk_bitmaps = mdb->mi_flags & MDB_BITMAP_KEYS;
+			mdb_txn_abort( txn );
+		}
+		bulk_rc = 0;
+	}
+
 #ifdef MDB_TOOL_IDL_CACHING			/* threaded indexing has no performance advantage */
 	/* Set up for threaded slapindex */
 	if (( slapMode & (SLAP_TOOL_QUICK|SLAP_TOOL_READONLY)) == SLAP_TOOL_QUICK ) {
@@ -147,6 +213,9 @@ int mdb_tool_entry_open(
 int mdb_tool_entry_close(
 	BackendDB *be )
 {
+	if ( slapMode & SLAP_TOOL_READONLY )
+		ldap_pvt_thread_mutex_destroy( &mdb_tool_walk_mutex );
+
 #ifdef MDB_TOOL_IDL_CACHING
 	if ( mdb_tool_info ) {
 		int i;
@@ -204,6 +273,33 @@ int mdb_tool_entry_close(
 			int i;
 			for (i=0; i<mdb->mi_nattrs; i++)
 				mdb->mi_attrs[i]->ai_cursor = NULL;
+
+			/* record the new format once all keys were rebuilt */
+			if ( tool_rehash == 2 && !txi )
+				mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txi );
+			if ( txi ) {
+				int rc = 0;
+				if ( tool_rehash == 2 )
+					rc = mdb_format_write( mdb, txi );
+				MDB_TOOL_IDL_FLUSH( be, txi );
+				if ( rc == 0 )
+					rc = mdb_txn_commit( txi );
+				else
+					mdb_txn_abort( txi );
+				txi = NULL;
+				mdb_writes = 0;
+				if ( rc ) {
+					Debug( LDAP_DEBUG_ANY,
+						LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+						"txn_commit failed: %s (%d)\n",
+						be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+					tool_rehash = 0;
+					return -1;
+				}
+				if ( tool_rehash == 2 )
+					mdb->mi_flags &= ~MDB_NEED_REHASH;
+			}
+			tool_rehash = 0;
 		}
 	}
 	if( mdb_tool_txn ) {
@@ -213,11 +309,26 @@ int mdb_tool_entry_close(
 				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
 				"txn_commit failed: %s (%d)\n",
 				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			if ( be->be_private )
+				mdb_tool_bulk_free( be->be_private );
 			return -1;
 		}
 		mdb_tool_txn = NULL;
 	}
 
+	{
+		struct mdb_info *mdb = be->be_private;
+		if ( mdb && ( mdb->mi_flags & MDB_TOOL_BULK )) {
+			if ( bulk_rc ) {
+				mdb_tool_bulk_free( mdb );
+				return -1;
+			}
+			mdb_tool_bulk_commit();
+			if ( mdb_tool_bulk_merge( be ))
+				return -1;
+		}
+	}
+
 	if( nholes ) {
 		unsigned i;
 		fprintf( stderr, "Error, entries missing!\n");
@@ -274,6 +385,8 @@ next:;
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT );
 
 	if( rc ) {
+		if ( rc == MDB_NOTFOUND && tool_rehash == 1 )
+			tool_rehash = 2;
 		return NOID;
 	}
 
@@ -402,7 +515,7 @@ mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep )
 			}
 		}
 	}
-	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, id, &e );
+	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, id, &e, NULL );
 	e->e_id = id;
 	if ( !BER_BVISNULL( &dn )) {
 		e->e_name = dn;
@@ -446,6 +559,137 @@ mdb_tool_entry_get( BackendDB *be, ID id )
 	return e;
 }
 
+static void
+mdb_tool_walk_end( mdb_tool_walker *mw )
+{
+	if ( mw->mw_idcursor )
+		mdb_cursor_close( mw->mw_idcursor );
+	if ( mw->mw_cursor )
+		mdb_cursor_close( mw->mw_cursor );
+	if ( mw->mw_txn )
+		mdb_txn_abort( mw->mw_txn );
+	ch_free( mw );
+}
+
+int
+mdb_tool_entry_walk(
+	BackendDB *be,
+	void **ctx,
+	ID *idp,
+	ID last,
+	BI_tool_entry_cb *cb,
+	void *arg )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_walker *mw;
+	Operation op = {0};
+	Opheader ohdr = {0};
+	MDB_val key, data;
+	ID id;
+	int rc;
+
+	assert( slapMode & SLAP_TOOL_READONLY );
+
+	if ( !ctx ) {
+		ldap_pvt_thread_mutex_lock( &mdb_tool_walk_mutex );
+		mdb_tool_walk_set = 0;
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_walk_mutex );
+		return 0;
+	}
+
+	mw = *ctx;
+	if ( !cb ) {
+		if ( mw ) {
+			mdb_tool_walk_end( mw );
+			*ctx = NULL;
+			return 0;
+		}
+
+		mw = ch_calloc( 1, sizeof( mdb_tool_walker ));
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &mw->mw_txn );
+		if ( rc == 0 )
+			rc = mdb_cursor_open( mw->mw_txn, mdb->mi_id2entry, &mw->mw_cursor );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				"=> mdb_tool_entry_walk: txn_begin failed: %s (%d)\n",
+				mdb_strerror(rc), rc, 0 );
+			mdb_tool_walk_end( mw );
+			return LDAP_OTHER;
+		}
+
+		/* a write committed while the readers were starting */
+		ldap_pvt_thread_mutex_lock( &mdb_tool_walk_mutex );
+		if ( !mdb_tool_walk_set ) {
+			mdb_tool_walk_txnid = mdb_txn_id( mw->mw_txn );
+			mdb_tool_walk_set = 1;
+		}
+		if ( mdb_txn_id( mw->mw_txn ) == mdb_tool_walk_txnid ) {
+			rc = 0;
+		} else {
+			rc = LDAP_BUSY;
+		}
+		ldap_pvt_thread_mutex_unlock( &mdb_tool_walk_mutex );
+		if ( rc ) {
+			mdb_tool_walk_end( mw );
+			return rc;
+		}
+		*ctx = mw;
+		return 0;
+	}
+
+	op.o_hdr = &ohdr;
+	op.o_bd = be;
+	op.o_tmpmemctx = NULL;
+	op.o_tmpmfuncs = &ch_mfuncs;
+
+	id = *idp;
+	key.mv_size = sizeof(ID);
+	key.mv_data = &id;
+	rc = mdb_cursor_get( mw->mw_cursor, &key, &data, MDB_SET_RANGE );
+	for ( ; rc == 0; rc = mdb_cursor_get( mw->mw_cursor, &key, &data, MDB_NEXT )) {
+		struct berval dn, ndn;
+		Entry *e;
+
+		memcpy( &id, key.mv_data, sizeof(ID) );
+		if ( id > last )
+			break;
+		if ( !data.mv_size )
+			continue;
+
+		rc = mdb_id2name( &op, mw->mw_txn, &mw->mw_idcursor, id, &dn, &ndn );
+		if ( rc ) {
+			*idp = id;
+			return LDAP_OTHER;
+		}
+		rc = mdb_entry_decode( &op, mw->mw_txn, &data, id, &e, NULL );
+		if ( rc ) {
+			ch_free( dn.bv_val );
+			ch_free( ndn.bv_val );
+			*idp = id;
+			return rc;
+		}
+		e->e_id = id;
+		e->e_name = dn;
+		e->e_nname = ndn;
+
+		rc = cb( e, arg );
+		mdb_entry_release( &op, e, 0 );
+		if ( rc ) {
+			*idp = id;
+			return rc;
+		}
+	}
+	if ( rc == 0 ) {
+		*idp = id;
+	} else if ( rc == MDB_NOTFOUND ) {
+		*idp = NOID;
+	} else {
+		*idp = id;
+		return LDAP_OTHER;
+	}
+	return 0;
+}
+
 static int mdb_tool_next_id(
 	Operation *op,
 	MDB_txn *tid,
@@ -562,7 +806,7 @@ mdb_tool_index_add(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 
-	if ( !mdb->mi_nattrs )
+	if ( !mdb->mi_nattrs && !mdb->mi_ncomps )
 		return 0;
 
 	if ( mdb_tool_threads > 1 ) {
@@ -603,7 +847,10 @@ mdb_tool_index_add(
 		ldap_pvt_thread_cond_broadcast( &mdb_tool_index_cond_work );
 		ldap_pvt_thread_mutex_unlock( &mdb_tool_index_mutex );
 
-		return mdb_index_recrun( op, txn, mdb, ir, e->e_id, 0 );
+		rc = mdb_index_recrun( op, txn, mdb, ir, e->e_id, 0 );
+		if ( rc == 0 )
+			rc = mdb_index_comps( op, txn, SLAP_INDEX_ADD_OP, e );
+		return rc;
 	} else
 	{
 		return mdb_index_entry_add( op, txn, e );
@@ -653,6 +900,13 @@ ID mdb_tool_entry_put(
 
 	mdb = (struct mdb_info *) be->be_private;
 
+	if ( bulk_rc ) {
+		snprintf( text->bv_val, text->bv_len,
+			"bulk load failed: %s (%d)",
+			STRERROR(bulk_rc), bulk_rc );
+		return NOID;
+	}
+
 	if ( !mdb_tool_txn ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
 		if( rc != 0 ) {
@@ -753,6 +1007,7 @@ done:
 			idcursor = NULL;
 			if( rc != 0 ) {
 				mdb->mi_numads = 0;
+				mdb_tool_bulk_abort( mdb );
 				snprintf( text->bv_val, text->bv_len,
 						"txn_commit failed: %s (%d)",
 						mdb_strerror(rc), rc );
@@ -760,11 +1015,23 @@ done:
 					"=> " LDAP_XSTRING(mdb_tool_entry_put) ": %s\n",
 					text->bv_val, 0, 0 );
 				e->e_id = NOID;
+			} else if ( mdb->mi_flags & MDB_TOOL_BULK ) {
+				mdb_tool_bulk_commit();
+				if ( bulk_len >= bulk_size - bulk_size / 8 &&
+					( bulk_rc = mdb_tool_bulk_spill( mdb )))
+				{
+					snprintf( text->bv_val, text->bv_len,
+						"bulk load failed: %s (%d)",
+						STRERROR(bulk_rc), bulk_rc );
+					e->e_id = NOID;
+				}
 			}
 		}
 
 	} else {
 		unsigned i;
+		/* the keys of the aborted entries go too */
+		mdb_tool_bulk_abort( mdb );
 		mdb_txn_abort( mdb_tool_txn );
 		mdb_tool_txn = NULL;
 		idcursor = NULL;
@@ -784,8 +1051,542 @@ done:
 	return e->e_id;
 }
 
+/* Bulk loading. When slapadd -q starts on an empty database the index
+ * keys are not inserted as they are generated, which would descend the
+ * trees at random and leave half empty pages behind. They are collected
+ * with their entry IDs instead, sorted and spilled to run files in the
+ * database directory, and merged into the index databases at close.
+ * The merge writes in key order, so every put is an append.
+ */
+typedef struct bulk_rec {
+	ID br_id;
+	MDB_dbi br_dbi;
+	unsigned short br_klen;
+	char br_key[1];
+} bulk_rec;
+
+#define BULK_HDRSIZE	offsetof(bulk_rec, br_key)
+#define BULK_RECSIZE(klen)	\
+	((BULK_HDRSIZE + (klen) + sizeof(ID) - 1) & ~(sizeof(ID) - 1))
+
+typedef struct bulk_src {
+	bulk_rec *bs_rec;	/* current record, NULL at the end */
+	FILE *bs_fp;		/* a run file */
+	bulk_rec *bs_buf;
+	size_t bs_size;
+	int bs_err;
+	bulk_rec **bs_next, **bs_end;	/* or the sorted buffer */
+} bulk_src;
+
+static int
+bulk_rec_cmp( const bulk_rec *a, const bulk_rec *b )
+{
+	int rc;
+
+	if ( a->br_dbi != b->br_dbi )
+		return a->br_dbi < b->br_dbi ? -1 : 1;
+	rc = memcmp( a->br_key, b->br_key,
+		a->br_klen < b->br_klen ? a->br_klen : b->br_klen );
+	if ( rc )
+		return rc;
+	if ( a->br_klen != b->br_klen )
+		return a->br_klen < b->br_klen ? -1 : 1;
+	if ( a->br_id != b->br_id )
+		return a->br_id < b->br_id ? -1 : 1;
+	return 0;
+}
+
+static int
+bulk_rec_qcmp( const void *a, const void *b )
+{
+	return bulk_rec_cmp( *(bulk_rec **)a, *(bulk_rec **)b );
+}
+
+int
+mdb_tool_bulk_keys(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_dbi dbi = mdb_cursor_dbi( mc );
+	bulk_rec *br;
+	size_t klen, size;
+	int k, rc;
+
+	for ( k = 0; keys[k].bv_val; k++ ) {
+		klen = keys[k].bv_len;
+#ifndef MISALIGNED_OK
+		/* the same padding as mdb_idl_insert_keys */
+		if ( klen & ALIGNER )
+			klen = 2 * sizeof(int);
+#endif
+		size = BULK_RECSIZE( klen );
+		if ( bulk_len + size > bulk_size ) {
+			if ( bulk_len && ( rc = mdb_tool_bulk_spill( mdb ))) {
+				bulk_rc = rc;
+				return rc;
+			}
+			/* the buffer must hold at least this one key */
+			if ( size > bulk_size ) {
+				bulk_size = mdb->mi_bulk_size ? mdb->mi_bulk_size :
+					MDB_TOOL_BULK_SIZE;
+				if ( bulk_size < size )
+					bulk_size = size;
+				bulk_buf = ch_realloc( bulk_buf, bulk_size );
+			}
+		}
+		br = (bulk_rec *)( bulk_buf + bulk_len );
+		memset( br, 0, size );
+		br->br_id = id;
+		br->br_dbi = dbi;
+		br->br_klen = klen;
+		memcpy( br->br_key, keys[k].bv_val, keys[k].bv_len );
+		bulk_len += size;
+	}
+	return 0;
+}
+
+/* Sort the records of the buffer from start to end, returns an array
+ * of them
+ */
+static bulk_rec **
+mdb_tool_bulk_sort( size_t start, size_t end, size_t *np )
+{
+	bulk_rec **recs;
+	size_t n = 0, off;
+
+	for ( off = start; off < end; n++ )
+		off += BULK_RECSIZE( ((bulk_rec *)( bulk_buf + off ))->br_klen );
+	recs = ch_malloc( ( n + 1 ) * sizeof(bulk_rec *));
+	for ( n = 0, off = start; off < end; n++ ) {
+		recs[n] = (bulk_rec *)( bulk_buf + off );
+		off += BULK_RECSIZE( recs[n]->br_klen );
+	}
+	qsort( recs, n, sizeof(bulk_rec *), bulk_rec_qcmp );
+	*np = n;
+	return recs;
+}
+
+/* Write the records of the buffer from start to end as a sorted run */
+static int
+mdb_tool_bulk_run( struct mdb_info *mdb, size_t start, size_t end )
+{
+	bulk_rec **recs;
+	char path[MAXPATHLEN];
+	FILE *fp;
+	size_t i, n;
+	int rc = 0;
+
+	snprintf( path, sizeof(path), "%s" LDAP_DIRSEP "bulk%u.tmp",
+		mdb->mi_dbenv_home, bulk_nruns );
+	fp = fopen( path, "w+b" );
+	if ( fp == NULL ) {
+		rc = errno;
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_run)
+			": cannot create %s: %s\n", path, STRERROR( rc ), 0 );
+		return rc;
+	}
+	bulk_runs = ch_realloc( bulk_runs, ( bulk_nruns + 1 ) * sizeof(FILE *));
+	bulk_runs[bulk_nruns++] = fp;
+
+	recs = mdb_tool_bulk_sort( start, end, &n );
+	for ( i = 0; i < n; i++ ) {
+		if ( fwrite( recs[i], BULK_RECSIZE( recs[i]->br_klen ), 1, fp ) != 1 )
+			break;
+	}
+	ch_free( recs );
+	if ( i < n || fflush( fp )) {
+		rc = errno ? errno : EIO;
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_run)
+			": cannot write %s: %s\n", path, STRERROR( rc ), 0 );
+	}
+	return rc;
+}
+
+/* Empty the buffer into run files. The keys of the batch in progress
+ * get a run of their own, so that an abort can still drop them.
+ */
+static int
+mdb_tool_bulk_spill( struct mdb_info *mdb )
+{
+	int rc = 0;
+
+	if ( bulk_mark ) {
+		rc = mdb_tool_bulk_run( mdb, 0, bulk_mark );
+		bulk_keep = bulk_nruns;
+	}
+	if ( rc == 0 && bulk_len > bulk_mark )
+		rc = mdb_tool_bulk_run( mdb, bulk_mark, bulk_len );
+	bulk_len = 0;
+	bulk_mark = 0;
+	return rc;
+}
+
+/* The keys collected so far belong to committed entries */
+static void
+mdb_tool_bulk_commit( void )
+{
+	bulk_mark = bulk_len;
+	bulk_keep = bulk_nruns;
+}
+
+/* Drop the keys of the entries of an aborted batch */
+static void
+mdb_tool_bulk_abort( struct mdb_info *mdb )
+{
+	char path[MAXPATHLEN];
+
+	bulk_len = bulk_mark;
+	while ( bulk_nruns > bulk_keep ) {
+		bulk_nruns--;
+		fclose( bulk_runs[bulk_nruns] );
+		snprintf( path, sizeof(path), "%s" LDAP_DIRSEP "bulk%u.tmp",
+			mdb->mi_dbenv_home, bulk_nruns );
+		remove( path );
+	}
+}
+
+/* Drop the collected keys and the run files */
+static void
+mdb_tool_bulk_free( struct mdb_info *mdb )
+{
+	char path[MAXPATHLEN];
+	unsigned i;
+
+	for ( i = 0; i < bulk_nruns; i++ ) {
+		fclose( bulk_runs[i] );
+		snprintf( path, sizeof(path), "%s" LDAP_DIRSEP "bulk%u.tmp",
+			mdb->mi_dbenv_home, i );
+		remove( path );
+	}
+	ch_free( bulk_runs );
+	bulk_runs = NULL;
+	bulk_nruns = bulk_keep = 0;
+	ch_free( bulk_buf );
+	bulk_buf = NULL;
+	bulk_len = bulk_size = bulk_mark = 0;
+	mdb->mi_flags &= ~MDB_TOOL_BULK;
+}
+
+static bulk_rec *
+bulk_src_next( bulk_src *bs )
+{
+	bulk_rec hdr;
+	size_t size;
+
+	if ( !bs->bs_fp ) {
+		bs->bs_rec = bs->bs_next < bs->bs_end ? *bs->bs_next++ : NULL;
+		return bs->bs_rec;
+	}
+	bs->bs_rec = NULL;
+	if ( fread( &hdr, BULK_HDRSIZE, 1, bs->bs_fp ) != 1 ) {
+		bs->bs_err = ferror( bs->bs_fp );
+		return NULL;
+	}
+	size = BULK_RECSIZE( hdr.br_klen );
+	if ( size > bs->bs_size ) {
+		bs->bs_size = size;
+		bs->bs_buf = ch_realloc( bs->bs_buf, size );
+	}
+	memcpy( bs->bs_buf, &hdr, BULK_HDRSIZE );
+	if ( fread( bs->bs_buf->br_key, size - BULK_HDRSIZE, 1, bs->bs_fp ) != 1 ) {
+		bs->bs_err = 1;
+		return NULL;
+	}
+	bs->bs_rec = bs->bs_buf;
+	return bs->bs_rec;
+}
+
+/* The IDs of one key, stored the way mdb_idl_insert_keys would have
+ * left them after inserting them in ascending order.
+ */
+typedef struct bulk_key {
+	ID *bk_ids;		/* up to MDB_IDL_DB_MAX as a list */
+	ID bk_nids;
+	ID *bk_words;	/* or a bitmap */
+	ID bk_nwords, bk_maxwords;
+	ID bk_lo, bk_hi;
+	int bk_shape;
+} bulk_key;
+
+#ifdef MDB_IDL_BITMAPS
+/* Returns -1 if the bitmap would grow past MDB_IDL_BM_LIMIT words,
+ * as mdb_idl_insert_keys keeps such a key as a plain range.
+ */
+static int
+bulk_key_bit( bulk_key *bk, ID id )
+{
+	ID x = id >> MDB_IDL_BM_SHIFT, bit = (ID)1 << ( id & ( MDB_IDL_BM_BITS-1 ));
+
+	if ( bk->bk_nwords && MDB_IDL_BM_IDX( bk->bk_words[bk->bk_nwords-1] ) == x ) {
+		bk->bk_words[bk->bk_nwords-1] |= bit;
+		return 0;
+	}
+	if ( bk->bk_nwords >= MDB_IDL_BM_LIMIT )
+		return -1;
+	if ( bk->bk_nwords == bk->bk_maxwords ) {
+		bk->bk_maxwords = bk->bk_maxwords ? bk->bk_maxwords * 2 : 4096;
+		bk->bk_words = ch_realloc( bk->bk_words, bk->bk_maxwords * sizeof(ID));
+	}
+	bk->bk_words[bk->bk_nwords++] = MDB_IDL_BM_WORD( x, bit );
+	return 0;
+}
+#endif
+
+/* IDs arrive in ascending order */
+static void
+bulk_key_add( bulk_key *bk, ID id )
+{
+	if ( bk->bk_nids && bk->bk_hi == id )
+		return;
+	if ( !bk->bk_nids )
+		bk->bk_lo = id;
+
+	switch ( bk->bk_shape ) {
+	case MDB_IDL_KEY_LIST:
+		if ( bk->bk_nids < MDB_IDL_DB_MAX ) {
+			bk->bk_ids[bk->bk_nids] = id;
+			break;
+		}
+		/* No room, convert */
+#ifdef MDB_IDL_BITMAPS
+		if ( id <= MDB_IDL_BM_MAXID && bulk_bitmaps ) {
+			ID i;
+			bk->bk_shape = MDB_IDL_KEY_BITMAP;
+			bk->bk_nwords = 0;
+			for ( i = 0; i < bk->bk_nids; i++ )
+				bulk_key_bit( bk, bk->bk_ids[i] );
+			bulk_key_bit( bk, id );
+			break;
+		}
+#endif
+		bk->bk_shape = MDB_IDL_KEY_RANGE;
+		break;
+#ifdef MDB_IDL_BITMAPS
+	case MDB_IDL_KEY_BITMAP:
+		if ( id > MDB_IDL_BM_MAXID || bulk_key_bit( bk, id ))
+			bk->bk_shape = MDB_IDL_KEY_RANGE;
+		break;
+#endif
+	}
+	bk->bk_nids++;
+	bk->bk_hi = id;
+}
+
+static int
+bulk_key_put( MDB_cursor *mc, MDB_val *key, bulk_key *bk, size_t *puts )
+{
+	MDB_val data;
+	ID i, *ids, n, zero = 0;
+	unsigned flag = MDB_APPEND;
+	int rc = 0;
+
+	data.mv_size = sizeof(ID);
+	if ( bk->bk_shape == MDB_IDL_KEY_LIST ) {
+		ids = bk->bk_ids;
+		n = bk->bk_nids;
+	} else {
+		/* a range, lo and hi, then the bitmap words if any */
+		data.mv_data = &zero;
+		rc = mdb_cursor_put( mc, key, &data, flag );
+		flag = MDB_APPENDDUP;
+		if ( rc == 0 ) {
+			data.mv_data = &bk->bk_lo;
+			rc = mdb_cursor_put( mc, key, &data, flag );
+		}
+		if ( rc == 0 ) {
+			data.mv_data = &bk->bk_hi;
+			rc = mdb_cursor_put( mc, key, &data, flag );
+		}
+		*puts += 3;
+		ids = bk->bk_words;
+		n = bk->bk_shape == MDB_IDL_KEY_BITMAP ? bk->bk_nwords : 0;
+	}
+	for ( i = 0; rc == 0 && i < n; i++ ) {
+		data.mv_data = &ids[i];
+		rc = mdb_cursor_put( mc, key, &data, flag );
+		flag = MDB_APPENDDUP;
+	}
+	*puts += n;
+	bk->bk_nids = 0;
+	bk->bk_shape = MDB_IDL_KEY_LIST;
+	return rc;
+}
+
+/* Merge the runs into the index databases */
+static int
+mdb_tool_bulk_merge( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	bulk_src *srcs;
+	bulk_rec **recs = NULL, *br, *cur = NULL;
+	bulk_key bk = {0};
+	unsigned nsrcs, i, *heap, nheap;
+	size_t n, puts = 0, cursize = 0;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc = NULL;
+	MDB_val key;
+	int rc = 0;
+
+	/* a load that fit in memory is merged from there */
+	if ( bulk_nruns ) {
+		if ( bulk_len && ( rc = mdb_tool_bulk_spill( mdb )))
+			return rc;
+		nsrcs = bulk_nruns;
+	} else {
+		recs = mdb_tool_bulk_sort( 0, bulk_len, &n );
+		nsrcs = 1;
+	}
+	srcs = ch_calloc( nsrcs, sizeof(bulk_src));
+	heap = ch_malloc( nsrcs * sizeof(unsigned));
+	bk.bk_ids = ch_malloc( MDB_IDL_DB_MAX * sizeof(ID));
+
+	/* a min-heap of the sources by their current record */
+	nheap = 0;
+	for ( i = 0; i < nsrcs; i++ ) {
+		unsigned j, p;
+		if ( recs ) {
+			srcs[i].bs_next = recs;
+			srcs[i].bs_end = recs + n;
+		} else {
+			srcs[i].bs_fp = bulk_runs[i];
+			rewind( srcs[i].bs_fp );
+		}
+		if ( !bulk_src_next( &srcs[i] )) {
+			if ( srcs[i].bs_err )
+				rc = EIO;
+			continue;
+		}
+		for ( j = nheap++; j; j = p ) {
+			p = ( j - 1 ) / 2;
+			if ( bulk_rec_cmp( srcs[heap[p]].bs_rec, srcs[i].bs_rec ) <= 0 )
+				break;
+			heap[j] = heap[p];
+		}
+		heap[j] = i;
+	}
+
+	if ( rc == 0 )
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	while ( rc == 0 ) {
+		br = nheap ? srcs[heap[0]].bs_rec : NULL;
+
+		/* a new key, store the previous one */
+		if ( cur && ( !br || br->br_dbi != cur->br_dbi ||
+			br->br_klen != cur->br_klen ||
+			memcmp( br->br_key, cur->br_key, cur->br_klen )))
+		{
+			key.mv_size = cur->br_klen;
+			key.mv_data = cur->br_key;
+			rc = bulk_key_put( mc, &key, &bk, &puts );
+			if ( rc )
+				break;
+			if ( !br )
+				break;
+			/* keep the txn small enough, the appends go on in the next */
+			if ( puts >= MDB_TOOL_BULK_PUTS || br->br_dbi != cur->br_dbi ) {
+				mdb_cursor_close( mc );
+				mc = NULL;
+			}
+			if ( puts >= MDB_TOOL_BULK_PUTS ) {
+				puts = 0;
+				rc = mdb_txn_commit( txn );
+				txn = NULL;
+				if ( rc == 0 )
+					rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+				if ( rc )
+					break;
+			}
+		}
+		if ( !br )
+			break;
+		if ( !mc ) {
+			rc = mdb_cursor_open( txn, br->br_dbi, &mc );
+			if ( rc )
+				break;
+		}
+		if ( !bk.bk_nids ) {
+			size_t size = BULK_RECSIZE( br->br_klen );
+			if ( size > cursize ) {
+				cursize = size;
+				cur = ch_realloc( cur, size );
+			}
+			memcpy( cur, br, size );
+		}
+		bulk_key_add( &bk, br->br_id );
+
+		/* advance the source and restore the heap */
+		i = heap[0];
+		if ( !bulk_src_next( &srcs[i] )) {
+			if ( srcs[i].bs_err ) {
+				rc = EIO;
+				break;
+			}
+			i = heap[--nheap];
+		}
+		if ( nheap ) {
+			unsigned j = 0, c;
+			for (;;) {
+				c = 2 * j + 1;
+				if ( c >= nheap )
+					break;
+				if ( c + 1 < nheap && bulk_rec_cmp( srcs[heap[c+1]].bs_rec,
+					srcs[heap[c]].bs_rec ) < 0 )
+					c++;
+				if ( bulk_rec_cmp( srcs[i].bs_rec, srcs[heap[c]].bs_rec ) <= 0 )
+					break;
+				heap[j] = heap[c];
+				j = c;
+			}
+			heap[j] = i;
+		}
+	}
+
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( txn ) {
+		if ( rc == 0 )
+			rc = mdb_txn_commit( txn );
+		else
+			mdb_txn_abort( txn );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_merge)
+			": database %s: %s (%d)\n",
+			be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	}
+
+	for ( i = 0; i < nsrcs; i++ )
+		ch_free( srcs[i].bs_buf );
+	ch_free( srcs );
+	ch_free( heap );
+	ch_free( recs );
+	ch_free( cur );
+	ch_free( bk.bk_ids );
+	ch_free( bk.bk_words );
+	mdb_tool_bulk_free( mdb );
+	return rc;
+}
+
 static int mdb_dn2id_upgrade( BackendDB *be );
 
+/* Is ad a member of one of the first n composite indexes */
+static int
+mdb_tool_comp_member( struct mdb_info *mi, int n, AttributeDescription *ad )
+{
+	int i, j;
+
+	for ( i = 0; i < n; i++ ) {
+		for ( j = 0; j < mi->mi_comps[i]->ci_nattrs; j++ ) {
+			if ( mi->mi_comps[i]->ci_descs[j] == ad )
+				return 1;
+		}
+	}
+	return 0;
+}
+
 int mdb_tool_entry_reindex(
 	BackendDB *be,
 	ID id,
@@ -810,18 +1611,42 @@ int mdb_tool_entry_reindex(
 		return mdb_dn2id_upgrade( be );
 	}
 
+#ifdef MDB_IDL_BITMAPS
+	/* A full reindex brings the keys of an older database to bitmaps */
+	if ( !adv && !( mi->mi_flags & MDB_BITMAP_KEYS ))
+		mi->mi_flags |= MDB_NEED_REHASH;
+#endif
+
+	/* Keys made with the old format are useless, drop them all */
+	if ( mi->mi_flags & MDB_NEED_REHASH ) {
+		if ( adv ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_reindex)
+				": index format changed, all indexes must be rebuilt\n",
+				0, 0, 0 );
+			return -1;
+		}
+		if ( !tool_rehash ) {
+			slapMode |= SLAP_TRUNCATE_MODE;
+			tool_rehash = 1;
+#ifdef MDB_IDL_BITMAPS
+			mi->mi_flags |= MDB_BITMAP_KEYS;
+#endif
+		}
+	}
+
 	/* No indexes configured, nothing to do. Could return an
 	 * error here to shortcut things.
 	 */
-	if (!mi->mi_attrs) {
+	if (!mi->mi_attrs && !mi->mi_comps) {
 		return 0;
 	}
 
 	/* Check for explicit list of attrs to index */
 	if ( adv ) {
-		int i, j, n;
+		int i, j, k, n;
 
-		if ( mi->mi_attrs[0]->ai_desc != adv[0] ) {
+		if ( !mi->mi_nattrs || mi->mi_attrs[0]->ai_desc != adv[0] ) {
 			/* count */
 			for ( n = 0; adv[n]; n++ ) ;
 
@@ -836,26 +1661,40 @@ int mdb_tool_entry_reindex(
 			}
 		}
 
-		for ( i = 0; adv[i]; i++ ) {
-			if ( mi->mi_attrs[i]->ai_desc != adv[i] ) {
-				for ( j = i+1; j < mi->mi_nattrs; j++ ) {
-					if ( mi->mi_attrs[j]->ai_desc == adv[i] ) {
-						AttrInfo *ai = mi->mi_attrs[i];
-						mi->mi_attrs[i] = mi->mi_attrs[j];
-						mi->mi_attrs[j] = ai;
-						break;
-					}
-				}
-				if ( j == mi->mi_nattrs ) {
-					Debug( LDAP_DEBUG_ANY,
-						LDAP_XSTRING(mdb_tool_entry_reindex)
-						": no index configured for %s\n",
-						adv[i]->ad_cname.bv_val, 0, 0 );
-					return -1;
+		/* keep the composite indexes over any of the attrs */
+		for ( i = 0, n = 0; i < mi->mi_ncomps; i++ ) {
+			CompInfo *ci = mi->mi_comps[i];
+			for ( j = 0; j < ci->ci_nattrs; j++ ) {
+				for ( k = 0; adv[k] && adv[k] != ci->ci_descs[j]; k++ )
+					;
+				if ( adv[k] )
+					break;
+			}
+			if ( j < ci->ci_nattrs ) {
+				mi->mi_comps[i] = mi->mi_comps[n];
+				mi->mi_comps[n++] = ci;
+			}
+		}
+
+		for ( i = 0, k = 0; adv[i]; i++ ) {
+			for ( j = k; j < mi->mi_nattrs; j++ ) {
+				if ( mi->mi_attrs[j]->ai_desc == adv[i] ) {
+					AttrInfo *ai = mi->mi_attrs[k];
+					mi->mi_attrs[k++] = mi->mi_attrs[j];
+					mi->mi_attrs[j] = ai;
+					break;
 				}
 			}
+			if ( j == mi->mi_nattrs && !mdb_tool_comp_member( mi, n, adv[i] )) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": no index configured for %s\n",
+					adv[i]->ad_cname.bv_val, 0, 0 );
+				return -1;
+			}
 		}
-		mi->mi_nattrs = i;
+		mi->mi_nattrs = k;
+		mi->mi_ncomps = n;
 	}
 
 	e = mdb_tool_entry_get( be, id );
@@ -892,6 +1731,17 @@ int mdb_tool_entry_reindex(
 				return -1;
 			}
 		}
+		for ( i=0; i < mi->mi_ncomps; i++ ) {
+			rc = mdb_drop( txi, mi->mi_comps[i]->ci_dbi, 0 );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": (Truncate) mdb_drop(%s) failed: %s (%d)\n",
+					mi->mi_comps[i]->ci_name.bv_val,
+					mdb_strerror(rc), rc );
+				return -1;
+			}
+		}
 		slapMode ^= SLAP_TRUNCATE_MODE;
 	}
 
@@ -955,6 +1805,8 @@ done:
 			rc, 0, 0 );
 		e->e_id = NOID;
 		txi = NULL;
+		if ( tool_rehash )
+			tool_rehash = -1;
 	}
 	mdb_entry_release( &op, e, 0 );
 
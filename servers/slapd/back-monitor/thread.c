@@ -66,6 +66,12 @@ static struct {
 	{ BER_BVC( "cn=Backload" ),	
 		BER_BVC("Number of active plus pending threads"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD,	MT_UNKNOWN },
+	{ BER_BVC( "cn=Steals" ),
+		BER_BVC("Number of pending tasks taken over from another work queue"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_STEALS,	MT_UNKNOWN },
+	{ BER_BVC( "cn=Steal Wakeups" ),
+		BER_BVC("Number of idle threads woken to help another work queue"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_STEAL_WAKEUPS,	MT_UNKNOWN },
 #if 0	/* not meaningful right now */
 	{ BER_BVC( "cn=Active Max" ),
 		BER_BVNULL,
@@ -91,11 +97,20 @@ static struct {
 	{ BER_BVNULL }
 };
 
+/* normalized RDNs of the per-class admission entries */
+static struct berval	mt_opclass[ SLAP_OPCLASS_LAST ];
+
 static int 
 monitor_subsys_thread_update( 
 	Operation		*op,
 	SlapReply		*rs,
 	Entry 			*e );
+
+static void
+monitor_subsys_thread_opclass(
+	monitor_info_t		*mi,
+	Entry			*e,
+	int			cls );
 #endif /* ! NO_THREADS */
 
 /*
@@ -209,6 +224,47 @@ monitor_subsys_thread_init(
 		ep = &mp->mp_next;
 	}
 
+	for ( i = SLAP_OPCLASS_BIND; i < SLAP_OPCLASS_LAST; i++ ) {
+		char		buf[ BACKMONITOR_BUFSIZE ];
+		struct berval	rdn;
+
+		rdn.bv_val = buf;
+		rdn.bv_len = snprintf( buf, sizeof( buf ), "cn=Class %s",
+			limits_opclass2bv( i )->bv_val );
+		e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn, &rdn,
+			mi->mi_oc_monitoredObject, NULL, NULL );
+		if ( e == NULL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_thread_init: "
+				"unable to create entry \"%s,%s\"\n",
+				buf, ms->mss_ndn.bv_val, 0 );
+			return( -1 );
+		}
+
+		dnRdn( &e->e_nname, &mt_opclass[ i ] );
+		monitor_subsys_thread_opclass( mi, e, i );
+
+		mp = monitor_entrypriv_create();
+		if ( mp == NULL ) {
+			return -1;
+		}
+		e->e_private = ( void * )mp;
+		mp->mp_info = ms;
+		mp->mp_flags = ms->mss_flags \
+			| MONITOR_F_SUB | MONITOR_F_PERSISTENT;
+
+		if ( monitor_cache_add( mi, e ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_thread_init: "
+				"unable to add entry \"%s,%s\"\n",
+				buf, ms->mss_dn.bv_val, 0 );
+			return( -1 );
+		}
+
+		*ep = e;
+		ep = &mp->mp_next;
+	}
+
 	monitor_cache_release( mi, e_thread );
 
 #endif /* ! NO_THREADS */
@@ -244,6 +300,12 @@ monitor_subsys_thread_update(
 
 	which = i;
 	if ( BER_BVISNULL( &mt[ which ].nrdn ) ) {
+		for ( i = SLAP_OPCLASS_BIND; i < SLAP_OPCLASS_LAST; i++ ) {
+			if ( dn_match( &mt_opclass[ i ], &rdn ) ) {
+				monitor_subsys_thread_opclass( mi, e, i );
+				break;
+			}
+		}
 		return SLAP_CB_CONTINUE;
 	}
 
@@ -355,4 +417,48 @@ monitor_subsys_thread_update(
 
 	return SLAP_CB_CONTINUE;
 }
+
+static void
+monitor_subsys_thread_set(
+	Entry			*e,
+	AttributeDescription	*ad,
+	struct berval		*bv )
+{
+	Attribute	*a = attr_find( e->e_attrs, ad );
+
+	if ( a == NULL ) {
+		attr_merge_normalize_one( e, ad, bv, NULL );
+
+	} else {
+		ber_bvreplace( &a->a_vals[ 0 ], bv );
+	}
+}
+
+/*
+ * admitted/completed operations and queue state of an admission class
+ */
+static void
+monitor_subsys_thread_opclass(
+	monitor_info_t		*mi,
+	Entry			*e,
+	int			cls )
+{
+	slap_opclass_info	qc;
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	struct berval		bv;
+
+	slap_opclass_get( cls, &qc );
+	bv.bv_val = buf;
+
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", qc.qc_admitted );
+	monitor_subsys_thread_set( e, mi->mi_ad_monitorOpInitiated, &bv );
+
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", qc.qc_completed );
+	monitor_subsys_thread_set( e, mi->mi_ad_monitorOpCompleted, &bv );
+
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"active=%d queued=%d deferred=%lu rejected=%lu",
+		qc.qc_active, qc.qc_queued, qc.qc_deferred, qc.qc_rejected );
+	monitor_subsys_thread_set( e, mi->mi_ad_monitoredInfo, &bv );
+}
 #endif /* ! NO_THREADS */
@@ -2042,6 +2042,19 @@ int backend_operational( Operation *op, SlapReply *rs )
 	return rc;
 }
 
+/* The order an overlay asked the entries of a search to be sent in */
+SortedSearch *
+backend_sorted_search( Operation *op )
+{
+	OpExtra *oex;
+
+	LDAP_SLIST_FOREACH(oex, &op->o_extra, oe_next) {
+		if ( oex->oe_key == (void *)backend_sorted_search )
+			return (SortedSearch *)oex;
+	}
+	return NULL;
+}
+
 /* helper that calls the bi_tool_entry_first_x() variant with default args;
  * use to initialize a backend's bi_tool_entry_first() when appropriate
  */
@@ -119,6 +119,7 @@ static ConfigDriver config_passwd_hash;
 static ConfigDriver config_schema_dn;
 static ConfigDriver config_sizelimit;
 static ConfigDriver config_timelimit;
+static ConfigDriver config_opclass;
 static ConfigDriver config_overlay;
 static ConfigDriver config_subordinate; 
 static ConfigDriver config_suffix; 
@@ -197,6 +198,7 @@ enum {
 	CFG_SYNC_SUBENTRY,
 	CFG_LTHREADS,
 	CFG_IX_HASH64,
+	CFG_IX_HASH,
 	CFG_DISABLED,
 	CFG_THREADQS,
 	CFG_TLS_ECNAME,
@@ -405,6 +407,10 @@ static ConfigTable config_back_cf_table[] = {
 	{ "include", "file", 2, 2, 0, ARG_MAGIC,
 		&config_include, "( OLcfgGlAt:19 NAME 'olcInclude' "
 			"SUP labeledURI )", NULL, NULL },
+	{ "index_hash", "fnv|xxh64", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_IX_HASH,
+		&config_generic, "( OLcfgGlAt:101 NAME 'olcIndexHash' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "index_hash64", "on|off", 2, 2, 0, ARG_ON_OFF|ARG_MAGIC|CFG_IX_HASH64,
 		&config_generic, "( OLcfgGlAt:94 NAME 'olcIndexHash64' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
@@ -495,6 +501,16 @@ static ConfigTable config_back_cf_table[] = {
 			"EQUALITY caseIgnoreMatch "
 			"SUBSTR caseIgnoreSubstringsMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "opclass", "class> <[reserve=<n>] [pending=<n>]", 3, 4, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_MAGIC, &config_opclass,
+#endif
+		"( OLcfgGlAt:100 NAME 'olcOpClass' "
+			"DESC 'Operation admission class settings' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
 	{ "overlay", "overlay", 2, 2, 0, ARG_MAGIC,
 		&config_overlay, "( OLcfgGlAt:34 NAME 'olcOverlay' "
 			"SUP olcDatabase SINGLE-VALUE X-ORDERED 'SIBLINGS' )", NULL, NULL },
@@ -882,10 +898,11 @@ static ConfigOCs cf_ocs[] = {
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
 		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
-		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
+		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash $ "
+		 "olcIndexHash64 $ "
 		 "olcIndexIntLen $ "
 		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
-		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
+		 "olcOpClass $ olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
 		 "olcPluginLogFile $ olcReadOnly $ olcReferral $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcReverseLookup $ "
 		 "olcRootDSE $ "
@@ -985,6 +1002,12 @@ typedef struct ADlist {
 
 static ADlist *sortVals;
 
+static slap_verbmasks index_hashes[] = {
+	{ BER_BVC("fnv"), SLAP_INDEX_HASH_FNV },
+	{ BER_BVC("xxh64"), SLAP_INDEX_HASH_XXH64 },
+	{ BER_BVNULL, 0 }
+};
+
 static int
 config_generic(ConfigArgs *c) {
 	int i;
@@ -1282,6 +1305,11 @@ config_generic(ConfigArgs *c) {
 		case CFG_IX_HASH64:
 			c->value_int = slap_hash64( -1 );
 			break;
+		case CFG_IX_HASH: {
+			struct berval bv;
+			enum_to_verb( index_hashes, slap_hashfunc( -1 ), &bv );
+			c->value_string = ch_strdup( bv.bv_val );
+			} break;
 		case CFG_IX_INTLEN:
 			c->value_int = index_intlen;
 			break;
@@ -1481,6 +1509,17 @@ config_generic(ConfigArgs *c) {
 			slap_hash64( 0 );
 			break;
 
+		case CFG_IX_HASH:
+			/* open databases would be left with keys they can't find */
+			if ( slapMode & SLAP_SERVER_RUNNING ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> cannot be changed while running", c->argv[0] );
+				rc = 1;
+				break;
+			}
+			slap_hashfunc( SLAP_INDEX_HASH_FNV );
+			break;
+
 		case CFG_IX_INTLEN:
 			index_intlen = SLAP_INDEX_INTLEN_DEFAULT;
 			index_intlen_strlen = SLAP_INDEX_INTLEN_STRLEN(
@@ -2011,6 +2050,25 @@ config_generic(ConfigArgs *c) {
 				return 1;
 			break;
 
+		case CFG_IX_HASH:
+			i = verb_to_mask( c->argv[1], index_hashes );
+			ch_free( c->value_string );
+			if ( slapMode & SLAP_SERVER_RUNNING ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> cannot be changed while running", c->argv[0] );
+				Debug(LDAP_DEBUG_ANY, "%s: %s\n",
+					c->log, c->cr_msg, 0 );
+				return(1);
+			}
+			if ( BER_BVISNULL( &index_hashes[i].word ) ||
+				slap_hashfunc( index_hashes[i].mask ))
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unknown or unsupported hash", c->argv[0] );
+				Debug(LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+					c->log, c->cr_msg, c->argv[1] );
+				return(1);
+			}
+			break;
+
 		case CFG_IX_INTLEN:
 			if ( c->value_int < SLAP_INDEX_INTLEN_DEFAULT )
 				c->value_int = SLAP_INDEX_INTLEN_DEFAULT;
@@ -2717,6 +2775,79 @@ ok:
 	return(0);
 }
 
+static int
+config_opclass(ConfigArgs *c) {
+	slap_opclass_info *qc;
+	int i, cls, reserve = 0, pending = 0;
+
+	if (c->op == SLAP_CONFIG_EMIT) {
+		char buf[ 128 ];
+		struct berval bv;
+
+		for ( cls = SLAP_OPCLASS_BIND; cls < SLAP_OPCLASS_LAST; cls++ ) {
+			qc = &slap_opclasses[ cls ];
+			if ( !qc->qc_reserve && !qc->qc_max_pending )
+				continue;
+			bv.bv_val = buf;
+			bv.bv_len = snprintf( buf, sizeof( buf ), "%s",
+				limits_opclass2bv( cls )->bv_val );
+			if ( qc->qc_reserve )
+				bv.bv_len += snprintf( buf + bv.bv_len, sizeof( buf ) - bv.bv_len,
+					" reserve=%d", qc->qc_reserve );
+			if ( qc->qc_max_pending )
+				bv.bv_len += snprintf( buf + bv.bv_len, sizeof( buf ) - bv.bv_len,
+					" pending=%d", qc->qc_max_pending );
+			value_add_one( &c->rvalue_vals, &bv );
+		}
+		return c->rvalue_vals ? 0 : 1;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		for ( cls = SLAP_OPCLASS_BIND; cls < SLAP_OPCLASS_LAST; cls++ ) {
+			if ( c->line && cls != limits_str2opclass( c->argv[1] ) )
+				continue;
+			slap_opclasses[ cls ].qc_reserve = 0;
+			slap_opclasses[ cls ].qc_max_pending = 0;
+		}
+		slap_opclass_configure();
+		return 0;
+	}
+
+	cls = limits_str2opclass( c->argv[1] );
+	if ( cls <= SLAP_OPCLASS_DEFAULT ) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unknown class", c->argv[0] );
+		Debug(LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+			c->log, c->cr_msg, c->argv[1]);
+		return(1);
+	}
+
+	for ( i = 2; i < c->argc; i++ ) {
+		int *val;
+		char *arg;
+
+		if ( !strncasecmp( c->argv[i], "reserve=", STRLENOF( "reserve=" ) ) ) {
+			val = &reserve;
+			arg = c->argv[i] + STRLENOF( "reserve=" );
+		} else if ( !strncasecmp( c->argv[i], "pending=", STRLENOF( "pending=" ) ) ) {
+			val = &pending;
+			arg = c->argv[i] + STRLENOF( "pending=" );
+		} else {
+			val = NULL;
+		}
+		if ( val == NULL || lutil_atoi( val, arg ) != 0 || *val < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unable to parse value", c->argv[0] );
+			Debug(LDAP_DEBUG_ANY, "%s: %s \"%s\"\n",
+				c->log, c->cr_msg, c->argv[i]);
+			return(1);
+		}
+	}
+
+	qc = &slap_opclasses[ cls ];
+	qc->qc_reserve = reserve;
+	qc->qc_max_pending = pending;
+	slap_opclass_configure();
+	return(0);
+}
+
 static int
 config_overlay(ConfigArgs *c) {
 	if (c->op == SLAP_CONFIG_EMIT) {
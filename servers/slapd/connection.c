@@ -56,6 +56,14 @@ static unsigned long conn_nextid = SLAPD_SYNC_SYNCCONN_OFFSET;
 
 static const char conn_lost_str[] = "connection lost";
 
+/* Operation admission classes, see limits_opclass() */
+slap_opclass_info slap_opclasses[SLAP_OPCLASS_LAST];
+int slap_opclass_enabled;
+
+/* protects the class queues and counters */
+static ldap_pvt_thread_mutex_t slap_opclass_mutex;
+static int slap_opclass_executing;	/* admitted and not completed */
+
 const char *
 connection_state2str( int state )
 {
@@ -91,6 +99,10 @@ static void connection_abandon( Connection *conn );
 static void connection_destroy( Connection *c );
 
 static ldap_pvt_thread_start_t connection_operation;
+static int connection_op_admit( Operation *op );
+static void connection_op_release( int cls );
+static void connection_op_unadmit( struct qc_q *back );
+static void connection_op_flush( void );
 
 /*
  * Initialize connection management infrastructure.
@@ -110,6 +122,11 @@ int connections_init(void)
 	/* should check return of every call */
 	ldap_pvt_thread_mutex_init( &connections_mutex );
 	ldap_pvt_thread_mutex_init( &conn_nextid_mutex );
+	ldap_pvt_thread_mutex_init( &slap_opclass_mutex );
+
+	for ( i = 0; i < SLAP_OPCLASS_LAST; i++ ) {
+		LDAP_STAILQ_INIT( &slap_opclasses[i].qc_queue );
+	}
 
 	connections = (Connection *) ch_calloc( dtblsize, sizeof(Connection) );
 
@@ -169,6 +186,7 @@ int connections_destroy(void)
 
 	ldap_pvt_thread_mutex_destroy( &connections_mutex );
 	ldap_pvt_thread_mutex_destroy( &conn_nextid_mutex );
+	ldap_pvt_thread_mutex_destroy( &slap_opclass_mutex );
 	return 0;
 }
 
@@ -179,6 +197,9 @@ int connections_shutdown(void)
 {
 	ber_socket_t i;
 
+	/* parked ops would keep their connections open */
+	connection_op_flush();
+
 	for ( i = 0; i < dtblsize; i++ ) {
 		if( connections[i].c_struct_state != SLAP_C_UNINITIALIZED ) {
 			ldap_pvt_thread_mutex_lock( &connections[i].c_mutex );
@@ -1077,6 +1098,7 @@ connection_operation( void *ctx, void *arg_v )
 	void *memctx = NULL;
 	void *memctx_null = NULL;
 	ber_len_t memsiz;
+	int opclass = op->o_opclass;
 
 	gettimeofday( &op->o_qtime, NULL );
 	op->o_qtime.tv_usec -= op->o_tusec;
@@ -1166,9 +1188,20 @@ connection_operation( void *ctx, void *arg_v )
 	opidx = slap_req2op( tag );
 	assert( opidx != SLAP_OP_LAST );
 	INCR_OP_INITIATED( opidx );
-	rc = (*(opfun[opidx]))( op, &rs );
+	if ( opclass < 0 ) {
+		/* its class queue was full, see connection_op_admit() */
+		send_ldap_error( op, &rs, LDAP_BUSY,
+			"too many pending operations" );
+		rc = LDAP_BUSY;
+	} else {
+		rc = (*(opfun[opidx]))( op, &rs );
+	}
 
 operations_error:
+	if ( opclass > 0 ) {
+		connection_op_release( opclass );
+	}
+
 	if ( rc == SLAPD_DISCONNECT ) {
 		tag = LBER_ERROR;
 
@@ -1765,7 +1798,8 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		if ( cri->op == NULL ) {
 			/* the first incoming request */
 			connection_op_queue( op );
-			cri->op = op;
+			if ( !connection_op_admit( op ) )
+				cri->op = op;
 		} else {
 			if ( !cri->nullop ) {
 				cri->nullop = 1;
@@ -1960,6 +1994,10 @@ static int connection_op_activate( Operation *op )
 
 	connection_op_queue( op );
 
+	/* parked ops are submitted by connection_op_release() */
+	if ( connection_op_admit( op ) )
+		return 0;
+
 	rc = ldap_pvt_thread_pool_submit( &connection_pool,
 		connection_operation, (void *) op );
 
@@ -1967,12 +2005,238 @@ static int connection_op_activate( Operation *op )
 		Debug( LDAP_DEBUG_ANY,
 			"connection_op_activate: submit failed (%d) for conn=%lu\n",
 			rc, op->o_connid, 0 );
+		if ( op->o_opclass > 0 ) {
+			struct qc_q back;
+
+			/* park it, the next release submits it again */
+			LDAP_STAILQ_INIT( &back );
+			LDAP_STAILQ_INSERT_TAIL( &back, op, o_qnext );
+			connection_op_unadmit( &back );
+			rc = 0;
+		}
 		/* should move op to pending list */
 	}
 
 	return rc;
 }
 
+/* Threads that class cls may use now: every operation that is
+ * executing occupies one, and the unused reservations of the
+ * other classes are kept free.  A class may always run one
+ * operation, so a queued operation always has some executing
+ * operation to wake it up.  slap_opclass_mutex must be locked.
+ */
+static int
+connection_op_room( int cls )
+{
+	slap_opclass_info *qc;
+	int i, limit = connection_pool_max;
+
+	for ( i = SLAP_OPCLASS_BIND; i < SLAP_OPCLASS_LAST; i++ ) {
+		qc = &slap_opclasses[i];
+		if ( i != cls && qc->qc_reserve > qc->qc_active )
+			limit -= qc->qc_reserve - qc->qc_active;
+	}
+	if ( limit < 1 )
+		limit = 1;
+
+	return slap_opclass_executing < limit;
+}
+
+/* Admission control: returns 0 if op can be submitted now, 1 if
+ * it was parked in its class queue.  An op rejected because that
+ * queue is full still runs, to return LDAP_BUSY.
+ */
+static int
+connection_op_admit( Operation *op )
+{
+	slap_opclass_info *qc;
+	int cls, rc = 0;
+
+	if ( !slap_opclass_enabled )
+		return 0;
+
+	cls = limits_opclass( op );
+	if ( cls == SLAP_OPCLASS_DEFAULT )
+		return 0;
+
+	qc = &slap_opclasses[cls];
+	ldap_pvt_thread_mutex_lock( &slap_opclass_mutex );
+	if ( LDAP_STAILQ_EMPTY( &qc->qc_queue ) && connection_op_room( cls ) ) {
+		op->o_opclass = cls;
+		qc->qc_active++;
+		qc->qc_admitted++;
+		slap_opclass_executing++;
+
+	} else if ( qc->qc_max_pending && qc->qc_queued >= qc->qc_max_pending ) {
+		op->o_opclass = -cls;
+		qc->qc_rejected++;
+
+	} else {
+		op->o_opclass = cls;
+		LDAP_STAILQ_INSERT_TAIL( &qc->qc_queue, op, o_qnext );
+		qc->qc_queued++;
+		qc->qc_deferred++;
+		rc = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_opclass_mutex );
+
+	if ( op->o_opclass < 0 ) {
+		Debug( LDAP_DEBUG_ANY, "connection_op_admit: conn=%lu op=%lu "
+			"rejected, %s queue full\n",
+			op->o_connid, op->o_opid, limits_opclass2bv( cls )->bv_val );
+	}
+
+	return rc;
+}
+
+/* An op of class cls completed: admit parked ops, highest
+ * priority class first, as far as there is room.
+ */
+static void
+connection_op_release( int cls )
+{
+	struct qc_q ready;
+	slap_opclass_info *qc;
+	Operation *op;
+	int i, rc;
+
+	LDAP_STAILQ_INIT( &ready );
+
+	ldap_pvt_thread_mutex_lock( &slap_opclass_mutex );
+	qc = &slap_opclasses[cls];
+	qc->qc_active--;
+	qc->qc_completed++;
+	slap_opclass_executing--;
+
+	for ( i = SLAP_OPCLASS_BIND; i < SLAP_OPCLASS_LAST; i++ ) {
+		qc = &slap_opclasses[i];
+		while ( ( op = LDAP_STAILQ_FIRST( &qc->qc_queue ) ) != NULL &&
+			connection_op_room( i ) )
+		{
+			LDAP_STAILQ_REMOVE_HEAD( &qc->qc_queue, o_qnext );
+			qc->qc_queued--;
+			qc->qc_active++;
+			qc->qc_admitted++;
+			slap_opclass_executing++;
+			LDAP_STAILQ_INSERT_TAIL( &ready, op, o_qnext );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_opclass_mutex );
+
+	while ( ( op = LDAP_STAILQ_FIRST( &ready ) ) != NULL ) {
+		LDAP_STAILQ_REMOVE_HEAD( &ready, o_qnext );
+		LDAP_STAILQ_NEXT( op, o_qnext ) = NULL;
+
+		rc = ldap_pvt_thread_pool_submit( &connection_pool,
+			connection_operation, (void *) op );
+		if ( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"connection_op_release: submit failed (%d) for conn=%lu\n",
+				rc, op->o_connid, 0 );
+			/* keep it and the rest parked for the next release */
+			LDAP_STAILQ_INSERT_HEAD( &ready, op, o_qnext );
+			connection_op_unadmit( &ready );
+			break;
+		}
+	}
+}
+
+/* Undo the admission of ops that could not be submitted and put
+ * them back at the head of their class queues, in order.
+ */
+static void
+connection_op_unadmit( struct qc_q *back )
+{
+	Operation *op, *last[SLAP_OPCLASS_LAST] = { NULL };
+	slap_opclass_info *qc;
+	int cls;
+
+	ldap_pvt_thread_mutex_lock( &slap_opclass_mutex );
+	while ( ( op = LDAP_STAILQ_FIRST( back ) ) != NULL ) {
+		LDAP_STAILQ_REMOVE_HEAD( back, o_qnext );
+		cls = op->o_opclass;
+		qc = &slap_opclasses[cls];
+		if ( last[cls] ) {
+			LDAP_STAILQ_INSERT_AFTER( &qc->qc_queue, last[cls], op, o_qnext );
+		} else {
+			LDAP_STAILQ_INSERT_HEAD( &qc->qc_queue, op, o_qnext );
+		}
+		last[cls] = op;
+		qc->qc_queued++;
+		qc->qc_active--;
+		qc->qc_admitted--;
+		slap_opclass_executing--;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_opclass_mutex );
+}
+
+/* At shutdown, reject every parked op so that it runs to return
+ * LDAP_BUSY and its connection can close.
+ */
+static void
+connection_op_flush( void )
+{
+	struct qc_q flush;
+	slap_opclass_info *qc;
+	Operation *op;
+	int i, rc;
+
+	LDAP_STAILQ_INIT( &flush );
+
+	ldap_pvt_thread_mutex_lock( &slap_opclass_mutex );
+	for ( i = SLAP_OPCLASS_BIND; i < SLAP_OPCLASS_LAST; i++ ) {
+		qc = &slap_opclasses[i];
+		while ( ( op = LDAP_STAILQ_FIRST( &qc->qc_queue ) ) != NULL ) {
+			LDAP_STAILQ_REMOVE_HEAD( &qc->qc_queue, o_qnext );
+			qc->qc_queued--;
+			qc->qc_rejected++;
+			op->o_opclass = -i;
+			LDAP_STAILQ_INSERT_TAIL( &flush, op, o_qnext );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_opclass_mutex );
+
+	while ( ( op = LDAP_STAILQ_FIRST( &flush ) ) != NULL ) {
+		LDAP_STAILQ_REMOVE_HEAD( &flush, o_qnext );
+		LDAP_STAILQ_NEXT( op, o_qnext ) = NULL;
+
+		rc = ldap_pvt_thread_pool_submit( &connection_pool,
+			connection_operation, (void *) op );
+		if ( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"connection_op_flush: submit failed (%d) for conn=%lu\n",
+				rc, op->o_connid, 0 );
+		}
+	}
+}
+
+/* Recompute whether admission control is in effect after the
+ * class settings changed.
+ */
+void
+slap_opclass_configure( void )
+{
+	int i;
+
+	slap_opclass_enabled = 0;
+	for ( i = SLAP_OPCLASS_BIND; i < SLAP_OPCLASS_LAST; i++ ) {
+		if ( slap_opclasses[i].qc_reserve || slap_opclasses[i].qc_max_pending )
+			slap_opclass_enabled = 1;
+	}
+}
+
+/* Snapshot of the settings and counters of a class */
+void
+slap_opclass_get( int cls, slap_opclass_info *qc )
+{
+	assert( cls > SLAP_OPCLASS_DEFAULT && cls < SLAP_OPCLASS_LAST );
+
+	ldap_pvt_thread_mutex_lock( &slap_opclass_mutex );
+	*qc = slap_opclasses[cls];
+	ldap_pvt_thread_mutex_unlock( &slap_opclass_mutex );
+}
+
 int connection_write(ber_socket_t s)
 {
 	Connection *c;
@@ -49,6 +49,13 @@
 # include <sys/types.h>
 # include <sys/event.h>
 # include <sys/time.h>
+#elif defined(SLAP_X_IOURING) && defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_IO_URING)
+# include <poll.h>
+# include <endian.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+# define SLAP_IOURING 1
 #elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
 # include <sys/epoll.h>
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_SYS_DEVPOLL_H) && defined(HAVE_DEVPOLL)
@@ -56,7 +63,7 @@
 # include <sys/stat.h>
 # include <fcntl.h>
 # include <sys/devpoll.h>
-#endif /* ! kqueue && ! epoll && ! /dev/poll */
+#endif /* ! kqueue && ! io_uring && ! epoll && ! /dev/poll */
 
 #ifdef HAVE_TCPD
 int allow_severity = LOG_INFO;
@@ -69,6 +76,11 @@ int deny_severity = LOG_NOTICE;
 # define LDAPI_MOD_URLEXT		"x-mod"
 #endif /* LDAP_PF_LOCAL */
 
+#ifdef SO_REUSEPORT
+/* open one SO_REUSEPORT socket per listener thread */
+# define SLAPD_REUSEPORT_URLEXT		"x-reuseport"
+#endif /* SO_REUSEPORT */
+
 #ifdef LDAP_PF_INET6
 int slap_inet4or6 = AF_UNSPEC;
 #else /* ! INETv6 */
@@ -100,7 +112,15 @@ static ldap_pvt_thread_t *listener_tid;
 #define SLAPD_LISTEN_BACKLOG 2048
 #endif /* ! SLAPD_LISTEN_BACKLOG */
 
-#define	DAEMON_ID(fd)	(fd & slapd_daemon_mask)
+/* Daemon thread owning each descriptor. Only allocated when a listener
+ * is sharded with SO_REUSEPORT, so that accepted sessions stay on the
+ * thread of the shard that accepted them; otherwise descriptors are
+ * spread by their number.
+ */
+static unsigned char *slapd_fd_tid;
+
+#define	DAEMON_ID_HASH(fd)	(fd & slapd_daemon_mask)
+#define	DAEMON_ID(fd)	(slapd_fd_tid ? slapd_fd_tid[fd] : DAEMON_ID_HASH(fd))
 
 static ber_socket_t wake_sds[SLAPD_MAX_DAEMON_THREADS][2];
 static int emfile;
@@ -157,6 +177,41 @@ typedef struct slap_daemon_st {
 	}               sd_kqc[2];
 	int             sd_changeidx; /* index to current change buffer */
 	int             sd_kq;
+#elif defined(SLAP_IOURING)
+	/* eXperimental */
+	struct slap_uring_sock {
+		Listener	*us_l;
+		unsigned	us_gen;		/* tags the outstanding poll */
+		unsigned short	us_want;	/* poll events requested */
+		unsigned short	us_armed;	/* poll events pending in the ring */
+		char		us_active;
+		char		us_parked;	/* hung up, don't rearm */
+		char		us_accept;	/* pending request is an accept */
+	}			*sd_socks;	/* indexed by fd */
+	struct slap_uring_event {
+		ber_socket_t	ue_fd;		/* or accepted fd / -errno */
+		unsigned	ue_events;
+		Listener	*ue_l;
+		char		ue_accept;
+	}			*sd_revents;
+	ber_socket_t		*sd_rearm;	/* fds whose poll fired */
+	int			sd_nrearm;
+
+	int			sd_ringfd;
+	void			*sd_sq_ring;
+	size_t			sd_sq_ringsz;
+	unsigned		*sd_sq_head;
+	unsigned		*sd_sq_tail;
+	unsigned		sd_sq_mask;
+	unsigned		sd_sq_entries;
+	struct io_uring_sqe	*sd_sqes;
+	size_t			sd_sqesz;
+	void			*sd_cq_ring;
+	size_t			sd_cq_ringsz;
+	unsigned		*sd_cq_head;
+	unsigned		*sd_cq_tail;
+	unsigned		sd_cq_mask;
+	struct io_uring_cqe	*sd_cqes;
 #elif defined(HAVE_EPOLL)
 
 	struct epoll_event	*sd_epolls;
@@ -168,7 +223,7 @@ typedef struct slap_daemon_st {
 	int			*sd_index;
 	Listener		**sd_l;
 	int			sd_dpfd;
-#else /* ! kqueue && ! epoll && ! /dev/poll */
+#else /* ! kqueue && ! io_uring && ! epoll && ! /dev/poll */
 #ifdef HAVE_WINSOCK
 	char	*sd_flags;
 	char	*sd_rflags;
@@ -177,7 +232,7 @@ typedef struct slap_daemon_st {
 	fd_set			sd_readers;
 	fd_set			sd_writers;
 #endif /* ! HAVE_WINSOCK */
-#endif /* ! kqueue && ! epoll && ! /dev/poll */
+#endif /* ! kqueue && ! io_uring && ! epoll && ! /dev/poll */
 } slap_daemon_st;
 
 static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
@@ -189,7 +244,7 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
  *   with file descriptors and events respectively
  *
  * - SLAP_<type>_* for private interface; type by now is one of
- *   EPOLL, DEVPOLL, SELECT, KQUEUE
+ *   EPOLL, DEVPOLL, SELECT, KQUEUE, IOURING
  *
  * private interface should not be used in the code.
  */
@@ -402,6 +457,491 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 
 /*-------------------------------------------------------------------------------*/
 
+#elif defined(SLAP_IOURING)
+/**********************************************
+ * Use io_uring infrastructure - io_uring(7) *
+ **********************************************/
+/*
+ * This is an event backend: sessions are still read and written by
+ * the worker threads through their Sockbuf, the ring only reports
+ * readiness and accepts connections.
+ *
+ * Each active descriptor has at most one oneshot IORING_OP_POLL_ADD
+ * outstanding, tagged with the descriptor and a generation count.
+ * SLAP_SOCK_SET_* only queue submissions; they reach the kernel along
+ * with the next wait in a single io_uring_enter(2), so there is no
+ * per-change syscall as with epoll_ctl(2).  Clearing interest is lazy:
+ * a completion that no longer matches sd_socks is dropped and the
+ * descriptor is not rearmed.  Descriptors whose poll fired are rearmed
+ * at the start of the next wait if they still want events.
+ *
+ * TCP and IPC listeners get a multishot IORING_OP_ACCEPT instead, so
+ * the kernel accepts on its own and each completion carries a new
+ * session that is handed to a pool thread without another accept(2).
+ * Muting a listener cancels its accept, and a session accepted by a
+ * cancelled request is closed when its completion is reaped.  Kernels
+ * without multishot accept fall back to polling the listener.
+ */
+# define SLAP_EVENT_FNAME		"io_uring"
+# define SLAP_EVENTS_ARE_INDEXED	0
+
+# define SLAP_IOURING_NOOP		((__u64) -1)
+# define SLAP_IOURING_ACCEPT		((__u64) 1 << 31)
+# define SLAP_IOURING_UDATA(s,gen)	(((__u64) (gen) << 32) | (unsigned) (s))
+# define SLAP_IOURING_UDATA_FD(u)	((ber_socket_t) ((u) & 0x7fffffffU))
+# define SLAP_IOURING_UDATA_GEN(u)	((unsigned) ((u) >> 32))
+# ifndef IORING_ACCEPT_MULTISHOT	/* headers older than Linux 5.19 */
+#  define IORING_ACCEPT_MULTISHOT	(1U << 0)
+# endif
+# ifndef IORING_CQE_F_MORE
+#  define IORING_CQE_F_MORE		(1U << 1)
+# endif
+# if __BYTE_ORDER == __BIG_ENDIAN
+#  define SLAP_IOURING_POLL32(ev)	(((ev) << 16) | ((ev) >> 16))
+# else
+#  define SLAP_IOURING_POLL32(ev)	(ev)
+# endif
+
+# define SLAP_IOURING_SOCK(t,s)		(slap_daemon[t].sd_socks[(s)])
+# define SLAP_SOCK_IS_ACTIVE(t,s)	(SLAP_IOURING_SOCK(t,s).us_active)
+# define SLAP_SOCK_NOT_ACTIVE(t,s)	(!SLAP_IOURING_SOCK(t,s).us_active)
+# define SLAP_SOCK_IS_READ(t,s)		(SLAP_IOURING_SOCK(t,s).us_want & POLLIN)
+# define SLAP_SOCK_IS_WRITE(t,s)	(SLAP_IOURING_SOCK(t,s).us_want & POLLOUT)
+
+# define SLAP_SOCK_SET_READ(t,s)	slap_uring_sock_set( (t), (s), POLLIN )
+# define SLAP_SOCK_SET_WRITE(t,s)	slap_uring_sock_set( (t), (s), POLLOUT )
+# define SLAP_SOCK_CLR_READ(t,s)	slap_uring_sock_clr( (t), (s), POLLIN )
+# define SLAP_SOCK_CLR_WRITE(t,s)	(SLAP_IOURING_SOCK(t,s).us_want &= ~POLLOUT)
+
+/* Stop reporting a hangup until interest changes */
+# define SLAP_IOURING_SOCK_PARK(t,s)	(SLAP_IOURING_SOCK(t,s).us_parked = 1)
+
+# define SLAP_SOCK_ADD(t,s,l)		slap_uring_sock_add( (t), (s), (l) )
+# define SLAP_SOCK_DEL(t,s)		slap_uring_sock_del( (t), (s) )
+
+# define SLAP_SOCK_INIT(t)		slap_uring_init( (t) )
+# define SLAP_SOCK_DESTROY(t)		slap_uring_destroy( (t) )
+
+# define SLAP_EVENT_MAX(t)		slap_daemon[t].sd_nfds
+# define SLAP_EVENT_DECL		struct slap_uring_event *revents
+# define SLAP_EVENT_INIT(t)		do { \
+	revents = slap_daemon[t].sd_revents; \
+} while (0)
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_uring_wait( (t), (tvp) ); \
+} while (0)
+
+# define SLAP_EVENT_FD(t,i)		(revents[(i)].ue_fd)
+# define SLAP_EVENT_IS_READ(i)		(revents[(i)].ue_events & POLLIN)
+# define SLAP_EVENT_IS_WRITE(i)		(revents[(i)].ue_events & POLLOUT)
+# define SLAP_EVENT_CLR_READ(i)		(revents[(i)].ue_events &= ~POLLIN)
+# define SLAP_EVENT_CLR_WRITE(i)	(revents[(i)].ue_events &= ~POLLOUT)
+# define SLAP_EVENT_IS_LISTENER(t,i)	(revents[(i)].ue_l != NULL)
+# define SLAP_EVENT_LISTENER(t,i)	(revents[(i)].ue_l)
+# define SLAP_IOURING_EVENT_IS_ACCEPT(i)	(revents[(i)].ue_accept)
+
+/* Cleared if the kernel rejects IORING_ACCEPT_MULTISHOT */
+static int slap_uring_multishot = 1;
+
+static int
+slap_uring_enter( int t, unsigned to_submit, unsigned min_complete,
+	unsigned flags, void *arg, size_t argsz )
+{
+	return syscall( __NR_io_uring_enter, slap_daemon[t].sd_ringfd,
+		to_submit, min_complete, flags, arg, argsz );
+}
+
+static unsigned
+slap_uring_pending( int t )
+{
+	return *slap_daemon[t].sd_sq_tail -
+		__atomic_load_n( slap_daemon[t].sd_sq_head, __ATOMIC_ACQUIRE );
+}
+
+/* Must be called with sd_mutex held */
+static struct io_uring_sqe *
+slap_uring_get_sqe( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_sqe *sqe;
+
+	if ( slap_uring_pending( t ) >= sd->sd_sq_entries ) {
+		/* Ring is full, push what we have */
+		slap_uring_enter( t, sd->sd_sq_entries, 0, 0, NULL, 0 );
+		if ( slap_uring_pending( t ) >= sd->sd_sq_entries ) {
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: io_uring submission queue full, errno=%d, "
+				"shutting down\n", errno, 0, 0 );
+			slapd_shutdown = 2;
+			return NULL;
+		}
+	}
+	sqe = &sd->sd_sqes[*sd->sd_sq_tail & sd->sd_sq_mask];
+	memset( sqe, 0, sizeof(*sqe) );
+	return sqe;
+}
+
+static void
+slap_uring_put_sqe( int t )
+{
+	__atomic_store_n( slap_daemon[t].sd_sq_tail,
+		*slap_daemon[t].sd_sq_tail + 1, __ATOMIC_RELEASE );
+}
+
+static __u64
+slap_uring_udata( int t, ber_socket_t s )
+{
+	struct slap_uring_sock *us = &SLAP_IOURING_SOCK(t,s);
+
+	return SLAP_IOURING_UDATA( s, us->us_gen ) |
+		( us->us_accept ? SLAP_IOURING_ACCEPT : 0 );
+}
+
+/* Cancel the pending poll or accept */
+static void
+slap_uring_cancel( int t, ber_socket_t s )
+{
+	struct io_uring_sqe *sqe = slap_uring_get_sqe( t );
+
+	if ( sqe == NULL ) return;
+	sqe->opcode = SLAP_IOURING_SOCK(t,s).us_accept ?
+		IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = slap_uring_udata( t, s );
+	sqe->user_data = SLAP_IOURING_NOOP;
+	slap_uring_put_sqe( t );
+}
+
+/* Make sure a poll covering us_want is pending. sd_mutex must be held. */
+static void
+slap_uring_sock_sync( int t, ber_socket_t s )
+{
+	struct slap_uring_sock *us = &SLAP_IOURING_SOCK(t,s);
+	struct io_uring_sqe *sqe;
+
+	if ( !us->us_active || us->us_parked ||
+		!( us->us_want & ~us->us_armed ))
+		return;
+
+	if ( us->us_armed ) {
+		/* Interest grew while a poll was pending, replace it */
+		slap_uring_cancel( t, s );
+		us->us_gen++;
+		us->us_armed = 0;
+	}
+
+	sqe = slap_uring_get_sqe( t );
+	if ( sqe == NULL ) return;
+	sqe->fd = s;
+	us->us_accept = us->us_l != NULL && slap_uring_multishot;
+#ifdef LDAP_CONNECTIONLESS
+	if ( us->us_l != NULL && us->us_l->sl_is_udp )
+		us->us_accept = 0;
+#endif /* LDAP_CONNECTIONLESS */
+	if ( us->us_accept ) {
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	} else {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = SLAP_IOURING_POLL32( (__u32) us->us_want );
+	}
+	sqe->user_data = slap_uring_udata( t, s );
+	slap_uring_put_sqe( t );
+	us->us_armed = us->us_want;
+}
+
+static void
+slap_uring_sock_set( int t, ber_socket_t s, unsigned short mode )
+{
+	struct slap_uring_sock *us = &SLAP_IOURING_SOCK(t,s);
+
+	if ( ( us->us_want & mode ) != mode ) {
+		us->us_want |= mode;
+		us->us_parked = 0;
+	}
+	slap_uring_sock_sync( t, s );
+}
+
+static void
+slap_uring_sock_clr( int t, ber_socket_t s, unsigned short mode )
+{
+	struct slap_uring_sock *us = &SLAP_IOURING_SOCK(t,s);
+
+	us->us_want &= ~mode;
+	/* An accept would go on accepting, don't leave it pending */
+	if ( us->us_accept && ( us->us_armed & mode )) {
+		slap_uring_cancel( t, s );
+		us->us_gen++;
+		us->us_armed = 0;
+	}
+}
+
+static void
+slap_uring_sock_add( int t, ber_socket_t s, Listener *l )
+{
+	struct slap_uring_sock *us = &SLAP_IOURING_SOCK(t,s);
+
+	us->us_l = l;
+	us->us_want = POLLIN;
+	us->us_armed = 0;
+	us->us_parked = 0;
+	us->us_active = 1;
+	slap_daemon[t].sd_nfds++;
+	slap_uring_sock_sync( t, s );
+}
+
+static void
+slap_uring_sock_del( int t, ber_socket_t s )
+{
+	struct slap_uring_sock *us = &SLAP_IOURING_SOCK(t,s);
+
+	if ( !us->us_active ) return;
+	if ( us->us_armed ) {
+		slap_uring_cancel( t, s );
+		/* The pending request holds a reference on the socket,
+		 * don't wait for the next event loop pass to drop it.
+		 */
+		slap_uring_enter( t, slap_uring_pending( t ), 0, 0, NULL, 0 );
+	}
+	us->us_gen++;
+	us->us_l = NULL;
+	us->us_want = 0;
+	us->us_armed = 0;
+	us->us_parked = 0;
+	us->us_accept = 0;
+	us->us_active = 0;
+	slap_daemon[t].sd_nfds--;
+}
+
+/* Collect completions into sd_revents, return the number of events */
+static int
+slap_uring_reap( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	unsigned head, tail;
+	int n = 0;
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	head = *sd->sd_cq_head;
+	tail = __atomic_load_n( sd->sd_cq_tail, __ATOMIC_ACQUIRE );
+	for ( ; head != tail && sd->sd_nrearm < dtblsize && n < dtblsize;
+		head++ )
+	{
+		struct io_uring_cqe *cqe = &sd->sd_cqes[head & sd->sd_cq_mask];
+		struct slap_uring_sock *us;
+		ber_socket_t s;
+		unsigned ev;
+
+		if ( cqe->user_data == SLAP_IOURING_NOOP ) continue;
+
+		s = SLAP_IOURING_UDATA_FD( cqe->user_data );
+		us = &sd->sd_socks[s];
+		if ( !us->us_active ||
+			us->us_gen != SLAP_IOURING_UDATA_GEN( cqe->user_data ))
+		{
+			/* stale, replaced or removed */
+			if (( cqe->user_data & SLAP_IOURING_ACCEPT ) && cqe->res >= 0 )
+				tcp_close( cqe->res );
+			continue;
+		}
+
+		if ( cqe->user_data & SLAP_IOURING_ACCEPT ) {
+			if ( !( cqe->flags & IORING_CQE_F_MORE )) {
+				/* The accept has ended, submit another */
+				us->us_armed = 0;
+				sd->sd_rearm[sd->sd_nrearm++] = s;
+			}
+			if ( cqe->res == -EINVAL && slap_uring_multishot ) {
+				Debug( LDAP_DEBUG_ANY,
+					"daemon: io_uring has no multishot accept, "
+					"polling listeners\n", 0, 0, 0 );
+				slap_uring_multishot = 0;
+				continue;
+			}
+			sd->sd_revents[n].ue_fd = cqe->res;
+			sd->sd_revents[n].ue_events = 0;
+			sd->sd_revents[n].ue_l = us->us_l;
+			sd->sd_revents[n].ue_accept = 1;
+			n++;
+			continue;
+		}
+
+		us->us_armed = 0;
+		sd->sd_rearm[sd->sd_nrearm++] = s;
+		if ( cqe->res < 0 ) {
+			Debug( LDAP_DEBUG_CONNS,
+				"daemon: io_uring poll on %d failed, res=%d\n",
+				s, cqe->res, 0 );
+			continue;
+		}
+
+		ev = cqe->res & ( us->us_want | POLLHUP | POLLERR );
+		if ( !ev ) continue;
+
+		sd->sd_revents[n].ue_fd = s;
+		sd->sd_revents[n].ue_events = ev;
+		sd->sd_revents[n].ue_l = us->us_l;
+		sd->sd_revents[n].ue_accept = 0;
+		n++;
+	}
+	__atomic_store_n( sd->sd_cq_head, head, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	return n;
+}
+
+static int
+slap_uring_wait( int t, struct timeval *tvp )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned pending;
+	int i, rc;
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	for ( i = 0; i < sd->sd_nrearm; i++ ) {
+		slap_uring_sock_sync( t, sd->sd_rearm[i] );
+	}
+	sd->sd_nrearm = 0;
+	pending = slap_uring_pending( t );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	memset( &arg, 0, sizeof(arg) );
+	if ( tvp ) {
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64) (uintptr_t) &ts;
+	}
+
+	/* Submit all queued changes and wait in one syscall */
+	rc = slap_uring_enter( t, pending, 1,
+		IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		&arg, sizeof(arg) );
+	if ( rc < 0 && errno != ETIME && errno != EBUSY ) {
+		return -1;
+	}
+
+	return slap_uring_reap( t );
+}
+
+static void
+slap_uring_init( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_params p;
+	unsigned entries = 64, *array, i;
+	char *sq, *cq;
+
+	sd->sd_socks = ch_calloc( dtblsize, sizeof(struct slap_uring_sock) );
+	sd->sd_revents = ch_malloc( dtblsize * sizeof(struct slap_uring_event) );
+	sd->sd_rearm = ch_malloc( dtblsize * sizeof(ber_socket_t) );
+	sd->sd_nrearm = 0;
+	sd->sd_nfds = 0;
+
+	while ( entries < dtblsize / slapd_daemon_threads && entries < 4096 )
+		entries <<= 1;
+
+	memset( &p, 0, sizeof(p) );
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = 2 * dtblsize;
+	sd->sd_ringfd = syscall( __NR_io_uring_setup, entries, &p );
+	if ( sd->sd_ringfd < 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: io_uring_setup(%u) failed, errno=%d, shutting down\n",
+			entries, errno, 0 );
+		slapd_shutdown = 2;
+		return;
+	}
+	if ( !( p.features & IORING_FEAT_EXT_ARG ) ||
+		!( p.features & IORING_FEAT_NODROP ))
+	{
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: io_uring lacks required features (0x%x), "
+			"shutting down\n", p.features, 0, 0 );
+		slapd_shutdown = 2;
+		return;
+	}
+
+	sd->sd_sq_ringsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	sd->sd_cq_ringsz = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( sd->sd_cq_ringsz > sd->sd_sq_ringsz )
+			sd->sd_sq_ringsz = sd->sd_cq_ringsz;
+		sd->sd_cq_ringsz = 0;
+	}
+	sq = mmap( NULL, sd->sd_sq_ringsz, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, sd->sd_ringfd, IORING_OFF_SQ_RING );
+	if ( sq == MAP_FAILED ) goto fail;
+	sd->sd_sq_ring = sq;
+	if ( sd->sd_cq_ringsz ) {
+		cq = mmap( NULL, sd->sd_cq_ringsz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, sd->sd_ringfd, IORING_OFF_CQ_RING );
+		if ( cq == MAP_FAILED ) goto fail;
+		sd->sd_cq_ring = cq;
+	} else {
+		cq = sq;
+	}
+	sd->sd_sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+	sd->sd_sqes = mmap( NULL, sd->sd_sqesz, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, sd->sd_ringfd, IORING_OFF_SQES );
+	if ( sd->sd_sqes == MAP_FAILED ) {
+		sd->sd_sqes = NULL;
+		goto fail;
+	}
+
+	sd->sd_sq_head = (unsigned *)( sq + p.sq_off.head );
+	sd->sd_sq_tail = (unsigned *)( sq + p.sq_off.tail );
+	sd->sd_sq_mask = *(unsigned *)( sq + p.sq_off.ring_mask );
+	sd->sd_sq_entries = p.sq_entries;
+	/* SQEs are always consumed in order, map them 1:1 once */
+	array = (unsigned *)( sq + p.sq_off.array );
+	for ( i = 0; i < p.sq_entries; i++ )
+		array[i] = i;
+
+	sd->sd_cq_head = (unsigned *)( cq + p.cq_off.head );
+	sd->sd_cq_tail = (unsigned *)( cq + p.cq_off.tail );
+	sd->sd_cq_mask = *(unsigned *)( cq + p.cq_off.ring_mask );
+	sd->sd_cqes = (struct io_uring_cqe *)( cq + p.cq_off.cqes );
+	return;
+
+fail:
+	Debug( LDAP_DEBUG_ANY,
+		"daemon: io_uring mmap failed, errno=%d, shutting down\n",
+		errno, 0, 0 );
+	slapd_shutdown = 2;
+}
+
+static void
+slap_uring_destroy( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+
+	if ( sd->sd_sqes != NULL ) {
+		munmap( sd->sd_sqes, sd->sd_sqesz );
+		sd->sd_sqes = NULL;
+	}
+	if ( sd->sd_cq_ring != NULL ) {
+		munmap( sd->sd_cq_ring, sd->sd_cq_ringsz );
+		sd->sd_cq_ring = NULL;
+	}
+	if ( sd->sd_sq_ring != NULL ) {
+		munmap( sd->sd_sq_ring, sd->sd_sq_ringsz );
+		sd->sd_sq_ring = NULL;
+	}
+	if ( sd->sd_socks != NULL ) {
+		close( sd->sd_ringfd );
+		ch_free( sd->sd_socks );
+		ch_free( sd->sd_revents );
+		ch_free( sd->sd_rearm );
+		sd->sd_socks = NULL;
+		sd->sd_revents = NULL;
+		sd->sd_rearm = NULL;
+	}
+	sd->sd_nfds = 0;
+}
+
 #elif defined(HAVE_EPOLL)
 /***************************************
  * Use epoll infrastructure - epoll(4) *
@@ -1489,6 +2029,80 @@ errexit:
 	return -1;
 }
 
+#ifdef SLAPD_REUSEPORT_URLEXT
+/* Look for the x-reuseport extension and remove it, so that the
+ * remaining extensions can be checked as usual.
+ */
+static int
+get_url_reuseport(
+	char	**exts )
+{
+	int	i, found = 0;
+
+	for ( i = 0; exts[ i ]; ) {
+		char	*type = exts[ i ];
+		int	j;
+
+		if ( type[ 0 ] == '!' ) type++;
+
+		if ( strcasecmp( type, SLAPD_REUSEPORT_URLEXT ) != 0 ) {
+			i++;
+			continue;
+		}
+
+		found = 1;
+		ldap_memfree( exts[ i ] );
+		for ( j = i; exts[ j ]; j++ ) {
+			exts[ j ] = exts[ j + 1 ];
+		}
+	}
+
+	return found;
+}
+
+/* Open and bind another socket in the SO_REUSEPORT group of sa */
+static ber_socket_t
+slap_open_reuseport_spare(
+	struct sockaddr *sa,
+	int addrlen )
+{
+	ber_socket_t s, sd;
+	int tmp = 1;
+
+	s = socket( sa->sa_family, SOCK_STREAM, 0 );
+	if ( s == AC_SOCKET_INVALID ) {
+		return AC_SOCKET_INVALID;
+	}
+	sd = SLAP_SOCKNEW( s );
+	if ( sd >= dtblsize ) {
+		tcp_close( s );
+		return AC_SOCKET_INVALID;
+	}
+
+	(void) setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
+		(char *) &tmp, sizeof(tmp) );
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+	if ( sa->sa_family == AF_INET6 ) {
+		(void) setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY,
+			(char *) &tmp, sizeof(tmp) );
+	}
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+	if ( setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+			(char *) &tmp, sizeof(tmp) ) == AC_SOCKET_ERROR ||
+		bind( s, sa, addrlen ) )
+	{
+		int err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: SO_REUSEPORT bind(%ld) failed errno=%d (%s)\n",
+			(long) sd, err, sock_errstr( err ) );
+		tcp_close( s );
+		return AC_SOCKET_INVALID;
+	}
+
+	return sd;
+}
+#endif /* SLAPD_REUSEPORT_URLEXT */
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1504,6 +2118,7 @@ slap_open_listener(
 	struct sockaddr **sal = NULL, **psal;
 	int socktype = SOCK_STREAM;	/* default to COTS */
 	ber_socket_t s;
+	int reuseport = 0;
 
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
 	/*
@@ -1524,6 +2139,14 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_shard = -1;
+	l.sl_spares = NULL;
+
+#ifdef SLAPD_REUSEPORT_URLEXT
+	if ( lud->lud_exts ) {
+		reuseport = get_url_reuseport( lud->lud_exts );
+	}
+#endif /* SLAPD_REUSEPORT_URLEXT */
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1577,10 +2200,19 @@ slap_open_listener(
 
 #ifdef LDAP_CONNECTIONLESS
 	l.sl_is_udp = ( tmp == LDAP_PROTO_UDP );
+	if ( l.sl_is_udp ) reuseport = 0;
 #endif /* LDAP_CONNECTIONLESS */
 
+#ifdef SLAPD_REUSEPORT_URLEXT
+	if ( reuseport && tmp == LDAP_PROTO_IPC ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAPD_REUSEPORT_URLEXT
+			" ignored for %s\n", url, 0, 0 );
+		reuseport = 0;
+	}
+#endif /* SLAPD_REUSEPORT_URLEXT */
+
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
-	if ( lud->lud_exts ) {
+	if ( lud->lud_exts && lud->lud_exts[ 0 ] ) {
 		err = get_url_perms( lud->lud_exts, &l.sl_perms, &crit );
 	} else {
 		l.sl_perms = S_IRWXU | S_IRWXO;
@@ -1667,6 +2299,19 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+#ifdef SLAPD_REUSEPORT_URLEXT
+			if ( reuseport ) {
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err) );
+				}
+			}
+#endif /* SLAPD_REUSEPORT_URLEXT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1788,6 +2433,29 @@ slap_open_listener(
 			break;
 		}
 
+#ifdef SLAPD_REUSEPORT_URLEXT
+		/* The number of listener threads is not known until the
+		 * config has been read, and by then we may no longer be
+		 * allowed to bind this address. Bind a sibling for every
+		 * possible thread now; slapd_daemon() keeps the ones it
+		 * needs and closes the rest before they ever listen.
+		 */
+		l.sl_spares = NULL;
+		if ( reuseport ) {
+			int i;
+
+			l.sl_shard = 0;
+			l.sl_spares = ch_malloc( SLAPD_MAX_DAEMON_THREADS *
+				sizeof( ber_socket_t ) );
+			for ( i = 0; i < SLAPD_MAX_DAEMON_THREADS - 1; i++ ) {
+				l.sl_spares[i] = slap_open_reuseport_spare(
+					*sal, addrlen );
+				if ( l.sl_spares[i] == AC_SOCKET_INVALID ) break;
+			}
+			l.sl_spares[i] = AC_SOCKET_INVALID;
+		}
+#endif /* SLAPD_REUSEPORT_URLEXT */
+
 		AC_MEMCPY(&l.sl_sa, *sal, addrlen);
 		ber_str2bv( url, 0, 1, &l.sl_url);
 		li = ch_malloc( sizeof( Listener ) );
@@ -1938,6 +2606,10 @@ slapd_daemon_destroy( void )
 		ldap_pvt_thread_mutex_destroy( &sd_tcpd_mutex );
 #endif /* TCP Wrappers */
 	}
+	if ( slapd_fd_tid ) {
+		ch_free( slapd_fd_tid );
+		slapd_fd_tid = NULL;
+	}
 	sockdestroy();
 
 #ifdef HAVE_SLP
@@ -1993,6 +2665,10 @@ destroy_listeners( void )
 			ber_memfree( lr->sl_url.bv_val );
 		}
 
+		if ( lr->sl_spares ) {
+			ch_free( lr->sl_spares );
+		}
+
 		if ( lr->sl_name.bv_val ) {
 			ber_memfree( lr->sl_name.bv_val );
 		}
@@ -2004,13 +2680,45 @@ destroy_listeners( void )
 	slap_listeners = NULL;
 }
 
+/* Mute the listener if we ran out of descriptors */
+static void
+slap_listener_failed(
+	Listener *sl,
+	int err )
+{
+	if(
+#ifdef EMFILE
+	    err == EMFILE ||
+#endif /* EMFILE */
+#ifdef ENFILE
+	    err == ENFILE ||
+#endif /* ENFILE */
+	    0 )
+	{
+		ldap_pvt_thread_mutex_lock( &slap_daemon[0].sd_mutex );
+		emfile++;
+		/* Stop listening until an existing session closes */
+		sl->sl_mute = 1;
+		ldap_pvt_thread_mutex_unlock( &slap_daemon[0].sd_mutex );
+	}
+
+	Debug( LDAP_DEBUG_ANY,
+		"daemon: accept(%ld) failed errno=%d (%s)\n",
+		(long) sl->sl_sd, err, sock_errstr(err) );
+}
+
+/*
+ * Set up a session on a new stream. If s is AC_SOCKET_INVALID,
+ * accept it from the listener first.
+ */
 static int
 slap_listener(
-	Listener *sl )
+	Listener *sl,
+	ber_socket_t s )
 {
 	Sockaddr		from;
 
-	ber_socket_t s, sfd;
+	ber_socket_t sfd;
 	ber_socklen_t len = sizeof(from);
 	Connection *c;
 	slap_ssf_t ssf = 0;
@@ -2053,37 +2761,30 @@ slap_listener(
 	from.sa_un_addr.sun_path[0] = '\0';
 #  endif /* LDAP_PF_LOCAL */
 
-	s = accept( SLAP_FD2SOCK( sl->sl_sd ), (struct sockaddr *) &from, &len );
-
-	/* Resume the listener FD to allow concurrent-processing of
-	 * additional incoming connections.
-	 */
-	sl->sl_busy = 0;
-	WAKE_LISTENER(DAEMON_ID(sl->sl_sd),1);
-
 	if ( s == AC_SOCKET_INVALID ) {
-		int err = sock_errno();
+		s = accept( SLAP_FD2SOCK( sl->sl_sd ),
+			(struct sockaddr *) &from, &len );
 
-		if(
-#ifdef EMFILE
-		    err == EMFILE ||
-#endif /* EMFILE */
-#ifdef ENFILE
-		    err == ENFILE ||
-#endif /* ENFILE */
-		    0 )
-		{
-			ldap_pvt_thread_mutex_lock( &slap_daemon[0].sd_mutex );
-			emfile++;
-			/* Stop listening until an existing session closes */
-			sl->sl_mute = 1;
-			ldap_pvt_thread_mutex_unlock( &slap_daemon[0].sd_mutex );
+		/* Resume the listener FD to allow concurrent-processing of
+		 * additional incoming connections.
+		 */
+		sl->sl_busy = 0;
+		WAKE_LISTENER(DAEMON_ID(sl->sl_sd),1);
+
+		if ( s == AC_SOCKET_INVALID ) {
+			slap_listener_failed( sl, sock_errno() );
+			ldap_pvt_thread_yield();
+			return 0;
 		}
 
-		Debug( LDAP_DEBUG_ANY,
-			"daemon: accept(%ld) failed errno=%d (%s)\n",
-			(long) sl->sl_sd, err, sock_errstr(err) );
-		ldap_pvt_thread_yield();
+	} else if ( getpeername( s, (struct sockaddr *) &from, &len ) != 0 ) {
+		int err = sock_errno();
+
+		/* The event loop accepted it, the peer may be gone already */
+		Debug( LDAP_DEBUG_CONNS,
+			"daemon: getpeername(%ld) failed errno=%d (%s)\n",
+			(long) s, err, sock_errstr(err) );
+		tcp_close( s );
 		return 0;
 	}
 	sfd = SLAP_SOCKNEW( s );
@@ -2098,6 +2799,12 @@ slap_listener(
 		ldap_pvt_thread_yield();
 		return 0;
 	}
+
+	if ( slapd_fd_tid ) {
+		/* A sharded listener keeps what it accepts on its own thread */
+		slapd_fd_tid[sfd] = sl->sl_shard >= 0 ?
+			DAEMON_ID(sl->sl_sd) : DAEMON_ID_HASH(sfd);
+	}
 	tid = DAEMON_ID(sfd);
 
 #ifdef LDAP_DEBUG
@@ -2299,7 +3006,7 @@ slap_listener_thread(
 	int		rc;
 	Listener	*sl = (Listener *)ptr;
 
-	rc = slap_listener( sl );
+	rc = slap_listener( sl, AC_SOCKET_INVALID );
 
 	if( rc != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -2310,6 +3017,56 @@ slap_listener_thread(
 	return (void*)NULL;
 }
 
+#ifdef SLAP_IOURING
+typedef struct slap_accepted {
+	Listener	*sa_l;
+	ber_socket_t	sa_sd;
+} slap_accepted;
+
+static void*
+slap_accepted_thread(
+	void* ctx,
+	void* ptr )
+{
+	slap_accepted *sa = ptr;
+
+	slap_listener( sa->sa_l, sa->sa_sd );
+	ch_free( sa );
+
+	return (void*)NULL;
+}
+
+/* The ring accepted a stream on sl, or failed with -res */
+static void
+slap_listener_accepted(
+	Listener* sl,
+	int res )
+{
+	slap_accepted *sa;
+	int rc;
+
+	if ( res < 0 ) {
+		slap_listener_failed( sl, -res );
+		return;
+	}
+
+	sa = ch_malloc( sizeof( slap_accepted ));
+	sa->sa_l = sl;
+	sa->sa_sd = res;
+
+	rc = ldap_pvt_thread_pool_submit( &connection_pool,
+		slap_accepted_thread, (void *) sa );
+
+	if( rc != 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"slap_listener_accepted(%d): submit failed (%d)\n",
+			sl->sl_sd, rc, 0 );
+		tcp_close( res );
+		ch_free( sa );
+	}
+}
+#endif /* SLAP_IOURING */
+
 static int
 slap_listener_activate(
 	Listener* sl )
@@ -2958,6 +3715,13 @@ loop:
 			int rc = 1, fd, w = 0, r = 0;
 
 			if ( SLAP_EVENT_IS_LISTENER( tid, i ) ) {
+#ifdef SLAP_IOURING
+				if ( SLAP_IOURING_EVENT_IS_ACCEPT( i ) ) {
+					slap_listener_accepted( SLAP_EVENT_LISTENER( tid, i ),
+						SLAP_EVENT_FD( tid, i ) );
+					continue;
+				}
+#endif /* SLAP_IOURING */
 				rc = slap_listener_activate( SLAP_EVENT_LISTENER( tid, i ) );
 			}
 
@@ -3014,7 +3778,15 @@ loop:
 					SLAP_EVENT_CLR_READ( i );
 					connection_read_activate( fd );
 				} else if ( !w ) {
-#ifdef HAVE_EPOLL
+#ifdef SLAP_IOURING
+					/* Don't keep reporting the hangup
+					 */
+					ldap_pvt_thread_mutex_lock( &slap_daemon[tid].sd_mutex );
+					if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
+						SLAP_IOURING_SOCK_PARK( tid, fd );
+					}
+					ldap_pvt_thread_mutex_unlock( &slap_daemon[tid].sd_mutex );
+#elif defined(HAVE_EPOLL)
 					/* Don't keep reporting the hangup
 					 */
 					if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
@@ -3110,6 +3882,74 @@ connectionless_init( void )
 }
 #endif /* LDAP_CONNECTIONLESS */
 
+/*
+ * Turn the SO_REUSEPORT siblings bound at init time into one listener
+ * per listener thread, each polled and accepted on by its own thread,
+ * and close the ones that are not needed.
+ */
+static void
+slap_shard_listeners( void )
+{
+	int i, l, n, nl;
+
+	for ( nl = 0, n = 0; slap_listeners[nl] != NULL; nl++ ) {
+		ber_socket_t *sp = slap_listeners[nl]->sl_spares;
+
+		if ( sp == NULL ) continue;
+		for ( i = 0; sp[i] != AC_SOCKET_INVALID; i++ ) {
+			if ( i < slapd_daemon_threads - 1 ) n++;
+		}
+	}
+
+	if ( n ) {
+		slap_listeners = ch_realloc( slap_listeners,
+			( nl + n + 1 ) * sizeof( Listener * ) );
+		slapd_fd_tid = ch_malloc( dtblsize );
+		for ( i = 0; i < dtblsize; i++ ) {
+			slapd_fd_tid[i] = DAEMON_ID_HASH(i);
+		}
+	}
+
+	for ( l = 0, n = nl; l < nl; l++ ) {
+		Listener *lr = slap_listeners[l];
+		ber_socket_t *sp = lr->sl_spares;
+
+		if ( sp == NULL ) continue;
+
+		if ( slapd_fd_tid ) slapd_fd_tid[lr->sl_sd] = 0;
+		for ( i = 0; sp[i] != AC_SOCKET_INVALID; i++ ) {
+			Listener *li;
+
+			if ( i >= slapd_daemon_threads - 1 ) {
+				slapd_close( sp[i] );
+				continue;
+			}
+
+			li = ch_malloc( sizeof( Listener ) );
+			*li = *lr;
+			li->sl_sd = sp[i];
+			li->sl_shard = i + 1;
+			li->sl_spares = NULL;
+			ber_dupbv( &li->sl_url, &lr->sl_url );
+			ber_dupbv( &li->sl_name, &lr->sl_name );
+			slapd_fd_tid[li->sl_sd] = li->sl_shard;
+			slap_listeners[n++] = li;
+
+			Debug( LDAP_DEBUG_TRACE,
+				"daemon: listener %s shard %d on %ld\n",
+				li->sl_url.bv_val, li->sl_shard, (long) li->sl_sd );
+		}
+		if ( i < slapd_daemon_threads - 1 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: only %d SO_REUSEPORT shards for %s\n",
+				i + 1, lr->sl_url.bv_val, 0 );
+		}
+		ch_free( sp );
+		lr->sl_spares = NULL;
+	}
+	slap_listeners[n] = NULL;
+}
+
 int
 slapd_daemon( void )
 {
@@ -3122,6 +3962,8 @@ slapd_daemon( void )
 	if ( slapd_daemon_threads > SLAPD_MAX_DAEMON_THREADS )
 		slapd_daemon_threads = SLAPD_MAX_DAEMON_THREADS;
 
+	slap_shard_listeners();
+
 	listener_tid = ch_malloc(slapd_daemon_threads * sizeof(ldap_pvt_thread_t));
 
 	/* daemon_init only inits element 0 */
@@ -374,13 +374,12 @@ fail:
 #define GRABSIZE	BUFSIZ
 
 #define MAKE_SPACE( n )	{ \
-		while ( ecur + (n) > ebuf + emaxsize ) { \
+		while ( *cur + (n) > *buf + *max ) { \
 			ptrdiff_t	offset; \
-			offset = (int) (ecur - ebuf); \
-			ebuf = ch_realloc( ebuf, \
-				emaxsize + GRABSIZE ); \
-			emaxsize += GRABSIZE; \
-			ecur = ebuf + offset; \
+			offset = (int) (*cur - *buf); \
+			*max += *max > GRABSIZE ? *max : GRABSIZE; \
+			*buf = ch_realloc( *buf, *max ); \
+			*cur = *buf + offset; \
 		} \
 	}
 
@@ -393,10 +392,12 @@ entry2str(
 	return entry2str_wrap( e, len, LDIF_LINE_WIDTH );
 }
 
-char *
-entry2str_wrap(
+static void
+entry_sput(
 	Entry		*e,
-	int			*len,
+	char		**buf,
+	char		**cur,
+	int			*max,
 	ber_len_t	wrap )
 {
 	Attribute	*a;
@@ -404,22 +405,18 @@ entry2str_wrap(
 	int		i;
 	ber_len_t tmplen;
 
-	assert( e != NULL );
-
 	/*
 	 * In string format, an entry looks like this:
 	 *	dn: <dn>\n
 	 *	[<attr>: <value>\n]*
 	 */
 
-	ecur = ebuf;
-
 	/* put the dn */
 	if ( e->e_dn != NULL ) {
 		/* put "dn: <dn>" */
 		tmplen = e->e_name.bv_len;
 		MAKE_SPACE( LDIF_SIZE_NEEDED( 2, tmplen ));
-		ldif_sput_wrap( &ecur, LDIF_PUT_VALUE, "dn", e->e_dn, tmplen, wrap );
+		ldif_sput_wrap( cur, LDIF_PUT_VALUE, "dn", e->e_dn, tmplen, wrap );
 	}
 
 	/* put the attributes */
@@ -429,18 +426,52 @@ entry2str_wrap(
 			bv = &a->a_vals[i];
 			tmplen = a->a_desc->ad_cname.bv_len;
 			MAKE_SPACE( LDIF_SIZE_NEEDED( tmplen, bv->bv_len ));
-			ldif_sput_wrap( &ecur, LDIF_PUT_VALUE,
+			ldif_sput_wrap( cur, LDIF_PUT_VALUE,
 				a->a_desc->ad_cname.bv_val,
 				bv->bv_val, bv->bv_len, wrap );
 		}
 	}
 	MAKE_SPACE( 1 );
-	*ecur = '\0';
+	**cur = '\0';
+}
+
+char *
+entry2str_wrap(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap )
+{
+	assert( e != NULL );
+
+	ecur = ebuf;
+	entry_sput( e, &ebuf, &ecur, &emaxsize, wrap );
 	*len = ecur - ebuf;
 
 	return( ebuf );
 }
 
+/* Reentrant entry2str_wrap(): appends the entry at offset *len of the
+ * caller's buffer *buf of *max bytes, growing it as needed.
+ */
+char *
+entry2str_wrap_r(
+	Entry		*e,
+	char		**buf,
+	int			*len,
+	int			*max,
+	ber_len_t	wrap )
+{
+	char		*cur;
+
+	assert( e != NULL );
+
+	cur = *buf + *len;
+	entry_sput( e, buf, &cur, max, wrap );
+	*len = cur - *buf;
+
+	return( *buf );
+}
+
 void
 entry_clean( Entry *e )
 {
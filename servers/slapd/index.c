@@ -29,6 +29,7 @@ static slap_verbmasks idxstr[] = {
 	{ BER_BVC("subinitial"), SLAP_INDEX_SUBSTR_INITIAL },
 	{ BER_BVC("subany"), SLAP_INDEX_SUBSTR_ANY },
 	{ BER_BVC("subfinal"), SLAP_INDEX_SUBSTR_FINAL },
+	{ BER_BVC("subngram"), SLAP_INDEX_SUBSTR_NGRAM },
 	{ BER_BVC("sub"), SLAP_INDEX_SUBSTR_DEFAULT },
 	{ BER_BVC("substr"), 0 },
 	{ BER_BVC("notags"), SLAP_INDEX_NOTAGS },
@@ -61,6 +62,7 @@ void slap_index2bvlen( slap_mask_t idx, struct berval *bv )
 		if ( !idxstr[i].mask ) continue;
 		if ( IS_SLAP_INDEX( idx, idxstr[i].mask )) {
 			if ( (idxstr[i].mask & SLAP_INDEX_SUBSTR) &&
+				idxstr[i].mask != SLAP_INDEX_SUBSTR_NGRAM &&
 				((idx & SLAP_INDEX_SUBSTR_DEFAULT) != idxstr[i].mask))
 				continue;
 			if ( bv->bv_len ) bv->bv_len++;
@@ -82,6 +84,7 @@ void slap_index2bv( slap_mask_t idx, struct berval *bv )
 		if ( !idxstr[i].mask ) continue;
 		if ( IS_SLAP_INDEX( idx, idxstr[i].mask )) {
 			if ( (idxstr[i].mask & SLAP_INDEX_SUBSTR) &&
+				idxstr[i].mask != SLAP_INDEX_SUBSTR_NGRAM &&
 				((idx & SLAP_INDEX_SUBSTR_DEFAULT) != idxstr[i].mask))
 				continue;
 			if ( ptr != bv->bv_val ) *ptr++ = ',';
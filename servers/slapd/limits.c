@@ -40,6 +40,20 @@ static const struct berval lmpats[] = {
 	BER_BVC( "*" )
 };
 
+/* Values must match slap_opclass_t in slap.h */
+static const struct berval opclass_names[] = {
+	BER_BVC( "default" ),
+	BER_BVC( "bind" ),
+	BER_BVC( "read" ),
+	BER_BVC( "write" ),
+	BER_BVC( "extended" ),
+	BER_BVC( "search" ),
+	BER_BVNULL
+};
+
+/* set when any limits rule carries an opclass */
+static int limits_opclass_rules;
+
 #ifdef LDAP_DEBUG
 static const char *const dn_source[2] = { "DN", "DN.THIS" };
 static const char *const lmpats_out[] = {
@@ -712,6 +726,19 @@ limits_parse_one(
 			return( 1 );
 		}
 
+	} else if ( STRSTART( arg, "opclass=" ) ) {
+		int	cls;
+
+		arg += STRLENOF( "opclass=" );
+		cls = limits_str2opclass( arg );
+		if ( cls < 0 ) {
+			return( 1 );
+		}
+		limit->lms_opclass = cls;
+		if ( cls != SLAP_OPCLASS_DEFAULT ) {
+			limits_opclass_rules = 1;
+		}
+
 	} else if ( STRSTART( arg, "size" ) ) {
 		arg += STRLENOF( "size" );
 		
@@ -935,7 +962,7 @@ limits_unparse( struct slap_limits *lim, struct berval *bv, ber_len_t buflen )
 		btmp.bv_val = ptr;
 		btmp.bv_len = 0;
 		rc = limits_unparse_one( &lim->lm_limits,
-			SLAP_LIMIT_SIZE | SLAP_LIMIT_TIME,
+			SLAP_LIMIT_SIZE | SLAP_LIMIT_TIME | SLAP_LIMIT_OPCLASS,
 			&btmp, WHATSLEFT );
 		if ( rc == 0 )
 			bv->bv_len += btmp.bv_len;
@@ -1047,6 +1074,14 @@ t_hard:
 				return -1;
 		}
 	}
+
+	if ( which & SLAP_LIMIT_OPCLASS ) {
+		if ( lim->lms_opclass != SLAP_OPCLASS_DEFAULT ) {
+			if ( ptr_APPEND_LIT( " opclass=" ) ) return -1;
+			if ( ptr_APPEND_BV( opclass_names[ lim->lms_opclass ] ) ) return -1;
+			if ( ptr_APPEND_LIT( " " ) ) return -1;
+		}
+	}
 	if ( ptr != bv->bv_val ) {
 		ptr--;
 		*ptr = '\0';
@@ -1056,6 +1091,109 @@ t_hard:
 	return 0;
 }
 
+int
+limits_str2opclass( const char *str )
+{
+	int	i;
+
+	for ( i = 0; !BER_BVISNULL( &opclass_names[ i ] ); i++ ) {
+		if ( strcasecmp( str, opclass_names[ i ].bv_val ) == 0 ) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+const struct berval *
+limits_opclass2bv( int cls )
+{
+	assert( cls >= 0 && cls < SLAP_OPCLASS_LAST );
+
+	return &opclass_names[ cls ];
+}
+
+/*
+ * Admission class of an operation that has been read but not yet
+ * decoded: by type, unless a global limits rule matching the
+ * requester sets "opclass".  Binds are never reclassified.
+ */
+int
+limits_opclass( Operation *op )
+{
+	struct slap_limits_set	*limit;
+	BackendDB		*bd;
+	BerMemoryFunctions	*mfuncs;
+	void			*memctx;
+	int			cls;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_BIND:
+		return SLAP_OPCLASS_BIND;
+
+	case LDAP_REQ_COMPARE:
+		cls = SLAP_OPCLASS_READ;
+		break;
+
+	case LDAP_REQ_SEARCH: {
+		BerElementBuffer berbuf;
+		BerElement	*ber = (BerElement *)&berbuf;
+		struct berval	bv;
+		ber_int_t	scope;
+
+		/* peek at the scope without moving the request's BER */
+		cls = SLAP_OPCLASS_SEARCH;
+		if ( ber_peek_element( op->o_ber, &bv ) != LBER_ERROR ) {
+			ber_init2( ber, &bv, 0 );
+			if ( ber_scanf( ber, "xe", &scope ) != LBER_ERROR &&
+				scope == LDAP_SCOPE_BASE )
+			{
+				cls = SLAP_OPCLASS_READ;
+			}
+		}
+		} break;
+
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODIFY:
+	case LDAP_REQ_MODRDN:
+		cls = SLAP_OPCLASS_WRITE;
+		break;
+
+	case LDAP_REQ_EXTENDED:
+		cls = SLAP_OPCLASS_EXTENDED;
+		break;
+
+	default:
+		return SLAP_OPCLASS_DEFAULT;
+	}
+
+	if ( !limits_opclass_rules || frontendDB->be_limits == NULL ) {
+		return cls;
+	}
+
+	/* the operation has no backend nor memory context yet */
+	bd = op->o_bd;
+	mfuncs = op->o_tmpmfuncs;
+	memctx = op->o_tmpmemctx;
+	op->o_bd = frontendDB;
+	op->o_tmpmfuncs = &ch_mfuncs;
+	op->o_tmpmemctx = NULL;
+
+	(void)limits_get( op, &limit );
+	if ( limit->lms_opclass != SLAP_OPCLASS_DEFAULT ) {
+		cls = limit->lms_opclass;
+	}
+
+	/* drop group membership cached by group rules */
+	slap_op_groups_free( op );
+	op->o_bd = bd;
+	op->o_tmpmfuncs = mfuncs;
+	op->o_tmpmemctx = memctx;
+
+	return cls;
+}
+
 int
 limits_check( Operation *op, SlapReply *rs )
 {
@@ -93,6 +93,7 @@ typedef struct sort_node
 	int sn_session;
 	struct berval sn_dn;
 	struct berval *sn_vals;
+	Entry *sn_entry;	/* kept while its run is sorted */
 } sort_node;
 
 typedef struct sssvlv_info
@@ -117,6 +118,11 @@ typedef struct sort_op
 	int so_session;
 	unsigned long so_vcontext;
 	int so_running;
+	SortedSearch so_ss;	/* asks the backend for index order */
+	unsigned long so_run;
+	int so_vlv_limit;	/* entries left to send in the window */
+	int so_flushing;
+	int so_full;
 } sort_op;
 
 /* There is only one conn table for all overlay instances */
@@ -394,6 +400,16 @@ static int find_next_session(
 	}
 }
 	
+/* Also frees the entry a node kept for a sorted run */
+static void sort_node_free( void *ptr )
+{
+	sort_node *sn = ptr;
+
+	if ( sn->sn_entry )
+		entry_free( sn->sn_entry );
+	ch_free( sn );
+}
+
 static void free_sort_op( Connection *conn, sort_op *so )
 {
 	int sess_id;
@@ -419,7 +435,7 @@ static void free_sort_op( Connection *conn, sort_op *so )
 				    cur_node = next_node;
 			    }
 		    } else {
-			    tavl_free( so->so_tree, ch_free );
+			    tavl_free( so->so_tree, sort_node_free );
 		    }
 		    so->so_tree = NULL;
 	    }
@@ -681,6 +697,115 @@ static void send_entry(
 	}
 }
 
+/* A backend that walks an index in sort order sends its entries in
+ * runs, see SortedSearch. Only the entries of one run are kept, and
+ * once the next run begins they are sorted and sent. For a VLV the
+ * backend skips what it can of the entries before the window, and
+ * the search is stopped once the window is full.
+ */
+static int send_run(
+	Operation		*op,
+	SlapReply		*rs,
+	sort_op			*so)
+{
+	TAvlnode *cur_node;
+	int rc = LDAP_SUCCESS;
+
+	so->so_flushing = 1;
+	for ( cur_node = tavl_end( so->so_tree, TAVL_DIR_LEFT ); cur_node;
+		cur_node = tavl_next( cur_node, TAVL_DIR_RIGHT ))
+	{
+		sort_node *sn = cur_node->avl_data;
+		SlapReply rs2 = { REP_SEARCH };
+
+		if ( rc != LDAP_SUCCESS || slapd_shutdown ||
+			so->so_ss.ss_skip ||
+			( so->so_vlv > SLAP_CONTROL_IGNORED && !so->so_vlv_limit ))
+		{
+			if ( rc == LDAP_SUCCESS && so->so_ss.ss_skip )
+				so->so_ss.ss_skip--;
+			entry_free( sn->sn_entry );
+			continue;
+		}
+
+		rs2.sr_entry = sn->sn_entry;
+		rs2.sr_flags = REP_ENTRY_MUSTBEFREED;
+		rs2.sr_attrs = op->ors_attrs;
+		rs2.sr_nentries = rs->sr_nentries;
+		rc = send_search_entry( op, &rs2 );
+		rs->sr_nentries = rs2.sr_nentries;
+		if ( so->so_vlv > SLAP_CONTROL_IGNORED )
+			so->so_vlv_limit--;
+		if ( rc != LDAP_SIZELIMIT_EXCEEDED && rc != LDAP_UNAVAILABLE )
+			rc = LDAP_SUCCESS;
+	}
+	tavl_free( so->so_tree, ch_free );
+	so->so_tree = NULL;
+	so->so_flushing = 0;
+
+	/* the window is full, nothing more is wanted */
+	if ( rc == LDAP_SUCCESS && so->so_vlv > SLAP_CONTROL_IGNORED &&
+		!so->so_vlv_limit )
+	{
+		so->so_full = 1;
+		rc = LDAP_SIZELIMIT_EXCEEDED;
+	}
+	return rc;
+}
+
+/* Pick the VLV window from the entry count the backend found,
+ * the way send_list() does from the entries in the tree.
+ */
+static int sssvlv_window(
+	Operation		*op,
+	SortedSearch	*ss )
+{
+	sort_op *so = (sort_op *)((char *)ss - offsetof(sort_op, so_ss));
+	vlv_ctrl *vc = op->o_controls[vlv_cid];
+	int count = ss->ss_count;
+	int target, i = 0;
+
+	so->so_nentries = count;
+	if ( !count )
+		return 1;
+
+	if ( BER_BVISNULL( &vc->vc_value )) {
+		if ( vc->vc_offset == vc->vc_count ) {
+			target = count;
+		} else if ( vc->vc_offset == 1 ) {
+			target = 1;
+		} else if ( vc->vc_count && vc->vc_count != count ) {
+			if ( vc->vc_offset > vc->vc_count )
+				goto range_err;
+			target = count * vc->vc_offset / vc->vc_count;
+		} else {
+			if ( vc->vc_offset > count ) {
+range_err:
+				so->so_vlv_rc = LDAP_VLV_RANGE_ERROR;
+				return 1;
+			}
+			target = vc->vc_offset;
+		}
+		so->so_vlv_target = target;
+	} else {
+		target = ss->ss_target + 1;
+		so->so_vlv_target = target;
+		/* past the last entry, the window ends with it */
+		if ( target > count ) {
+			target = count;
+			i = 1;
+		}
+	}
+	if ( target < 1 )
+		target = 1;
+	for ( ; i < vc->vc_before && target > 1; i++ )
+		target--;
+	ss->ss_skip = target - 1;
+	so->so_vlv_limit = i + vc->vc_after + 1;
+	so->so_vlv_rc = LDAP_SUCCESS;
+	return 0;
+}
+
 static void send_result(
 	Operation		*op,
 	SlapReply		*rs,
@@ -715,6 +840,37 @@ static void send_result(
 	}
 }
 
+/* Finish a search the backend sent in sort order */
+static void send_sorted(
+	Operation		*op,
+	SlapReply		*rs,
+	sort_op			*so)
+{
+	int rc = LDAP_SUCCESS;
+
+	/* RFC 2891: as in send_entry() */
+	if ( !so->so_full && ( (op->o_ctrlflag[sss_cid] != SLAP_CONTROL_CRITICAL) ||
+		(rs->sr_err == LDAP_SUCCESS) ))
+	{
+		rc = send_run( op, rs, so );
+	} else {
+		tavl_free( so->so_tree, sort_node_free );
+		so->so_tree = NULL;
+	}
+
+	if ( rc == LDAP_SIZELIMIT_EXCEEDED )
+		rs->sr_err = rc;
+	if ( so->so_vlv > SLAP_CONTROL_IGNORED ) {
+		/* the search was only stopped because the window was full */
+		if ( so->so_vlv_rc == LDAP_VLV_RANGE_ERROR )
+			rs->sr_err = LDAP_VLV_ERROR;
+		else if ( so->so_full && rs->sr_err == LDAP_SIZELIMIT_EXCEEDED )
+			rs->sr_err = LDAP_SUCCESS;
+		/* nothing is kept for the next request to continue */
+		so->so_vcontext = 0;
+	}
+}
+
 static int sssvlv_op_response(
 	Operation	*op,
 	SlapReply	*rs )
@@ -729,6 +885,17 @@ static int sssvlv_op_response(
 		struct berval *bv;
 		char *ptr;
 
+		/* entries of a finished run on their way out */
+		if ( so->so_flushing )
+			return SLAP_CB_CONTINUE;
+
+		if ( so->so_ss.ss_sorted && so->so_ss.ss_run != so->so_run ) {
+			so->so_run = so->so_ss.ss_run;
+			rs->sr_err = send_run( op, rs, so );
+			if ( rs->sr_err != LDAP_SUCCESS )
+				return rs->sr_err;
+		}
+
 		len = sizeof(sort_node) + sc->sc_nkeys * sizeof(struct berval) +
 			rs->sr_entry->e_nname.bv_len + 1;
 		sn = op->o_tmpalloc( len, op->o_tmpmemctx );
@@ -776,11 +943,14 @@ static int sssvlv_op_response(
 		sn = sn2;
 		sn->sn_conn = op->o_conn->c_conn_idx;
 		sn->sn_session = find_session_by_so( so->so_info->svi_max_percon, op->o_conn->c_conn_idx, so );
+		sn->sn_entry = so->so_ss.ss_sorted ? entry_dup( rs->sr_entry ) : NULL;
 
 		/* Insert into the AVL tree */
 		tavl_insert(&(so->so_tree), sn, node_insert, avl_dup_error);
 
-		so->so_nentries++;
+		/* the backend counted the entries of a sorted VLV */
+		if ( !so->so_ss.ss_sorted )
+			so->so_nentries++;
 
 		/* Collected the keys so that they can be sorted.  Thus, stop
 		 * the entry from propagating.
@@ -796,7 +966,17 @@ static int sssvlv_op_response(
 			op->o_callback = op->o_callback->sc_next;
 		}
 
-		send_entry( op, rs, so );
+		if ( so->so_ss.ss_ad ) {
+			LDAP_SLIST_REMOVE( &op->o_extra, &so->so_ss.ss_oe, OpExtra, oe_next );
+			if ( so->so_ss.ss_value.bv_val )
+				op->o_tmpfree( so->so_ss.ss_value.bv_val, op->o_tmpmemctx );
+		}
+
+		if ( so->so_ss.ss_sorted ) {
+			send_sorted( op, rs, so );
+		} else {
+			send_entry( op, rs, so );
+		}
 		send_result( op, rs, so );
 	}
 
@@ -971,6 +1151,41 @@ static int sssvlv_op_search(
 			so->so_nentries = 0;
 			so->so_running = 1;
 
+			/* The backend may have an index to send the entries
+			 * in order from, if they are sorted the usual way on
+			 * their first key.
+			 */
+			if ( !ps && sc->sc_keys[0].sk_ordering &&
+				sc->sc_keys[0].sk_ordering ==
+				sc->sc_keys[0].sk_ad->ad_type->sat_ordering )
+			{
+				sort_key *sk = &sc->sc_keys[0];
+				MatchingRule *mr = sk->sk_ordering;
+				int ok = 1;
+
+				if ( vc ) {
+					so->so_ss.ss_window = sssvlv_window;
+					/* normalized as send_list() does */
+					if ( BER_BVISNULL( &vc->vc_value )) {
+						/* by offset */
+					} else if ( mr->smr_normalize ) {
+						ok = mr->smr_normalize( SLAP_MR_VALUE_OF_SYNTAX,
+							mr->smr_syntax, mr, &vc->vc_value,
+							&so->so_ss.ss_value, op->o_tmpmemctx ) == LDAP_SUCCESS;
+					} else {
+						ber_dupbv_x( &so->so_ss.ss_value, &vc->vc_value,
+							op->o_tmpmemctx );
+					}
+				}
+				if ( ok ) {
+					so->so_ss.ss_ad = sk->sk_ad;
+					so->so_ss.ss_reverse = sk->sk_direction < 0;
+					so->so_ss.ss_oe.oe_key = (void *)backend_sorted_search;
+					LDAP_SLIST_INSERT_HEAD( &op->o_extra, &so->so_ss.ss_oe,
+						oe_next );
+				}
+			}
+
 			op->o_callback		= cb;
 		}
 	} else {
@@ -439,6 +439,9 @@ LDAP_SLAPD_F (int) backend_operational LDAP_P((
 	SlapReply *rs 
 ));
 
+LDAP_SLAPD_F (SortedSearch *) backend_sorted_search LDAP_P((
+	Operation *op ));
+
 LDAP_SLAPD_F (ID) backend_tool_entry_first LDAP_P(( BackendDB *be ));
 
 LDAP_SLAPD_V(BackendInfo) slap_binfo[]; 
@@ -834,6 +837,12 @@ LDAP_SLAPD_F (void) operation_fake_init LDAP_P((
 	int newmem ));
 LDAP_SLAPD_F (void) connection_assign_nextid LDAP_P((Connection *));
 
+LDAP_SLAPD_V (slap_opclass_info) slap_opclasses[SLAP_OPCLASS_LAST];
+LDAP_SLAPD_V (int) slap_opclass_enabled;
+LDAP_SLAPD_F (void) slap_opclass_configure LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_opclass_get LDAP_P((
+	int cls, slap_opclass_info *qc ));
+
 /*
  * cr.c
  */
@@ -1029,6 +1038,8 @@ LDAP_SLAPD_F (Entry *) str2entry LDAP_P(( char	*s ));
 LDAP_SLAPD_F (Entry *) str2entry2 LDAP_P(( char	*s, int checkvals ));
 LDAP_SLAPD_F (char *) entry2str LDAP_P(( Entry *e, int *len ));
 LDAP_SLAPD_F (char *) entry2str_wrap LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
+LDAP_SLAPD_F (char *) entry2str_wrap_r LDAP_P(( Entry *e, char **buf,
+	int *len, int *max, ber_len_t wrap ));
 
 LDAP_SLAPD_F (ber_len_t) entry_flatsize LDAP_P(( Entry *e, int norm ));
 LDAP_SLAPD_F (void) entry_partsize LDAP_P(( Entry *e, ber_len_t *len,
@@ -1220,6 +1231,9 @@ LDAP_SLAPD_F (int) limits_parse LDAP_P((
 	int argc, char **argv ));
 LDAP_SLAPD_F (int) limits_parse_one LDAP_P(( const char *arg, 
 	struct slap_limits_set *limit ));
+LDAP_SLAPD_F (int) limits_opclass LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (int) limits_str2opclass LDAP_P(( const char *str ));
+LDAP_SLAPD_F (const struct berval *) limits_opclass2bv LDAP_P(( int cls ));
 LDAP_SLAPD_F (int) limits_check LDAP_P((
 	Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) limits_unparse_one LDAP_P(( 
@@ -1794,6 +1808,7 @@ LDAP_SLAPD_F (int) slap_schema_init LDAP_P((void));
 LDAP_SLAPD_F (void) schema_destroy LDAP_P(( void ));
 
 LDAP_SLAPD_F (int) slap_hash64 LDAP_P((int));
+LDAP_SLAPD_F (int) slap_hashfunc LDAP_P((int));
 
 LDAP_SLAPD_F( slap_mr_indexer_func ) octetStringIndexer;
 LDAP_SLAPD_F( slap_mr_filter_func ) octetStringFilter;
@@ -113,10 +113,39 @@ static void (*hashinit)(lutil_HASH_CTX *ctx) = lutil_HASHInit;
 static void (*hashupdate)(lutil_HASH_CTX *ctx,unsigned char const *buf, ber_len_t len) = lutil_HASHUpdate;
 static void (*hashfinal)(unsigned char digest[HASH_BYTES], lutil_HASH_CTX *ctx) = lutil_HASHFinal;
 static int hashlen = LUTIL_HASH_BYTES;
+static int hashfunc = SLAP_INDEX_HASH_FNV;
 #define HASH_Init(c)			hashinit(c)
 #define HASH_Update(c,buf,len)	hashupdate(c,buf,len)
 #define HASH_Final(d,c)			hashfinal(d,c)
 
+/* xxHash64 keys are cut to the configured hash length */
+static void
+xxhFinal( unsigned char digest[HASH_BYTES], lutil_HASH_CTX *ctx )
+{
+	unsigned char full[LUTIL_XXH64_BYTES];
+
+	lutil_XXH64Final( full, ctx );
+	AC_MEMCPY( digest, full, hashlen );
+}
+
+static void
+hashSelect( void )
+{
+	if ( hashfunc == SLAP_INDEX_HASH_XXH64 ) {
+		hashinit = lutil_XXH64Init;
+		hashupdate = lutil_XXH64Update;
+		hashfinal = xxhFinal;
+	} else if ( hashlen == LUTIL_HASH64_BYTES ) {
+		hashinit = lutil_HASH64Init;
+		hashupdate = lutil_HASH64Update;
+		hashfinal = lutil_HASH64Final;
+	} else {
+		hashinit = lutil_HASHInit;
+		hashupdate = lutil_HASHUpdate;
+		hashfinal = lutil_HASHFinal;
+	}
+}
+
 /* Toggle between 32 and 64 bit hashing, default to 32 for compatibility
    -1 to query, returns 1 if 64 bit, 0 if 32.
    0/1 to set 32/64, returns 0 on success, -1 on failure */
@@ -125,16 +154,25 @@ int slap_hash64( int onoff )
 	if ( onoff < 0 ) {
 		return hashlen == LUTIL_HASH64_BYTES;
 	} else if ( onoff ) {
-		hashinit = lutil_HASH64Init;
-		hashupdate = lutil_HASH64Update;
-		hashfinal = lutil_HASH64Final;
 		hashlen = LUTIL_HASH64_BYTES;
 	} else {
-		hashinit = lutil_HASHInit;
-		hashupdate = lutil_HASHUpdate;
-		hashfinal = lutil_HASHFinal;
 		hashlen = LUTIL_HASH_BYTES;
 	}
+	hashSelect();
+	return 0;
+}
+
+/* Select the hash function of index keys, FNV by default for
+   compatibility. -1 to query, returns the function in use.
+   Returns 0 on success, -1 on failure */
+int slap_hashfunc( int func )
+{
+	if ( func < 0 )
+		return hashfunc;
+	if ( func != SLAP_INDEX_HASH_FNV && func != SLAP_INDEX_HASH_XXH64 )
+		return -1;
+	hashfunc = func;
+	hashSelect();
 	return 0;
 }
 
@@ -153,6 +191,14 @@ int slap_has64( int onoff )
 		return onoff ? -1 : 0;
 }
 
+int slap_hashfunc( int func )
+{
+	if ( func < 0 )
+		return SLAP_INDEX_HASH_FNV;
+	else
+		return func == SLAP_INDEX_HASH_FNV ? 0 : -1;
+}
+
 #endif
 #define HASH_CONTEXT			lutil_HASH_CTX
 
@@ -922,17 +968,30 @@ octetStringSubstringsIndexer(
 {
 	ber_len_t i, nkeys;
 	BerVarray keys;
+	slap_mask_t ngram = flags & SLAP_INDEX_SUBSTR_NGRAM & SLAP_INDEX_SUBSTR_TYPE;
 
-	HASH_CONTEXT HCany, HCini, HCfin;
+	HASH_CONTEXT HCany, HCini, HCfin, HCgram;
 	unsigned char HASHdigest[HASH_BYTES];
 	struct berval digest;
 	digest.bv_val = (char *)HASHdigest;
 	digest.bv_len = HASH_LEN;
 
+	/* an n-gram index alone keeps none of the other keys */
+	if ( ngram && !( flags & SLAP_INDEX_SUBSTR_DEFAULT & SLAP_INDEX_SUBSTR_TYPE ))
+		flags &= ~SLAP_INDEX_SUBSTR;
+
 	nkeys = 0;
 
 	for ( i = 0; !BER_BVISNULL( &values[i] ); i++ ) {
 		/* count number of indices to generate */
+		if( ngram ) {
+			ber_len_t len = values[i].bv_len;
+
+			nkeys += 2 * ( len < 2 ? len : 2 );
+			if( len >= 2 ) nkeys += len - 1;
+			if( len >= 3 ) nkeys += len - 2;
+		}
+
 		if( flags & SLAP_INDEX_SUBSTR_INITIAL ) {
 			if( values[i].bv_len >= index_substr_if_maxlen ) {
 				nkeys += index_substr_if_maxlen -
@@ -968,15 +1027,41 @@ octetStringSubstringsIndexer(
 
 	if ( flags & SLAP_INDEX_SUBSTR_ANY )
 		hashPreset( &HCany, prefix, SLAP_INDEX_SUBSTR_PREFIX, syntax, mr );
-	if( flags & SLAP_INDEX_SUBSTR_INITIAL )
+	if( ngram || ( flags & SLAP_INDEX_SUBSTR_INITIAL ))
 		hashPreset( &HCini, prefix, SLAP_INDEX_SUBSTR_INITIAL_PREFIX, syntax, mr );
-	if( flags & SLAP_INDEX_SUBSTR_FINAL )
+	if( ngram || ( flags & SLAP_INDEX_SUBSTR_FINAL ))
 		hashPreset( &HCfin, prefix, SLAP_INDEX_SUBSTR_FINAL_PREFIX, syntax, mr );
+	if( ngram )
+		hashPreset( &HCgram, prefix, SLAP_INDEX_SUBSTR_NGRAM_PREFIX, syntax, mr );
 
 	nkeys = 0;
 	for ( i = 0; !BER_BVISNULL( &values[i] ); i++ ) {
 		ber_len_t j,max;
 
+		if( ngram ) {
+			/* The heads and tails are the same keys as a subinitial
+			 * and subfinal index keeps for them.
+			 */
+			max = values[i].bv_len < 2 ? values[i].bv_len : 2;
+			for( j=1; j<=max; j++ ) {
+				hashIter( &HCini, HASHdigest,
+					(unsigned char *)values[i].bv_val, j );
+				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
+				hashIter( &HCfin, HASHdigest,
+					(unsigned char *)&values[i].bv_val[values[i].bv_len-j], j );
+				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
+			}
+			for( j=0; j+2<=values[i].bv_len; j++ ) {
+				hashIter( &HCgram, HASHdigest,
+					(unsigned char *)&values[i].bv_val[j], 2 );
+				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
+				if( j+3 > values[i].bv_len ) continue;
+				hashIter( &HCgram, HASHdigest,
+					(unsigned char *)&values[i].bv_val[j], 3 );
+				ber_dupbv_x( &keys[nkeys++], &digest, ctx );
+			}
+		}
+
 		if( ( flags & SLAP_INDEX_SUBSTR_ANY ) &&
 			( values[i].bv_len >= index_substr_any_len ) )
 		{
@@ -1024,6 +1109,121 @@ octetStringSubstringsIndexer(
 	return LDAP_SUCCESS;
 }
 
+/* Keys of one substring for an n-gram index: all of its trigrams,
+ * or its bigram, and if it is the initial or final substring, its
+ * head or tail of up to two.
+ */
+static void
+ngramSubstringKeys(
+	struct berval *value,
+	char anchor,
+	Syntax *syntax,
+	MatchingRule *mr,
+	struct berval *prefix,
+	BerVarray keys,
+	ber_len_t *nkeys,
+	void *ctx )
+{
+	HASH_CONTEXT HASHcontext;
+	unsigned char HASHdigest[HASH_BYTES];
+	struct berval digest;
+	ber_len_t j, len;
+
+	digest.bv_val = (char *)HASHdigest;
+	digest.bv_len = HASH_LEN;
+
+	if( anchor && value->bv_len ) {
+		len = value->bv_len < 2 ? value->bv_len : 2;
+		hashPreset( &HASHcontext, prefix, anchor, syntax, mr );
+		hashIter( &HASHcontext, HASHdigest, (unsigned char *)(
+			anchor == SLAP_INDEX_SUBSTR_FINAL_PREFIX ?
+			&value->bv_val[value->bv_len-len] : value->bv_val ), len );
+		ber_dupbv_x( &keys[(*nkeys)++], &digest, ctx );
+	}
+
+	if( value->bv_len < 2 ) return;
+
+	hashPreset( &HASHcontext, prefix, SLAP_INDEX_SUBSTR_NGRAM_PREFIX,
+		syntax, mr );
+	if( value->bv_len == 2 ) {
+		/* a head or tail already says as much */
+		if( !anchor ) {
+			hashIter( &HASHcontext, HASHdigest,
+				(unsigned char *)value->bv_val, 2 );
+			ber_dupbv_x( &keys[(*nkeys)++], &digest, ctx );
+		}
+		return;
+	}
+	for( j=0; j+3<=value->bv_len; j++ ) {
+		hashIter( &HASHcontext, HASHdigest,
+			(unsigned char *)&value->bv_val[j], 3 );
+		ber_dupbv_x( &keys[(*nkeys)++], &digest, ctx );
+	}
+}
+
+/* Assertion value -> index hash keys, for an n-gram index. Every
+ * trigram of a substring is used, so that the candidates are those
+ * holding all of them; the entries are still tested afterwards.
+ */
+static int
+ngramSubstringsFilter(
+	Syntax *syntax,
+	MatchingRule *mr,
+	struct berval *prefix,
+	SubstringsAssertion *sa,
+	BerVarray *keysp,
+	void *ctx )
+{
+	ber_len_t i, nkeys = 0;
+	BerVarray keys;
+
+	/* at most one key per byte of each substring */
+	if( !BER_BVISNULL( &sa->sa_initial )) {
+		nkeys += sa->sa_initial.bv_len;
+	}
+	if( !BER_BVISNULL( &sa->sa_final )) {
+		nkeys += sa->sa_final.bv_len;
+	}
+	if( sa->sa_any != NULL ) {
+		for( i=0; !BER_BVISNULL( &sa->sa_any[i] ); i++ ) {
+			nkeys += sa->sa_any[i].bv_len;
+		}
+	}
+
+	if( nkeys == 0 ) {
+		*keysp = NULL;
+		return LDAP_SUCCESS;
+	}
+
+	keys = slap_sl_malloc( sizeof( struct berval ) * (nkeys+1), ctx );
+	nkeys = 0;
+
+	if( !BER_BVISNULL( &sa->sa_initial )) {
+		ngramSubstringKeys( &sa->sa_initial, SLAP_INDEX_SUBSTR_INITIAL_PREFIX,
+			syntax, mr, prefix, keys, &nkeys, ctx );
+	}
+	if( sa->sa_any != NULL ) {
+		for( i=0; !BER_BVISNULL( &sa->sa_any[i] ); i++ ) {
+			ngramSubstringKeys( &sa->sa_any[i], 0,
+				syntax, mr, prefix, keys, &nkeys, ctx );
+		}
+	}
+	if( !BER_BVISNULL( &sa->sa_final )) {
+		ngramSubstringKeys( &sa->sa_final, SLAP_INDEX_SUBSTR_FINAL_PREFIX,
+			syntax, mr, prefix, keys, &nkeys, ctx );
+	}
+
+	if( nkeys > 0 ) {
+		BER_BVZERO( &keys[nkeys] );
+		*keysp = keys;
+	} else {
+		slap_sl_free( keys, ctx );
+		*keysp = NULL;
+	}
+
+	return LDAP_SUCCESS;
+}
+
 /* Substring index generation function: Assertion value -> index hash keys */
 static int
 octetStringSubstringsFilter (
@@ -1048,6 +1248,10 @@ octetStringSubstringsFilter (
 
 	sa = (SubstringsAssertion *) assertedValue;
 
+	if( flags & SLAP_INDEX_SUBSTR_NGRAM & SLAP_INDEX_SUBSTR_TYPE ) {
+		return ngramSubstringsFilter( syntax, mr, prefix, sa, keysp, ctx );
+	}
+
 	if( flags & SLAP_INDEX_SUBSTR_INITIAL &&
 		!BER_BVISNULL( &sa->sa_initial ) &&
 		sa->sa_initial.bv_len >= index_substr_if_minlen )
@@ -264,6 +264,9 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_SUBSTR_INITIAL ( SLAP_INDEX_SUBSTR | 0x0100UL ) 
 #define SLAP_INDEX_SUBSTR_ANY     ( SLAP_INDEX_SUBSTR | 0x0200UL )
 #define SLAP_INDEX_SUBSTR_FINAL   ( SLAP_INDEX_SUBSTR | 0x0400UL )
+/* bigrams and trigrams anywhere, and heads and tails up to two long;
+ * not part of SLAP_INDEX_SUBSTR_DEFAULT */
+#define SLAP_INDEX_SUBSTR_NGRAM   ( SLAP_INDEX_SUBSTR | 0x0800UL )
 #define SLAP_INDEX_SUBSTR_DEFAULT \
 	( SLAP_INDEX_SUBSTR \
 	| SLAP_INDEX_SUBSTR_INITIAL \
@@ -278,6 +281,10 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_SUBSTR_ANY_LEN_DEFAULT		4
 #define SLAP_INDEX_SUBSTR_ANY_STEP_DEFAULT		2
 
+/* hash functions of index keys */
+#define SLAP_INDEX_HASH_FNV		0
+#define SLAP_INDEX_HASH_XXH64	1
+
 /* default for ordered integer index keys */
 #define SLAP_INDEX_INTLEN_DEFAULT	4
 
@@ -294,6 +301,7 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_SUBSTR_PREFIX	'*'		/* prefix for substring keys    */
 #define SLAP_INDEX_SUBSTR_INITIAL_PREFIX '^'
 #define SLAP_INDEX_SUBSTR_FINAL_PREFIX '$'
+#define SLAP_INDEX_SUBSTR_NGRAM_PREFIX '#'
 #define SLAP_INDEX_CONT_PREFIX		'.'		/* prefix for continuation keys */
 
 #define SLAP_SYNTAX_MATCHINGRULES_OID	 "1.3.6.1.4.1.1466.115.121.1.30"
@@ -1684,6 +1692,32 @@ slap_cf_aux_table_parse_x LDAP_P((
 
 #define SLAP_LIMIT_TIME	1
 #define SLAP_LIMIT_SIZE	2
+#define SLAP_LIMIT_OPCLASS	4
+
+/* Operation admission classes, in scheduling priority order */
+typedef enum slap_opclass_e {
+	SLAP_OPCLASS_DEFAULT = 0,	/* classify by operation type */
+	SLAP_OPCLASS_BIND,
+	SLAP_OPCLASS_READ,		/* base scope search, compare */
+	SLAP_OPCLASS_WRITE,
+	SLAP_OPCLASS_EXTENDED,
+	SLAP_OPCLASS_SEARCH,	/* onelevel and subtree search */
+	SLAP_OPCLASS_LAST
+} slap_opclass_t;
+
+typedef struct slap_opclass_info {
+	int	qc_reserve;		/* threads kept free for this class */
+	int	qc_max_pending;	/* queued ops before LDAP_BUSY, 0 = no limit */
+
+	/* protected by slap_opclass_mutex */
+	int	qc_active;
+	int	qc_queued;
+	unsigned long	qc_admitted;
+	unsigned long	qc_completed;
+	unsigned long	qc_deferred;
+	unsigned long	qc_rejected;
+	LDAP_STAILQ_HEAD(qc_q, Operation)	qc_queue;
+} slap_opclass_info;
 
 struct slap_limits_set {
 	/* time limits */
@@ -1697,6 +1731,9 @@ struct slap_limits_set {
 	int	lms_s_pr;
 	int	lms_s_pr_hide;
 	int	lms_s_pr_total;
+
+	/* admission class */
+	int	lms_opclass;
 };
 
 /* Note: this is different from LDAP_NO_LIMIT (0); slapd internal use only */
@@ -1838,6 +1875,7 @@ struct BackendDB {
 #define		be_dn2id_get bd_info->bi_tool_dn2id_get
 #define		be_entry_modify	bd_info->bi_tool_entry_modify
 #define		be_entry_delete	bd_info->bi_tool_entry_delete
+#define		be_entry_walk	bd_info->bi_tool_entry_walk
 #endif
 
 	/* supported controls */
@@ -2226,6 +2264,17 @@ typedef ID (BI_tool_entry_modify) LDAP_P(( BackendDB *be, Entry *e,
 	struct berval *text ));
 typedef int (BI_tool_entry_delete) LDAP_P(( BackendDB *be, struct berval *ndn,
 	struct berval *text ));
+/* Reentrant read for parallel tools: passes each entry with an ID in
+ * [*idp, last] to cb, in ID order. *ctx holds the calling thread's read
+ * state: a NULL cb sets it up when it is NULL and releases it otherwise.
+ * All readers set up start on one snapshot, or get LDAP_BUSY; a NULL ctx
+ * forgets that snapshot so that they can all be set up again.
+ * On return *idp is the first ID past last, or NOID if there is none;
+ * on failure it is the ID of the entry that failed.
+ */
+typedef int (BI_tool_entry_cb) LDAP_P(( Entry *e, void *arg ));
+typedef int (BI_tool_entry_walk) LDAP_P(( BackendDB *be, void **ctx,
+	ID *idp, ID last, BI_tool_entry_cb *cb, void *arg ));
 
 struct BackendInfo {
 	char	*bi_type; /* type of backend */
@@ -2331,6 +2380,7 @@ struct BackendInfo {
 	BI_tool_dn2id_get	*bi_tool_dn2id_get;
 	BI_tool_entry_modify	*bi_tool_entry_modify;
 	BI_tool_entry_delete	*bi_tool_entry_delete;
+	BI_tool_entry_walk	*bi_tool_entry_walk;
 
 #define SLAP_INDEX_ADD_OP		0x0001
 #define SLAP_INDEX_DELETE_OP	0x0002
@@ -2613,6 +2663,35 @@ typedef struct OpExtraDB {
 	BackendDB *oe_db;
 } OpExtraDB;
 
+/* Pushed by an overlay that wants the entries of a search in the
+ * order of ss_ad, keyed by backend_sorted_search. A backend that can
+ * walk an index in that order sets ss_sorted, and then sends entries
+ * in runs: each run sorts after the runs before it, but the entries
+ * within a run are in no particular order. ss_run changes as each
+ * run begins.
+ *
+ * For a virtual list view ss_window is set, and the backend only
+ * sorts if it can also count the entries, which must all be ones the
+ * user may see, since they are counted unread. It sets ss_count, and
+ * ss_target to the number of entries sorting before ss_value, if
+ * there is one, then calls ss_window. That returns nonzero if no
+ * entry is to be sent, or sets ss_skip to the number at the start
+ * to pass over. The backend passes over as many as it can without
+ * reading them, and leaves the rest of ss_skip to the caller.
+ */
+typedef struct SortedSearch {
+	OpExtra ss_oe;
+	AttributeDescription *ss_ad;
+	int ss_reverse;
+	struct berval ss_value;
+	int (*ss_window) LDAP_P(( Operation *op, struct SortedSearch *ss ));
+	unsigned long ss_count;
+	unsigned long ss_target;
+	unsigned long ss_skip;
+	int ss_sorted;
+	unsigned long ss_run;
+} SortedSearch;
+
 struct Operation {
 	Opheader *o_hdr;
 
@@ -2821,6 +2900,9 @@ struct Operation {
 	void	*o_private;	/* anything the backend needs */
 	LDAP_SLIST_HEAD(o_e, OpExtra) o_extra;	/* anything the backend needs */
 
+	int	o_opclass;	/* admission class, negated if rejected */
+	LDAP_STAILQ_ENTRY(Operation)	o_qnext;	/* next operation in class queue */
+
 	LDAP_STAILQ_ENTRY(Operation)	o_next;	/* next operation in list */
 };
 
@@ -3054,6 +3136,8 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_shard;	/* SO_REUSEPORT shard (owning listener thread), or -1 */
+	ber_socket_t *sl_spares;	/* bound SO_REUSEPORT siblings, startup only */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
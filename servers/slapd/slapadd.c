@@ -56,23 +56,35 @@
 
 extern int slap_DN_strict;	/* dn.c */
 
-static char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
-
 typedef struct Erec {
 	Entry *e;
 	unsigned long lineno;
 	unsigned long nextline;
 } Erec;
 
-typedef struct Trec {
-	Entry *e;
-	unsigned long lineno;
-	unsigned long nextline;
+/* A record slot of the threaded pipeline: the reader thread fills
+ * free slots in input order, parser threads turn them into entries,
+ * and the main thread adds the entries in the same order.
+ */
+typedef struct Arec {
+	Erec erec;
+	char *buf;
+	int lmax;
 	int rc;
-	int ready;
-} Trec;
+	int state;
+} Arec;
+
+#define AREC_FREE	0
+#define AREC_READ	1	/* holds a record to parse */
+#define AREC_BUSY	2	/* being parsed */
+#define AREC_DONE	3	/* holds an entry, a failure, or EOF */
+
+#define AREC_PER_THREAD	16
+
+static Arec *arecs;
+static int narecs;
+static int arec_read, arec_parse, arec_write;
 
-static Trec trec;
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -83,54 +95,68 @@ static char *buf;
 static int lmax;
 
 static ldap_pvt_thread_mutex_t add_mutex;
-static ldap_pvt_thread_cond_t add_cond;
-static int add_stop;
+static ldap_pvt_thread_cond_t add_cond;		/* a slot is done */
+static ldap_pvt_thread_cond_t read_cond;	/* a slot is free */
+static ldap_pvt_thread_cond_t parse_cond;	/* a slot was read */
+static ldap_pvt_thread_mutex_t uuid_mutex;
+static int add_stop, add_eof;
+static int ldif_threaded;
 
 /* returns:
  *	1: got a record
  *	0: EOF
  * -1: read failure
- * -2: parse failure
  */
 static int
-getrec0(Erec *erec)
+getrec_read(Erec *erec, char **bufp, int *lmaxp)
 {
-	const char *text;
 	int ldifrc;
-	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
-	size_t textlen = sizeof textbuf;
-	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
 
 again:
 	erec->lineno = erec->nextline+1;
 	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
+	ldifrc = ldif_read_record( ldiffp, &erec->nextline, bufp, lmaxp );
 	if (ldifrc < 1)
 		return ldifrc < 0 ? -1 : 0;
+
+	if ( erec->lineno < jumpline )
+		goto again;
+
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 ftello( ldiffp->fp ),
+				 0);
+	return 1;
+}
+
+/* returns:
+ *	1: got an entry
+ * -2: parse failure
+ */
+static int
+getrec_parse(Erec *erec, char *buf, Operation *op)
+{
+	const char *text;
+	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
+	size_t textlen = sizeof textbuf;
+	struct berval csn;
+	char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
+
 	{
 		BackendDB *bd;
 		Entry *e;
 		int prev_DN_strict;
 
-		if ( erec->lineno < jumpline )
-			goto again;
-
-		if ( !dbnum ) {
+		/* the threaded loader relaxes it for the whole run */
+		if ( !dbnum && !ldif_threaded ) {
 			prev_DN_strict = slap_DN_strict;
 			slap_DN_strict = 0;
 		}
 		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
+		if ( !dbnum && !ldif_threaded ) {
 			slap_DN_strict = prev_DN_strict;
 		}
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
-
 		if( e == NULL ) {
 			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
 				progname, erec->lineno );
@@ -246,7 +272,11 @@ again:
 				== NULL )
 			{
 				got &= ~GOT_UUID;
+				if ( ldif_threaded )
+					ldap_pvt_thread_mutex_lock( &uuid_mutex );
 				vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
+				if ( ldif_threaded )
+					ldap_pvt_thread_mutex_unlock( &uuid_mutex );
 				vals[0].bv_val = uuidbuf;
 				attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
 			}
@@ -301,50 +331,129 @@ again:
 				Debug( LDAP_DEBUG_ANY, "%s: warning, missing attrs %s from entry dn=\"%s\"\n",
 					progname, buf, e->e_name.bv_val );
 			}
-
-			sid = slap_tool_update_ctxcsn_check( progname, e );
 		}
 		erec->e = e;
 	}
 	return 1;
 }
 
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+static int
+getrec0(Erec *erec)
+{
+	int rc;
+
+	rc = getrec_read( erec, &buf, &lmax );
+	if ( rc == 1 ) {
+		opbuf.ob_op.o_hdr = &opbuf.ob_hdr;
+		rc = getrec_parse( erec, buf, &opbuf.ob_op );
+	}
+	return rc;
+}
+
 static void *
-getrec_thr(void *ctx)
+getrec_reader(void *ctx)
 {
+	unsigned long nextline = 0;
+	Arec *ar;
+
 	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
-			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
-		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+	while ( !add_stop ) {
+		ar = &arecs[arec_read];
+		if ( ar->state != AREC_FREE ) {
+			ldap_pvt_thread_cond_wait( &read_cond, &add_mutex );
+			continue;
+		}
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		ar->erec.nextline = nextline;
+		ar->rc = getrec_read( &ar->erec, &ar->buf, &ar->lmax );
+		nextline = ar->erec.nextline;
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		arec_read = ( arec_read + 1 ) % narecs;
+		if ( ar->rc == 1 ) {
+			ar->state = AREC_READ;
+			ldap_pvt_thread_cond_signal( &parse_cond );
+		} else {
+			/* eof or read failure */
+			ar->erec.e = NULL;
+			ar->state = AREC_DONE;
+			add_eof = 1;
+			ldap_pvt_thread_cond_broadcast( &parse_cond );
+			ldap_pvt_thread_cond_signal( &add_cond );
 			break;
+		}
 	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return NULL;
 }
 
-static int ldif_threaded;
+static void *
+getrec_parser(void *ctx)
+{
+	OperationBuffer *opb = ch_calloc( 1, sizeof( OperationBuffer ));
+	Operation *op = &opb->ob_op;
+	Arec *ar;
+
+	op->o_hdr = &opb->ob_hdr;
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	while ( !add_stop ) {
+		ar = &arecs[arec_parse];
+		if ( ar->state != AREC_READ ) {
+			/* the reader is done, so is everything after this slot */
+			if ( add_eof )
+				break;
+			ldap_pvt_thread_cond_wait( &parse_cond, &add_mutex );
+			continue;
+		}
+		ar->state = AREC_BUSY;
+		arec_parse = ( arec_parse + 1 ) % narecs;
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		ar->erec.e = NULL;
+		ar->rc = getrec_parse( &ar->erec, ar->buf, op );
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		ar->state = AREC_DONE;
+		ldap_pvt_thread_cond_signal( &add_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	ch_free( opb );
+	return NULL;
+}
 
 static int
 getrec(Erec *erec)
 {
+	Arec *ar;
 	int rc;
+
 	if ( !ldif_threaded )
 		return getrec0(erec);
 
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
+	ar = &arecs[arec_write];
+	while ( ar->state != AREC_DONE )
+		ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
+	rc = ar->rc;
+	erec->lineno = ar->erec.lineno;
+	erec->nextline = ar->erec.nextline;
+	if ( rc == 1 )
+		erec->e = ar->erec.e;
+	if ( rc == 1 || rc == -2 ) {
+		ar->erec.e = NULL;
+		ar->state = AREC_FREE;
+		arec_write = ( arec_write + 1 ) % narecs;
+		ldap_pvt_thread_cond_signal( &read_cond );
+	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
-	ldap_pvt_thread_cond_signal( &add_cond );
 	return rc;
 }
 
@@ -355,7 +464,8 @@ slapadd( int argc, char **argv )
 	size_t textlen = sizeof textbuf;
 	Erec erec;
 	struct berval bvtext;
-	ldap_pvt_thread_t thr;
+	ldap_pvt_thread_t *thr = NULL;
+	int i, nthr = 0, prev_DN_strict = 0;
 	ID id;
 	Entry *prev = NULL;
 
@@ -427,11 +537,25 @@ slapadd( int argc, char **argv )
 		enable_meter = 0;
 	}
 
+	/* one reader, and parsers for the other tool-threads */
 	if ( slap_tool_thread_max > 1 ) {
+		nthr = slap_tool_thread_max;
+		narecs = ( nthr - 1 ) * AREC_PER_THREAD;
+		arecs = ch_calloc( narecs, sizeof( Arec ));
+		thr = ch_malloc( nthr * sizeof( ldap_pvt_thread_t ));
 		ldap_pvt_thread_mutex_init( &add_mutex );
 		ldap_pvt_thread_cond_init( &add_cond );
-		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
+		ldap_pvt_thread_cond_init( &read_cond );
+		ldap_pvt_thread_cond_init( &parse_cond );
+		ldap_pvt_thread_mutex_init( &uuid_mutex );
 		ldif_threaded = 1;
+		if ( !dbnum ) {
+			prev_DN_strict = slap_DN_strict;
+			slap_DN_strict = 0;
+		}
+		ldap_pvt_thread_create( &thr[0], 0, getrec_reader, NULL );
+		for ( i = 1; i < nthr; i++ )
+			ldap_pvt_thread_create( &thr[i], 0, getrec_parser, NULL );
 	}
 
 	erec.nextline = 0;
@@ -445,6 +569,9 @@ slapadd( int argc, char **argv )
 			break;
 		}
 
+		if ( SLAP_LASTMOD(be) )
+			sid = slap_tool_update_ctxcsn_check( progname, erec.e );
+
 		if ( !dryrun ) {
 			/*
 			 * Initialize text buffer
@@ -482,10 +609,22 @@ slapadd( int argc, char **argv )
 	if ( ldif_threaded ) {
 		ldap_pvt_thread_mutex_lock( &add_mutex );
 		add_stop = 1;
-		trec.ready = 0;
-		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &read_cond );
+		ldap_pvt_thread_cond_broadcast( &parse_cond );
 		ldap_pvt_thread_mutex_unlock( &add_mutex );
-		ldap_pvt_thread_join( thr, NULL );
+		for ( i = 0; i < nthr; i++ )
+			ldap_pvt_thread_join( thr[i], NULL );
+		ch_free( thr );
+		if ( !dbnum )
+			slap_DN_strict = prev_DN_strict;
+
+		/* entries parsed ahead of a failure */
+		for ( i = 0; i < narecs; i++ ) {
+			if ( arecs[i].erec.e )
+				entry_free( arecs[i].erec.e );
+			ch_free( arecs[i].buf );
+		}
+		ch_free( arecs );
 	}
 	if ( erec.e ) entry_free( erec.e );
 
@@ -40,6 +40,273 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+/* A comment line to print before offset c_off of a block's LDIF */
+typedef struct Cnote {
+	int c_off;
+	ID c_id;
+	const char *c_fmt;
+} Cnote;
+
+/* An ID range of a threaded dump: worker threads format the entries
+ * of successive blocks, the main thread writes them out in ID order.
+ */
+typedef struct Crec {
+	char *buf;
+	int len;
+	int max;
+	Cnote *notes;
+	int nnotes;
+	int nmax;
+	int rc;
+	int state;
+	ID next;	/* first ID past the block, or NOID */
+} Crec;
+
+#define CREC_FREE	0
+#define CREC_BUSY	1
+#define CREC_DONE	2
+
+#define CREC_PER_THREAD	4
+#define CREC_IDS	1024
+
+/* times to restart the readers when a write lands between them */
+#define CAT_RETRIES	10
+
+static Crec *crecs;
+static int ncrecs;
+static ID crec_next, crec_write, crec_end;
+
+static ldap_pvt_thread_mutex_t cat_mutex;
+static ldap_pvt_thread_cond_t cat_cond;		/* a block is done */
+static ldap_pvt_thread_cond_t work_cond;	/* a block is free */
+static int cat_threads, cat_stop, cat_failed;
+static int cat_ready, cat_sync, cat_gen, cat_tries, cat_result;
+
+static void
+cat_note( Crec *cr, ID id, const char *fmt )
+{
+	if ( cr->nnotes == cr->nmax ) {
+		cr->nmax = cr->nmax ? cr->nmax * 2 : 16;
+		cr->notes = ch_realloc( cr->notes, cr->nmax * sizeof( Cnote ));
+	}
+	cr->notes[cr->nnotes].c_off = cr->len;
+	cr->notes[cr->nnotes].c_id = id;
+	cr->notes[cr->nnotes].c_fmt = fmt;
+	cr->nnotes++;
+}
+
+static int
+cat_entry( Entry *e, void *arg )
+{
+	Crec *cr = arg;
+
+	if ( gotsig )
+		return -1;
+
+	if ( sub_ndn.bv_len && !dnIsSuffixScope( &e->e_nname, &sub_ndn, scope ) )
+		return 0;
+
+	if ( filter != NULL &&
+		test_filter( NULL, e, filter ) != LDAP_COMPARE_TRUE )
+		return 0;
+
+	if ( verbose )
+		cat_note( cr, e->e_id, "# id=%08lx\n" );
+
+	entry2str_wrap_r( e, &cr->buf, &cr->len, &cr->max, ldif_wrap );
+	/* there is always room for the terminating NUL */
+	cr->buf[cr->len++] = '\n';
+	return 0;
+}
+
+static void
+cat_block( Crec *cr, ID blk, void **ctx )
+{
+	ID id = blk * CREC_IDS, last = id + CREC_IDS - 1;
+	int rc;
+
+	cr->rc = 0;
+	while (( rc = be->be_entry_walk( be, ctx, &id, last, cat_entry, cr ))) {
+		if ( gotsig )
+			break;
+		cat_note( cr, id, "# no data for entry id=%08lx\n\n" );
+		cr->rc = rc;
+		if ( !continuemode )
+			break;
+		id++;
+	}
+	cr->next = id;
+}
+
+/* Start a reader in each thread, on one snapshot of the database */
+static int
+cat_sync_readers( void **ctx )
+{
+	int rc, gen;
+
+	do {
+		rc = be->be_entry_walk( be, ctx, NULL, NOID, NULL, NULL );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		if ( rc == LDAP_BUSY ) {
+			if ( !cat_sync )
+				cat_sync = 1;
+		} else if ( rc ) {
+			cat_sync = -1;
+		}
+		gen = cat_gen;
+		if ( ++cat_ready == cat_threads ) {
+			if ( cat_sync > 0 && ++cat_tries == CAT_RETRIES )
+				cat_sync = -2;
+			/* everyone is past setting up, start the next round afresh */
+			if ( cat_sync > 0 )
+				be->be_entry_walk( be, NULL, NULL, NOID, NULL, NULL );
+			cat_result = cat_sync;
+			cat_ready = 0;
+			cat_sync = 0;
+			cat_gen++;
+			ldap_pvt_thread_cond_broadcast( &work_cond );
+		} else {
+			while ( gen == cat_gen )
+				ldap_pvt_thread_cond_wait( &work_cond, &cat_mutex );
+		}
+		rc = cat_result;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		if ( rc && *ctx )
+			be->be_entry_walk( be, ctx, NULL, NOID, NULL, NULL );
+	} while ( rc > 0 );
+
+	return rc;
+}
+
+static void *
+cat_worker( void *arg )
+{
+	void *ctx = NULL;
+	Crec *cr;
+	ID blk;
+	int rc;
+
+	rc = cat_sync_readers( &ctx );
+	if ( rc ) {
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cat_failed = rc;
+		ldap_pvt_thread_cond_signal( &cat_cond );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		return NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	while ( !cat_stop ) {
+		if ( crec_next >= crec_end || crec_next >= crec_write + ncrecs ) {
+			ldap_pvt_thread_cond_wait( &work_cond, &cat_mutex );
+			continue;
+		}
+		blk = crec_next++;
+		cr = &crecs[blk % ncrecs];
+		cr->state = CREC_BUSY;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		cat_block( cr, blk, &ctx );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cr->state = CREC_DONE;
+		if ( cr->next == NOID && blk < crec_end )
+			crec_end = blk + 1;
+		ldap_pvt_thread_cond_signal( &cat_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+	be->be_entry_walk( be, &ctx, NULL, NOID, NULL, NULL );
+	return NULL;
+}
+
+/* Dump the database with tool-threads formatters, each reading its
+ * own ID ranges; the output is the same as that of a single thread.
+ * Returns -1 without writing anything if the readers could not start,
+ * or -2 if writes kept them from starting on one snapshot.
+ */
+static int
+cat_threaded( const char *progname )
+{
+	ldap_pvt_thread_t *thr;
+	int i, werr = 0, rc = EXIT_SUCCESS;
+
+	cat_threads = slap_tool_thread_max;
+	ncrecs = cat_threads * CREC_PER_THREAD;
+	crecs = ch_calloc( ncrecs, sizeof( Crec ));
+	crec_end = NOID;
+	ldap_pvt_thread_mutex_init( &cat_mutex );
+	ldap_pvt_thread_cond_init( &cat_cond );
+	ldap_pvt_thread_cond_init( &work_cond );
+
+	thr = ch_malloc( cat_threads * sizeof( ldap_pvt_thread_t ));
+	for ( i = 0; i < cat_threads; i++ )
+		ldap_pvt_thread_create( &thr[i], 0, cat_worker, NULL );
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	for (;;) {
+		Crec *cr = &crecs[crec_write % ncrecs];
+		int off, n;
+
+		while ( cr->state != CREC_DONE && !cat_failed )
+			ldap_pvt_thread_cond_wait( &cat_cond, &cat_mutex );
+		if ( cat_failed ) {
+			rc = cat_failed;
+			break;
+		}
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		off = 0;
+		for ( n = 0; n <= cr->nnotes; n++ ) {
+			int end = n < cr->nnotes ? cr->notes[n].c_off : cr->len;
+
+			if ( end > off &&
+				fwrite( cr->buf + off, end - off, 1, ldiffp->fp ) != 1 ) {
+				fprintf( stderr, "%s: error writing output.\n",
+					progname );
+				rc = EXIT_FAILURE;
+				werr = 1;
+				break;
+			}
+			off = end;
+			if ( n < cr->nnotes )
+				printf( cr->notes[n].c_fmt, (long) cr->notes[n].c_id );
+		}
+		if ( cr->rc )
+			rc = EXIT_FAILURE;
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		if ( gotsig || werr || cr->next == NOID ||
+			( cr->rc && !continuemode ))
+			break;
+		cr->len = 0;
+		cr->nnotes = 0;
+		cr->state = CREC_FREE;
+		crec_write++;
+		ldap_pvt_thread_cond_broadcast( &work_cond );
+	}
+	cat_stop = 1;
+	ldap_pvt_thread_cond_broadcast( &work_cond );
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+	for ( i = 0; i < cat_threads; i++ )
+		ldap_pvt_thread_join( thr[i], NULL );
+	ch_free( thr );
+
+	for ( i = 0; i < ncrecs; i++ ) {
+		ch_free( crecs[i].buf );
+		ch_free( crecs[i].notes );
+	}
+	ch_free( crecs );
+	ldap_pvt_thread_cond_destroy( &work_cond );
+	ldap_pvt_thread_cond_destroy( &cat_cond );
+	ldap_pvt_thread_mutex_destroy( &cat_mutex );
+
+	return rc;
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -80,6 +347,23 @@ slapcat( int argc, char **argv )
 		exit( EXIT_FAILURE );
 	}
 
+	if ( slap_tool_thread_max > 1 && be->be_entry_walk ) {
+		rc = cat_threaded( progname );
+		if ( rc >= 0 )
+			goto done;
+		if ( rc == -2 ) {
+			fprintf( stderr, "%s: writes kept the reader threads from "
+				"starting on one snapshot %d times, "
+				"dumping with one thread.\n",
+				progname, CAT_RETRIES );
+		} else {
+			fprintf( stderr, "%s: could not start the reader threads, "
+				"dumping with one thread.\n",
+				progname );
+		}
+		rc = EXIT_SUCCESS;
+	}
+
 	op.o_bd = be;
 	if ( !requestBSF && be->be_entry_first ) {
 		id = be->be_entry_first( be );
@@ -167,6 +451,7 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+done:
 	be->be_entry_close( be );
 
 	if ( slap_tool_destroy())
@@ -41,6 +41,7 @@ RWM=${AC_rwm-rwmno}
 SYNCPROV=${AC_syncprov-syncprovno}
 TRANSLUCENT=${AC_translucent-translucentno}
 UNIQUE=${AC_unique-uniqueno}
+SSSVLV=${AC_sssvlv-sssvlvno}
 VALSORT=${AC_valsort-valsortno}
 
 # misc
@@ -144,6 +145,8 @@ PASSWDCONF=$DATADIR/slapd-passwd.conf
 UNDOCONF=$DATADIR/slapd-config-undo.conf
 NAKEDCONF=$DATADIR/slapd-config-naked.conf
 VALREGEXCONF=$DATADIR/slapd-valregex.conf
+BULKCONF=$DATADIR/slapd-bulk.conf
+VLVCONF=$DATADIR/slapd-vlv.conf
 
 DYNAMICCONF=$DATADIR/slapd-dynamic.ldif
 